@@ -0,0 +1,121 @@
+use criterion::{black_box, criterion_group, criterion_main, Criterion, Throughput};
+use wiimote_rs::normalize;
+use wiimote_rs::prelude::*;
+
+fn accelerometer(c: &mut Criterion) {
+    let report = [0x31, 0x40, 0x60, 0x85, 0x7B, 0x9A];
+    let report_3e = [0x3E, 0x20, 0x40, 0x85];
+    let report_3f = [0x3F, 0x60, 0x20, 0x7B];
+
+    let mut group = c.benchmark_group("AccelerometerData");
+    group.bench_function("from_normal_reporting", |b| {
+        b.iter(|| AccelerometerData::from_normal_reporting(black_box(&report[1..])))
+    });
+    group.bench_function("from_interleaved_reporting", |b| {
+        b.iter(|| {
+            AccelerometerData::from_interleaved_reporting(
+                black_box(&report_3e[1..]),
+                black_box(&report_3f[1..]),
+            )
+        })
+    });
+    group.finish();
+}
+
+fn normalize_values(c: &mut Criterion) {
+    let mut group = c.benchmark_group("normalize");
+    // Accelerometer: 10 bit values with 10 bit calibration
+    group.bench_function("accelerometer", |b| {
+        b.iter(|| {
+            normalize::<u16, f64>(black_box(0x21A), 10, black_box(0x200), black_box(0x268), 10)
+        })
+    });
+    // Motion Plus: 14 bit values with 16 bit calibration
+    group.bench_function("motion_plus", |b| {
+        b.iter(|| {
+            normalize::<u16, f64>(
+                black_box(0x1F80),
+                14,
+                black_box(0x7E00),
+                black_box(0x8A00),
+                16,
+            )
+        })
+    });
+    group.finish();
+}
+
+fn angular_velocity(c: &mut Criterion) {
+    let calibration = MotionPlusCalibration::default();
+    let slow_data = MotionPlusData {
+        yaw: 0x1F80,
+        roll: 0x2010,
+        pitch: 0x1FF0,
+        yaw_slow: true,
+        roll_slow: true,
+        pitch_slow: true,
+        extension_connected: false,
+    };
+    let fast_data = MotionPlusData {
+        yaw_slow: false,
+        roll_slow: false,
+        pitch_slow: false,
+        ..slow_data
+    };
+
+    let mut group = c.benchmark_group("MotionPlusCalibration::get_angular_velocity");
+    group.bench_function("slow", |b| {
+        b.iter(|| black_box(&calibration).get_angular_velocity(black_box(&slow_data)))
+    });
+    group.bench_function("fast", |b| {
+        b.iter(|| black_box(&calibration).get_angular_velocity(black_box(&fast_data)))
+    });
+    group.finish();
+}
+
+const BATCH_SIZE: usize = 1024;
+
+fn batch(c: &mut Criterion) {
+    let raw = (0..BATCH_SIZE)
+        .map(|index| (0x1F00 + index % 512) as u16)
+        .collect::<Vec<_>>();
+    let slow = (0..BATCH_SIZE)
+        .map(|index| index % 4 != 0)
+        .collect::<Vec<_>>();
+    let mut output = vec![[0f32; BATCH_SIZE]; 3];
+    let [x, y, z] = &mut output[..] else {
+        unreachable!()
+    };
+
+    let mut group = c.benchmark_group("batch");
+    group.throughput(Throughput::Elements(BATCH_SIZE as u64));
+    let calibration = AccelerometerCalibration::default();
+    group.bench_function("get_acceleration_batch", |b| {
+        b.iter(|| {
+            calibration.get_acceleration_batch(
+                [black_box(&raw), &raw, &raw],
+                [&mut x[..], &mut y[..], &mut z[..]],
+            );
+        })
+    });
+    let calibration = MotionPlusCalibration::default();
+    group.bench_function("get_angular_velocity_batch", |b| {
+        b.iter(|| {
+            calibration.get_angular_velocity_batch(
+                [black_box(&raw), &raw, &raw],
+                [&slow, &slow, &slow],
+                [&mut x[..], &mut y[..], &mut z[..]],
+            );
+        })
+    });
+    group.finish();
+}
+
+criterion_group!(
+    benches,
+    accelerometer,
+    normalize_values,
+    angular_velocity,
+    batch
+);
+criterion_main!(benches);
@@ -0,0 +1,149 @@
+use criterion::{black_box, criterion_group, criterion_main, BenchmarkId, Criterion};
+use wiimote_rs::input::{InputReport, RawReport};
+use wiimote_rs::output::{
+    Addressing, DataReporingMode, Mode0x30, Mode0x31, Mode0x32, Mode0x33, Mode0x34, Mode0x35,
+    Mode0x36, Mode0x37, Mode0x3D, Mode0x3E, Mode0x3F, OutputReport, PlayerLedFlags, ReportingMode,
+};
+
+/// Returns an input report with the ID and size of every report the Wii remote sends.
+fn sample_reports() -> Vec<(u8, Vec<u8>)> {
+    fn data_report<M: ReportingMode>() -> (u8, Vec<u8>) {
+        let mut report = vec![M::ID];
+        report.extend((0..M::SIZE).map(|index| 0x40 + index as u8));
+        (M::ID, report)
+    }
+
+    vec![
+        (0x20, vec![0x20, 0x00, 0x00, 0x02, 0x00, 0x00, 0xC0]),
+        (
+            0x21,
+            [0x21, 0x00, 0x00, 0xF0, 0x00, 0x20]
+                .into_iter()
+                .chain(0..16)
+                .collect(),
+        ),
+        (0x22, vec![0x22, 0x00, 0x00, 0x16, 0x00]),
+        data_report::<Mode0x30>(),
+        data_report::<Mode0x31>(),
+        data_report::<Mode0x32>(),
+        data_report::<Mode0x33>(),
+        data_report::<Mode0x34>(),
+        data_report::<Mode0x35>(),
+        data_report::<Mode0x36>(),
+        data_report::<Mode0x37>(),
+        data_report::<Mode0x3D>(),
+        data_report::<Mode0x3E>(),
+        data_report::<Mode0x3F>(),
+    ]
+}
+
+fn input_report(c: &mut Criterion) {
+    let reports = sample_reports();
+
+    let mut group = c.benchmark_group("InputReport::try_from");
+    for (id, report) in &reports {
+        group.bench_with_input(
+            BenchmarkId::from_parameter(format!("{id:#04x}")),
+            report.as_slice(),
+            |b, report| b.iter(|| InputReport::try_from(black_box(report))),
+        );
+    }
+    group.finish();
+
+    let mut group = c.benchmark_group("RawReport::view");
+    for (id, report) in &reports {
+        let raw_report = RawReport::from_bytes(report);
+        group.bench_with_input(
+            BenchmarkId::from_parameter(format!("{id:#04x}")),
+            &raw_report,
+            |b, raw_report| b.iter(|| black_box(raw_report).view().map(|view| view.buttons())),
+        );
+    }
+    group.finish();
+}
+
+fn typed_report(c: &mut Criterion) {
+    let reports = sample_reports();
+    let report_of = |id: u8| RawReport::from_bytes(&reports.iter().find(|r| r.0 == id).unwrap().1);
+
+    let mut group = c.benchmark_group("Report");
+    let report = report_of(Mode0x31::ID);
+    group.bench_function("0x31", |b| {
+        b.iter(|| {
+            let report = black_box(&report).view_as::<Mode0x31>()?;
+            Some((report.buttons(), report.accelerometer()))
+        })
+    });
+    let report = report_of(Mode0x33::ID);
+    group.bench_function("0x33", |b| {
+        b.iter(|| {
+            let report = black_box(&report).view_as::<Mode0x33>()?;
+            Some((report.buttons(), report.accelerometer(), report.ir()[0]))
+        })
+    });
+    let report = report_of(Mode0x35::ID);
+    group.bench_function("0x35", |b| {
+        b.iter(|| {
+            let report = black_box(&report).view_as::<Mode0x35>()?;
+            Some((
+                report.buttons(),
+                report.accelerometer(),
+                report.extension()[0],
+            ))
+        })
+    });
+    let report = report_of(Mode0x37::ID);
+    group.bench_function("0x37", |b| {
+        b.iter(|| {
+            let report = black_box(&report).view_as::<Mode0x37>()?;
+            Some((
+                report.buttons(),
+                report.accelerometer(),
+                report.ir()[0],
+                report.extension()[0],
+            ))
+        })
+    });
+    let report = report_of(Mode0x3D::ID);
+    group.bench_function("0x3d", |b| {
+        b.iter(|| Some(black_box(&report).view_as::<Mode0x3D>()?.extension()[0]))
+    });
+    group.finish();
+}
+
+fn output_report(c: &mut Criterion) {
+    let reports = [
+        ("rumble", OutputReport::Rumble(true)),
+        ("player_led", OutputReport::PlayerLed(PlayerLedFlags::LED_1)),
+        (
+            "data_reporting_mode",
+            OutputReport::DataReportingMode(DataReporingMode::of::<Mode0x37>(true)),
+        ),
+        ("ir_camera_enable", OutputReport::IrCameraEnable(true)),
+        ("speaker_enable", OutputReport::SpeakerEnable(true)),
+        ("status_request", OutputReport::StatusRequest),
+        (
+            "write_memory",
+            OutputReport::WriteMemory(Addressing::control_registers(0xA4_00F0, 1), [0x55; 16]),
+        ),
+        (
+            "read_memory",
+            OutputReport::ReadMemory(Addressing::eeprom(0x0016, 10)),
+        ),
+        ("speaker_data", OutputReport::SpeakerData(20, [0x80; 20])),
+        ("speaker_mute", OutputReport::SpeakerMute(true)),
+        ("ir_camera_enable_2", OutputReport::IrCameraEnable2(true)),
+    ];
+
+    let mut group = c.benchmark_group("OutputReport::fill_buffer");
+    let mut buffer = [0u8; wiimote_rs::WIIMOTE_DEFAULT_REPORT_BUFFER_SIZE];
+    for (name, report) in &reports {
+        group.bench_function(*name, |b| {
+            b.iter(|| black_box(report).fill_buffer(black_box(false), &mut buffer))
+        });
+    }
+    group.finish();
+}
+
+criterion_group!(benches, input_report, typed_report, output_report);
+criterion_main!(benches);
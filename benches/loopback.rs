@@ -0,0 +1,139 @@
+use std::sync::{Arc, Mutex};
+use std::time::{Duration, Instant};
+
+use criterion::{criterion_group, Criterion, Throughput};
+use wiimote_rs::input::RawReport;
+use wiimote_rs::mock::MockWiimote;
+use wiimote_rs::prelude::*;
+
+const BATCH_SIZE: usize = 64;
+const LATENCY_SAMPLES: usize = 10_000;
+/// Interval of the reports in the latency benchmark, a Wii remote sends data reports at 100 Hz to 200 Hz.
+const LATENCY_REPORT_INTERVAL: Duration = Duration::from_micros(500);
+
+/// Connects a simulated Wii remote through the `WiimoteManager`.
+fn connect(identifier: &str) -> (MockWiimote, Arc<Mutex<WiimoteDevice>>) {
+    let manager = WiimoteManager::get_instance();
+    let new_devices = {
+        let mut manager = manager.lock().unwrap();
+        manager.set_scan_interval(Duration::from_millis(10));
+        manager.new_devices_receiver()
+    };
+    let mock = MockWiimote::connect(identifier);
+    let device = new_devices
+        .recv_timeout(Duration::from_secs(5))
+        .expect("Simulated Wii remote was not connected");
+    (mock, device)
+}
+
+/// Returns a data report of mode 0x3D carrying `sequence` in the first extension bytes.
+fn sequence_report(sequence: u32) -> [u8; 22] {
+    let mut report = [0u8; 22];
+    report[0] = 0x3D;
+    report[1..5].copy_from_slice(&sequence.to_le_bytes());
+    report
+}
+
+fn throughput(c: &mut Criterion) {
+    let (mock, device) = connect("loopback-throughput");
+    let device = device.lock().unwrap();
+    let report = [0x37; 22];
+    let mut batch = [RawReport::default(); BATCH_SIZE];
+
+    let mut group = c.benchmark_group("loopback");
+    group.throughput(Throughput::Elements(1));
+    group.bench_function("read_batch", |b| {
+        b.iter_custom(|iterations| {
+            let mut elapsed = Duration::ZERO;
+            let mut remaining = iterations as usize;
+            while remaining > 0 {
+                let count = usize::min(remaining, BATCH_SIZE);
+                for _ in 0..count {
+                    mock.send_report(&report);
+                }
+                let start = Instant::now();
+                let mut received = 0;
+                while received < count {
+                    received += device.read_batch(&mut batch[..count - received]).unwrap();
+                }
+                elapsed += start.elapsed();
+                remaining -= count;
+            }
+            elapsed
+        })
+    });
+    group.bench_function("read_report", |b| {
+        let mut report_buffer = RawReport::default();
+        b.iter_custom(|iterations| {
+            let mut elapsed = Duration::ZERO;
+            for _ in 0..iterations {
+                mock.send_report(&report);
+                let start = Instant::now();
+                device.read_report(&mut report_buffer, Some(100)).unwrap();
+                elapsed += start.elapsed();
+            }
+            elapsed
+        })
+    });
+    group.finish();
+}
+
+/// Measures the time from queuing a report on the simulated Wii remote until it is read by another thread.
+fn latency() {
+    let (mock, device) = connect("loopback-latency");
+
+    let producer = std::thread::spawn(move || {
+        let mut sent_at = Vec::with_capacity(LATENCY_SAMPLES);
+        for sequence in 0..LATENCY_SAMPLES as u32 {
+            let next = Instant::now() + LATENCY_REPORT_INTERVAL;
+            sent_at.push(Instant::now());
+            mock.send_report(&sequence_report(sequence));
+            while Instant::now() < next {
+                std::hint::spin_loop();
+            }
+        }
+        sent_at
+    });
+
+    let device = device.lock().unwrap();
+    let mut received_at = vec![None; LATENCY_SAMPLES];
+    let mut report = RawReport::default();
+    let start = Instant::now();
+    let mut received = 0;
+    while received < LATENCY_SAMPLES && device.read_report(&mut report, Some(1000)).unwrap() > 0 {
+        let bytes = report.as_bytes();
+        let sequence = u32::from_le_bytes([bytes[1], bytes[2], bytes[3], bytes[4]]) as usize;
+        received_at[sequence] = Some(Instant::now());
+        received += 1;
+    }
+    let elapsed = start.elapsed();
+    let sent_at = producer.join().unwrap();
+
+    let mut latencies = sent_at
+        .iter()
+        .zip(&received_at)
+        .filter_map(|(sent_at, received_at)| Some(received_at.as_ref()?.duration_since(*sent_at)))
+        .collect::<Vec<_>>();
+    latencies.sort_unstable();
+    let percentile = |percent: usize| latencies[(latencies.len() - 1) * percent / 100];
+
+    println!("loopback/latency");
+    println!(
+        "  reports received: {} of {LATENCY_SAMPLES}",
+        latencies.len()
+    );
+    println!(
+        "  reports/sec:      {:.0}",
+        received as f64 / elapsed.as_secs_f64()
+    );
+    println!("  p50:              {:?}", percentile(50));
+    println!("  p99:              {:?}", percentile(99));
+}
+
+criterion_group!(benches, throughput);
+
+fn main() {
+    benches();
+    latency();
+    Criterion::default().configure_from_args().final_summary();
+}
@@ -1,5 +1,10 @@
 #[cfg(target_os = "linux")]
 fn main() {
+    // The mock backend does not use libbluetooth
+    if std::env::var_os("CARGO_FEATURE_MOCK").is_some() {
+        return;
+    }
+
     const HEADER_FILE: &str = "src/native/linux/bluetooth_linux.h";
     println!("cargo:rerun-if-changed={HEADER_FILE}");
 
@@ -3,8 +3,8 @@
 use std::sync::{Arc, Mutex};
 use std::time::Duration;
 
-use wiimote_rs::input::InputReport;
-use wiimote_rs::output::{DataReporingMode, OutputReport, PlayerLedFlags};
+use wiimote_rs::input::{InputReportRef, RawReport};
+use wiimote_rs::output::{DataReporingMode, Mode0x35, OutputReport, PlayerLedFlags};
 use wiimote_rs::prelude::*;
 
 fn main() -> WiimoteResult<()> {
@@ -40,9 +40,10 @@ fn main() -> WiimoteResult<()> {
 
             set_reporting_mode_accelerometer_and_extension(&d);
 
+            let mut report = RawReport::default();
             loop {
-                let input_report = d.lock().unwrap().read_timeout(50);
-                if let Ok(report) = input_report {
+                let input_report = d.lock().unwrap().read_report(&mut report, Some(50));
+                if let Ok(1..) = input_report {
                     handle_report(
                         &report,
                         &accelerometer_calibration,
@@ -61,22 +62,22 @@ fn main() -> WiimoteResult<()> {
 }
 
 fn handle_report(
-    report: &InputReport,
+    report: &RawReport,
     accelerometer_calibration: &AccelerometerCalibration,
     motion_plus_calibration: &Option<MotionPlusCalibration>,
     d: &Arc<Mutex<WiimoteDevice>>,
 ) {
-    if let InputReport::StatusInformation(_) = report {
+    if let Ok(InputReportRef::StatusInformation(_)) = report.view() {
         // If this report is received when not requested, the application 'MUST'
         // send report 0x12 to change the data reporting mode, otherwise no further data reports will be received.
         set_reporting_mode_accelerometer_and_extension(d);
-    } else if let InputReport::DataReport(0x35, wiimote_data) = &report {
+    } else if let Some(data_report) = report.view_as::<Mode0x35>() {
         if let Some(calibration) = &motion_plus_calibration {
-            let accelerometer_data = AccelerometerData::from_normal_reporting(&wiimote_data.data);
+            let accelerometer_data = data_report.accelerometer();
             let (x, y, z) = accelerometer_calibration.get_acceleration(&accelerometer_data);
 
             let mut motion_plus_buffer = [0u8; 6];
-            motion_plus_buffer.copy_from_slice(&wiimote_data.data[5..11]);
+            motion_plus_buffer.copy_from_slice(&data_report.extension()[..6]);
 
             if let Ok(motion_plus_data) = MotionPlusData::try_from(motion_plus_buffer) {
                 let (yaw, roll, pitch) = calibration.get_angular_velocity(&motion_plus_data);
@@ -89,9 +90,7 @@ fn handle_report(
 }
 
 fn set_reporting_mode_accelerometer_and_extension(d: &Arc<Mutex<WiimoteDevice>>) {
-    let reporting_mode = OutputReport::DataReportingMode(DataReporingMode {
-        continuous: false,
-        mode: 0x35, // Core Buttons and Accelerometer with 16 Extension Bytes
-    });
+    // Core Buttons and Accelerometer with 16 Extension Bytes
+    let reporting_mode = OutputReport::DataReportingMode(DataReporingMode::of::<Mode0x35>(false));
     d.lock().unwrap().write(&reporting_mode).unwrap();
 }
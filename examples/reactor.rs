@@ -0,0 +1,29 @@
+use std::time::Duration;
+
+use wiimote_rs::prelude::*;
+
+fn main() -> WiimoteResult<()> {
+    // Press the 1 and 2 buttons on the Wii remotes to connect
+
+    let manager = WiimoteManager::get_instance();
+
+    let new_devices = {
+        let manager = manager.lock().unwrap();
+        manager.new_devices_receiver()
+    };
+
+    // A single thread receives the reports of all connected Wii remotes
+    let mut reactor = WiimoteReactor::new()?;
+    let mut events = Vec::new();
+    loop {
+        new_devices
+            .try_iter()
+            .for_each(|device| reactor.register(device));
+
+        events.clear();
+        reactor.poll(&mut events, Some(Duration::from_millis(100)))?;
+        for event in &events {
+            println!("{}: {:?}", event.identifier, event.report);
+        }
+    }
+}
@@ -0,0 +1,69 @@
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+use wiimote_rs::input::RawReport;
+use wiimote_rs::mock::{MockReplay, MockWiimote, ReplayOptions};
+use wiimote_rs::prelude::*;
+
+const WIIMOTE_COUNT: usize = 64;
+const DURATION: Duration = Duration::from_secs(10);
+
+fn main() -> WiimoteResult<()> {
+    // Simulated Wii remotes are found next to Bluetooth ones with the `mock` feature:
+    // cargo run --release --features mock --example soak
+
+    let manager = WiimoteManager::get_instance();
+    let new_devices = {
+        let mut manager = manager.lock().unwrap();
+        manager.set_scan_interval(Duration::from_millis(50));
+        manager.new_devices_receiver()
+    };
+
+    // Buttons and accelerometer in mode 0x31
+    let reports: Arc<[RawReport]> = (0..=255u8)
+        .map(|x| RawReport::from_bytes(&[0x31, 0x00, 0x00, x, 0x80, 0x9A]))
+        .collect();
+    let streams = (0..WIIMOTE_COUNT)
+        .map(|index| {
+            let options = ReplayOptions {
+                rate: 200.0,
+                jitter: Duration::from_millis(1),
+                loss: 0.01,
+                disconnect_after: Some(Duration::from_secs(3 + index as u64 % 5)),
+                seed: index as u64,
+                ..ReplayOptions::default()
+            };
+            let mock = MockWiimote::connect(&format!("mock-{index:02}"));
+            (mock, Arc::clone(&reports), options)
+        })
+        .collect();
+    let replay = MockReplay::start(streams);
+
+    let mut reactor = WiimoteReactor::new()?;
+    let mut events = Vec::new();
+    let mut received = 0;
+    let mut disconnects = 0;
+    let start = Instant::now();
+    while start.elapsed() < DURATION {
+        new_devices
+            .try_iter()
+            .for_each(|device| reactor.register(device));
+
+        events.clear();
+        reactor.poll(&mut events, Some(Duration::from_millis(100)))?;
+        for event in &events {
+            match event.report {
+                Ok(_) => received += 1,
+                Err(_) => disconnects += 1,
+            }
+        }
+    }
+
+    let stats = replay.stop();
+    let sent = stats.iter().map(|stats| stats.sent).sum::<usize>();
+    println!(
+        "{WIIMOTE_COUNT} Wii remotes: {sent} reports sent, {received} received ({:.0}/s), {disconnects} disconnects",
+        received as f64 / DURATION.as_secs_f64()
+    );
+    Ok(())
+}
@@ -0,0 +1,289 @@
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::thread::JoinHandle;
+use std::time::{Duration, Instant};
+
+use crate::device::Connection;
+use crate::input::{InputReport, RawReport};
+use crate::native::{NativeReactor, NativeWiimoteReactor};
+use crate::output::{Addressing, OutputReport};
+use crate::prelude::*;
+use crate::ring::{spsc_ring, RingConsumer, RingProducer};
+use crate::transaction::TransactionRequest;
+
+/// Maximum time the background thread waits for a report before sending queued output reports,
+/// used if the Wii remote cannot be registered with a reactor.
+const READ_TIMEOUT_MILLIS: usize = 2;
+/// Interval in which a disconnected Wii remote is checked for a reconnect.
+const DISCONNECTED_INTERVAL: Duration = Duration::from_millis(50);
+const OUTPUT_QUEUE_CAPACITY: usize = 64;
+/// Maximum number of reports read from the Wii remote at once.
+const READ_BATCH_SIZE: usize = 32;
+/// Token of the Wii remote in the reactor of the background thread.
+const DEVICE_TOKEN: usize = 0;
+
+struct SharedState {
+    stop: AtomicBool,
+    dropped_reports: AtomicUsize,
+    /// Waits for input of the Wii remote and is woken when output reports are queued.
+    reactor: Option<Arc<NativeWiimoteReactor>>,
+}
+
+impl SharedState {
+    fn wake(&self) {
+        if let Some(reactor) = &self.reactor {
+            _ = reactor.wake();
+        }
+    }
+}
+
+/// Receives and sends the reports of a Wii remote on a background thread.
+///
+/// Received reports are stored in a bounded lock-free queue that can be drained without locking the device,
+/// output reports are queued without waiting for the Wii remote.
+pub struct BackgroundIo {
+    reports: RingConsumer<RawReport>,
+    output: crossbeam_channel::Sender<OutputReport>,
+    connection: Arc<Connection>,
+    state: Arc<SharedState>,
+    thread: Option<JoinHandle<()>>,
+}
+
+impl BackgroundIo {
+    pub(crate) fn start(connection: Arc<Connection>, capacity: usize) -> Self {
+        let (producer, reports) = spsc_ring(capacity);
+        let (output, output_receiver) = crossbeam_channel::bounded(OUTPUT_QUEUE_CAPACITY);
+        // Without a reactor the background thread polls the Wii remote
+        let reactor = NativeWiimoteReactor::new().ok().map(Arc::new);
+        connection.set_io_reactor(reactor.clone());
+        let state = Arc::new(SharedState {
+            stop: AtomicBool::new(false),
+            dropped_reports: AtomicUsize::new(0),
+            reactor,
+        });
+
+        let thread_connection = Arc::clone(&connection);
+        let thread_state = Arc::clone(&state);
+        let thread = std::thread::Builder::new()
+            .name("wii-remote-io".to_string())
+            .spawn(move || {
+                run(
+                    &thread_connection,
+                    producer,
+                    &output_receiver,
+                    &thread_state,
+                )
+            })
+            .expect("Failed to spawn Wii remote I/O thread");
+
+        Self {
+            reports,
+            output,
+            connection,
+            state,
+            thread: Some(thread),
+        }
+    }
+
+    /// Returns the oldest received report or `None` if no report is queued.
+    pub fn try_read(&mut self) -> Option<WiimoteResult<InputReport>> {
+        self.try_read_raw().map(|report| report.decode())
+    }
+
+    /// Returns the oldest received report without decoding it, e.g. to use its `RawReport::timestamp`.
+    pub fn try_read_raw(&mut self) -> Option<RawReport> {
+        self.reports.pop()
+    }
+
+    /// Calls `f` with every queued report and returns the number of reports.
+    pub fn drain<F>(&mut self, mut f: F) -> usize
+    where
+        F: FnMut(WiimoteResult<InputReport>),
+    {
+        let mut count = 0;
+        while let Some(report) = self.try_read() {
+            f(report);
+            count += 1;
+        }
+        count
+    }
+
+    /// Returns the number of queued reports.
+    #[must_use]
+    pub fn len(&self) -> usize {
+        self.reports.len()
+    }
+
+    /// Returns whether no reports are queued.
+    #[must_use]
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Queues the output report to be sent by the background thread.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the Wii remote is disconnected or the output queue is full.
+    pub fn write(&self, output_report: OutputReport) -> WiimoteResult<()> {
+        if !self.connection.is_connected() {
+            return Err(WiimoteError::Disconnected);
+        }
+        self.output
+            .try_send(output_report)
+            .map_err(|err| match err {
+                crossbeam_channel::TrySendError::Full(_) => WiimoteError::QueueFull,
+                crossbeam_channel::TrySendError::Disconnected(_) => WiimoteError::Disconnected,
+            })?;
+        self.state.wake();
+        Ok(())
+    }
+
+    /// Reads `addressing.size` bytes from the memory or registers of the Wii remote,
+    /// the reply is picked from the received reports by the background thread.
+    pub fn read_memory(&self, addressing: Addressing) -> MemoryTransaction {
+        self.connection.submit(TransactionRequest::Read(addressing))
+    }
+
+    /// Writes the first `addressing.size` bytes of `data` to the memory or registers of the Wii remote,
+    /// the acknowledges are picked from the received reports by the background thread.
+    pub fn write_memory(&self, addressing: Addressing, data: &[u8]) -> MemoryTransaction {
+        let size = usize::min(addressing.size as usize, data.len());
+        self.connection
+            .submit(TransactionRequest::Write(addressing, data[..size].to_vec()))
+    }
+
+    /// Returns the number of reports dropped because the queue was full.
+    #[must_use]
+    pub fn dropped_reports(&self) -> usize {
+        self.state.dropped_reports.load(Ordering::Relaxed)
+    }
+}
+
+impl Drop for BackgroundIo {
+    fn drop(&mut self) {
+        self.state.stop.store(true, Ordering::Relaxed);
+        self.connection.set_io_reactor(None);
+        self.state.wake();
+        if let Some(thread) = self.thread.take() {
+            _ = thread.join();
+        }
+    }
+}
+
+fn run(
+    connection: &Connection,
+    mut reports: RingProducer<RawReport>,
+    output: &crossbeam_channel::Receiver<OutputReport>,
+    state: &SharedState,
+) {
+    let mut batch = [RawReport::default(); READ_BATCH_SIZE];
+    let mut ready = Vec::with_capacity(1);
+    let mut registration = None;
+
+    while !state.stop.load(Ordering::Relaxed) {
+        while let Ok(output_report) = output.try_recv() {
+            if connection.write(&output_report).is_err() {
+                break;
+            }
+        }
+
+        let reactor = state
+            .reactor
+            .as_deref()
+            .filter(|reactor| register(connection, reactor, &mut registration));
+        let timeout_millis = if reactor.is_some() {
+            0
+        } else {
+            READ_TIMEOUT_MILLIS
+        };
+        match connection.read_batch_timeout(&mut batch, timeout_millis) {
+            Ok(reports_read) => {
+                for report in &batch[..reports_read] {
+                    if reports.push(*report).is_err() {
+                        state.dropped_reports.fetch_add(1, Ordering::Relaxed);
+                    }
+                }
+                if let Some(reactor) = reactor.filter(|_| reports_read < batch.len()) {
+                    // Woken by input, queued output reports, a disconnect or the next expiring memory request
+                    let timeout_millis =
+                        connection.next_transaction_deadline().map(remaining_millis);
+                    ready.clear();
+                    _ = reactor.wait(&mut ready, timeout_millis);
+                }
+            }
+            Err(_) => match state.reactor.as_deref() {
+                // Woken when the Wii remote reconnects or the `BackgroundIo` is dropped
+                Some(reactor) => {
+                    ready.clear();
+                    _ = reactor.wait(&mut ready, Some(DISCONNECTED_INTERVAL.as_millis() as usize));
+                }
+                None => std::thread::sleep(DISCONNECTED_INTERVAL),
+            },
+        }
+    }
+}
+
+/// Registers the native device with the reactor once per connection, returns whether it is registered.
+/// Registering fails e.g. if the device is already associated with another completion port on Windows.
+fn register(
+    connection: &Connection,
+    reactor: &NativeWiimoteReactor,
+    registration: &mut Option<(usize, bool)>,
+) -> bool {
+    let generation = connection.generation();
+    if let Some((registered_generation, registered)) = *registration {
+        if registered_generation == generation {
+            return registered;
+        }
+    }
+    let Some(result) =
+        connection.with_native_device(|native| reactor.register(native, DEVICE_TOKEN))
+    else {
+        return false;
+    };
+    *registration = Some((generation, result.is_ok()));
+    result.is_ok()
+}
+
+/// Returns the milliseconds until `deadline`, rounded up to not return early.
+fn remaining_millis(deadline: Instant) -> usize {
+    let remaining = deadline.saturating_duration_since(Instant::now());
+    usize::try_from(remaining.as_micros().div_ceil(1000)).unwrap_or(usize::MAX)
+}
+
+#[cfg(all(test, feature = "mock"))]
+mod tests {
+    use super::*;
+    use crate::mock::MockWiimote;
+    use crate::native::NativeWiimoteDevice;
+
+    #[test]
+    fn test_waiting_thread_woken_by_output_and_disconnect() {
+        let mock = MockWiimote::connect("background-wake");
+        let device = WiimoteDevice::new(NativeWiimoteDevice::take(&mock), None).unwrap();
+        let mut io = device.start_background_io(16);
+        let deadline = Instant::now() + Duration::from_secs(1);
+
+        // The status request is sent by the waiting thread and answered by the Wii remote
+        io.write(OutputReport::StatusRequest).unwrap();
+        let status = loop {
+            if let Some(report) = io.try_read() {
+                break report;
+            }
+            assert!(Instant::now() < deadline);
+            std::thread::yield_now();
+        };
+        assert!(matches!(status, Ok(InputReport::StatusInformation(_))));
+
+        mock.disconnect();
+        while device.is_connected() {
+            assert!(Instant::now() < deadline);
+            std::thread::yield_now();
+        }
+        assert!(matches!(
+            io.write(OutputReport::StatusRequest),
+            Err(WiimoteError::Disconnected)
+        ));
+    }
+}
@@ -0,0 +1,419 @@
+use std::collections::HashMap;
+use std::fmt::Write as _;
+use std::io::Write as _;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::Ordering;
+use std::sync::{Arc, Condvar, Mutex, MutexGuard};
+use std::thread::JoinHandle;
+
+use crate::device::WiimoteDevice;
+use crate::transaction::{MemoryTransaction, TransactionResult};
+
+/// The raw calibration and identification data read from a Wii remote during initialization.
+#[derive(Debug, Default, Clone, PartialEq, Eq)]
+pub(crate) struct CachedDevice {
+    /// Accelerometer calibration from the EEPROM at 0x0016.
+    pub(crate) accelerometer_calibration: [u8; 10],
+    /// Identifier of the Motion Plus at 0xA600FA, `None` if no Motion Plus was detected.
+    pub(crate) motion_plus: Option<[u8; 6]>,
+    /// Both calibration blocks of the Motion Plus at 0xA60020, `None` if not read yet.
+    pub(crate) motion_plus_calibration: Option<[u8; 32]>,
+    /// Identifier of the extension at 0xA400FA, `None` if no extension was connected.
+    pub(crate) extension: Option<[u8; 6]>,
+    /// Calibration blocks of the Balance Board at 0xA40024, `None` if not read yet.
+    pub(crate) balance_board_calibration: Option<[u8; 24]>,
+}
+
+impl CachedDevice {
+    fn to_line(&self, identifier: &str) -> String {
+        let mut line = identifier.to_string();
+        for field in [
+            Some(&self.accelerometer_calibration[..]),
+            self.motion_plus.as_ref().map(|bytes| &bytes[..]),
+            self.motion_plus_calibration
+                .as_ref()
+                .map(|bytes| &bytes[..]),
+            self.extension.as_ref().map(|bytes| &bytes[..]),
+            self.balance_board_calibration
+                .as_ref()
+                .map(|bytes| &bytes[..]),
+        ] {
+            line.push(' ');
+            match field {
+                Some(bytes) => bytes.iter().for_each(|byte| {
+                    _ = write!(line, "{byte:02x}");
+                }),
+                None => line.push('-'),
+            }
+        }
+        line
+    }
+
+    fn from_line(line: &str) -> Option<(String, Self)> {
+        let mut fields = line.split_whitespace();
+        let identifier = fields.next()?.to_string();
+        let accelerometer_calibration = parse_hex(fields.next()?)??;
+        let motion_plus = parse_hex(fields.next()?)?;
+        let motion_plus_calibration = parse_hex(fields.next()?)?;
+        let extension = parse_hex(fields.next()?)?;
+        // Missing in files written before the Balance Board calibration was cached
+        let balance_board_calibration = match fields.next() {
+            Some(field) => parse_hex(field)?,
+            None => None,
+        };
+        if fields.next().is_some() {
+            return None;
+        }
+        Some((
+            identifier,
+            Self {
+                accelerometer_calibration,
+                motion_plus,
+                motion_plus_calibration,
+                extension,
+                balance_board_calibration,
+            },
+        ))
+    }
+}
+
+/// Parses a field of `N` hex encoded bytes or `-` for a missing value.
+fn parse_hex<const N: usize>(field: &str) -> Option<Option<[u8; N]>> {
+    if field == "-" {
+        return Some(None);
+    }
+    if field.len() != N * 2 || !field.is_ascii() {
+        return None;
+    }
+    let mut bytes = [0u8; N];
+    for (index, byte) in bytes.iter_mut().enumerate() {
+        *byte = u8::from_str_radix(&field[index * 2..index * 2 + 2], 16).ok()?;
+    }
+    Some(Some(bytes))
+}
+
+/// Caches the calibration and extension identity of Wii remotes by their identifier,
+/// so reconnects do not have to read them again.
+///
+/// The cached data is used immediately on reconnect and revalidated in the background,
+/// entries that no longer match the Wii remote are removed and the Wii remote is refreshed,
+/// see `WiimoteDevice::needs_refresh`.
+/// The cache can optionally be stored in a file, which is written by a background thread.
+#[derive(Debug, Default)]
+pub struct CalibrationCache {
+    entries: Mutex<HashMap<String, CachedDevice>>,
+    writer: Option<CacheWriter>,
+}
+
+#[derive(Debug, Default)]
+struct WriterState {
+    /// The latest contents of the file that are not written yet.
+    contents: Option<String>,
+    stop: bool,
+}
+
+#[derive(Debug, Default)]
+struct WriterQueue {
+    state: Mutex<WriterState>,
+    changed: Condvar,
+}
+
+impl WriterQueue {
+    fn lock(&self) -> MutexGuard<'_, WriterState> {
+        match self.state.lock() {
+            Ok(state) => state,
+            Err(err) => err.into_inner(),
+        }
+    }
+}
+
+/// Writes the cache file on a background thread, so changes made by completion callbacks
+/// on the thread reading the Wii remote do not wait for the file system.
+#[derive(Debug)]
+struct CacheWriter {
+    queue: Arc<WriterQueue>,
+    thread: Option<JoinHandle<()>>,
+}
+
+impl CacheWriter {
+    fn start(path: PathBuf) -> Self {
+        let queue = Arc::new(WriterQueue::default());
+        let thread_queue = Arc::clone(&queue);
+        let thread = std::thread::Builder::new()
+            .name("wii-remote-cache".to_string())
+            .spawn(move || run_writer(&path, &thread_queue))
+            .expect("Failed to spawn calibration cache writer thread");
+        Self {
+            queue,
+            thread: Some(thread),
+        }
+    }
+
+    /// Replaces the contents that are written next, only the latest contents are written.
+    fn write(&self, contents: String) {
+        self.queue.lock().contents = Some(contents);
+        self.queue.changed.notify_one();
+    }
+}
+
+impl Drop for CacheWriter {
+    fn drop(&mut self) {
+        // The pending contents are written before the thread stops
+        self.queue.lock().stop = true;
+        self.queue.changed.notify_one();
+        if let Some(thread) = self.thread.take() {
+            _ = thread.join();
+        }
+    }
+}
+
+fn run_writer(path: &Path, queue: &WriterQueue) {
+    loop {
+        let (contents, stop) = {
+            let state = queue.lock();
+            let mut state = match queue
+                .changed
+                .wait_while(state, |state| state.contents.is_none() && !state.stop)
+            {
+                Ok(state) => state,
+                Err(err) => err.into_inner(),
+            };
+            (state.contents.take(), state.stop)
+        };
+        if let Some(contents) = contents {
+            if let Err(error) = write_atomically(path, &contents) {
+                eprintln!("Failed to write calibration cache: {error}");
+            }
+        }
+        if stop {
+            return;
+        }
+    }
+}
+
+/// Writes the contents to a temporary file next to `path` and renames it,
+/// so the file at `path` always contains either the previous or the new contents.
+fn write_atomically(path: &Path, contents: &str) -> std::io::Result<()> {
+    let mut temporary_path = path.as_os_str().to_owned();
+    temporary_path.push(".tmp");
+    let temporary_path = PathBuf::from(temporary_path);
+    let mut file = std::fs::File::create(&temporary_path)?;
+    file.write_all(contents.as_bytes())?;
+    file.sync_all()?;
+    drop(file);
+    std::fs::rename(&temporary_path, path)
+}
+
+impl CalibrationCache {
+    /// Creates an empty cache that is only held in memory.
+    #[must_use]
+    pub fn in_memory() -> Arc<Self> {
+        Arc::new(Self::default())
+    }
+
+    /// Creates a cache that is stored in the file at `path`, the existing entries of the file are loaded.
+    /// Invalid lines of the file are ignored.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the file exists but could not be read.
+    pub fn with_file(path: impl AsRef<Path>) -> std::io::Result<Arc<Self>> {
+        let path = path.as_ref().to_path_buf();
+        let entries = match std::fs::read_to_string(&path) {
+            Ok(contents) => contents
+                .lines()
+                .filter_map(CachedDevice::from_line)
+                .collect(),
+            Err(error) if error.kind() == std::io::ErrorKind::NotFound => HashMap::new(),
+            Err(error) => return Err(error),
+        };
+        Ok(Arc::new(Self {
+            entries: Mutex::new(entries),
+            writer: Some(CacheWriter::start(path)),
+        }))
+    }
+
+    /// Removes the cached data of the Wii remote, it is read again on the next reconnect.
+    pub fn remove(&self, identifier: &str) {
+        if self.lock().remove(identifier).is_some() {
+            self.save();
+        }
+    }
+
+    /// Removes the cached data of all Wii remotes.
+    pub fn clear(&self) {
+        self.lock().clear();
+        self.save();
+    }
+
+    /// Returns whether data of the Wii remote is cached.
+    #[must_use]
+    pub fn contains(&self, identifier: &str) -> bool {
+        self.lock().contains_key(identifier)
+    }
+
+    pub(crate) fn get(&self, identifier: &str) -> Option<CachedDevice> {
+        self.lock().get(identifier).cloned()
+    }
+
+    pub(crate) fn insert(&self, identifier: &str, device: CachedDevice) {
+        let previous = self.lock().insert(identifier.to_string(), device.clone());
+        if previous.as_ref() != Some(&device) {
+            self.save();
+        }
+    }
+
+    /// Updates the cached data of the Wii remote if it is cached.
+    pub(crate) fn update(&self, identifier: &str, f: impl FnOnce(&mut CachedDevice)) {
+        let changed = self.lock().get_mut(identifier).is_some_and(|device| {
+            let previous = device.clone();
+            f(device);
+            *device != previous
+        });
+        if changed {
+            self.save();
+        }
+    }
+
+    /// Removes the cached data of the Wii remote and marks it to be refreshed
+    /// if `is_valid` rejects the result of the transaction.
+    /// `is_valid` returns `None` if the result is inconclusive, for example when the read timed out.
+    pub(crate) fn revalidate(
+        self: &Arc<Self>,
+        wiimote: &WiimoteDevice,
+        transaction: MemoryTransaction,
+        is_valid: impl FnOnce(TransactionResult) -> Option<bool> + Send + 'static,
+    ) {
+        let cache = Arc::clone(self);
+        let identifier = wiimote.identifier().to_string();
+        let stale = Arc::clone(wiimote.stale_flag());
+        transaction.on_complete(move |result| {
+            if is_valid(result) == Some(false) {
+                cache.remove(&identifier);
+                stale.store(true, Ordering::Relaxed);
+            }
+        });
+    }
+
+    fn lock(&self) -> MutexGuard<'_, HashMap<String, CachedDevice>> {
+        match self.entries.lock() {
+            Ok(entries) => entries,
+            Err(err) => err.into_inner(),
+        }
+    }
+
+    fn save(&self) {
+        let Some(writer) = &self.writer else {
+            return;
+        };
+        let contents = {
+            let entries = self.lock();
+            let mut lines = entries
+                .iter()
+                .map(|(identifier, device)| device.to_line(identifier))
+                .collect::<Vec<_>>();
+            lines.sort_unstable();
+            lines.join("\n")
+        };
+        writer.write(contents);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_line_round_trip() {
+        let device = CachedDevice {
+            accelerometer_calibration: [0x80, 0x81, 0x82, 0x00, 0x9A, 0x9B, 0x9C, 0x00, 0x40, 0xD6],
+            motion_plus: Some([0x00, 0x00, 0xA6, 0x20, 0x00, 0x05]),
+            motion_plus_calibration: None,
+            extension: Some([0x00, 0x00, 0xA4, 0x20, 0x00, 0x00]),
+            balance_board_calibration: None,
+        };
+
+        let line = device.to_line("00:19:1D:00:00:01");
+        assert_eq!(
+            CachedDevice::from_line(&line),
+            Some(("00:19:1D:00:00:01".to_string(), device))
+        );
+    }
+
+    #[test]
+    fn test_invalid_lines_ignored() {
+        assert_eq!(CachedDevice::from_line(""), None);
+        assert_eq!(CachedDevice::from_line("id 0102 - - -"), None);
+        assert_eq!(CachedDevice::from_line("id - - - -"), None);
+        assert_eq!(
+            CachedDevice::from_line("id 00010203040506070809 - - - - -"),
+            None
+        );
+        // Lines without the Balance Board calibration are still valid
+        assert!(CachedDevice::from_line("id 00010203040506070809 - - -").is_some());
+        assert_eq!(
+            CachedDevice::from_line("id 000102030405060708zz - - -"),
+            None
+        );
+    }
+
+    #[test]
+    fn test_file_written_on_drop() {
+        let path = std::env::temp_dir().join(format!("wiimote-cache-{}", std::process::id()));
+        let device = CachedDevice::default();
+        let cache = CalibrationCache::with_file(&path).unwrap();
+        cache.insert("00:19:1D:00:00:02", device.clone());
+        drop(cache);
+
+        let cache = CalibrationCache::with_file(&path).unwrap();
+        assert_eq!(cache.get("00:19:1D:00:00:02"), Some(device));
+        drop(cache);
+        let mut temporary_path = path.clone().into_os_string();
+        temporary_path.push(".tmp");
+        assert!(!Path::new(&temporary_path).exists());
+        std::fs::remove_file(path).unwrap();
+    }
+
+    #[cfg(feature = "mock")]
+    #[test]
+    fn test_mismatch_marks_device_stale() {
+        use crate::mock::MockWiimote;
+        use crate::native::NativeWiimoteDevice;
+
+        let cache = CalibrationCache::in_memory();
+        let connect = |mock: &MockWiimote| {
+            WiimoteDevice::new(NativeWiimoteDevice::take(mock), Some(Arc::clone(&cache))).unwrap()
+        };
+        let mock = MockWiimote::connect("cache-stale");
+        let calibration = format!("{:?}", connect(&mock).accelerometer_calibration());
+
+        // A cached calibration that the Wii remote no longer has, with a valid checksum
+        cache.update("cache-stale", |cached| {
+            cached.accelerometer_calibration[0] += 1;
+            cached.accelerometer_calibration[9] += 1;
+        });
+        let mock = mock.reconnect();
+        let mut device = connect(&mock);
+        assert_ne!(
+            format!("{:?}", device.accelerometer_calibration()),
+            calibration
+        );
+        // The revalidation completes while the reports are read
+        for _ in 0..100 {
+            if device.needs_refresh() {
+                break;
+            }
+            _ = device.read_timeout(10);
+        }
+        assert!(device.needs_refresh());
+        assert!(!cache.contains("cache-stale"));
+
+        device.refresh().unwrap();
+        assert!(!device.needs_refresh());
+        assert_eq!(
+            format!("{:?}", device.accelerometer_calibration()),
+            calibration
+        );
+        assert!(cache.contains("cache-stale"));
+    }
+}
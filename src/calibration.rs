@@ -1,3 +1,5 @@
+/// Maps a raw sensor value to `(value - zero) / (max - zero)`.
+/// The value and calibration are shifted to the same number of bits first.
 #[allow(clippy::cast_sign_loss, clippy::cast_possible_wrap)] // Numbers will not be that large
 pub fn normalize<TValue, TResult>(
     value: TValue,
@@ -22,3 +24,278 @@ where
     (Into::<TResult>::into(value) - Into::<TResult>::into(zero))
         / (Into::<TResult>::into(max) - Into::<TResult>::into(zero))
 }
+
+/// Number of samples converted per step of the batch conversions.
+/// Every step works on fixed size arrays that compile to SIMD instructions (e.g. `f32x8` with AVX).
+const LANES: usize = 8;
+
+/// Precomputed conversion of raw values of one axis, same as `normalize` multiplied by a constant
+/// but without the division.
+#[derive(Debug, Default, Clone, Copy, PartialEq)]
+pub struct AxisScale {
+    /// Scale of the raw value to the bits of the calibration, a power of two.
+    value_scale: f32,
+    zero: f32,
+    /// Reciprocal of `max - zero` multiplied by the conversion factor.
+    factor: f32,
+}
+
+impl AxisScale {
+    /// Precomputes `normalize(value, value_bits, zero, max, calibration_bits) * multiplier`.
+    /// A calibration with `zero == max` converts every value to 0.
+    #[must_use]
+    #[allow(clippy::cast_possible_truncation, clippy::float_cmp)]
+    pub fn new(
+        value_bits: usize,
+        zero: u16,
+        max: u16,
+        calibration_bits: usize,
+        multiplier: f64,
+    ) -> Self {
+        let missing_calibration_bits = value_bits.saturating_sub(calibration_bits);
+        let missing_value_bits = calibration_bits.saturating_sub(value_bits);
+
+        let zero = f64::from(u32::from(zero) << missing_calibration_bits);
+        let max = f64::from(u32::from(max) << missing_calibration_bits);
+        let factor = if max == zero {
+            0.0
+        } else {
+            multiplier / (max - zero)
+        };
+        Self {
+            value_scale: (1u32 << missing_value_bits) as f32,
+            zero: zero as f32,
+            factor: factor as f32,
+        }
+    }
+
+    /// Packs the scale into two words to be stored in a `SeqLock`.
+    pub(crate) fn to_words(self) -> [u64; 2] {
+        [
+            u64::from(self.value_scale.to_bits()) | u64::from(self.zero.to_bits()) << 32,
+            u64::from(self.factor.to_bits()),
+        ]
+    }
+
+    #[allow(clippy::cast_possible_truncation)]
+    pub(crate) fn from_words([first, second]: [u64; 2]) -> Self {
+        Self {
+            value_scale: f32::from_bits(first as u32),
+            zero: f32::from_bits((first >> 32) as u32),
+            factor: f32::from_bits(second as u32),
+        }
+    }
+
+    /// Converts a single raw value.
+    #[must_use]
+    #[inline]
+    pub fn apply(&self, value: u16) -> f32 {
+        // Both terms of the subtraction are integers, only the multiplication rounds
+        (f32::from(value) * self.value_scale - self.zero) * self.factor
+    }
+
+    /// Converts the raw values into `output`, up to the length of the shorter slice.
+    pub fn apply_batch(&self, values: &[u16], output: &mut [f32]) {
+        let length = usize::min(values.len(), output.len());
+        let (values, output) = (&values[..length], &mut output[..length]);
+
+        let mut value_chunks = values.chunks_exact(LANES);
+        let mut output_chunks = output.chunks_exact_mut(LANES);
+        for (values, output) in (&mut value_chunks).zip(&mut output_chunks) {
+            for lane in 0..LANES {
+                output[lane] = self.apply(values[lane]);
+            }
+        }
+        for (value, output) in value_chunks
+            .remainder()
+            .iter()
+            .zip(output_chunks.into_remainder())
+        {
+            *output = self.apply(*value);
+        }
+    }
+
+    /// Converts the raw values into `output` with `slow` or `fast` depending on the flag of every value,
+    /// up to the length of the shortest slice.
+    pub fn apply_select_batch(
+        slow: &Self,
+        fast: &Self,
+        values: &[u16],
+        is_slow: &[bool],
+        output: &mut [f32],
+    ) {
+        let length = values.len().min(is_slow.len()).min(output.len());
+        let (values, is_slow, output) =
+            (&values[..length], &is_slow[..length], &mut output[..length]);
+        let select = |value: u16, is_slow: bool| {
+            // Selecting the factors instead of branching keeps the lanes independent
+            let scale = if is_slow { slow } else { fast };
+            (f32::from(value) * scale.value_scale - scale.zero) * scale.factor
+        };
+
+        let mut value_chunks = values.chunks_exact(LANES);
+        let mut flag_chunks = is_slow.chunks_exact(LANES);
+        let mut output_chunks = output.chunks_exact_mut(LANES);
+        for ((values, is_slow), output) in (&mut value_chunks)
+            .zip(&mut flag_chunks)
+            .zip(&mut output_chunks)
+        {
+            for lane in 0..LANES {
+                output[lane] = select(values[lane], is_slow[lane]);
+            }
+        }
+        for ((value, is_slow), output) in value_chunks
+            .remainder()
+            .iter()
+            .zip(flag_chunks.remainder())
+            .zip(output_chunks.into_remainder())
+        {
+            *output = select(*value, *is_slow);
+        }
+    }
+}
+
+/// Number of fractional bits of the fixed-point results, `1 << FIXED_POINT_BITS` represents `1.0`.
+pub const FIXED_POINT_BITS: u32 = 16;
+/// Number of fractional bits of the precomputed multiplier.
+const MULTIPLIER_BITS: u32 = 16;
+
+/// Precomputed fixed-point conversion of raw values of one axis, same as `normalize` multiplied by a constant
+/// with [`FIXED_POINT_BITS`] fractional bits, computed with a single integer multiplication and shift.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct FixedPointScale {
+    /// Shift of the raw value to the bits of the calibration.
+    value_shift: u32,
+    zero: i64,
+    /// `(1 << (FIXED_POINT_BITS + MULTIPLIER_BITS)) / (max - zero)` multiplied by the conversion factor.
+    multiplier: i64,
+}
+
+impl FixedPointScale {
+    /// Precomputes `normalize(value, value_bits, zero, max, calibration_bits) * multiplier`.
+    /// A calibration with `zero == max` converts every value to 0.
+    #[must_use]
+    #[allow(clippy::cast_possible_truncation, clippy::cast_precision_loss)]
+    pub fn new(
+        value_bits: usize,
+        zero: u16,
+        max: u16,
+        calibration_bits: usize,
+        multiplier: f64,
+    ) -> Self {
+        let missing_calibration_bits = value_bits.saturating_sub(calibration_bits);
+        let missing_value_bits = calibration_bits.saturating_sub(value_bits);
+
+        let zero = i64::from(zero) << missing_calibration_bits;
+        let range = (i64::from(max) << missing_calibration_bits) - zero;
+        let multiplier = if range == 0 {
+            0
+        } else {
+            let one = (1u64 << (FIXED_POINT_BITS + MULTIPLIER_BITS)) as f64;
+            (multiplier * one / range as f64).round() as i64
+        };
+        Self {
+            value_shift: missing_value_bits as u32,
+            zero,
+            multiplier,
+        }
+    }
+
+    /// Packs the scale into three words to be stored in a `SeqLock`.
+    #[allow(clippy::cast_sign_loss)]
+    pub(crate) const fn to_words(self) -> [u64; 3] {
+        [
+            self.value_shift as u64,
+            self.zero as u64,
+            self.multiplier as u64,
+        ]
+    }
+
+    #[allow(clippy::cast_possible_truncation, clippy::cast_possible_wrap)]
+    pub(crate) const fn from_words([value_shift, zero, multiplier]: [u64; 3]) -> Self {
+        Self {
+            value_shift: value_shift as u32,
+            zero: zero as i64,
+            multiplier: multiplier as i64,
+        }
+    }
+
+    /// Converts a single raw value, the result saturates at the bounds of `i32`.
+    #[must_use]
+    #[inline]
+    #[allow(clippy::cast_possible_truncation)]
+    pub fn apply(&self, value: u16) -> i32 {
+        let value = (i64::from(value) << self.value_shift) - self.zero;
+        let rounding = 1 << (MULTIPLIER_BITS - 1);
+        ((value * self.multiplier + rounding) >> MULTIPLIER_BITS)
+            .clamp(i64::from(i32::MIN), i64::from(i32::MAX)) as i32
+    }
+}
+
+/// Converts a fixed-point result with [`FIXED_POINT_BITS`] fractional bits to a float.
+#[must_use]
+#[inline]
+#[allow(clippy::cast_precision_loss)]
+pub fn fixed_point_to_f32(value: i32) -> f32 {
+    value as f32 / (1u32 << FIXED_POINT_BITS) as f32
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_axis_scale_matches_normalize() {
+        let accelerometer = AxisScale::new(10, 0x200, 0x268, 10, 1.0);
+        let motion_plus = AxisScale::new(14, 0x7E00, 0x8A00, 16, 2.5);
+        for value in (0..1024).step_by(7) {
+            let expected: f64 = normalize(value, 10, 0x200, 0x268, 10);
+            assert!((f64::from(accelerometer.apply(value)) - expected).abs() < 1e-4);
+        }
+        for value in (0..0x4000).step_by(61) {
+            let expected: f64 = normalize(value, 14, 0x7E00, 0x8A00, 16);
+            assert!((f64::from(motion_plus.apply(value)) - expected * 2.5).abs() < 1e-4);
+        }
+    }
+
+    #[test]
+    fn test_fixed_point_scale_matches_normalize() {
+        let tolerance = 1.0 / f64::from(1u32 << FIXED_POINT_BITS);
+        let accelerometer = FixedPointScale::new(10, 0x200, 0x268, 10, 1.0);
+        let motion_plus = FixedPointScale::new(14, 0x7E00, 0x8A00, 16, 90.0);
+        for value in 0..1024 {
+            let expected: f64 = normalize(value, 10, 0x200, 0x268, 10);
+            let actual = f64::from(accelerometer.apply(value)) * tolerance;
+            assert!((actual - expected).abs() <= tolerance, "{value}");
+        }
+        for value in 0..0x4000 {
+            let expected: f64 = normalize(value, 14, 0x7E00, 0x8A00, 16);
+            let actual = f64::from(motion_plus.apply(value)) * tolerance;
+            assert!((actual - expected * 90.0).abs() <= tolerance, "{value}");
+        }
+        assert_eq!(
+            FixedPointScale::new(10, 0x200, 0x200, 10, 1.0).apply(0x300),
+            0
+        );
+    }
+
+    #[test]
+    fn test_batch_matches_single_values() {
+        let slow = AxisScale::new(14, 0x7E00, 0x8A00, 16, 1.0);
+        let fast = AxisScale::new(14, 0x7F00, 0x8800, 16, 4.5);
+        let values = (0..21).map(|value| value * 700).collect::<Vec<u16>>();
+        let is_slow = (0..21).map(|index| index % 3 == 0).collect::<Vec<_>>();
+        let mut output = [0f32; 21];
+
+        slow.apply_batch(&values, &mut output);
+        for (value, output) in values.iter().zip(&output) {
+            assert_eq!(*output, slow.apply(*value));
+        }
+
+        AxisScale::apply_select_batch(&slow, &fast, &values, &is_slow, &mut output);
+        for ((value, is_slow), output) in values.iter().zip(&is_slow).zip(&output) {
+            let scale = if *is_slow { &slow } else { &fast };
+            assert_eq!(*output, scale.apply(*value));
+        }
+    }
+}
@@ -0,0 +1,585 @@
+//! Compact append-only recording of received input reports.
+//!
+//! A capture starts with an 8 byte header followed by records:
+//! - device: `0x01`, device number and identifier length as varints, identifier bytes
+//! - report: `0x02`, device number and microseconds since the previous record as varints,
+//!   report length byte, report bytes starting with the report ID
+//!
+//! Captures are read from a byte slice, so they can be read from a memory-mapped file without copying.
+
+use std::fs::File;
+use std::io::{self, Write};
+use std::path::Path;
+use std::sync::{Arc, Mutex, MutexGuard};
+use std::thread::JoinHandle;
+use std::time::{Duration, Instant};
+
+use crate::input::RawReport;
+use crate::WIIMOTE_DEFAULT_REPORT_BUFFER_SIZE;
+
+const MAGIC: &[u8; 6] = b"WIICAP";
+const VERSION: u8 = 1;
+const HEADER_SIZE: usize = 8;
+
+const DEVICE_RECORD: u8 = 0x01;
+const REPORT_RECORD: u8 = 0x02;
+/// Largest report record: tag, two varints of up to 10 bytes, length and report bytes.
+const MAX_REPORT_RECORD_SIZE: usize = 1 + 10 + 10 + 1 + WIIMOTE_DEFAULT_REPORT_BUFFER_SIZE;
+/// Size of the buffer collecting records before they are written.
+const WRITE_BUFFER_SIZE: usize = 64 * 1024;
+/// Number of full buffers a recorder queues for its writer thread before recording waits for it.
+const QUEUED_BUFFER_COUNT: usize = 4;
+
+fn invalid_data(message: &str) -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, message)
+}
+
+fn write_varint(buffer: &mut Vec<u8>, mut value: u64) {
+    while value >= 0x80 {
+        #[allow(clippy::cast_possible_truncation)]
+        buffer.push((value as u8) | 0x80);
+        value >>= 7;
+    }
+    #[allow(clippy::cast_possible_truncation)]
+    buffer.push(value as u8);
+}
+
+/// Writes a capture to `W`. Records are collected in a preallocated buffer,
+/// writing a report does not allocate.
+pub struct CaptureWriter<W: Write> {
+    inner: W,
+    buffer: Vec<u8>,
+    device_count: u32,
+    last_timestamp: Duration,
+}
+
+impl<W: Write> CaptureWriter<W> {
+    /// Starts a capture written to `inner`.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the header could not be written.
+    pub fn new(mut inner: W) -> io::Result<Self> {
+        let mut header = [0u8; HEADER_SIZE];
+        header[..MAGIC.len()].copy_from_slice(MAGIC);
+        header[MAGIC.len()] = VERSION;
+        inner.write_all(&header)?;
+        Ok(Self {
+            inner,
+            buffer: Vec::with_capacity(WRITE_BUFFER_SIZE),
+            device_count: 0,
+            last_timestamp: Duration::ZERO,
+        })
+    }
+
+    /// Adds a device to the capture, returns the device number used for its reports.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the buffered records could not be written.
+    pub fn add_device(&mut self, identifier: &str) -> io::Result<u32> {
+        self.reserve(1 + 10 + 10 + identifier.len())?;
+        let device = self.device_count;
+        self.buffer.push(DEVICE_RECORD);
+        write_varint(&mut self.buffer, device.into());
+        write_varint(&mut self.buffer, identifier.len() as u64);
+        self.buffer.extend_from_slice(identifier.as_bytes());
+        self.device_count += 1;
+        Ok(device)
+    }
+
+    /// Appends a report of the device received at `timestamp` since the start of the capture.
+    /// Timestamps before the previous record are stored as the time of the previous record.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the report is longer than a Wii remote report
+    /// or the buffered records could not be written.
+    pub fn write_report(
+        &mut self,
+        device: u32,
+        timestamp: Duration,
+        report: &[u8],
+    ) -> io::Result<()> {
+        if report.len() > WIIMOTE_DEFAULT_REPORT_BUFFER_SIZE {
+            return Err(io::Error::new(
+                io::ErrorKind::InvalidInput,
+                "Report is too long",
+            ));
+        }
+        self.reserve(MAX_REPORT_RECORD_SIZE)?;
+
+        let delta = timestamp.saturating_sub(self.last_timestamp);
+        self.last_timestamp = self.last_timestamp.max(timestamp);
+        self.buffer.push(REPORT_RECORD);
+        write_varint(&mut self.buffer, device.into());
+        write_varint(
+            &mut self.buffer,
+            u64::try_from(delta.as_micros()).unwrap_or(u64::MAX),
+        );
+        #[allow(clippy::cast_possible_truncation)]
+        self.buffer.push(report.len() as u8);
+        self.buffer.extend_from_slice(report);
+        Ok(())
+    }
+
+    /// Writes the buffered records to the inner writer.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if writing failed.
+    pub fn flush(&mut self) -> io::Result<()> {
+        self.inner.write_all(&self.buffer)?;
+        self.buffer.clear();
+        self.inner.flush()
+    }
+
+    /// Writes the buffered records if `size` more bytes do not fit into the buffer.
+    fn reserve(&mut self, size: usize) -> io::Result<()> {
+        if self.buffer.len() + size > self.buffer.capacity() {
+            self.inner.write_all(&self.buffer)?;
+            self.buffer.clear();
+        }
+        Ok(())
+    }
+}
+
+impl<W: Write> Drop for CaptureWriter<W> {
+    fn drop(&mut self) {
+        if let Err(error) = self.flush() {
+            eprintln!("Failed to write capture: {error}");
+        }
+    }
+}
+
+enum SinkMessage {
+    Data(Vec<u8>),
+    Flush,
+}
+
+/// Hands the full buffers of a `CaptureWriter` to a writer thread,
+/// so reading threads recording reports do not wait for the inner writer.
+struct CaptureSink {
+    /// `None` once the sink is dropped, which stops the writer thread.
+    messages: Option<crossbeam_channel::Sender<SinkMessage>>,
+    /// Buffers written by the writer thread, reused for the next records.
+    written: crossbeam_channel::Receiver<Vec<u8>>,
+    flushed: crossbeam_channel::Receiver<io::Result<()>>,
+    buffer_count: usize,
+    thread: Option<JoinHandle<()>>,
+}
+
+fn disconnected() -> io::Error {
+    io::Error::new(io::ErrorKind::BrokenPipe, "Capture writer thread stopped")
+}
+
+impl CaptureSink {
+    fn start(mut inner: Box<dyn Write + Send>) -> Self {
+        let (messages, message_receiver) = crossbeam_channel::bounded(QUEUED_BUFFER_COUNT);
+        let (written_sender, written) = crossbeam_channel::bounded(QUEUED_BUFFER_COUNT);
+        let (flushed_sender, flushed) = crossbeam_channel::bounded(1);
+        let thread = std::thread::Builder::new()
+            .name("wii-remote-capture".to_string())
+            .spawn(move || {
+                // After a failed write the records are dropped, the error is returned by the next flush
+                let mut result = Ok(());
+                while let Ok(message) = message_receiver.recv() {
+                    match message {
+                        SinkMessage::Data(mut buffer) => {
+                            if result.is_ok() {
+                                result = inner.write_all(&buffer);
+                            }
+                            buffer.clear();
+                            _ = written_sender.send(buffer);
+                        }
+                        SinkMessage::Flush => {
+                            let flush_result =
+                                std::mem::replace(&mut result, Ok(())).and_then(|()| inner.flush());
+                            _ = flushed_sender.send(flush_result);
+                        }
+                    }
+                }
+                if let Err(error) = result.and_then(|()| inner.flush()) {
+                    eprintln!("Failed to write capture: {error}");
+                }
+            })
+            .expect("Failed to spawn capture writer thread");
+        Self {
+            messages: Some(messages),
+            written,
+            flushed,
+            buffer_count: 0,
+            thread: Some(thread),
+        }
+    }
+
+    fn send(&self, message: SinkMessage) -> io::Result<()> {
+        self.messages
+            .as_ref()
+            .and_then(|messages| messages.send(message).ok())
+            .ok_or_else(disconnected)
+    }
+
+    /// Returns a written buffer, allocates until `QUEUED_BUFFER_COUNT` buffers are in use.
+    fn empty_buffer(&mut self) -> io::Result<Vec<u8>> {
+        if let Ok(buffer) = self.written.try_recv() {
+            return Ok(buffer);
+        }
+        if self.buffer_count < QUEUED_BUFFER_COUNT {
+            self.buffer_count += 1;
+            return Ok(Vec::with_capacity(WRITE_BUFFER_SIZE));
+        }
+        // The writer thread is behind by all buffers
+        self.written.recv().map_err(|_| disconnected())
+    }
+}
+
+impl Write for CaptureSink {
+    fn write(&mut self, data: &[u8]) -> io::Result<usize> {
+        let mut buffer = self.empty_buffer()?;
+        buffer.extend_from_slice(data);
+        self.send(SinkMessage::Data(buffer))?;
+        Ok(data.len())
+    }
+
+    /// Waits until the writer thread wrote the queued buffers.
+    fn flush(&mut self) -> io::Result<()> {
+        self.send(SinkMessage::Flush)?;
+        self.flushed.recv().map_err(|_| disconnected())?
+    }
+}
+
+impl Drop for CaptureSink {
+    fn drop(&mut self) {
+        // The queued buffers are written before the thread stops
+        self.messages = None;
+        if let Some(thread) = self.thread.take() {
+            _ = thread.join();
+        }
+    }
+}
+
+/// Records the reports received by Wii remotes into a capture, see `WiimoteDevice::start_capture`.
+/// Timestamps are relative to the creation of the recorder.
+///
+/// Recording only encodes the reports, full buffers are written by a writer thread.
+pub struct CaptureRecorder {
+    writer: Mutex<CaptureWriter<CaptureSink>>,
+    start: Instant,
+}
+
+impl CaptureRecorder {
+    /// Creates a recorder writing to `writer` on a writer thread.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the header could not be written.
+    pub fn new(writer: impl Write + Send + 'static) -> io::Result<Arc<Self>> {
+        let sink = CaptureSink::start(Box::new(writer));
+        Ok(Arc::new(Self {
+            writer: Mutex::new(CaptureWriter::new(sink)?),
+            start: Instant::now(),
+        }))
+    }
+
+    /// Creates a recorder writing to a new file at `path`.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the file could not be created.
+    pub fn create(path: impl AsRef<Path>) -> io::Result<Arc<Self>> {
+        Self::new(File::create(path)?)
+    }
+
+    /// Writes the buffered records and waits for the writer thread to write them.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if writing failed since the previous flush.
+    pub fn flush(&self) -> io::Result<()> {
+        self.lock().flush()
+    }
+
+    pub(crate) fn add_device(&self, identifier: &str) -> io::Result<u32> {
+        self.lock().add_device(identifier)
+    }
+
+    pub(crate) fn record(&self, device: u32, reports: &[RawReport]) {
+        let now = self.start.elapsed();
+        let mut writer = self.lock();
+        for report in reports {
+            let timestamp = report.timestamp().map_or(now, |timestamp| {
+                timestamp.saturating_duration_since(self.start)
+            });
+            if let Err(error) = writer.write_report(device, timestamp, report.as_bytes()) {
+                eprintln!("Failed to write capture: {error}");
+                return;
+            }
+        }
+    }
+
+    fn lock(&self) -> MutexGuard<'_, CaptureWriter<CaptureSink>> {
+        match self.writer.lock() {
+            Ok(writer) => writer,
+            Err(err) => err.into_inner(),
+        }
+    }
+}
+
+/// A report read from a capture.
+#[derive(Debug, Clone, Copy)]
+pub struct CaptureRecord<'a> {
+    /// Time the report was received since the start of the capture.
+    pub timestamp: Duration,
+    /// Identifier of the Wii remote that received the report.
+    pub identifier: &'a str,
+    /// The report bytes starting with the report ID.
+    pub report: &'a [u8],
+}
+
+/// The reports of a single Wii remote in a capture, for example to replay on a simulated Wii remote.
+#[derive(Debug, Clone)]
+pub struct CapturedStream {
+    pub reports: Arc<[RawReport]>,
+    /// Time every report was received since the start of the capture.
+    pub timestamps: Arc<[Duration]>,
+}
+
+/// Reads the records of a capture from a byte slice without copying the reports.
+pub struct CaptureReader<'a> {
+    data: &'a [u8],
+    position: usize,
+    timestamp: Duration,
+    devices: Vec<&'a str>,
+}
+
+impl<'a> CaptureReader<'a> {
+    /// Reads the capture in `data`, which can be a memory-mapped capture file.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if `data` does not start with a capture header.
+    pub fn new(data: &'a [u8]) -> io::Result<Self> {
+        if data.len() < HEADER_SIZE || &data[..MAGIC.len()] != MAGIC {
+            return Err(invalid_data("Not a capture"));
+        }
+        if data[MAGIC.len()] != VERSION {
+            return Err(invalid_data("Unsupported capture version"));
+        }
+        Ok(Self {
+            data,
+            position: HEADER_SIZE,
+            timestamp: Duration::ZERO,
+            devices: Vec::new(),
+        })
+    }
+
+    /// Reads the next records into `reports` until `reports` is full or the capture ended.
+    /// Returns the number of reports read, like `WiimoteDevice::read_batch`.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the capture is corrupted.
+    pub fn read_batch(&mut self, reports: &mut [RawReport]) -> io::Result<usize> {
+        for (index, report) in reports.iter_mut().enumerate() {
+            match self.next() {
+                Some(record) => *report = RawReport::from_bytes(record?.report),
+                None => return Ok(index),
+            }
+        }
+        Ok(reports.len())
+    }
+
+    /// Collects the remaining reports of the Wii remote with the identifier.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the capture is corrupted.
+    pub fn collect_stream(self, identifier: &str) -> io::Result<CapturedStream> {
+        let mut reports = Vec::new();
+        let mut timestamps = Vec::new();
+        for record in self {
+            let record = record?;
+            if record.identifier == identifier {
+                reports.push(RawReport::from_bytes(record.report));
+                timestamps.push(record.timestamp);
+            }
+        }
+        Ok(CapturedStream {
+            reports: reports.into(),
+            timestamps: timestamps.into(),
+        })
+    }
+
+    fn read_u8(&mut self) -> io::Result<u8> {
+        let byte = *self
+            .data
+            .get(self.position)
+            .ok_or_else(|| invalid_data("Truncated record"))?;
+        self.position += 1;
+        Ok(byte)
+    }
+
+    fn read_varint(&mut self) -> io::Result<u64> {
+        let mut value = 0u64;
+        for shift in (0..64).step_by(7) {
+            let byte = self.read_u8()?;
+            value |= u64::from(byte & 0x7F) << shift;
+            if byte & 0x80 == 0 {
+                return Ok(value);
+            }
+        }
+        Err(invalid_data("Invalid varint"))
+    }
+
+    fn read_bytes(&mut self, length: usize) -> io::Result<&'a [u8]> {
+        let bytes = self
+            .data
+            .get(self.position..self.position + length)
+            .ok_or_else(|| invalid_data("Truncated record"))?;
+        self.position += length;
+        Ok(bytes)
+    }
+
+    fn read_record(&mut self) -> io::Result<Option<CaptureRecord<'a>>> {
+        match self.read_u8()? {
+            DEVICE_RECORD => {
+                let device = self.read_varint()?;
+                if device != self.devices.len() as u64 {
+                    return Err(invalid_data("Unexpected device number"));
+                }
+                let length = usize::try_from(self.read_varint()?)
+                    .map_err(|_| invalid_data("Invalid identifier length"))?;
+                let identifier = std::str::from_utf8(self.read_bytes(length)?)
+                    .map_err(|_| invalid_data("Invalid identifier"))?;
+                self.devices.push(identifier);
+                Ok(None)
+            }
+            REPORT_RECORD => {
+                let device = self.read_varint()?;
+                let identifier = usize::try_from(device)
+                    .ok()
+                    .and_then(|device| self.devices.get(device))
+                    .copied()
+                    .ok_or_else(|| invalid_data("Unknown device number"))?;
+                let delta = Duration::from_micros(self.read_varint()?);
+                self.timestamp += delta;
+                let length = self.read_u8()? as usize;
+                let report = self.read_bytes(length)?;
+                Ok(Some(CaptureRecord {
+                    timestamp: self.timestamp,
+                    identifier,
+                    report,
+                }))
+            }
+            _ => Err(invalid_data("Unknown record")),
+        }
+    }
+}
+
+impl<'a> Iterator for CaptureReader<'a> {
+    type Item = io::Result<CaptureRecord<'a>>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        while self.position < self.data.len() {
+            match self.read_record() {
+                Ok(Some(record)) => return Some(Ok(record)),
+                Ok(None) => {}
+                Err(error) => {
+                    // Corrupted captures end with the error
+                    self.position = self.data.len();
+                    return Some(Err(error));
+                }
+            }
+        }
+        None
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_capture_round_trip() {
+        let mut data = Vec::new();
+        {
+            let mut writer = CaptureWriter::new(&mut data).unwrap();
+            let first = writer.add_device("00:19:1D:00:00:01").unwrap();
+            let second = writer.add_device("00:19:1D:00:00:02").unwrap();
+            writer
+                .write_report(first, Duration::from_micros(5000), &[0x30, 0x00, 0x08])
+                .unwrap();
+            writer
+                .write_report(
+                    second,
+                    Duration::from_micros(5200),
+                    &[0x31, 0x00, 0x00, 0x80],
+                )
+                .unwrap();
+        }
+
+        let records = CaptureReader::new(&data)
+            .unwrap()
+            .collect::<io::Result<Vec<_>>>()
+            .unwrap();
+        assert_eq!(records.len(), 2);
+        assert_eq!(records[0].identifier, "00:19:1D:00:00:01");
+        assert_eq!(records[0].timestamp, Duration::from_micros(5000));
+        assert_eq!(records[0].report, [0x30, 0x00, 0x08]);
+        assert_eq!(records[1].identifier, "00:19:1D:00:00:02");
+        assert_eq!(records[1].timestamp, Duration::from_micros(5200));
+        assert_eq!(records[1].report, [0x31, 0x00, 0x00, 0x80]);
+    }
+
+    /// Appends to a buffer shared with the test.
+    struct SharedBuffer(Arc<Mutex<Vec<u8>>>);
+
+    impl Write for SharedBuffer {
+        fn write(&mut self, data: &[u8]) -> io::Result<usize> {
+            self.0.lock().unwrap().extend_from_slice(data);
+            Ok(data.len())
+        }
+
+        fn flush(&mut self) -> io::Result<()> {
+            Ok(())
+        }
+    }
+
+    #[test]
+    fn test_recorder_writes_on_writer_thread() {
+        let data = Arc::new(Mutex::new(Vec::new()));
+        let recorder = CaptureRecorder::new(SharedBuffer(Arc::clone(&data))).unwrap();
+        let device = recorder.add_device("wiimote").unwrap();
+        // More reports than fit into all queued buffers
+        let report = RawReport::from_bytes(&[0x30, 0x00, 0x00]);
+        let report_count = QUEUED_BUFFER_COUNT * WRITE_BUFFER_SIZE / MAX_REPORT_RECORD_SIZE * 2;
+        for _ in 0..report_count {
+            recorder.record(device, &[report]);
+        }
+        recorder.flush().unwrap();
+
+        let data = data.lock().unwrap();
+        let reader = CaptureReader::new(&data).unwrap();
+        let stream = reader.collect_stream("wiimote").unwrap();
+        assert_eq!(stream.reports.len(), report_count);
+    }
+
+    #[test]
+    fn test_truncated_capture() {
+        let mut data = Vec::new();
+        {
+            let mut writer = CaptureWriter::new(&mut data).unwrap();
+            let device = writer.add_device("wiimote").unwrap();
+            writer
+                .write_report(device, Duration::ZERO, &[0x30, 0x00, 0x00])
+                .unwrap();
+        }
+        data.pop();
+
+        let mut reader = CaptureReader::new(&data).unwrap();
+        assert!(matches!(reader.next(), Some(Err(_))));
+        assert!(reader.next().is_none());
+        assert!(CaptureReader::new(b"WIICAP").is_err());
+    }
+}
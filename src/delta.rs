@@ -0,0 +1,153 @@
+use crate::input::{ButtonData, InputReport, InputReportRef};
+
+/// A change of the state of a Wii remote, see `DeltaFilter`.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum DeltaEvent {
+    /// The buttons that were pressed since the previous report.
+    Pressed(ButtonData),
+    /// The buttons that were released since the previous report.
+    Released(ButtonData),
+    /// The raw 10 bit x, y and z accelerometer values, at least one moved past the dead-band.
+    Accelerometer([u16; 3]),
+}
+
+/// Turns full input reports into the changes since the previous report.
+///
+/// Buttons emit an event on every press and release, the accelerometer emits an event once an axis
+/// changes by more than the dead-band from the last emitted value. Reports without changes emit nothing.
+///
+/// Only the accelerometer of the Wii remote is filtered. The extension bytes, including the Motion Plus
+/// gyroscope, depend on the connected extension and are not looked at, decode them with
+/// `WiimoteDevice::decode_extension` and compare them against a dead-band of their own.
+#[derive(Debug, Clone)]
+pub struct DeltaFilter {
+    accelerometer_dead_band: u16,
+    buttons: ButtonData,
+    /// The last emitted accelerometer values, `None` until the first report with accelerometer data.
+    accelerometer: Option<[u16; 3]>,
+}
+
+impl DeltaFilter {
+    /// Creates a filter that ignores accelerometer changes of up to `accelerometer_dead_band` raw units.
+    /// The dead-band does not apply to the gyroscope or extension axes, see `DeltaFilter`.
+    #[must_use]
+    pub const fn new(accelerometer_dead_band: u16) -> Self {
+        Self {
+            accelerometer_dead_band,
+            buttons: ButtonData::empty(),
+            accelerometer: None,
+        }
+    }
+
+    /// Forgets the previous state, the next report emits all pressed buttons and the accelerometer values.
+    pub fn reset(&mut self) {
+        *self = Self::new(self.accelerometer_dead_band);
+    }
+
+    /// Returns the changes of `report` since the previous report, see `update_ref`.
+    pub fn update(&mut self, report: &InputReport) -> impl Iterator<Item = DeltaEvent> {
+        self.update_ref(&report.view())
+    }
+
+    /// Returns the changes of the borrowed `report` since the previous report.
+    /// At most one event of every kind is returned, without allocating.
+    pub fn update_ref(&mut self, report: &InputReportRef<'_>) -> impl Iterator<Item = DeltaEvent> {
+        let mut events = [None; 3];
+
+        if let Some(buttons) = report.buttons() {
+            // The unused bits carry the lowest accelerometer bits in some reporting modes
+            let buttons = ButtonData::from_bits_truncate(buttons.bits());
+            let pressed = buttons.difference(self.buttons);
+            let released = self.buttons.difference(buttons);
+            self.buttons = buttons;
+            events[0] = (!pressed.is_empty()).then_some(DeltaEvent::Pressed(pressed));
+            events[1] = (!released.is_empty()).then_some(DeltaEvent::Released(released));
+        }
+
+        let accelerometer = match report {
+            InputReportRef::DataReport(_, data) => data.accelerometer(),
+            _ => None,
+        };
+        if let Some(accelerometer) = accelerometer {
+            let values = [accelerometer.x(), accelerometer.y(), accelerometer.z()];
+            let is_changed = match self.accelerometer {
+                Some(previous) => previous.iter().zip(values).any(|(previous, value)| {
+                    previous.abs_diff(value) > self.accelerometer_dead_band
+                }),
+                None => true,
+            };
+            if is_changed {
+                self.accelerometer = Some(values);
+                events[2] = Some(DeltaEvent::Accelerometer(values));
+            }
+        }
+
+        events.into_iter().flatten()
+    }
+}
+
+impl Default for DeltaFilter {
+    /// Ignores accelerometer noise of a Wii remote lying still.
+    fn default() -> Self {
+        Self::new(2)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn report(buttons: u16, accelerometer: [u8; 3]) -> InputReport {
+        let [first, second] = buttons.to_le_bytes();
+        let mut bytes = [0u8; 22];
+        bytes[0] = 0x31;
+        bytes[1..6].copy_from_slice(&[
+            first,
+            second,
+            accelerometer[0],
+            accelerometer[1],
+            accelerometer[2],
+        ]);
+        InputReport::try_from(&bytes[..]).unwrap()
+    }
+
+    #[test]
+    fn test_button_edges() {
+        let mut filter = DeltaFilter::new(4);
+        let a = ButtonData::A.bits();
+        let b = ButtonData::B.bits();
+
+        let events = filter.update(&report(a, [0x80; 3])).collect::<Vec<_>>();
+        assert_eq!(
+            events,
+            [
+                DeltaEvent::Pressed(ButtonData::A),
+                DeltaEvent::Accelerometer([0x200; 3])
+            ]
+        );
+        assert_eq!(filter.update(&report(a, [0x80; 3])).count(), 0);
+        // The lowest accelerometer bits in the button bytes are not buttons
+        assert_eq!(filter.update(&report(a | 0x6060, [0x80; 3])).count(), 0);
+
+        let events = filter.update(&report(b, [0x80; 3])).collect::<Vec<_>>();
+        assert_eq!(
+            events,
+            [
+                DeltaEvent::Pressed(ButtonData::B),
+                DeltaEvent::Released(ButtonData::A)
+            ]
+        );
+    }
+
+    #[test]
+    fn test_accelerometer_dead_band() {
+        let mut filter = DeltaFilter::new(4);
+        assert_eq!(filter.update(&report(0, [0x80; 3])).count(), 1);
+        // One raw unit of the high bits is 4 units of the 10 bit value
+        assert_eq!(filter.update(&report(0, [0x81, 0x80, 0x80])).count(), 0);
+        let events = filter
+            .update(&report(0, [0x81, 0x80, 0x82]))
+            .collect::<Vec<_>>();
+        assert_eq!(events, [DeltaEvent::Accelerometer([0x204, 0x200, 0x208])]);
+    }
+}
@@ -1,13 +1,29 @@
-use std::sync::atomic::{AtomicBool, Ordering};
-use std::sync::Mutex;
+use std::collections::VecDeque;
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex, MutexGuard};
+use std::time::{Duration, Instant};
 
-use crate::calibration::normalize;
-use crate::extensions::{MotionPlus, WiimoteExtension};
-use crate::input::InputReport;
-use crate::native::{NativeWiimote, NativeWiimoteDevice};
+use crate::background::BackgroundIo;
+use crate::cache::{CachedDevice, CalibrationCache};
+use crate::calibration::{normalize, AxisScale, FixedPointScale};
+use crate::capture::CaptureRecorder;
+#[cfg(feature = "async")]
+use crate::driver::{OutputWrite, Readiness, ReportStream};
+use crate::extensions::{
+    BalanceBoardCalibration, ExtensionData, MotionPlus, MotionPlusMode, WiimoteExtension,
+};
+use crate::input::{DataReportRef, InputReport, RawReport};
+#[cfg(feature = "metrics")]
+use crate::metrics::DeviceMetricsSnapshot;
+use crate::metrics::{DeviceMetrics, Timer};
+use crate::native::{
+    InputWaiter, NativeReactor, NativeWiimote, NativeWiimoteDevice, NativeWiimoteReactor,
+};
 use crate::output::{Addressing, OutputReport};
 use crate::prelude::*;
-use crate::simple_io;
+use crate::simple_io::{self, MemoryRequest};
+use crate::transaction::{MemoryTransaction, TransactionEngine, TransactionRequest};
+use once_cell::sync::OnceCell;
 
 /// The calibration data for the accelerometer of the Wii remote.
 /// Can be used to convert raw accelerometer data to acceleration values.
@@ -19,9 +35,29 @@ pub struct AccelerometerCalibration {
     x_gravity: u16,
     y_gravity: u16,
     z_gravity: u16,
+    /// Conversions of the x, y and z axes, precomputed when the calibration is read.
+    scales: [AxisScale; 3],
+    fixed_point_scales: [FixedPointScale; 3],
 }
 
 impl AccelerometerCalibration {
+    fn new(zero_offsets: [u16; 3], gravity: [u16; 3]) -> Self {
+        let [x_zero_offset, y_zero_offset, z_zero_offset] = zero_offsets;
+        let [x_gravity, y_gravity, z_gravity] = gravity;
+        Self {
+            x_zero_offset,
+            y_zero_offset,
+            z_zero_offset,
+            x_gravity,
+            y_gravity,
+            z_gravity,
+            scales: [0, 1, 2]
+                .map(|axis| AxisScale::new(10, zero_offsets[axis], gravity[axis], 10, 1.0)),
+            fixed_point_scales: [0, 1, 2]
+                .map(|axis| FixedPointScale::new(10, zero_offsets[axis], gravity[axis], 10, 1.0)),
+        }
+    }
+
     /// Returns the acceleration values from the raw data using the current calibration.
     #[must_use]
     pub fn get_acceleration(&self, data: &AccelerometerData) -> (f64, f64, f64) {
@@ -30,6 +66,28 @@ impl AccelerometerCalibration {
         let z = normalize(data.z, 10, self.z_zero_offset, self.z_gravity, 10);
         (x, y, z)
     }
+
+    /// Returns the acceleration values in fixed-point with [`FIXED_POINT_BITS`](crate::prelude::FIXED_POINT_BITS)
+    /// fractional bits, same as `get_acceleration` but with a single integer multiplication per axis.
+    #[must_use]
+    pub fn get_acceleration_fixed_point(&self, data: &AccelerometerData) -> (i32, i32, i32) {
+        let [x, y, z] = &self.fixed_point_scales;
+        (x.apply(data.x), y.apply(data.y), z.apply(data.z))
+    }
+
+    /// Returns the precomputed conversion of the x, y and z axes, same as `get_acceleration`.
+    #[must_use]
+    pub const fn axis_scales(&self) -> [AxisScale; 3] {
+        self.scales
+    }
+
+    /// Converts many raw samples stored as separate x, y and z arrays into acceleration values,
+    /// up to the length of the shortest slice of every axis.
+    pub fn get_acceleration_batch(&self, raw: [&[u16]; 3], output: [&mut [f32]; 3]) {
+        for ((scale, raw), output) in self.scales.iter().zip(raw).zip(output) {
+            scale.apply_batch(raw, output);
+        }
+    }
 }
 
 /// The raw accelerometer data from the Wii remote.
@@ -40,6 +98,24 @@ pub struct AccelerometerData {
 }
 
 impl AccelerometerData {
+    /// Returns the raw 10 bit value of the x axis.
+    #[must_use]
+    pub const fn x(&self) -> u16 {
+        self.x
+    }
+
+    /// Returns the raw 10 bit value of the y axis.
+    #[must_use]
+    pub const fn y(&self) -> u16 {
+        self.y
+    }
+
+    /// Returns the raw 10 bit value of the z axis.
+    #[must_use]
+    pub const fn z(&self) -> u16 {
+        self.z
+    }
+
     /// The first two bytes are button data, the next three bytes are acceleration data.
     #[must_use]
     pub const fn from_normal_reporting(data: &[u8]) -> Self {
@@ -65,34 +141,513 @@ impl AccelerometerData {
     }
 }
 
+/// Location of the accelerometer calibration in the EEPROM.
+const CALIBRATION_ADDRESSING: Addressing = Addressing::eeprom(0x0016, 10);
+
+/// Maximum number of reports kept for the next read while a memory transaction reads from the Wii remote.
+const DEFERRED_CAPACITY: usize = 64;
+/// Maximum number of reports read at once while a memory transaction reads from the Wii remote.
+const PUMP_BATCH_SIZE: usize = 16;
+
+fn lock_ignore_poison<T>(mutex: &Mutex<T>) -> MutexGuard<'_, T> {
+    match mutex.lock() {
+        Ok(guard) => guard,
+        Err(err) => err.into_inner(),
+    }
+}
+
+/// The native device of a Wii remote shared between the `WiimoteDevice` and its background I/O.
+/// The native device is replaced on reconnect and removed when the Wii remote disconnects.
+///
+/// Every read passes the received reports through the memory transaction engine,
+/// replies to pending memory transactions are removed before the reports are returned.
+pub(crate) struct Connection {
+    device: Mutex<Option<NativeWiimoteDevice>>,
+    /// Waiter of the native device, reads wait for input with `device` unlocked if set.
+    /// Replaced with `device` and locked after it.
+    input_waiter: Mutex<Option<Arc<dyn InputWaiter>>>,
+    /// Whether `device` is set, read without waiting for a thread that is reading the device.
+    connected: AtomicBool,
+    /// Number of times the native device was replaced.
+    generation: AtomicUsize,
+    /// Reactor of the `BackgroundIo` thread, woken when the native device changes or a memory request is sent.
+    io_reactor: Mutex<Option<Arc<NativeWiimoteReactor>>>,
+    rumble_enabled: AtomicBool,
+    /// Pending memory transactions, always locked after `device`.
+    transactions: Mutex<TransactionEngine>,
+    /// Reports read while waiting for a memory transaction, returned by the next read.
+    deferred: Mutex<VecDeque<RawReport>>,
+    /// Recorder of the returned reports and the device number in the capture.
+    capture: Mutex<Option<(Arc<CaptureRecorder>, u32)>>,
+    metrics: DeviceMetrics,
+    /// Registration with the driver of asynchronous reads and writes, always locked after `device`.
+    #[cfg(feature = "async")]
+    readiness: Mutex<Readiness>,
+}
+
+impl Connection {
+    fn new(device: NativeWiimoteDevice) -> Self {
+        Self {
+            input_waiter: Mutex::new(device.input_waiter()),
+            device: Mutex::new(Some(device)),
+            connected: AtomicBool::new(true),
+            generation: AtomicUsize::new(0),
+            io_reactor: Mutex::new(None),
+            rumble_enabled: AtomicBool::new(false),
+            transactions: Mutex::new(TransactionEngine::default()),
+            deferred: Mutex::new(VecDeque::new()),
+            capture: Mutex::new(None),
+            metrics: DeviceMetrics::default(),
+            #[cfg(feature = "async")]
+            readiness: Mutex::new(Readiness::default()),
+        }
+    }
+
+    fn lock(&self) -> MutexGuard<'_, Option<NativeWiimoteDevice>> {
+        let timer = Timer::start();
+        let device = lock_ignore_poison(&self.device);
+        self.metrics.lock_wait.record(timer);
+        device
+    }
+
+    pub(crate) const fn metrics(&self) -> &DeviceMetrics {
+        &self.metrics
+    }
+
+    pub(crate) fn is_connected(&self) -> bool {
+        self.connected.load(Ordering::Acquire)
+    }
+
+    /// Returns the number of times the native device was replaced by a reconnect.
+    pub(crate) fn generation(&self) -> usize {
+        self.generation.load(Ordering::Acquire)
+    }
+
+    pub(crate) fn set_io_reactor(&self, reactor: Option<Arc<NativeWiimoteReactor>>) {
+        *lock_ignore_poison(&self.io_reactor) = reactor;
+    }
+
+    fn wake_io(&self) {
+        if let Some(reactor) = lock_ignore_poison(&self.io_reactor).as_ref() {
+            _ = reactor.wake();
+        }
+    }
+
+    /// Returns when the first sent memory request without reply expires.
+    pub(crate) fn next_transaction_deadline(&self) -> Option<Instant> {
+        lock_ignore_poison(&self.transactions).next_deadline()
+    }
+
+    pub(crate) fn write(&self, output_report: &OutputReport) -> WiimoteResult<()> {
+        let timer = Timer::start();
+        let mut device = self.lock();
+        if let Some(native) = device.as_mut() {
+            if self.write_native(native, output_report) {
+                drop(device);
+                self.metrics.write.record(timer);
+                return Ok(());
+            }
+        }
+        self.disconnected(device);
+        Err(WiimoteError::Disconnected)
+    }
+
+    /// Sets the rumble state sent with the next output report.
+    pub(crate) fn set_rumble(&self, rumble: bool) {
+        self.rumble_enabled.store(rumble, Ordering::Relaxed);
+    }
+
+    fn write_native(&self, native: &mut NativeWiimoteDevice, output_report: &OutputReport) -> bool {
+        self.write_native_with(native, output_report, NativeWiimote::write)
+            .is_some()
+    }
+
+    /// Writes the output report with the current rumble state using `write`,
+    /// returns the size written or 0 if a nonblocking write would block.
+    fn write_native_with(
+        &self,
+        native: &mut NativeWiimoteDevice,
+        output_report: &OutputReport,
+        write: impl FnOnce(&mut NativeWiimoteDevice, &[u8]) -> Option<usize>,
+    ) -> Option<usize> {
+        let rumble = if let OutputReport::Rumble(new_rumble) = output_report {
+            // Rumble is sent in every output report, so the new value needs to be stored.
+            self.rumble_enabled.store(*new_rumble, Ordering::Relaxed);
+            *new_rumble
+        } else {
+            self.rumble_enabled.load(Ordering::Relaxed)
+        };
+        let mut buffer = [0u8; WIIMOTE_DEFAULT_REPORT_BUFFER_SIZE];
+        let size = output_report.fill_buffer(rumble, &mut buffer);
+        let written = write(native, &buffer[..size]);
+        match written {
+            Some(0) => {}
+            Some(_) => self.metrics.reports_written.increment(),
+            None => self.metrics.write_errors.increment(),
+        }
+        written
+    }
+
+    /// Writes the output report unless the write would block, returns whether it was written.
+    #[cfg(feature = "async")]
+    pub(crate) fn write_nonblocking(&self, output_report: &OutputReport) -> WiimoteResult<bool> {
+        let timer = Timer::start();
+        let mut device = self.lock();
+        if let Some(native) = device.as_mut() {
+            match self.write_native_with(native, output_report, NativeWiimote::write_nonblocking) {
+                Some(0) => return Ok(false),
+                Some(_) => {
+                    drop(device);
+                    self.metrics.write.record(timer);
+                    return Ok(true);
+                }
+                None => {}
+            }
+        }
+        self.disconnected(device);
+        Err(WiimoteError::Disconnected)
+    }
+
+    /// Wakes the task of `waker` once the Wii remote has input, a write would no longer block
+    /// if `writable` or `deadline` passed.
+    #[cfg(feature = "async")]
+    pub(crate) fn arm(
+        &self,
+        waker: &std::task::Waker,
+        writable: bool,
+        deadline: Option<Instant>,
+    ) -> WiimoteResult<()> {
+        let device = self.lock();
+        let Some(native) = device.as_ref() else {
+            return Err(WiimoteError::Disconnected);
+        };
+        lock_ignore_poison(&self.readiness).arm(native, waker, writable, deadline)
+    }
+
+    /// Sends the memory request to the Wii remote without waiting for the reply.
+    pub(crate) fn submit(self: &Arc<Self>, request: TransactionRequest) -> MemoryTransaction {
+        let (transaction, state) = MemoryTransaction::new(Arc::clone(self));
+        let mut device = self.lock();
+        let mut engine = lock_ignore_poison(&self.transactions);
+        engine.submit(request, state);
+        let sent = match device.as_mut() {
+            Some(native) => {
+                engine.send_pending(Instant::now(), |report| self.write_native(native, report))
+            }
+            None => false,
+        };
+        drop(engine);
+        if sent {
+            self.complete_transactions(device);
+            // The reply is picked up by the background thread, which waits until the request expires
+            self.wake_io();
+        } else {
+            self.disconnected(device);
+        }
+        transaction
+    }
+
+    /// Reads a single report into `report`, waits forever if `timeout_millis` is `None`.
+    /// Returns the size of the report or 0 if no report was received before the timeout.
+    pub(crate) fn read_timeout(
+        &self,
+        report: &mut RawReport,
+        timeout_millis: Option<usize>,
+    ) -> WiimoteResult<usize> {
+        let timer = Timer::start();
+        let result = self.read_single(report, timeout_millis);
+        self.metrics.read.record(timer);
+        result
+    }
+
+    fn read_single(
+        &self,
+        report: &mut RawReport,
+        timeout_millis: Option<usize>,
+    ) -> WiimoteResult<usize> {
+        let deferred = lock_ignore_poison(&self.deferred).pop_front();
+        if let Some(deferred) = deferred {
+            *report = deferred;
+            self.record(std::slice::from_ref(report));
+            return Ok(report.length as usize);
+        }
+
+        let deadline = deadline_after(timeout_millis);
+        let (device, bytes_read) = self.read_native(deadline, |native, timeout_millis| {
+            let bytes_read = native.read_report(report, timeout_millis)?;
+            // A reply to a memory transaction is not returned, the read continues
+            let routed =
+                bytes_read > 0 && self.route_reports(native, std::slice::from_mut(report)) == 0;
+            Some(if routed { 0 } else { bytes_read })
+        });
+        let Some(bytes_read) = bytes_read else {
+            self.disconnected(device);
+            return Err(WiimoteError::Disconnected);
+        };
+        self.complete_transactions(device);
+        if bytes_read > 0 {
+            self.record(std::slice::from_ref(report));
+        }
+        Ok(bytes_read)
+    }
+
+    /// Waits up to `timeout_millis` for the first report, then reads all queued reports without waiting.
+    /// Returns the number of reports read into `reports`.
+    pub(crate) fn read_batch_timeout(
+        &self,
+        reports: &mut [RawReport],
+        timeout_millis: usize,
+    ) -> WiimoteResult<usize> {
+        let timer = Timer::start();
+        let result = self.read_batch(reports, timeout_millis);
+        self.metrics.read.record(timer);
+        result
+    }
+
+    fn read_batch(&self, reports: &mut [RawReport], timeout_millis: usize) -> WiimoteResult<usize> {
+        let mut reports_read = self.take_deferred(reports);
+        if reports_read == reports.len() {
+            self.record(reports);
+            return Ok(reports_read);
+        }
+
+        let timeout_millis = if reports_read > 0 { 0 } else { timeout_millis };
+        let deadline = deadline_after(Some(timeout_millis));
+        let (device, kept) = self.read_native(deadline, |native, timeout_millis| {
+            let reports = &mut reports[reports_read..];
+            let received = Self::read_native_batch(native, reports, timeout_millis.unwrap_or(0))?;
+            // Only replies to memory transactions were received if none are kept, the read continues
+            Some(self.route_reports(native, &mut reports[..received]))
+        });
+        let Some(kept) = kept else {
+            self.disconnected(device);
+            return Err(WiimoteError::Disconnected);
+        };
+        reports_read += kept;
+        self.complete_transactions(device);
+        self.record(&reports[..reports_read]);
+        Ok(reports_read)
+    }
+
+    /// Reads reports for up to `timeout` to receive the replies to pending memory transactions.
+    /// Other reports are kept for the next read.
+    pub(crate) fn pump(&self, timeout: Duration) -> WiimoteResult<()> {
+        let mut reports = [RawReport::default(); PUMP_BATCH_SIZE];
+        let deadline = Instant::now() + timeout;
+        let (device, received) = self.read_native(Some(deadline), |native, timeout_millis| {
+            let received =
+                Self::read_native_batch(native, &mut reports, timeout_millis.unwrap_or(0))?;
+            let kept = self.route_reports(native, &mut reports[..received]);
+            let mut deferred = lock_ignore_poison(&self.deferred);
+            for report in &reports[..kept] {
+                if deferred.len() == DEFERRED_CAPACITY {
+                    _ = deferred.pop_front();
+                }
+                deferred.push_back(*report);
+            }
+            Some(received)
+        });
+        if received.is_none() {
+            self.disconnected(device);
+            return Err(WiimoteError::Disconnected);
+        }
+        self.complete_transactions(device);
+        Ok(())
+    }
+
+    /// Reads from the native device with `read` until it returns a count other than 0
+    /// or `deadline` passed, `read` is passed the timeout of the native read.
+    /// With an input waiter the native reads do not wait, the device is unlocked while waiting for input.
+    /// Returns the locked device with the count, `None` if the device is missing or failed.
+    fn read_native(
+        &self,
+        deadline: Option<Instant>,
+        mut read: impl FnMut(&mut NativeWiimoteDevice, Option<usize>) -> Option<usize>,
+    ) -> (MutexGuard<'_, Option<NativeWiimoteDevice>>, Option<usize>) {
+        loop {
+            let mut device = self.lock();
+            let input_waiter = lock_ignore_poison(&self.input_waiter).clone();
+            let Some(native) = device.as_mut() else {
+                return (device, None);
+            };
+            let remaining = remaining_millis(deadline);
+            let timeout_millis = if input_waiter.is_some() {
+                Some(0)
+            } else {
+                remaining
+            };
+            let count = read(native, timeout_millis);
+            if count != Some(0) || remaining == Some(0) {
+                return (device, count);
+            }
+            if let Some(input_waiter) = input_waiter {
+                self.complete_transactions(device);
+                input_waiter.wait(remaining_millis(deadline));
+            }
+        }
+    }
+
+    fn read_native_batch(
+        native: &mut NativeWiimoteDevice,
+        reports: &mut [RawReport],
+        timeout_millis: usize,
+    ) -> Option<usize> {
+        let (first, remaining) = reports.split_first_mut()?;
+        if timeout_millis == 0 {
+            native.read_batch(reports)
+        } else {
+            match native.read_report(first, Some(timeout_millis))? {
+                0 => Some(0),
+                _ => Some(1 + native.read_batch(remaining).unwrap_or(0)),
+            }
+        }
+    }
+
+    /// Records the reports returned by a read if a capture is running.
+    fn record(&self, reports: &[RawReport]) {
+        if reports.is_empty() {
+            return;
+        }
+        self.metrics.reports_read.add(reports.len());
+        if let Some((recorder, device)) = lock_ignore_poison(&self.capture).as_ref() {
+            recorder.record(*device, reports);
+        }
+    }
+
+    fn set_capture(&self, capture: Option<(Arc<CaptureRecorder>, u32)>) {
+        *lock_ignore_poison(&self.capture) = capture;
+    }
+
+    /// Moves the deferred reports into `reports`, returns the number of reports moved.
+    fn take_deferred(&self, reports: &mut [RawReport]) -> usize {
+        let mut deferred = lock_ignore_poison(&self.deferred);
+        let count = usize::min(deferred.len(), reports.len());
+        for (report, deferred) in reports.iter_mut().zip(deferred.drain(..count)) {
+            *report = deferred;
+        }
+        count
+    }
+
+    /// Passes the reports to the pending memory transactions and sends the requests waiting for them.
+    /// Returns the number of remaining reports, which are moved to the front of `reports`.
+    fn route_reports(&self, native: &mut NativeWiimoteDevice, reports: &mut [RawReport]) -> usize {
+        let mut engine = lock_ignore_poison(&self.transactions);
+        if engine.is_idle() {
+            return reports.len();
+        }
+
+        let mut kept = 0;
+        for index in 0..reports.len() {
+            if !engine.route(&reports[index]) {
+                reports[kept] = reports[index];
+                kept += 1;
+            }
+        }
+        let now = Instant::now();
+        engine.expire(now);
+        // A failed write is detected by the next write or read of the reports
+        _ = engine.send_pending(now, |report| self.write_native(native, report));
+        kept
+    }
+
+    /// Completes the finished memory transactions after releasing the device,
+    /// completion callbacks can use the Wii remote again.
+    fn complete_transactions(&self, device: MutexGuard<'_, Option<NativeWiimoteDevice>>) {
+        let finished = lock_ignore_poison(&self.transactions).take_finished();
+        drop(device);
+        for (state, result) in finished {
+            state.complete(result);
+        }
+    }
+
+    /// Removes the native device and fails the pending memory transactions.
+    fn disconnected(&self, mut device: MutexGuard<'_, Option<NativeWiimoteDevice>>) {
+        _ = device.take();
+        _ = lock_ignore_poison(&self.input_waiter).take();
+        self.connected.store(false, Ordering::Release);
+        lock_ignore_poison(&self.transactions).fail_all();
+        self.complete_transactions(device);
+        self.wake_io();
+    }
+
+    fn replace(&self, device: NativeWiimoteDevice) {
+        let mut current = self.lock();
+        // Requests sent to the previous connection are never answered
+        lock_ignore_poison(&self.transactions).fail_all();
+        *lock_ignore_poison(&self.input_waiter) = device.input_waiter();
+        _ = current.replace(device);
+        self.generation.fetch_add(1, Ordering::AcqRel);
+        self.connected.store(true, Ordering::Release);
+        lock_ignore_poison(&self.deferred).clear();
+        #[cfg(feature = "async")]
+        lock_ignore_poison(&self.readiness).reset();
+        self.complete_transactions(current);
+        // The new native device is registered with the reactor by the background thread
+        self.wake_io();
+    }
+
+    fn disconnect(&self) {
+        self.disconnected(self.lock());
+    }
+
+    pub(crate) fn with_native_device<R>(
+        &self,
+        f: impl FnOnce(&mut NativeWiimoteDevice) -> R,
+    ) -> Option<R> {
+        self.lock().as_mut().map(f)
+    }
+}
+
+fn deadline_after(timeout_millis: Option<usize>) -> Option<Instant> {
+    timeout_millis
+        .map(|timeout_millis| Instant::now() + Duration::from_millis(timeout_millis as u64))
+}
+
+/// Returns the milliseconds until `deadline`, rounded up to not return early.
+fn remaining_millis(deadline: Option<Instant>) -> Option<usize> {
+    deadline.map(|deadline| {
+        let remaining = deadline.saturating_duration_since(Instant::now());
+        usize::try_from(remaining.as_micros().div_ceil(1000)).unwrap_or(usize::MAX)
+    })
+}
+
 /// A `WiimoteDevice` can be used to communicate with a Wii remote.
 pub struct WiimoteDevice {
-    device: Mutex<Option<NativeWiimoteDevice>>,
-    identifier: String,
+    connection: Arc<Connection>,
+    /// Shared with the `WiimoteManager` as key of the seen devices.
+    identifier: Arc<str>,
     calibration_data: AccelerometerCalibration,
     motion_plus: Option<MotionPlus>,
     extension: Option<WiimoteExtension>,
-    rumble_enabled: AtomicBool,
+    /// Read on first use and kept until the Wii remote reconnects.
+    balance_board_calibration: OnceCell<BalanceBoardCalibration>,
+    connection_generation: usize,
+    cache: Option<Arc<CalibrationCache>>,
+    /// Set by the revalidation of cached data that no longer matches the Wii remote.
+    stale: Arc<AtomicBool>,
 }
 
-unsafe impl Sync for WiimoteDevice {}
-unsafe impl Send for WiimoteDevice {}
-
 impl WiimoteDevice {
     /// Wraps the `NativeWiimoteDevice` as a `WiimoteDevice`.
     ///
     /// # Errors
     ///
     /// This function will return an error if the device is not a recognized Wii remote or initialization failed.
-    pub(crate) fn new(device: NativeWiimoteDevice) -> WiimoteResult<Self> {
-        let identifier = device.identifier();
+    pub(crate) fn new(
+        device: NativeWiimoteDevice,
+        cache: Option<Arc<CalibrationCache>>,
+    ) -> WiimoteResult<Self> {
+        let identifier = Arc::from(device.identifier());
         let mut wiimote = Self {
-            device: Mutex::new(Some(device)),
+            connection: Arc::new(Connection::new(device)),
             identifier,
             calibration_data: AccelerometerCalibration::default(),
             motion_plus: None,
             extension: None,
-            rumble_enabled: AtomicBool::new(false),
+            balance_board_calibration: OnceCell::new(),
+            connection_generation: 0,
+            cache,
+            stale: Arc::new(AtomicBool::new(false)),
         };
 
         wiimote.initialize()?;
@@ -105,6 +660,10 @@ impl WiimoteDevice {
         &self.identifier
     }
 
+    pub(crate) fn shared_identifier(&self) -> Arc<str> {
+        Arc::clone(&self.identifier)
+    }
+
     /// Returns the accelerometer calibration data of the Wii remote.
     /// This data is used to convert raw accelerometer data to acceleration values.
     #[must_use]
@@ -124,14 +683,83 @@ impl WiimoteDevice {
         self.extension.as_ref()
     }
 
+    /// Returns the calibration of the connected Balance Board, `None` if the extension is not a Balance Board.
+    /// The calibration is read the first time this is called after connecting.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error on I/O error or if invalid data is received.
+    pub fn balance_board_calibration(&self) -> WiimoteResult<Option<&BalanceBoardCalibration>> {
+        if !matches!(self.extension, Some(WiimoteExtension::BalanceBoard)) {
+            return Ok(None);
+        }
+        self.balance_board_calibration
+            .get_or_try_init(|| BalanceBoardCalibration::read(self))
+            .map(Some)
+    }
+
+    /// Decodes the extension bytes of the data report with the connected extension
+    /// and the current mode of the Motion Plus, see `WiimoteExtension::decode`.
+    #[must_use]
+    pub fn decode_extension(&self, report: &DataReportRef<'_>) -> Option<ExtensionData> {
+        let bytes = report.extension_bytes()?;
+        let motion_plus_mode = self
+            .motion_plus
+            .as_ref()
+            .map_or(MotionPlusMode::Inactive, MotionPlus::mode);
+        // Without extension only Motion Plus data is decoded, same as for an unknown extension
+        const NO_EXTENSION: WiimoteExtension = WiimoteExtension::Unknown([0; 6]);
+        self.extension
+            .as_ref()
+            .unwrap_or(&NO_EXTENSION)
+            .decode(bytes, motion_plus_mode)
+    }
+
+    /// Returns the counters and latencies of the Wii remote since it was first connected.
+    #[cfg(feature = "metrics")]
+    #[must_use]
+    pub fn metrics(&self) -> DeviceMetricsSnapshot {
+        self.connection.metrics().snapshot()
+    }
+
+    /// Returns whether cached calibration or extension data applied on connect turned out to no longer match
+    /// the Wii remote. The `WiimoteManager` refreshes such Wii remotes on its next scan.
+    #[must_use]
+    pub fn needs_refresh(&self) -> bool {
+        self.stale.load(Ordering::Relaxed)
+    }
+
+    /// Reads the calibration and extension identity from the Wii remote again, see `needs_refresh`.
+    /// The Motion Plus needs to be initialized again afterwards.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the Wii remote failed to initialize.
+    pub fn refresh(&mut self) -> WiimoteResult<()> {
+        if let Some(cache) = &self.cache {
+            cache.remove(&self.identifier);
+        }
+        self.initialize()
+    }
+
+    pub(crate) const fn stale_flag(&self) -> &Arc<AtomicBool> {
+        &self.stale
+    }
+
     /// Returns whether the Wii remote is currently connected.
     /// The Wii remote is automatically re-assigned to this object when reconnected.
     #[must_use]
     pub fn is_connected(&self) -> bool {
-        self.device
-            .lock()
-            .map(|device| device.is_some())
-            .unwrap_or(false)
+        self.connection.is_connected()
+    }
+
+    /// Returns the address of the Bluetooth adapter the Wii remote is connected through,
+    /// `None` if it is disconnected or the platform does not report the adapter.
+    #[must_use]
+    pub fn adapter(&self) -> Option<String> {
+        self.connection
+            .with_native_device(|native| native.adapter())
+            .flatten()
     }
 
     /// Reconnects the Wii remote from a `NativeWiimoteDevice`.
@@ -140,37 +768,90 @@ impl WiimoteDevice {
     ///
     /// This function will return an error if the device is not a recognized Wii remote or the Wii remote failed to initialize.
     pub fn reconnect(&mut self, device: NativeWiimoteDevice) -> WiimoteResult<()> {
-        self.disconnected();
-        _ = self.device.lock().map(|mut d| d.replace(device));
+        self.connection.replace(device);
+        self.connection_generation = self.connection_generation.wrapping_add(1);
         self.initialize()
     }
 
+    pub(crate) const fn connection(&self) -> &Arc<Connection> {
+        &self.connection
+    }
+
+    /// Counts the reconnects of the Wii remote, changes whenever the native device is replaced.
+    pub(crate) const fn connection_generation(&self) -> usize {
+        self.connection_generation
+    }
+
+    /// Sets the cache used for the calibration and extension identity on the next reconnect.
+    pub(crate) fn set_calibration_cache(&mut self, cache: Option<Arc<CalibrationCache>>) {
+        self.cache = cache;
+    }
+
+    pub(crate) const fn calibration_cache(&self) -> Option<&Arc<CalibrationCache>> {
+        self.cache.as_ref()
+    }
+
+    /// Runs `f` with the connected native device, returns `None` if the Wii remote is disconnected.
+    pub(crate) fn with_native_device<R>(
+        &self,
+        f: impl FnOnce(&mut NativeWiimoteDevice) -> R,
+    ) -> Option<R> {
+        self.connection.with_native_device(f)
+    }
+
+    /// Records the reports returned by reads of the Wii remote, including the background I/O and reactor,
+    /// until `stop_capture` is called. Replies to memory transactions are not recorded.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the Wii remote could not be added to the capture.
+    pub fn start_capture(&self, recorder: &Arc<CaptureRecorder>) -> std::io::Result<()> {
+        let device = recorder.add_device(&self.identifier)?;
+        self.connection
+            .set_capture(Some((Arc::clone(recorder), device)));
+        Ok(())
+    }
+
+    /// Stops recording the reports of the Wii remote.
+    pub fn stop_capture(&self) {
+        self.connection.set_capture(None);
+    }
+
+    /// Starts a background thread that receives the reports of the Wii remote into a lock-free queue
+    /// holding up to `capacity` reports and sends queued output reports.
+    ///
+    /// While the background I/O is running, reports should only be received through it.
+    /// On Windows the background thread polls instead of waiting for input if the Wii remote
+    /// is registered with a `WiimoteReactor` or used asynchronously.
+    #[must_use]
+    pub fn start_background_io(&self, capacity: usize) -> BackgroundIo {
+        BackgroundIo::start(Arc::clone(&self.connection), capacity)
+    }
+
     /// Writes the data to the connected Wii remote.
     ///
     /// # Errors
     ///
     /// This function will return an error if the Wii remote is disconnected or write failed.
     pub fn write(&self, output_report: &OutputReport) -> WiimoteResult<()> {
-        let mut device = match self.device.lock() {
-            Ok(device) => device,
-            Err(err) => err.into_inner(),
-        };
-        if let Some(device) = device.as_mut() {
-            let rumble = if let OutputReport::Rumble(new_rumble) = output_report {
-                // Rumble is sent in every output report, so the new value needs to be stored.
-                self.rumble_enabled.store(*new_rumble, Ordering::Relaxed);
-                *new_rumble
-            } else {
-                self.rumble_enabled.load(Ordering::Relaxed)
-            };
-            let mut buffer = [0u8; WIIMOTE_DEFAULT_REPORT_BUFFER_SIZE];
-            let size = output_report.fill_buffer(rumble, &mut buffer);
-            if device.write(&buffer[..size]).is_some() {
-                return Ok(());
-            }
-        }
-        _ = device.take();
-        Err(WiimoteError::Disconnected)
+        self.connection.write(output_report)
+    }
+
+    /// Writes the output report without blocking the thread, the task is woken once the Wii remote accepts the report.
+    #[cfg(feature = "async")]
+    pub fn write_async(&self, output_report: OutputReport) -> OutputWrite {
+        OutputWrite::new(Arc::clone(&self.connection), output_report)
+    }
+
+    /// Returns the input reports of the Wii remote as `Stream`, the task is woken when the Wii remote has input.
+    ///
+    /// Like polling a `MemoryTransaction`, the stream is driven by one thread for all Wii remotes that waits for
+    /// the native devices. A Wii remote should not be used asynchronously while it is registered with a `WiimoteReactor`,
+    /// on Windows asynchronous I/O fails while the Wii remote is registered with a reactor or its background I/O runs.
+    #[cfg(feature = "async")]
+    #[must_use]
+    pub fn reports(&self) -> ReportStream {
+        ReportStream::new(Arc::clone(&self.connection))
     }
 
     /// Reads data from the connected Wii remote.
@@ -179,18 +860,9 @@ impl WiimoteDevice {
     ///
     /// This function will return an error if the Wii remote is disconnected or read failed.
     pub fn read(&self) -> WiimoteResult<InputReport> {
-        let mut device = match self.device.lock() {
-            Ok(device) => device,
-            Err(err) => err.into_inner(),
-        };
-        if let Some(device) = device.as_mut() {
-            let mut buffer = [0u8; WIIMOTE_DEFAULT_REPORT_BUFFER_SIZE];
-            if let Some(bytes_read) = device.read(&mut buffer) {
-                return InputReport::try_from(&buffer[..bytes_read]);
-            }
-        }
-        _ = device.take();
-        Err(WiimoteError::Disconnected)
+        let mut report = RawReport::default();
+        self.connection.read_timeout(&mut report, None)?;
+        report.decode()
     }
 
     /// Reads data from the connected Wii remote waiting for a maximum of `timeout_millis`.
@@ -199,36 +871,194 @@ impl WiimoteDevice {
     ///
     /// This function will return an error if the Wii remote is disconnected or read failed.
     pub fn read_timeout(&self, timeout_millis: usize) -> WiimoteResult<InputReport> {
-        let mut device = match self.device.lock() {
-            Ok(device) => device,
-            Err(err) => err.into_inner(),
-        };
-        if let Some(device) = device.as_mut() {
-            let mut buffer = [0u8; WIIMOTE_DEFAULT_REPORT_BUFFER_SIZE];
-            if let Some(bytes_read) = device.read_timeout(&mut buffer, timeout_millis) {
-                return InputReport::try_from(&buffer[..bytes_read]);
-            }
-        }
-        _ = device.take();
-        Err(WiimoteError::Disconnected)
+        let mut report = RawReport::default();
+        self.connection
+            .read_timeout(&mut report, Some(timeout_millis))?;
+        report.decode()
+    }
+
+    /// Reads `addressing.size` bytes from the memory or registers of the Wii remote without waiting for the reply.
+    /// The Wii remote replies to reads of more than 16 bytes with multiple reports that are assembled by the transaction.
+    ///
+    /// The reply is received while reading from the Wii remote, other reports are not affected.
+    pub fn read_memory(&self, addressing: Addressing) -> MemoryTransaction {
+        self.connection.submit(TransactionRequest::Read(addressing))
+    }
+
+    /// Writes the first `addressing.size` bytes of `data` to the memory or registers of the Wii remote
+    /// without waiting for the acknowledge. Writes of more than 16 bytes are sent in chunks without waiting in between.
+    ///
+    /// The acknowledges are received while reading from the Wii remote, other reports are not affected.
+    pub fn write_memory(&self, addressing: Addressing, data: &[u8]) -> MemoryTransaction {
+        let size = usize::min(addressing.size as usize, data.len());
+        self.connection
+            .submit(TransactionRequest::Write(addressing, data[..size].to_vec()))
+    }
+
+    /// Reads a single report into `report` without decoding it, waits forever if `timeout_millis` is `None`.
+    /// Returns the size of the report or 0 if no report was received before the timeout.
+    ///
+    /// Use `RawReport::view` to access the report without copying it.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the Wii remote is disconnected or read failed.
+    pub fn read_report(
+        &self,
+        report: &mut RawReport,
+        timeout_millis: Option<usize>,
+    ) -> WiimoteResult<usize> {
+        self.connection.read_timeout(report, timeout_millis)
+    }
+
+    /// Reads all reports queued by the Wii remote without waiting for new reports.
+    /// Returns the number of reports read into `reports`, a single call can handle bursts of many reports.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the Wii remote is disconnected or read failed.
+    pub fn read_batch(&self, reports: &mut [RawReport]) -> WiimoteResult<usize> {
+        self.connection.read_batch_timeout(reports, 0)
+    }
+
+    /// Waits up to `timeout_millis` for a report, then reads all queued reports without waiting.
+    /// Returns the number of reports read into `reports` or 0 if no report was received before the timeout.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the Wii remote is disconnected or read failed.
+    pub fn read_batch_timeout(
+        &self,
+        reports: &mut [RawReport],
+        timeout_millis: usize,
+    ) -> WiimoteResult<usize> {
+        self.connection.read_batch_timeout(reports, timeout_millis)
     }
 
     fn initialize(&mut self) -> WiimoteResult<()> {
+        let timer = Timer::start();
+        let result = self.read_initial_state();
+        self.connection.metrics().initialize.record(timer);
+        result
+    }
+
+    /// Reads the calibration and extension identity, from the cache if available.
+    fn read_initial_state(&mut self) -> WiimoteResult<()> {
+        self.stale.store(false, Ordering::Relaxed);
         self.motion_plus = None;
         self.extension = None;
+        self.balance_board_calibration = OnceCell::new();
+
+        if let Some(cache) = self.cache.clone() {
+            if let Some(cached) = cache.get(&self.identifier) {
+                if self.initialize_from_cache(&cache, &cached).is_ok() {
+                    return Ok(());
+                }
+                cache.remove(&self.identifier);
+            }
+        }
+
+        // The extension only reports its identifier once both initialization writes were applied in order
+        let has_extension = WiimoteExtension::initialize(self)?;
+        // The reads are independent of each other, retrying one out of order does not matter
+        let requests = [
+            MemoryRequest::Read(CALIBRATION_ADDRESSING),
+            MemoryRequest::Read(MotionPlus::IDENTIFY_ADDRESSING),
+            MemoryRequest::Read(WiimoteExtension::IDENTIFY_ADDRESSING),
+        ];
+        let request_count = if has_extension { 3 } else { 2 };
+        let mut results = simple_io::transfer(self, &requests[..request_count]).into_iter();
+        let mut next_result = || results.next().unwrap_or(Err(WiimoteError::Timeout));
 
-        self.calibration_data = self.read_calibration_data()?;
-        self.motion_plus = MotionPlus::detect(self)?;
-        self.extension = WiimoteExtension::detect(self)?;
+        let calibration = next_result()?;
+        self.calibration_data = Self::parse_calibration_data(&calibration)?;
+        let motion_plus = MotionPlus::identifier_from_result(next_result())?;
+        self.motion_plus = motion_plus.as_ref().and_then(MotionPlus::from_identifier);
+        let extension = if has_extension {
+            WiimoteExtension::identifier_from_read(next_result())?
+        } else {
+            None
+        };
+        self.extension = extension.map(WiimoteExtension::from_identifier);
+
+        if let Some(cache) = &self.cache {
+            let mut accelerometer_calibration = [0u8; 10];
+            accelerometer_calibration.copy_from_slice(&calibration[..10]);
+            cache.insert(
+                &self.identifier,
+                CachedDevice {
+                    accelerometer_calibration,
+                    motion_plus,
+                    motion_plus_calibration: None,
+                    extension,
+                    balance_board_calibration: None,
+                },
+            );
+        }
+        Ok(())
+    }
+
+    /// Applies the cached calibration and extension identity without waiting for the Wii remote.
+    /// The cached data is read again in the background, if it changed it is removed from the cache
+    /// and the device is marked to be refreshed.
+    fn initialize_from_cache(
+        &mut self,
+        cache: &Arc<CalibrationCache>,
+        cached: &CachedDevice,
+    ) -> WiimoteResult<()> {
+        self.calibration_data = Self::parse_calibration_data(&cached.accelerometer_calibration)?;
+        self.motion_plus = cached
+            .motion_plus
+            .as_ref()
+            .and_then(MotionPlus::from_identifier);
+        self.extension = cached.extension.map(WiimoteExtension::from_identifier);
+
+        let accelerometer_calibration = cached.accelerometer_calibration;
+        cache.revalidate(
+            self,
+            self.read_memory(CALIBRATION_ADDRESSING),
+            move |result| result.ok().map(|data| data == accelerometer_calibration),
+        );
+
+        let motion_plus_type = cached
+            .motion_plus
+            .as_ref()
+            .and_then(MotionPlus::type_from_identifier);
+        cache.revalidate(
+            self,
+            self.read_memory(MotionPlus::IDENTIFY_ADDRESSING),
+            move |result| {
+                let identifier = MotionPlus::identifier_from_result(result).ok()?;
+                Some(
+                    identifier
+                        .as_ref()
+                        .and_then(MotionPlus::type_from_identifier)
+                        == motion_plus_type,
+                )
+            },
+        );
+
+        // The extension loses its initialization when the Wii remote is turned off, the writes are not awaited.
+        for request in &WiimoteExtension::INITIALIZE_REQUESTS {
+            _ = simple_io::send(self, request);
+        }
+        let extension = cached.extension;
+        cache.revalidate(
+            self,
+            self.read_memory(WiimoteExtension::IDENTIFY_ADDRESSING),
+            move |result| Some(WiimoteExtension::identifier_from_read(result).ok()? == extension),
+        );
         Ok(())
     }
 
-    fn read_calibration_data(&mut self) -> WiimoteResult<AccelerometerCalibration> {
+    fn parse_calibration_data(data: &[u8]) -> WiimoteResult<AccelerometerCalibration> {
         // https://www.wiibrew.org/wiki/Wiimote#EEPROM_Memory
         // The four bytes starting at 0x0016 and 0x0020 store the calibrated zero offsets for the accelerometer
         // (high 8 bits of X,Y,Z in the first three bytes, low 2 bits packed in the fourth byte as --XXYYZZ).
         // The four bytes at 0x001A and 0x24 store the force of gravity on those axes.
-        let data = simple_io::read_16_bytes_sync_checked(self, Addressing::eeprom(0x0016, 10))?;
+        if data.len() < 10 {
+            return Err(WiimoteDeviceError::MissingData.into());
+        }
 
         let mut checksum = 0x55u8;
         for byte in &data[..9] {
@@ -238,18 +1068,22 @@ impl WiimoteDevice {
             return Err(WiimoteDeviceError::InvalidChecksum.into());
         }
 
-        Ok(AccelerometerCalibration {
-            x_zero_offset: ((data[0] as u16) << 2) | ((data[3] as u16) >> 4 & 0b11),
-            y_zero_offset: ((data[1] as u16) << 2) | ((data[3] as u16) >> 2 & 0b11),
-            z_zero_offset: ((data[2] as u16) << 2) | ((data[3] as u16) & 0b11),
-            x_gravity: ((data[4] as u16) << 2) | ((data[7] as u16) >> 4 & 0b11),
-            y_gravity: ((data[5] as u16) << 2) | ((data[7] as u16) >> 2 & 0b11),
-            z_gravity: ((data[6] as u16) << 2) | ((data[7] as u16) & 0b11),
-        })
+        Ok(AccelerometerCalibration::new(
+            [
+                ((data[0] as u16) << 2) | ((data[3] as u16) >> 4 & 0b11),
+                ((data[1] as u16) << 2) | ((data[3] as u16) >> 2 & 0b11),
+                ((data[2] as u16) << 2) | ((data[3] as u16) & 0b11),
+            ],
+            [
+                ((data[4] as u16) << 2) | ((data[7] as u16) >> 4 & 0b11),
+                ((data[5] as u16) << 2) | ((data[7] as u16) >> 2 & 0b11),
+                ((data[6] as u16) << 2) | ((data[7] as u16) & 0b11),
+            ],
+        ))
     }
 
     fn disconnected(&self) {
-        _ = self.device.lock().map(|mut device| device.take());
+        self.connection.disconnect();
     }
 }
 
@@ -258,3 +1092,27 @@ impl Drop for WiimoteDevice {
         self.disconnected();
     }
 }
+
+#[cfg(all(test, feature = "mock"))]
+mod tests {
+    use super::*;
+    use crate::mock::MockWiimote;
+
+    #[test]
+    fn test_write_while_read_waits() {
+        let mock = MockWiimote::connect("device-write-while-read");
+        let device = WiimoteDevice::new(NativeWiimoteDevice::take(&mock), None).unwrap();
+
+        std::thread::scope(|scope| {
+            let reader = scope.spawn(|| device.read_timeout(5000));
+            std::thread::sleep(Duration::from_millis(50));
+            // The waiting read does not hold the device, the status request is answered right away
+            let start = Instant::now();
+            device.write(&OutputReport::StatusRequest).unwrap();
+            assert!(start.elapsed() < Duration::from_secs(1));
+            let status = reader.join().unwrap();
+            assert!(matches!(status, Ok(InputReport::StatusInformation(_))));
+            assert!(start.elapsed() < Duration::from_secs(1));
+        });
+    }
+}
@@ -0,0 +1,378 @@
+use std::future::Future;
+use std::io;
+use std::pin::Pin;
+use std::sync::{Arc, Mutex, MutexGuard};
+use std::task::{Context, Poll, Waker};
+use std::time::{Duration, Instant};
+
+use futures_core::Stream;
+use once_cell::sync::Lazy;
+
+use crate::device::Connection;
+use crate::input::{InputReport, RawReport};
+use crate::native::{NativeReactor, NativeWiimoteDevice, NativeWiimoteReactor};
+use crate::output::OutputReport;
+use crate::prelude::*;
+
+/// Longest time the driver waits for the native devices before it checks the deadlines of the waiting tasks.
+const DEADLINE_INTERVAL: Duration = Duration::from_millis(100);
+
+/// The driver of all asynchronous Wii remotes, started on first use.
+static DRIVER: Lazy<io::Result<&'static IoDriver>> = Lazy::new(IoDriver::start);
+
+#[derive(Default)]
+struct Waiters {
+    in_use: bool,
+    wakers: Vec<Waker>,
+    /// Whether a waiting task writes to the Wii remote.
+    writable: bool,
+    deadline: Option<Instant>,
+}
+
+/// Wakes the tasks waiting for Wii remotes once their native devices are ready, on a single thread
+/// for all Wii remotes. The devices are registered like with the `WiimoteReactor`, but only report
+/// readiness once until a task drained the device and armed it again.
+struct IoDriver {
+    native: NativeWiimoteReactor,
+    /// The waiting tasks by the token of their Wii remote.
+    waiters: Mutex<Vec<Waiters>>,
+}
+
+impl IoDriver {
+    fn start() -> io::Result<&'static Self> {
+        let driver: &'static Self = Box::leak(Box::new(Self {
+            native: NativeWiimoteReactor::new()?,
+            waiters: Mutex::new(Vec::new()),
+        }));
+        std::thread::Builder::new()
+            .name("wii-remote-driver".to_string())
+            .spawn(move || driver.run())?;
+        Ok(driver)
+    }
+
+    fn get() -> WiimoteResult<&'static Self> {
+        match &*DRIVER {
+            Ok(driver) => Ok(driver),
+            Err(error) => Err(io::Error::new(error.kind(), error.to_string()).into()),
+        }
+    }
+
+    fn lock(&self) -> MutexGuard<'_, Vec<Waiters>> {
+        match self.waiters.lock() {
+            Ok(waiters) => waiters,
+            Err(err) => err.into_inner(),
+        }
+    }
+
+    /// Stores the waker of the task and arms the native device of the Wii remote.
+    fn arm(
+        &self,
+        readiness: &mut Readiness,
+        native: &NativeWiimoteDevice,
+        waker: &Waker,
+        writable: bool,
+        deadline: Option<Instant>,
+    ) -> io::Result<()> {
+        let mut waiters = self.lock();
+        let token = *readiness.token.get_or_insert_with(|| {
+            let token = waiters
+                .iter()
+                .position(|waiters| !waiters.in_use)
+                .unwrap_or(waiters.len());
+            if token == waiters.len() {
+                waiters.push(Waiters::default());
+            }
+            waiters[token].in_use = true;
+            token
+        });
+
+        let slot = &mut waiters[token];
+        if !slot.wakers.iter().any(|stored| stored.will_wake(waker)) {
+            slot.wakers.push(waker.clone());
+        }
+        slot.writable |= writable;
+        slot.deadline = match (slot.deadline, deadline) {
+            (Some(current), Some(deadline)) => Some(current.min(deadline)),
+            (current, deadline) => current.or(deadline),
+        };
+
+        // Armed while locked, a readiness reported in the meantime wakes the stored waker
+        let writable = slot.writable;
+        if readiness.registered {
+            self.native.rearm(native, token, writable)
+        } else {
+            self.native.register_oneshot(native, token, writable)?;
+            readiness.registered = true;
+            Ok(())
+        }
+    }
+
+    fn release(&self, token: usize) {
+        if let Some(waiters) = self.lock().get_mut(token) {
+            *waiters = Waiters::default();
+        }
+    }
+
+    fn run(&self) {
+        let mut ready = Vec::new();
+        let mut wakers = Vec::new();
+        loop {
+            ready.clear();
+            let timeout = self.next_timeout();
+            let timeout_millis =
+                usize::try_from(timeout.as_micros().div_ceil(1000)).unwrap_or(usize::MAX);
+            if let Err(error) = self.native.wait(&mut ready, Some(timeout_millis)) {
+                eprintln!("Failed to wait for wiimotes: {error}");
+                std::thread::sleep(DEADLINE_INTERVAL);
+            }
+
+            let now = Instant::now();
+            let mut waiters = self.lock();
+            for &token in &ready {
+                if let Some(waiters) = waiters.get_mut(token) {
+                    wakers.append(&mut waiters.wakers);
+                    waiters.writable = false;
+                    waiters.deadline = None;
+                }
+            }
+            for waiters in waiters.iter_mut() {
+                if waiters.deadline.is_some_and(|deadline| deadline <= now) {
+                    wakers.append(&mut waiters.wakers);
+                    waiters.deadline = None;
+                }
+            }
+            drop(waiters);
+
+            for waker in wakers.drain(..) {
+                waker.wake();
+            }
+        }
+    }
+
+    /// Returns the time until the next deadline, at most `DEADLINE_INTERVAL` to pick up deadlines added while waiting.
+    fn next_timeout(&self) -> Duration {
+        let now = Instant::now();
+        self.lock()
+            .iter()
+            .filter_map(|waiters| waiters.deadline)
+            .map(|deadline| deadline.saturating_duration_since(now))
+            .fold(DEADLINE_INTERVAL, Duration::min)
+    }
+}
+
+/// The registration of a connection with the driver, kept for all native devices of the connection.
+#[derive(Default)]
+pub(crate) struct Readiness {
+    token: Option<usize>,
+    /// Whether the current native device is registered, reset when the native device is replaced.
+    registered: bool,
+}
+
+impl Readiness {
+    pub(crate) fn reset(&mut self) {
+        self.registered = false;
+    }
+
+    /// Wakes the task once the native device has input, a write would no longer block if `writable`
+    /// or `deadline` passed.
+    pub(crate) fn arm(
+        &mut self,
+        native: &NativeWiimoteDevice,
+        waker: &Waker,
+        writable: bool,
+        deadline: Option<Instant>,
+    ) -> WiimoteResult<()> {
+        IoDriver::get()?.arm(self, native, waker, writable, deadline)?;
+        Ok(())
+    }
+}
+
+impl Drop for Readiness {
+    fn drop(&mut self) {
+        if let (Some(token), Ok(driver)) = (self.token, &*DRIVER) {
+            driver.release(token);
+        }
+    }
+}
+
+/// Polls `attempt`, if it is pending the task is woken once the Wii remote is ready.
+/// `attempt` is polled again after arming the Wii remote to not miss input received in between.
+pub(crate) fn poll_ready<T>(
+    connection: &Connection,
+    cx: &Context<'_>,
+    writable: bool,
+    deadline: Option<Instant>,
+    mut attempt: impl FnMut() -> Poll<T>,
+) -> WiimoteResult<Poll<T>> {
+    if let Poll::Ready(value) = attempt() {
+        return Ok(Poll::Ready(value));
+    }
+    connection.arm(cx.waker(), writable, deadline)?;
+    Ok(attempt())
+}
+
+/// The input reports of a Wii remote as `Stream`, returned by `WiimoteDevice::reports`.
+///
+/// The stream ends after returning `WiimoteError::Disconnected`, a new stream can be created after a reconnect.
+pub struct ReportStream {
+    connection: Arc<Connection>,
+    disconnected: bool,
+}
+
+impl ReportStream {
+    pub(crate) const fn new(connection: Arc<Connection>) -> Self {
+        Self {
+            connection,
+            disconnected: false,
+        }
+    }
+}
+
+impl Stream for ReportStream {
+    type Item = WiimoteResult<InputReport>;
+
+    fn poll_next(mut self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Option<Self::Item>> {
+        if self.disconnected {
+            return Poll::Ready(None);
+        }
+
+        let mut report = RawReport::default();
+        let connection = &self.connection;
+        let poll = poll_ready(connection, cx, false, None, || {
+            match connection.read_timeout(&mut report, Some(0)) {
+                Ok(0) => Poll::Pending,
+                result => Poll::Ready(result),
+            }
+        })
+        .unwrap_or_else(|error| Poll::Ready(Err(error)));
+        match poll {
+            Poll::Ready(Ok(_)) => Poll::Ready(Some(report.decode())),
+            Poll::Ready(Err(error)) => {
+                self.disconnected = true;
+                Poll::Ready(Some(Err(error)))
+            }
+            Poll::Pending => Poll::Pending,
+        }
+    }
+}
+
+/// Writes an output report once the Wii remote accepts it without blocking, returned by `WiimoteDevice::write_async`.
+#[must_use]
+pub struct OutputWrite {
+    connection: Arc<Connection>,
+    output_report: OutputReport,
+    finished: bool,
+}
+
+impl OutputWrite {
+    pub(crate) const fn new(connection: Arc<Connection>, output_report: OutputReport) -> Self {
+        Self {
+            connection,
+            output_report,
+            finished: false,
+        }
+    }
+}
+
+impl Future for OutputWrite {
+    type Output = WiimoteResult<()>;
+
+    fn poll(mut self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Self::Output> {
+        if self.finished {
+            return Poll::Ready(Ok(()));
+        }
+
+        let this = &*self;
+        let result = poll_ready(&this.connection, cx, true, None, || {
+            match this.connection.write_nonblocking(&this.output_report) {
+                Ok(false) => Poll::Pending,
+                Ok(true) => Poll::Ready(Ok(())),
+                Err(error) => Poll::Ready(Err(error)),
+            }
+        });
+        let poll = result.unwrap_or_else(|error| Poll::Ready(Err(error)));
+        if poll.is_ready() {
+            self.finished = true;
+        }
+        poll
+    }
+}
+
+#[cfg(all(test, feature = "mock"))]
+mod tests {
+    use std::sync::atomic::{AtomicBool, Ordering};
+    use std::task::Wake;
+    use std::thread::Thread;
+
+    use super::*;
+    use crate::mock::MockWiimote;
+    use crate::output::Addressing;
+
+    struct ThreadWaker {
+        thread: Thread,
+        woken: AtomicBool,
+    }
+
+    impl Wake for ThreadWaker {
+        fn wake(self: Arc<Self>) {
+            self.woken.store(true, Ordering::Release);
+            self.thread.unpark();
+        }
+    }
+
+    /// Polls the future on the current thread, parking the thread until the future is woken.
+    fn block_on<F: Future>(future: F) -> F::Output {
+        let mut future = std::pin::pin!(future);
+        let waker = Arc::new(ThreadWaker {
+            thread: std::thread::current(),
+            woken: AtomicBool::new(false),
+        });
+        let context_waker = Waker::from(Arc::clone(&waker));
+        let mut cx = Context::from_waker(&context_waker);
+        loop {
+            if let Poll::Ready(output) = future.as_mut().poll(&mut cx) {
+                return output;
+            }
+            while !waker.woken.swap(false, Ordering::Acquire) {
+                std::thread::park();
+            }
+        }
+    }
+
+    fn next(stream: &mut ReportStream) -> Option<WiimoteResult<InputReport>> {
+        block_on(std::future::poll_fn(|cx| {
+            Pin::new(&mut *stream).poll_next(cx)
+        }))
+    }
+
+    #[test]
+    fn test_report_stream_woken_by_input() {
+        let mock = MockWiimote::connect("driver-stream");
+        let device = WiimoteDevice::new(NativeWiimoteDevice::take(&mock), None).unwrap();
+        let mut reports = device.reports();
+
+        let sender = mock.clone();
+        let thread = std::thread::spawn(move || {
+            std::thread::sleep(Duration::from_millis(20));
+            assert!(sender.send_report(&[0x30, 0x00, 0x08]));
+        });
+        let report = next(&mut reports).unwrap().unwrap();
+        assert!(matches!(report, InputReport::DataReport(0x30, _)));
+        thread.join().unwrap();
+
+        block_on(device.write_async(OutputReport::StatusRequest)).unwrap();
+        assert!(matches!(
+            next(&mut reports),
+            Some(Ok(InputReport::StatusInformation(_)))
+        ));
+        let calibration = block_on(device.read_memory(Addressing::eeprom(0x16, 10))).unwrap();
+        assert_eq!(calibration.len(), 10);
+
+        mock.disconnect();
+        assert!(matches!(
+            next(&mut reports),
+            Some(Err(WiimoteError::Disconnected))
+        ));
+        assert!(next(&mut reports).is_none());
+    }
+}
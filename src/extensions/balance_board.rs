@@ -0,0 +1,174 @@
+use std::time::Duration;
+
+use crate::output::Addressing;
+use crate::prelude::*;
+
+/// Maximum time to wait for the calibration data of the Balance Board.
+const CALIBRATION_READ_TIMEOUT: Duration = Duration::from_millis(500);
+/// Weight in kg of the second and third calibration point, the first is at 0 kg.
+const CALIBRATION_WEIGHT: f32 = 17.0;
+
+/// The raw readings of the four pressure sensors of a Balance Board
+/// decoded from the first eight extension bytes of a data report.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct BalanceBoardData {
+    pub top_right: u16,
+    pub bottom_right: u16,
+    pub top_left: u16,
+    pub bottom_left: u16,
+}
+
+impl BalanceBoardData {
+    /// Decodes the first eight extension bytes, returns `None` if there are fewer bytes (reporting mode 0x37).
+    #[must_use]
+    pub const fn from_bytes(bytes: &[u8]) -> Option<Self> {
+        // https://www.wiibrew.org/wiki/Wii_Balance_Board#Data_Format
+        let [b0, b1, b2, b3, b4, b5, b6, b7, ..] = *bytes else {
+            return None;
+        };
+        Some(Self {
+            top_right: u16::from_be_bytes([b0, b1]),
+            bottom_right: u16::from_be_bytes([b2, b3]),
+            top_left: u16::from_be_bytes([b4, b5]),
+            bottom_left: u16::from_be_bytes([b6, b7]),
+        })
+    }
+
+    const fn sensors(&self) -> [u16; 4] {
+        [
+            self.top_right,
+            self.bottom_right,
+            self.top_left,
+            self.bottom_left,
+        ]
+    }
+}
+
+/// Converts the raw readings of a Balance Board to kg, interpolating between the calibration
+/// points at 0 kg, 17 kg and 34 kg of every sensor.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct BalanceBoardCalibration {
+    /// Raw readings at 0 kg and 17 kg of the top right, bottom right, top left and bottom left sensors.
+    points: [[u16; 2]; 4],
+    /// kg per raw unit below and above the 17 kg calibration point of every sensor.
+    slopes: [[f32; 2]; 4],
+}
+
+impl BalanceBoardCalibration {
+    /// Location of the 0 kg, 17 kg and 34 kg calibration blocks of the Balance Board.
+    pub(crate) const ADDRESSING: Addressing = Addressing::control_registers(0xA4_0024, 24);
+
+    /// Parses the three calibration blocks of eight bytes, one big endian reading per sensor,
+    /// read from `ADDRESSING`.
+    pub(crate) fn parse(data: &[u8]) -> WiimoteResult<Self> {
+        if data.len() < 24 {
+            return Err(WiimoteDeviceError::MissingData.into());
+        }
+        let reading = |block: usize, sensor: usize| {
+            let offset = block * 8 + sensor * 2;
+            u16::from_be_bytes([data[offset], data[offset + 1]])
+        };
+
+        let mut points = [[0u16; 2]; 4];
+        let mut slopes = [[0f32; 2]; 4];
+        for sensor in 0..4 {
+            let [zero, middle, high] = [0, 1, 2].map(|block| reading(block, sensor));
+            if zero >= middle || middle >= high {
+                return Err(WiimoteDeviceError::InvalidData.into());
+            }
+            points[sensor] = [zero, middle];
+            slopes[sensor] = [
+                CALIBRATION_WEIGHT / f32::from(middle - zero),
+                CALIBRATION_WEIGHT / f32::from(high - middle),
+            ];
+        }
+        Ok(Self { points, slopes })
+    }
+
+    /// Reads the calibration of the Balance Board, a calibration cached for the Wii remote
+    /// is used without waiting and revalidated in the background.
+    pub(crate) fn read(wiimote: &WiimoteDevice) -> WiimoteResult<Self> {
+        let cache = wiimote.calibration_cache();
+        let cached = cache
+            .and_then(|cache| cache.get(wiimote.identifier()))
+            .and_then(|cached| cached.balance_board_calibration);
+        if let Some(cached) = cached {
+            if let Ok(calibration) = Self::parse(&cached) {
+                if let Some(cache) = cache {
+                    cache.revalidate(
+                        wiimote,
+                        wiimote.read_memory(Self::ADDRESSING),
+                        move |result| result.ok().map(|data| data == cached),
+                    );
+                }
+                return Ok(calibration);
+            }
+        }
+
+        let data = wiimote
+            .read_memory(Self::ADDRESSING)
+            .wait(CALIBRATION_READ_TIMEOUT)?;
+        let calibration = Self::parse(&data)?;
+        if let Some(cache) = cache {
+            let mut raw_calibration = [0u8; 24];
+            raw_calibration.copy_from_slice(&data[..24]);
+            cache.update(wiimote.identifier(), |cached| {
+                cached.balance_board_calibration = Some(raw_calibration);
+            });
+        }
+        Ok(calibration)
+    }
+
+    /// Returns the weight in kg on the top right, bottom right, top left and bottom left sensors.
+    #[must_use]
+    pub fn get_weights(&self, data: &BalanceBoardData) -> [f32; 4] {
+        let sensors = data.sensors();
+        std::array::from_fn(|sensor| {
+            let [zero, middle] = self.points[sensor];
+            let [low_slope, high_slope] = self.slopes[sensor];
+            let value = sensors[sensor];
+            if value < middle {
+                (f32::from(value) - f32::from(zero)) * low_slope
+            } else {
+                CALIBRATION_WEIGHT + f32::from(value - middle) * high_slope
+            }
+        })
+    }
+
+    /// Returns the total weight in kg on the Balance Board.
+    #[must_use]
+    pub fn get_total_weight(&self, data: &BalanceBoardData) -> f32 {
+        self.get_weights(data).iter().sum()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_weights_interpolated_between_calibration_points() {
+        let mut data = [0u8; 24];
+        for (block, value) in [1000u16, 2700, 4400].into_iter().enumerate() {
+            for sensor in 0..4 {
+                let offset = block * 8 + sensor * 2;
+                data[offset..offset + 2].copy_from_slice(&(value + sensor as u16).to_be_bytes());
+            }
+        }
+        let calibration = BalanceBoardCalibration::parse(&data).unwrap();
+
+        let reading = BalanceBoardData::from_bytes(&[
+            0x03, 0xE8, // 0 kg
+            0x07, 0x3B, // 8.5 kg
+            0x0A, 0x8E, // 17 kg
+            0x0D, 0xE1, // 25.5 kg
+        ])
+        .unwrap();
+        let expected = [0.0, 8.5, 17.0, 25.5];
+        for (weight, expected) in calibration.get_weights(&reading).iter().zip(expected) {
+            assert!((weight - expected).abs() < 1e-3, "{weight} != {expected}");
+        }
+        assert!((calibration.get_total_weight(&reading) - 51.0).abs() < 1e-3);
+        assert!(BalanceBoardData::from_bytes(&[0; 6]).is_none());
+    }
+}
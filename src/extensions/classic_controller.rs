@@ -0,0 +1,118 @@
+use bitflags::bitflags;
+
+bitflags! {
+    #[derive(Debug, Clone, Copy, PartialEq, Eq)]
+    pub struct ClassicControllerButtons: u16 {
+        const UP = 1 << 0;
+        const LEFT = 1 << 1;
+        const ZR = 1 << 2;
+        const X = 1 << 3;
+        const A = 1 << 4;
+        const Y = 1 << 5;
+        const B = 1 << 6;
+        const ZL = 1 << 7;
+
+        const R = 1 << 9;
+        const PLUS = 1 << 10;
+        const HOME = 1 << 11;
+        const MINUS = 1 << 12;
+        const L = 1 << 13;
+        const DOWN = 1 << 14;
+        const RIGHT = 1 << 15;
+    }
+}
+
+/// The state of a Classic Controller or Classic Controller Pro
+/// decoded from the six extension bytes of a data report.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct ClassicControllerData {
+    /// 6 bit left stick position, the lowest bit is always 0 in Motion Plus passthrough mode.
+    pub left_stick_x: u8,
+    pub left_stick_y: u8,
+    /// 5 bit right stick position.
+    pub right_stick_x: u8,
+    pub right_stick_y: u8,
+    /// 5 bit analog trigger position, the Classic Controller Pro only reports 0 or 31.
+    pub left_trigger: u8,
+    pub right_trigger: u8,
+    pub buttons: ClassicControllerButtons,
+}
+
+impl ClassicControllerData {
+    /// Decodes the first six extension bytes, returns `None` if there are fewer bytes.
+    #[must_use]
+    pub const fn from_bytes(bytes: &[u8]) -> Option<Self> {
+        // https://www.wiibrew.org/wiki/Wiimote/Extension_Controllers/Classic_Controller#Data_Format
+        let [first, second, _, _, fifth, sixth, ..] = *bytes else {
+            return None;
+        };
+        Some(Self::decode(
+            bytes,
+            first & 0x3F,
+            second & 0x3F,
+            u16::from_be_bytes([fifth, sixth]),
+        ))
+    }
+
+    /// Decodes the first six extension bytes of the extension reports interleaved by the Motion Plus
+    /// in `MotionPlusMode::ClassicControllerPassthrough`, returns `None` if there are fewer bytes.
+    #[must_use]
+    pub const fn from_passthrough_bytes(bytes: &[u8]) -> Option<Self> {
+        // https://www.wiibrew.org/wiki/Wiimote/Extension_Controllers/Wii_Motion_Plus#Classic_Controller_pass-through_mode
+        // Up and left take the lowest bits of the left stick to make room for the passthrough flags.
+        let [first, second, _, _, fifth, sixth, ..] = *bytes else {
+            return None;
+        };
+        let directions = (second & 0b1) << 1 | (first & 0b1);
+        Some(Self::decode(
+            bytes,
+            first & 0x3E,
+            second & 0x3E,
+            u16::from_be_bytes([fifth, (sixth & !0b11) | directions]),
+        ))
+    }
+
+    /// Decodes the fields shared by both formats from at least four bytes,
+    /// `buttons` are the active low button bits.
+    const fn decode(bytes: &[u8], left_stick_x: u8, left_stick_y: u8, buttons: u16) -> Self {
+        let (first, second, third, fourth) = (bytes[0], bytes[1], bytes[2], bytes[3]);
+        Self {
+            left_stick_x,
+            left_stick_y,
+            right_stick_x: (first >> 6) << 3 | (second >> 6) << 1 | third >> 7,
+            right_stick_y: third & 0x1F,
+            left_trigger: (third >> 5 & 0b11) << 3 | fourth >> 5,
+            right_trigger: fourth & 0x1F,
+            buttons: ClassicControllerButtons::from_bits_truncate(!buttons),
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_passthrough_matches_normal_format() {
+        // Up, A and L pressed, left stick at 32/30, right stick at 21/10, triggers at 31 and 0
+        let normal = [0xA0, 0x9E, 0xEA, 0xE0, 0b1101_1111, 0b1110_1110];
+        let passthrough = [0xA0, 0x9F, 0xEA, 0xE0, 0b1101_1110, 0b1110_1110];
+
+        let expected = ClassicControllerData {
+            left_stick_x: 32,
+            left_stick_y: 30,
+            right_stick_x: 21,
+            right_stick_y: 10,
+            left_trigger: 31,
+            right_trigger: 0,
+            buttons: ClassicControllerButtons::UP
+                | ClassicControllerButtons::A
+                | ClassicControllerButtons::L,
+        };
+        assert_eq!(ClassicControllerData::from_bytes(&normal), Some(expected));
+        assert_eq!(
+            ClassicControllerData::from_passthrough_bytes(&passthrough),
+            Some(expected)
+        );
+    }
+}
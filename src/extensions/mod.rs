@@ -1,10 +1,16 @@
+pub(crate) mod balance_board;
+pub(crate) mod classic_controller;
 pub(crate) mod motion_plus;
+pub(crate) mod nunchuck;
 
 use crate::output::Addressing;
 use crate::prelude::*;
-use crate::simple_io;
+use crate::simple_io::{self, MemoryRequest};
 
+pub use balance_board::*;
+pub use classic_controller::*;
 pub use motion_plus::*;
+pub use nunchuck::*;
 
 #[derive(Debug)]
 pub enum WiimoteExtension {
@@ -15,6 +21,15 @@ pub enum WiimoteExtension {
     Unknown([u8; 6]),
 }
 
+/// The data of an extension decoded from the extension bytes of a data report.
+#[derive(Debug, Clone, Copy)]
+pub enum ExtensionData {
+    Nunchuck(NunchuckData),
+    ClassicController(ClassicControllerData),
+    BalanceBoard(BalanceBoardData),
+    MotionPlus(MotionPlusData),
+}
+
 impl WiimoteExtension {
     /// Detects the extension (except for Motion Plus) connected to the Wii remote.
     ///
@@ -22,52 +37,117 @@ impl WiimoteExtension {
     ///
     /// This function will return an error on I/O error or if invalid data is received.
     pub fn detect(wiimote: &WiimoteDevice) -> WiimoteResult<Option<Self>> {
-        let identifier = Self::identify_extension(wiimote)?;
+        if !Self::initialize(wiimote)? {
+            return Ok(None);
+        }
+        let read = simple_io::transfer(wiimote, &[MemoryRequest::Read(Self::IDENTIFY_ADDRESSING)])
+            .pop()
+            .unwrap_or(Err(WiimoteError::Timeout));
+        Ok(Self::identifier_from_read(read)?.map(Self::from_identifier))
+    }
 
-        // https://www.wiibrew.org/wiki/Wiimote/Extension_Controllers#Identification
-        Ok(match identifier {
-            Some([_, _, 0xA4, 0x20, 0x00, 0x00]) => Some(Self::Nunchuck),
-            Some([0x01, 0x00, 0xA4, 0x20, 0x01, 0x01]) => Some(Self::ClassicControllerPro),
-            Some([_, _, 0xA4, 0x20, 0x01, 0x01]) => Some(Self::ClassicController),
-            Some([_, _, 0xA4, 0x20, 0x04, 0x02]) => Some(Self::BalanceBoard),
-            Some(identifier) => Some(Self::Unknown(identifier)),
-            None => None,
-        })
+    // https://www.wiibrew.org/wiki/Wiimote/Extension_Controllers#Identification
+    // The new way to initialize the extension is by writing 0x55 to 0x(4)A400F0, then writing 0x00 to 0x(4)A400FB.
+    // Once initialized, the last six bytes of the register block identify the connected Extension Controller.
+    // A six-byte read of register 0xA400FA will return these bytes.
+    // The Extension Controller must have been initialized prior to this.
+    /// Writes that initialize the extension, sent in order before `IDENTIFY_ADDRESSING` is read.
+    pub(crate) const INITIALIZE_REQUESTS: [MemoryRequest; 2] = [
+        MemoryRequest::Write(
+            Addressing::control_registers(0xA4_00F0, 1),
+            single_byte_write(0x55),
+        ),
+        MemoryRequest::Write(
+            Addressing::control_registers(0xA4_00FB, 1),
+            single_byte_write(0x00),
+        ),
+    ];
+    /// Address of the extension identifier, the read result is passed to `identifier_from_read`.
+    pub(crate) const IDENTIFY_ADDRESSING: Addressing = Addressing::control_registers(0xA4_00FA, 6);
+
+    /// Initializes the extension with `INITIALIZE_REQUESTS`, every write once the previous one
+    /// was acknowledged. Returns `false` if no extension is connected.
+    pub(crate) fn initialize(wiimote: &WiimoteDevice) -> WiimoteResult<bool> {
+        let result = simple_io::transfer_in_order(wiimote, &Self::INITIALIZE_REQUESTS);
+        if is_no_extension(&result) {
+            return Ok(false);
+        }
+        result.map(|()| true)
     }
 
-    fn identify_extension(wiimote: &WiimoteDevice) -> WiimoteResult<Option<[u8; 6]>> {
-        // https://www.wiibrew.org/wiki/Wiimote/Extension_Controllers#Identification
-        // The new way to initialize the extension is by writing 0x55 to 0x(4)A400F0, then writing 0x00 to 0x(4)A400FB.
-        // Once initialized, the last six bytes of the register block identify the connected Extension Controller.
-        // A six-byte read of register 0xA400FA will return these bytes.
-        // The Extension Controller must have been initialized prior to this.
-        let mut memory_write_buffer = [0u8; 16];
+    /// Decodes the extension bytes of a data report, e.g. `DataReportRef::extension_bytes`,
+    /// sent while the Motion Plus is in `motion_plus_mode` (`MotionPlusMode::Inactive` without Motion Plus).
+    ///
+    /// In the passthrough modes the reports alternate between Motion Plus data and data of this extension.
+    /// Returns `None` if there are too few bytes or the extension is unknown.
+    #[must_use]
+    pub fn decode(&self, bytes: &[u8], motion_plus_mode: MotionPlusMode) -> Option<ExtensionData> {
+        let motion_plus = || {
+            let bytes: [u8; 6] = bytes.get(..6)?.try_into().ok()?;
+            MotionPlusData::try_from(bytes)
+                .ok()
+                .map(ExtensionData::MotionPlus)
+        };
+        match motion_plus_mode {
+            MotionPlusMode::Inactive => match self {
+                Self::Nunchuck => NunchuckData::from_bytes(bytes).map(ExtensionData::Nunchuck),
+                Self::ClassicController | Self::ClassicControllerPro => {
+                    ClassicControllerData::from_bytes(bytes).map(ExtensionData::ClassicController)
+                }
+                Self::BalanceBoard => {
+                    BalanceBoardData::from_bytes(bytes).map(ExtensionData::BalanceBoard)
+                }
+                Self::Unknown(_) => None,
+            },
+            MotionPlusMode::Active => motion_plus(),
+            MotionPlusMode::NunchuckPassthrough => motion_plus().or_else(|| {
+                NunchuckData::from_passthrough_bytes(bytes).map(ExtensionData::Nunchuck)
+            }),
+            MotionPlusMode::ClassicControllerPassthrough => motion_plus().or_else(|| {
+                ClassicControllerData::from_passthrough_bytes(bytes)
+                    .map(ExtensionData::ClassicController)
+            }),
+        }
+    }
 
-        memory_write_buffer[0] = 0x55;
-        let addressing = Addressing::control_registers(0xA4_00F0, 1);
-        let ack = simple_io::write_16_bytes_sync(wiimote, addressing, &memory_write_buffer)?;
-        if ack.error_code() == 7 {
-            return Ok(None);
+    /// Returns the extension identified by the six bytes at 0xA400FA.
+    pub(crate) const fn from_identifier(identifier: [u8; 6]) -> Self {
+        // https://www.wiibrew.org/wiki/Wiimote/Extension_Controllers#Identification
+        match identifier {
+            [_, _, 0xA4, 0x20, 0x00, 0x00] => Self::Nunchuck,
+            [0x01, 0x00, 0xA4, 0x20, 0x01, 0x01] => Self::ClassicControllerPro,
+            [_, _, 0xA4, 0x20, 0x01, 0x01] => Self::ClassicController,
+            [_, _, 0xA4, 0x20, 0x04, 0x02] => Self::BalanceBoard,
+            identifier => Self::Unknown(identifier),
         }
+    }
 
-        memory_write_buffer[0] = 0x00;
-        let addressing = Addressing::control_registers(0xA4_00FB, 1);
-        let ack = simple_io::write_16_bytes_sync(wiimote, addressing, &memory_write_buffer)?;
-        if ack.error_code() == 7 {
+    /// Returns the extension identifier from the read of 0xA400FA, `None` if no extension is connected.
+    pub(crate) fn identifier_from_read(
+        read: WiimoteResult<Vec<u8>>,
+    ) -> WiimoteResult<Option<[u8; 6]>> {
+        if is_no_extension(&read) {
             return Ok(None);
         }
 
-        let addressing = Addressing::control_registers(0xA4_00FA, 6);
-        let read_result = simple_io::read_16_bytes_sync(wiimote, addressing)?;
-        // Address is actually 0xA4_00FA, but only the lower 2 bytes are returned
-        if read_result.address_offset() != 0x00FA || read_result.size() < 6 {
-            Err(WiimoteDeviceError::InvalidData.into())
-        } else if read_result.error_flag() == 7 {
-            Ok(None)
-        } else {
-            let mut extension_info = [0u8; 6];
-            extension_info.copy_from_slice(&read_result.data[..6]);
-            Ok(Some(extension_info))
-        }
+        let mut extension_info = [0u8; 6];
+        extension_info.copy_from_slice(read?.get(..6).ok_or(WiimoteDeviceError::MissingData)?);
+        Ok(Some(extension_info))
     }
 }
+
+/// Error 7 means that no extension is connected.
+const fn is_no_extension<T>(result: &WiimoteResult<T>) -> bool {
+    matches!(
+        result,
+        Err(WiimoteError::WiimoteDeviceError(
+            WiimoteDeviceError::MemoryAccess(7)
+        ))
+    )
+}
+/// Returns the 16 byte write buffer to write `value` to a single register.
+const fn single_byte_write(value: u8) -> [u8; 16] {
+    let mut buffer = [0u8; 16];
+    buffer[0] = value;
+    buffer
+}
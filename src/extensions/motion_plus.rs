@@ -1,12 +1,19 @@
-use std::cell::RefCell;
-use std::sync::atomic::AtomicBool;
+use std::sync::atomic::{AtomicBool, AtomicU8, Ordering};
+use std::time::Duration;
 
-use crate::calibration::normalize;
+use crate::calibration::{normalize, AxisScale, FixedPointScale};
 use crate::output::Addressing;
 use crate::prelude::*;
+use crate::seqlock::SeqLock;
 use crate::simple_io;
 
+/// Maximum time to wait for the calibration data of the Motion Plus.
+const CALIBRATION_READ_TIMEOUT: Duration = Duration::from_millis(500);
+/// Location of both calibration blocks of the Motion Plus.
+const CALIBRATION_ADDRESSING: Addressing = Addressing::control_registers(0xA6_0020, 32);
+
 #[derive(Debug, Clone, Copy)]
+#[repr(u8)]
 pub enum MotionPlusMode {
     Inactive,
     Active,
@@ -14,25 +21,109 @@ pub enum MotionPlusMode {
     ClassicControllerPassthrough,
 }
 
-#[derive(Debug, Clone, Copy)]
+impl MotionPlusMode {
+    const fn from_u8(value: u8) -> Self {
+        match value {
+            1 => Self::Active,
+            2 => Self::NunchuckPassthrough,
+            3 => Self::ClassicControllerPassthrough,
+            _ => Self::Inactive,
+        }
+    }
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
 pub enum MotionPlusType {
     External,
     Builtin,
 }
 
+// https://www.wiibrew.org/wiki/Wiimote/Extension_Controllers/Wii_Motion_Plus#Data_Format
+const UNIT_PER_DEG_PER_S: f64 = 8192.0 / 595.0;
+const HIGH_SPEED_MULTIPLIER: f64 = 2000.0 / 440.0;
+
 #[derive(Debug, Default, Clone)]
 pub struct MotionPlusCalibration {
     fast: MotionPlusCalibrationData,
     slow: MotionPlusCalibrationData,
+    /// Conversions of the yaw, roll and pitch axes in slow and fast mode,
+    /// precomputed when the calibration is changed.
+    slow_scales: [AxisScale; 3],
+    fast_scales: [AxisScale; 3],
+    slow_fixed_point_scales: [FixedPointScale; 3],
+    fast_fixed_point_scales: [FixedPointScale; 3],
 }
 
+/// Words of the `SeqLock` holding a `MotionPlusCalibration`:
+/// the fast and slow calibration data followed by the precomputed scales.
+const CALIBRATION_WORDS: usize = 2 * 2 + 6 * 2 + 6 * 3;
+
 impl MotionPlusCalibration {
+    fn new(fast: MotionPlusCalibrationData, slow: MotionPlusCalibrationData) -> Self {
+        Self {
+            slow_scales: slow
+                .axes(1.0)
+                .map(|(zero, max, multiplier)| AxisScale::new(14, zero, max, 16, multiplier)),
+            fast_scales: fast
+                .axes(HIGH_SPEED_MULTIPLIER)
+                .map(|(zero, max, multiplier)| AxisScale::new(14, zero, max, 16, multiplier)),
+            slow_fixed_point_scales: slow
+                .axes(1.0)
+                .map(|(zero, max, multiplier)| FixedPointScale::new(14, zero, max, 16, multiplier)),
+            fast_fixed_point_scales: fast
+                .axes(HIGH_SPEED_MULTIPLIER)
+                .map(|(zero, max, multiplier)| FixedPointScale::new(14, zero, max, 16, multiplier)),
+            fast,
+            slow,
+        }
+    }
+
+    /// Packs the calibration and its precomputed scales into words to be stored in a `SeqLock`,
+    /// so readers do not compute the scales again.
+    fn to_words(&self) -> [u64; CALIBRATION_WORDS] {
+        let values = self
+            .fast
+            .to_words()
+            .into_iter()
+            .chain(self.slow.to_words())
+            .chain(self.slow_scales.iter().flat_map(|scale| scale.to_words()))
+            .chain(self.fast_scales.iter().flat_map(|scale| scale.to_words()))
+            .chain(
+                self.slow_fixed_point_scales
+                    .iter()
+                    .flat_map(|scale| scale.to_words()),
+            )
+            .chain(
+                self.fast_fixed_point_scales
+                    .iter()
+                    .flat_map(|scale| scale.to_words()),
+            );
+        let mut words = [0; CALIBRATION_WORDS];
+        for (word, value) in words.iter_mut().zip(values) {
+            *word = value;
+        }
+        words
+    }
+
+    fn from_words(words: [u64; CALIBRATION_WORDS]) -> Self {
+        let mut words = words.into_iter();
+        let mut next = || words.next().unwrap_or(0);
+        Self {
+            fast: MotionPlusCalibrationData::from_words([next(), next()]),
+            slow: MotionPlusCalibrationData::from_words([next(), next()]),
+            slow_scales: std::array::from_fn(|_| AxisScale::from_words([next(), next()])),
+            fast_scales: std::array::from_fn(|_| AxisScale::from_words([next(), next()])),
+            slow_fixed_point_scales: std::array::from_fn(|_| {
+                FixedPointScale::from_words([next(), next(), next()])
+            }),
+            fast_fixed_point_scales: std::array::from_fn(|_| {
+                FixedPointScale::from_words([next(), next(), next()])
+            }),
+        }
+    }
+
     #[must_use]
     pub fn get_angular_velocity(&self, data: &MotionPlusData) -> (f64, f64, f64) {
-        // https://www.wiibrew.org/wiki/Wiimote/Extension_Controllers/Wii_Motion_Plus#Data_Format
-        const UNIT_PER_DEG_PER_S: f64 = 8192.0 / 595.0;
-        const HIGH_SPEED_MULTIPLIER: f64 = 2000.0 / 440.0;
-
         #[rustfmt::skip]
         let calibration = (
             if data.yaw_slow { &self.slow } else { &self.fast },
@@ -75,6 +166,51 @@ impl MotionPlusCalibration {
             pitch * degrees.2 * mode_multiplier.2 / UNIT_PER_DEG_PER_S,
         )
     }
+
+    /// Returns the angular velocities in deg/s in fixed-point with
+    /// [`FIXED_POINT_BITS`](crate::prelude::FIXED_POINT_BITS) fractional bits,
+    /// same as `get_angular_velocity` but with a single integer multiplication per axis.
+    #[must_use]
+    pub fn get_angular_velocity_fixed_point(&self, data: &MotionPlusData) -> (i32, i32, i32) {
+        let scale = |axis: usize, is_slow: bool| {
+            if is_slow {
+                &self.slow_fixed_point_scales[axis]
+            } else {
+                &self.fast_fixed_point_scales[axis]
+            }
+        };
+        (
+            scale(0, data.yaw_slow).apply(data.yaw),
+            scale(1, data.roll_slow).apply(data.roll),
+            scale(2, data.pitch_slow).apply(data.pitch),
+        )
+    }
+
+    /// Returns the precomputed conversion of the yaw, roll and pitch axes in slow and fast mode,
+    /// same as `get_angular_velocity`.
+    #[must_use]
+    pub const fn axis_scales(&self) -> ([AxisScale; 3], [AxisScale; 3]) {
+        (self.slow_scales, self.fast_scales)
+    }
+
+    /// Converts many raw samples stored as separate yaw, roll and pitch arrays with their slow flags
+    /// into angular velocities, up to the length of the shortest slice of every axis.
+    pub fn get_angular_velocity_batch(
+        &self,
+        raw: [&[u16]; 3],
+        slow: [&[bool]; 3],
+        output: [&mut [f32]; 3],
+    ) {
+        for (((slow_scale, fast_scale), (raw, slow)), output) in self
+            .slow_scales
+            .iter()
+            .zip(&self.fast_scales)
+            .zip(raw.into_iter().zip(slow))
+            .zip(output)
+        {
+            AxisScale::apply_select_batch(slow_scale, fast_scale, raw, slow, output);
+        }
+    }
 }
 
 #[derive(Debug, Default, Clone)]
@@ -88,6 +224,44 @@ struct MotionPlusCalibrationData {
     degrees_div_6: u8,
 }
 
+impl MotionPlusCalibrationData {
+    /// Packs the calibration into two words, see `MotionPlusCalibration::to_words`.
+    fn to_words(&self) -> [u64; 2] {
+        [
+            u64::from(self.yaw_zero_value)
+                | u64::from(self.roll_zero_value) << 16
+                | u64::from(self.pitch_zero_value) << 32
+                | u64::from(self.yaw_scale) << 48,
+            u64::from(self.roll_scale)
+                | u64::from(self.pitch_scale) << 16
+                | u64::from(self.degrees_div_6) << 32,
+        ]
+    }
+
+    #[allow(clippy::cast_possible_truncation)]
+    const fn from_words([first, second]: [u64; 2]) -> Self {
+        Self {
+            yaw_zero_value: first as u16,
+            roll_zero_value: (first >> 16) as u16,
+            pitch_zero_value: (first >> 32) as u16,
+            yaw_scale: (first >> 48) as u16,
+            roll_scale: second as u16,
+            pitch_scale: (second >> 16) as u16,
+            degrees_div_6: (second >> 32) as u8,
+        }
+    }
+
+    /// Returns the zero value, scale and conversion factor to deg/s of the yaw, roll and pitch axes.
+    fn axes(&self, mode_multiplier: f64) -> [(u16, u16, f64); 3] {
+        let multiplier = f64::from(self.degrees_div_6) * 6.0 * mode_multiplier / UNIT_PER_DEG_PER_S;
+        [
+            (self.yaw_zero_value, self.yaw_scale, multiplier),
+            (self.roll_zero_value, self.roll_scale, multiplier),
+            (self.pitch_zero_value, self.pitch_scale, multiplier),
+        ]
+    }
+}
+
 impl From<[u8; 16]> for MotionPlusCalibrationData {
     fn from(value: [u8; 16]) -> Self {
         Self {
@@ -103,7 +277,7 @@ impl From<[u8; 16]> for MotionPlusCalibrationData {
 }
 
 #[allow(clippy::struct_excessive_bools)]
-#[derive(Debug)]
+#[derive(Debug, Clone, Copy)]
 pub struct MotionPlusData {
     pub yaw: u16,
     pub roll: u16,
@@ -138,36 +312,138 @@ impl TryFrom<[u8; 6]> for MotionPlusData {
     }
 }
 
+/// Divisor of the difference between the current zero values and the average of a still window.
+const ZERO_DRIFT_SMOOTHING: i32 = 4;
+
+/// Averages Motion Plus readings one at a time to recalibrate the zero values while the Wii remote is in use.
+///
+/// A window completes after `window` consecutive readings in slow mode on all axes that stay within
+/// `max_deviation` of the first reading of the window, any other reading starts a new window.
+/// Only running sums are kept, no readings are buffered.
+#[derive(Debug, Clone)]
+pub struct ZeroDriftCalibrator {
+    window: u32,
+    max_deviation: u16,
+    count: u32,
+    first: [u16; 3],
+    sums: [u64; 3],
+}
+
+impl ZeroDriftCalibrator {
+    /// Creates a calibrator averaging windows of `window` readings (at least 8)
+    /// that deviate at most `max_deviation` raw units from each other.
+    #[must_use]
+    pub fn new(window: u32, max_deviation: u16) -> Self {
+        Self {
+            window: window.max(8),
+            max_deviation,
+            count: 0,
+            first: [0; 3],
+            sums: [0; 3],
+        }
+    }
+
+    /// Adds a reading and returns the 16 bit averages of yaw, roll and pitch when a window completed.
+    pub fn push(&mut self, reading: &MotionPlusData) -> Option<[u16; 3]> {
+        if !reading.yaw_slow || !reading.roll_slow || !reading.pitch_slow {
+            // Too much movement, start again with the next reading
+            self.count = 0;
+            return None;
+        }
+
+        let values = [reading.yaw, reading.roll, reading.pitch];
+        let is_still = values
+            .iter()
+            .zip(&self.first)
+            .all(|(value, first)| value.abs_diff(*first) <= self.max_deviation);
+        if self.count == 0 || !is_still {
+            self.count = 0;
+            self.first = values;
+            self.sums = [0; 3];
+        }
+        for (sum, value) in self.sums.iter_mut().zip(values) {
+            *sum += u64::from(value);
+        }
+        self.count += 1;
+        if self.count < self.window {
+            return None;
+        }
+
+        let count = u64::from(self.count);
+        self.count = 0;
+        // Calibration has 16 bits, values only 14
+        #[allow(clippy::cast_possible_truncation)]
+        Some(
+            self.sums
+                .map(|sum| (((sum << 2) + count / 2) / count) as u16),
+        )
+    }
+}
+
+impl Default for ZeroDriftCalibrator {
+    /// About one second of readings at 100 Hz within roughly 4 deg/s.
+    fn default() -> Self {
+        Self::new(100, 64)
+    }
+}
+
 #[derive(Debug)]
 pub struct MotionPlus {
     motion_plus_type: MotionPlusType,
     initialized: AtomicBool,
-    mode: RefCell<MotionPlusMode>,
-    calibration: RefCell<MotionPlusCalibration>,
+    mode: AtomicU8,
+    /// The fast and slow calibration with its precomputed scales,
+    /// readers do not block while it is changed.
+    calibration: SeqLock<CALIBRATION_WORDS>,
 }
 
 // https://www.wiibrew.org/wiki/Wiimote/Extension_Controllers/Wii_Motion_Plus
 impl MotionPlus {
-    /// Detects if the Wii remote has a Motion Plus extension.
-    ///
-    /// # Errors
-    ///
-    /// This function will return an error if communication to the Wii remote failed.
-    pub(crate) fn detect(wiimote: &WiimoteDevice) -> WiimoteResult<Option<Self>> {
-        let address = Addressing::control_registers(0xA6_00FA, 6);
-        let memory_data = simple_io::read_16_bytes_sync(wiimote, address)?;
-        let motion_plus_type = match memory_data.data[0..6] {
-            [0x00, 0x00, 0xA6, 0x20, _, 0x05] => MotionPlusType::External,
-            [_, 0x00, 0xA6, 0x20, _, 0x05] => MotionPlusType::Builtin,
-            _ => return Ok(None),
+    /// Address of the Motion Plus identifier, the read result is passed to `identifier_from_result`.
+    pub(crate) const IDENTIFY_ADDRESSING: Addressing = Addressing::control_registers(0xA6_00FA, 6);
+
+    /// Returns the Motion Plus identifier from the result of reading `IDENTIFY_ADDRESSING`,
+    /// `None` if no Motion Plus is connected.
+    pub(crate) fn identifier_from_result(
+        result: WiimoteResult<Vec<u8>>,
+    ) -> WiimoteResult<Option<[u8; 6]>> {
+        let identifier = match result {
+            Ok(identifier) => identifier,
+            // The registers of the Motion Plus are not readable if it is not connected
+            Err(WiimoteError::WiimoteDeviceError(WiimoteDeviceError::MemoryAccess(_))) => {
+                return Ok(None)
+            }
+            Err(error) => return Err(error),
         };
+        let mut motion_plus_info = [0u8; 6];
+        motion_plus_info
+            .copy_from_slice(identifier.get(..6).ok_or(WiimoteDeviceError::MissingData)?);
+        Ok(Some(motion_plus_info))
+    }
 
-        Ok(Some(Self {
-            motion_plus_type,
+    /// Returns the type of the Motion Plus identified by the six bytes at 0xA600FA.
+    pub(crate) const fn type_from_identifier(identifier: &[u8; 6]) -> Option<MotionPlusType> {
+        match identifier {
+            [0x00, 0x00, 0xA6, 0x20, _, 0x05] => Some(MotionPlusType::External),
+            [_, 0x00, 0xA6, 0x20, _, 0x05] => Some(MotionPlusType::Builtin),
+            _ => None,
+        }
+    }
+
+    /// Detects the Motion Plus from the six bytes at 0xA600FA.
+    pub(crate) fn from_identifier(identifier: &[u8; 6]) -> Option<Self> {
+        Some(Self {
+            motion_plus_type: Self::type_from_identifier(identifier)?,
             initialized: AtomicBool::new(false),
-            mode: RefCell::new(MotionPlusMode::Inactive),
-            calibration: RefCell::new(MotionPlusCalibration::default()),
-        }))
+            mode: AtomicU8::new(MotionPlusMode::Inactive as u8),
+            calibration: SeqLock::new(
+                MotionPlusCalibration::new(
+                    MotionPlusCalibrationData::default(),
+                    MotionPlusCalibrationData::default(),
+                )
+                .to_words(),
+            ),
+        })
     }
 
     #[must_use]
@@ -177,20 +453,26 @@ impl MotionPlus {
 
     #[must_use]
     pub fn is_initialized(&self) -> bool {
-        self.initialized.load(std::sync::atomic::Ordering::Relaxed)
+        self.initialized.load(Ordering::Relaxed)
     }
 
     #[must_use]
     pub fn mode(&self) -> MotionPlusMode {
-        *self.mode.borrow()
+        MotionPlusMode::from_u8(self.mode.load(Ordering::Relaxed))
     }
 
+    /// Returns the current calibration, can be called from any thread without blocking.
     #[must_use]
     pub fn calibration(&self) -> MotionPlusCalibration {
-        self.calibration.borrow().clone()
+        MotionPlusCalibration::from_words(self.calibration.read())
+    }
+
+    fn set_calibration(&self, calibration: &MotionPlusCalibration) {
+        self.calibration.store(calibration.to_words());
     }
 
     /// Tries to initialize the Motion Plus extension and read its calibration.
+    /// A calibration cached for the Wii remote is used without waiting and revalidated in the background.
     ///
     /// # Errors
     ///
@@ -198,8 +480,7 @@ impl MotionPlus {
     pub fn initialize(&self, wiimote: &WiimoteDevice) -> WiimoteResult<()> {
         Self::write_single_control_byte(wiimote, 0xA6_00F0, 0x55)?;
         self.read_calibration_data(wiimote)?;
-        self.initialized
-            .store(true, std::sync::atomic::Ordering::Relaxed);
+        self.initialized.store(true, Ordering::Relaxed);
         Ok(())
     }
 
@@ -232,21 +513,61 @@ impl MotionPlus {
             let average_roll = ((roll_sum as f64 / read_count as f64).round() as u16) << 2;
             let average_pitch = ((pitch_sum as f64 / read_count as f64).round() as u16) << 2;
 
-            let mut calibration = self.calibration.borrow_mut();
-
-            calibration.slow.yaw_zero_value = average_yaw;
-            calibration.slow.roll_zero_value = average_roll;
-            calibration.slow.pitch_zero_value = average_pitch;
-
-            calibration.fast.yaw_zero_value = average_yaw;
-            calibration.fast.roll_zero_value = average_roll;
-            calibration.fast.pitch_zero_value = average_pitch;
-            Some(calibration.clone())
+            Some(self.update_calibration(|_, _| [average_yaw, average_roll, average_pitch]))
         } else {
             None
         }
     }
 
+    /// Feeds a reading to `calibrator` and updates the zero values when it completes a window
+    /// in which the Motion Plus did not move. Can be called with every reading during normal use.
+    /// Returns the new calibration data if it was updated.
+    pub fn update_zero_values(
+        &self,
+        calibrator: &mut ZeroDriftCalibrator,
+        reading: &MotionPlusData,
+    ) -> Option<MotionPlusCalibration> {
+        let averages = calibrator.push(reading)?;
+        // Move the zero values a part of the way to damp the noise of single windows
+        Some(self.update_calibration(|_, slow| {
+            let current = [
+                slow.yaw_zero_value,
+                slow.roll_zero_value,
+                slow.pitch_zero_value,
+            ];
+            [0, 1, 2].map(|axis| {
+                let current = i32::from(current[axis]);
+                let difference = i32::from(averages[axis]) - current;
+                #[allow(clippy::cast_possible_truncation, clippy::cast_sign_loss)]
+                {
+                    (current + difference / ZERO_DRIFT_SMOOTHING) as u16
+                }
+            })
+        }))
+    }
+
+    /// Sets the 16 bit zero values of yaw, roll and pitch in slow and fast mode
+    /// returned by `f` for the current fast and slow calibration.
+    fn update_calibration(
+        &self,
+        f: impl Fn(&MotionPlusCalibrationData, &MotionPlusCalibrationData) -> [u16; 3],
+    ) -> MotionPlusCalibration {
+        let words = self.calibration.update(|words| {
+            let MotionPlusCalibration {
+                mut fast, mut slow, ..
+            } = MotionPlusCalibration::from_words(words);
+            let [yaw, roll, pitch] = f(&fast, &slow);
+            for data in [&mut fast, &mut slow] {
+                data.yaw_zero_value = yaw;
+                data.roll_zero_value = roll;
+                data.pitch_zero_value = pitch;
+            }
+            // The scales are computed by the writer, not by every reader
+            MotionPlusCalibration::new(fast, slow).to_words()
+        });
+        MotionPlusCalibration::from_words(words)
+    }
+
     /// Changes the mode of the Motion Plus extension.
     ///
     /// # Errors
@@ -260,7 +581,7 @@ impl MotionPlus {
             MotionPlusMode::ClassicControllerPassthrough => (0xA6_00FE, 0x07),
         };
         Self::write_single_control_byte(wiimote, address, value)?;
-        self.mode.replace(mode);
+        self.mode.store(mode as u8, Ordering::Relaxed);
         Ok(())
     }
 
@@ -272,42 +593,235 @@ impl MotionPlus {
         let addressing = Addressing::control_registers(address, 1);
         let mut memory_write_buffer = [0u8; 16];
         memory_write_buffer[0] = value;
-        let ack = simple_io::write_16_bytes_sync(wiimote, addressing, &memory_write_buffer)?;
-        if ack.error_code() == 7 {
-            return Err(WiimoteDeviceError::InvalidData.into());
+        simple_io::write_16_bytes_sync(wiimote, addressing, &memory_write_buffer)
+    }
+
+    fn read_calibration_data(&self, wiimote: &WiimoteDevice) -> WiimoteResult<()> {
+        let cache = wiimote.calibration_cache();
+        let cached = cache
+            .and_then(|cache| cache.get(wiimote.identifier()))
+            .and_then(|cached| cached.motion_plus_calibration);
+        if let Some(cached) = cached {
+            if let Ok(calibration) = Self::parse_calibration(&cached) {
+                self.set_calibration(&calibration);
+                if let Some(cache) = cache {
+                    cache.revalidate(
+                        wiimote,
+                        wiimote.read_memory(CALIBRATION_ADDRESSING),
+                        move |result| result.ok().map(|data| data == cached),
+                    );
+                }
+                return Ok(());
+            }
         }
 
+        // Both calibration blocks are read with a single request, the Wii remote replies with a report per block
+        let data = wiimote
+            .read_memory(CALIBRATION_ADDRESSING)
+            .wait(CALIBRATION_READ_TIMEOUT)?;
+        let calibration = Self::parse_calibration(&data)?;
+        if let Some(cache) = cache {
+            let mut raw_calibration = [0u8; 32];
+            raw_calibration.copy_from_slice(&data[..32]);
+            cache.update(wiimote.identifier(), |cached| {
+                cached.motion_plus_calibration = Some(raw_calibration);
+            });
+        }
+        self.set_calibration(&calibration);
         Ok(())
     }
 
-    fn read_calibration_data(&self, wiimote: &WiimoteDevice) -> WiimoteResult<()> {
+    fn parse_calibration(data: &[u8]) -> WiimoteResult<MotionPlusCalibration> {
+        if data.len() < 32 {
+            return Err(WiimoteDeviceError::MissingData.into());
+        }
+
         let mut hasher = crc32fast::Hasher::new();
         let mut checksum = [0u8; 4];
 
-        let fast =
-            Self::read_calibration_part(wiimote, 0xA6_0020, &mut hasher, &mut checksum[0..2])?;
-        let slow =
-            Self::read_calibration_part(wiimote, 0xA6_0020 + 16, &mut hasher, &mut checksum[2..4])?;
+        let fast = Self::read_calibration_part(&data[0..16], &mut hasher, &mut checksum[0..2]);
+        let slow = Self::read_calibration_part(&data[16..32], &mut hasher, &mut checksum[2..4]);
 
         if hasher.finalize() != u32::from_be_bytes(checksum) {
             return Err(WiimoteDeviceError::InvalidChecksum.into());
         }
-
-        self.calibration
-            .replace(MotionPlusCalibration { fast, slow });
-        Ok(())
+        Ok(MotionPlusCalibration::new(fast, slow))
     }
 
     fn read_calibration_part(
-        wiimote: &WiimoteDevice,
-        address: u32,
+        data: &[u8],
         hasher: &mut crc32fast::Hasher,
         checksum_buffer: &mut [u8],
-    ) -> WiimoteResult<MotionPlusCalibrationData> {
-        let addressing = Addressing::control_registers(address, 16);
-        let data = simple_io::read_16_bytes_sync_checked(wiimote, addressing)?;
-        hasher.update(&data[0..14]);
-        checksum_buffer.copy_from_slice(&data[14..16]);
-        Ok(MotionPlusCalibrationData::from(data))
+    ) -> MotionPlusCalibrationData {
+        let mut block = [0u8; 16];
+        block.copy_from_slice(data);
+        hasher.update(&block[0..14]);
+        checksum_buffer.copy_from_slice(&block[14..16]);
+        MotionPlusCalibrationData::from(block)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::calibration::fixed_point_to_f32;
+
+    fn reading(yaw: u16, roll: u16, pitch: u16, slow: bool) -> MotionPlusData {
+        MotionPlusData {
+            yaw,
+            roll,
+            pitch,
+            yaw_slow: slow,
+            roll_slow: slow,
+            pitch_slow: slow,
+            extension_connected: false,
+        }
+    }
+
+    #[test]
+    fn test_state_is_shared_between_threads() {
+        fn assert_send_sync<T: Send + Sync>() {}
+        assert_send_sync::<MotionPlus>();
+        assert_send_sync::<WiimoteDevice>();
+    }
+
+    #[test]
+    fn test_calibration_words_round_trip() {
+        let mut block = [0u8; 16];
+        block[..13].copy_from_slice(&[
+            0x7E, 0x01, 0x7F, 0x22, 0x7D, 0x83, 0x8A, 0x04, 0x8B, 0x05, 0x89, 0x86, 0x2D,
+        ]);
+        let motion_plus =
+            MotionPlus::from_identifier(&[0x00, 0x00, 0xA6, 0x20, 0x00, 0x05]).unwrap();
+        let calibration = MotionPlusCalibration::new(
+            MotionPlusCalibrationData::from(block),
+            MotionPlusCalibrationData::default(),
+        );
+        motion_plus.set_calibration(&calibration);
+        let read = motion_plus.calibration();
+        assert_eq!(read.fast.to_words(), calibration.fast.to_words());
+        assert_eq!(read.slow.to_words(), [0, 0]);
+        assert_eq!(read.axis_scales(), calibration.axis_scales());
+        assert_eq!(
+            read.slow_fixed_point_scales,
+            calibration.slow_fixed_point_scales
+        );
+        assert_eq!(
+            read.fast_fixed_point_scales,
+            calibration.fast_fixed_point_scales
+        );
+    }
+
+    #[test]
+    fn test_zero_drift_calibrator_averages_still_windows() {
+        let mut calibrator = ZeroDriftCalibrator::new(8, 16);
+        for index in 0..7 {
+            assert_eq!(
+                calibrator.push(&reading(0x2000 + index % 2, 0x1F00, 0x2100, true)),
+                None
+            );
+        }
+        assert_eq!(
+            calibrator.push(&reading(0x2001, 0x1F00, 0x2100, true)),
+            Some([0x8002, 0x7C00, 0x8400])
+        );
+    }
+
+    #[test]
+    fn test_zero_drift_calibrator_restarts_on_movement() {
+        let mut calibrator = ZeroDriftCalibrator::new(8, 16);
+        for _ in 0..7 {
+            assert_eq!(
+                calibrator.push(&reading(0x2000, 0x2000, 0x2000, true)),
+                None
+            );
+        }
+        assert_eq!(
+            calibrator.push(&reading(0x2000, 0x2000, 0x2000, false)),
+            None
+        );
+        for _ in 0..7 {
+            assert_eq!(
+                calibrator.push(&reading(0x2000, 0x2000, 0x2000, true)),
+                None
+            );
+        }
+        // Deviating reading starts a new window with itself
+        assert_eq!(
+            calibrator.push(&reading(0x2100, 0x2000, 0x2000, true)),
+            None
+        );
+        for _ in 0..6 {
+            assert_eq!(
+                calibrator.push(&reading(0x2100, 0x2000, 0x2000, true)),
+                None
+            );
+        }
+        assert_eq!(
+            calibrator.push(&reading(0x2100, 0x2000, 0x2000, true)),
+            Some([0x8400, 0x8000, 0x8000])
+        );
+    }
+
+    #[test]
+    fn test_angular_velocity_batch_matches_single_samples() {
+        let mut block = [0u8; 16];
+        block[..12].copy_from_slice(&[
+            0x7E, 0x00, 0x7F, 0x20, 0x7D, 0x80, 0x8A, 0x00, 0x8B, 0x00, 0x89, 0x80,
+        ]);
+        block[12] = 0x2D;
+        let calibration = MotionPlusCalibration::new(
+            MotionPlusCalibrationData::from(block),
+            MotionPlusCalibrationData::from(block),
+        );
+        let samples = (0..12u16)
+            .map(|index| MotionPlusData {
+                yaw: 0x1F00 + index * 37,
+                roll: 0x2000 - index * 29,
+                pitch: 0x1F80 + index * 11,
+                yaw_slow: index % 2 == 0,
+                roll_slow: index % 3 == 0,
+                pitch_slow: true,
+                extension_connected: false,
+            })
+            .collect::<Vec<_>>();
+
+        let yaw = samples.iter().map(|sample| sample.yaw).collect::<Vec<_>>();
+        let roll = samples.iter().map(|sample| sample.roll).collect::<Vec<_>>();
+        let pitch = samples
+            .iter()
+            .map(|sample| sample.pitch)
+            .collect::<Vec<_>>();
+        let yaw_slow = samples
+            .iter()
+            .map(|sample| sample.yaw_slow)
+            .collect::<Vec<_>>();
+        let roll_slow = samples
+            .iter()
+            .map(|sample| sample.roll_slow)
+            .collect::<Vec<_>>();
+        let pitch_slow = samples
+            .iter()
+            .map(|sample| sample.pitch_slow)
+            .collect::<Vec<_>>();
+        let mut output = [[0f32; 12]; 3];
+        let [yaw_output, roll_output, pitch_output] = &mut output;
+        calibration.get_angular_velocity_batch(
+            [&yaw, &roll, &pitch],
+            [&yaw_slow, &roll_slow, &pitch_slow],
+            [yaw_output, roll_output, pitch_output],
+        );
+
+        for (index, sample) in samples.iter().enumerate() {
+            let (yaw, roll, pitch) = calibration.get_angular_velocity(sample);
+            assert!((f64::from(output[0][index]) - yaw).abs() < 1e-2);
+            assert!((f64::from(output[1][index]) - roll).abs() < 1e-2);
+            assert!((f64::from(output[2][index]) - pitch).abs() < 1e-2);
+
+            let fixed_point = calibration.get_angular_velocity_fixed_point(sample);
+            assert!((f64::from(fixed_point_to_f32(fixed_point.0)) - yaw).abs() < 1e-3);
+            assert!((f64::from(fixed_point_to_f32(fixed_point.1)) - roll).abs() < 1e-3);
+            assert!((f64::from(fixed_point_to_f32(fixed_point.2)) - pitch).abs() < 1e-3);
+        }
     }
 }
@@ -0,0 +1,88 @@
+use bitflags::bitflags;
+
+bitflags! {
+    #[derive(Debug, Clone, Copy, PartialEq, Eq)]
+    pub struct NunchuckButtons: u8 {
+        const Z = 1 << 0;
+        const C = 1 << 1;
+    }
+}
+
+/// The state of a Nunchuck decoded from the six extension bytes of a data report.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct NunchuckData {
+    /// Analog stick position, about 128 when centered.
+    pub stick_x: u8,
+    pub stick_y: u8,
+    /// 10 bit accelerometer values, the lowest bit is always 0 in Motion Plus passthrough mode.
+    pub acceleration_x: u16,
+    pub acceleration_y: u16,
+    pub acceleration_z: u16,
+    pub buttons: NunchuckButtons,
+}
+
+impl NunchuckData {
+    /// Decodes the first six extension bytes, returns `None` if there are fewer bytes.
+    #[must_use]
+    pub const fn from_bytes(bytes: &[u8]) -> Option<Self> {
+        // https://www.wiibrew.org/wiki/Wiimote/Extension_Controllers/Nunchuck#Data_Format
+        let [stick_x, stick_y, x, y, z, last, ..] = *bytes else {
+            return None;
+        };
+        Some(Self {
+            stick_x,
+            stick_y,
+            acceleration_x: (x as u16) << 2 | (last as u16 >> 2 & 0b11),
+            acceleration_y: (y as u16) << 2 | (last as u16 >> 4 & 0b11),
+            acceleration_z: (z as u16) << 2 | (last as u16 >> 6),
+            // Buttons are active low
+            buttons: NunchuckButtons::from_bits_truncate(!last),
+        })
+    }
+
+    /// Decodes the first six extension bytes of the extension reports interleaved by the Motion Plus
+    /// in `MotionPlusMode::NunchuckPassthrough`, returns `None` if there are fewer bytes.
+    #[must_use]
+    pub const fn from_passthrough_bytes(bytes: &[u8]) -> Option<Self> {
+        // https://www.wiibrew.org/wiki/Wiimote/Extension_Controllers/Wii_Motion_Plus#Nunchuck_pass-through_mode
+        // The lowest bit of every acceleration value is dropped to make room for the passthrough flags.
+        let [stick_x, stick_y, x, y, z, last, ..] = *bytes else {
+            return None;
+        };
+        Some(Self {
+            stick_x,
+            stick_y,
+            acceleration_x: (x as u16) << 2 | (last as u16 >> 4 & 0b1) << 1,
+            acceleration_y: (y as u16) << 2 | (last as u16 >> 5 & 0b1) << 1,
+            acceleration_z: (z as u16 & 0xFE) << 2 | (last as u16 >> 6) << 1,
+            buttons: NunchuckButtons::from_bits_truncate(!last >> 2),
+        })
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_passthrough_matches_normal_format() {
+        // C pressed, accelerometer at 0x202, 0x1FE and 0x2FE
+        let normal = [0x80, 0x7F, 0x80, 0x7F, 0xBF, 0b1010_1001];
+        let passthrough = [0x80, 0x7F, 0x80, 0x7F, 0xBE, 0b1111_0100];
+
+        let expected = NunchuckData {
+            stick_x: 0x80,
+            stick_y: 0x7F,
+            acceleration_x: 0x202,
+            acceleration_y: 0x1FE,
+            acceleration_z: 0x2FE,
+            buttons: NunchuckButtons::C,
+        };
+        assert_eq!(NunchuckData::from_bytes(&normal), Some(expected));
+        assert_eq!(
+            NunchuckData::from_passthrough_bytes(&passthrough),
+            Some(expected)
+        );
+        assert_eq!(NunchuckData::from_bytes(&normal[..5]), None);
+    }
+}
@@ -0,0 +1,224 @@
+use std::time::{Duration, Instant};
+
+use crate::input::DataReportRef;
+use crate::prelude::*;
+
+/// Time between reports above which the orientation is not integrated, e.g. after a reconnect.
+const MAX_REPORT_INTERVAL: Duration = Duration::from_millis(250);
+/// Range of the accelerometer magnitude in g in which it is used to correct the orientation,
+/// outside of it the Wii remote is accelerated too much to measure gravity.
+const GRAVITY_RANGE: (f32, f32) = (0.5, 1.5);
+
+/// The orientation of the Wii remote as unit quaternion.
+///
+/// The x axis points to the right, the y axis along the Wii remote towards the IR camera
+/// and the z axis out of the buttons, same as the axes of the accelerometer.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct Quaternion {
+    pub w: f32,
+    pub x: f32,
+    pub y: f32,
+    pub z: f32,
+}
+
+impl Quaternion {
+    /// The Wii remote lying flat with the buttons up.
+    pub const IDENTITY: Self = Self {
+        w: 1.0,
+        x: 0.0,
+        y: 0.0,
+        z: 0.0,
+    };
+
+    /// Returns the rotations around the y (roll), x (pitch) and z (yaw) axes in radians.
+    #[must_use]
+    pub fn euler_angles(&self) -> (f32, f32, f32) {
+        let Self { w, x, y, z } = *self;
+        let pitch = (2.0 * (w * x + y * z)).atan2(1.0 - 2.0 * (x * x + y * y));
+        let roll = (2.0 * (w * y - z * x)).clamp(-1.0, 1.0).asin();
+        let yaw = (2.0 * (w * z + x * y)).atan2(1.0 - 2.0 * (y * y + z * z));
+        (roll, pitch, yaw)
+    }
+
+    fn normalized(self) -> Self {
+        let norm = (self.w * self.w + self.x * self.x + self.y * self.y + self.z * self.z).sqrt();
+        if norm == 0.0 {
+            return Self::IDENTITY;
+        }
+        Self {
+            w: self.w / norm,
+            x: self.x / norm,
+            y: self.y / norm,
+            z: self.z / norm,
+        }
+    }
+}
+
+impl Default for Quaternion {
+    fn default() -> Self {
+        Self::IDENTITY
+    }
+}
+
+/// Estimates the orientation of the Wii remote from the accelerometer and the Motion Plus
+/// with a Mahony complementary filter.
+///
+/// The angular velocity is integrated every report and the drift is corrected towards the gravity
+/// measured by the accelerometer. Yaw is not corrected since the Wii remote has no magnetometer.
+/// The filter keeps no heap state and can be updated at report rate.
+#[derive(Debug, Clone, Copy)]
+pub struct MahonyFilter {
+    orientation: Quaternion,
+    /// Integral of the error between the measured and estimated gravity.
+    integral_error: [f32; 3],
+    proportional_gain: f32,
+    integral_gain: f32,
+    last_timestamp: Option<Instant>,
+}
+
+impl MahonyFilter {
+    /// Creates a filter starting at `Quaternion::IDENTITY`.
+    /// Higher `proportional_gain` follows the accelerometer faster, `integral_gain` corrects gyro bias.
+    #[must_use]
+    pub const fn new(proportional_gain: f32, integral_gain: f32) -> Self {
+        Self {
+            orientation: Quaternion::IDENTITY,
+            integral_error: [0.0; 3],
+            proportional_gain,
+            integral_gain,
+            last_timestamp: None,
+        }
+    }
+
+    /// Returns the current orientation.
+    #[must_use]
+    pub const fn orientation(&self) -> Quaternion {
+        self.orientation
+    }
+
+    /// Resets the orientation to `Quaternion::IDENTITY`.
+    pub fn reset(&mut self) {
+        *self = Self::new(self.proportional_gain, self.integral_gain);
+    }
+
+    /// Updates the orientation with the data report received at `timestamp`, e.g. `ReactorEvent::timestamp`.
+    ///
+    /// Returns `None` if the report is not reporting mode 0x35 or 0x37 or its extension data
+    /// is not Motion Plus data, e.g. the extension data of passthrough modes.
+    /// The first report and reports after a long gap only set the time of the next update.
+    pub fn update_report(
+        &mut self,
+        report: &DataReportRef<'_>,
+        timestamp: Instant,
+        accelerometer_calibration: &AccelerometerCalibration,
+        motion_plus_calibration: &MotionPlusCalibration,
+    ) -> Option<Quaternion> {
+        if !matches!(report.mode(), 0x35 | 0x37) {
+            return None;
+        }
+        let accelerometer = report.accelerometer()?;
+        let mut extension = [0u8; 6];
+        extension.copy_from_slice(report.extension_bytes()?.get(..6)?);
+        let motion_plus = MotionPlusData::try_from(extension).ok()?;
+
+        let interval = self
+            .last_timestamp
+            .map(|last_timestamp| timestamp.saturating_duration_since(last_timestamp));
+        self.last_timestamp = Some(timestamp);
+        let Some(interval) = interval.filter(|interval| *interval <= MAX_REPORT_INTERVAL) else {
+            return Some(self.orientation);
+        };
+
+        let [x, y, z] = accelerometer_calibration.axis_scales();
+        let acceleration = [
+            x.apply(accelerometer.x()),
+            y.apply(accelerometer.y()),
+            z.apply(accelerometer.z()),
+        ];
+        #[allow(clippy::cast_possible_truncation)]
+        let (yaw, roll, pitch) = {
+            let (yaw, roll, pitch) = motion_plus_calibration.get_angular_velocity(&motion_plus);
+            (yaw as f32, roll as f32, pitch as f32)
+        };
+        let angular_velocity = [pitch.to_radians(), roll.to_radians(), yaw.to_radians()];
+        Some(self.update(angular_velocity, acceleration, interval.as_secs_f32()))
+    }
+
+    /// Updates the orientation with the angular velocity around the x, y and z axes in rad/s
+    /// and the acceleration in g, measured `interval` seconds after the previous update.
+    pub fn update(
+        &mut self,
+        angular_velocity: [f32; 3],
+        acceleration: [f32; 3],
+        interval: f32,
+    ) -> Quaternion {
+        let [mut gx, mut gy, mut gz] = angular_velocity;
+        let [ax, ay, az] = acceleration;
+        let Quaternion { w, x, y, z } = self.orientation;
+
+        let norm = (ax * ax + ay * ay + az * az).sqrt();
+        if norm > GRAVITY_RANGE.0 && norm < GRAVITY_RANGE.1 {
+            let (ax, ay, az) = (ax / norm, ay / norm, az / norm);
+            // Direction of gravity in the frame of the Wii remote as estimated by the orientation
+            let vx = 2.0 * (x * z - w * y);
+            let vy = 2.0 * (w * x + y * z);
+            let vz = w * w - x * x - y * y + z * z;
+            let error = [ay * vz - az * vy, az * vx - ax * vz, ax * vy - ay * vx];
+
+            if self.integral_gain > 0.0 {
+                for (integral, error) in self.integral_error.iter_mut().zip(error) {
+                    *integral += self.integral_gain * error * interval;
+                }
+            }
+            gx += self.proportional_gain * error[0] + self.integral_error[0];
+            gy += self.proportional_gain * error[1] + self.integral_error[1];
+            gz += self.proportional_gain * error[2] + self.integral_error[2];
+        }
+
+        let half_interval = 0.5 * interval;
+        self.orientation = Quaternion {
+            w: w + (-x * gx - y * gy - z * gz) * half_interval,
+            x: x + (w * gx + y * gz - z * gy) * half_interval,
+            y: y + (w * gy - x * gz + z * gx) * half_interval,
+            z: z + (w * gz + x * gy - y * gx) * half_interval,
+        }
+        .normalized();
+        self.orientation
+    }
+}
+
+impl Default for MahonyFilter {
+    fn default() -> Self {
+        Self::new(1.0, 0.0)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_integrates_angular_velocity() {
+        let mut filter = MahonyFilter::new(0.0, 0.0);
+        // A quarter turn around the z axis in one second
+        for _ in 0..100 {
+            filter.update([0.0, 0.0, std::f32::consts::FRAC_PI_2], [0.0; 3], 0.01);
+        }
+        let (roll, pitch, yaw) = filter.orientation().euler_angles();
+        assert!(roll.abs() < 1e-3 && pitch.abs() < 1e-3);
+        assert!((yaw - std::f32::consts::FRAC_PI_2).abs() < 1e-3);
+    }
+
+    #[test]
+    fn test_converges_to_gravity() {
+        let mut filter = MahonyFilter::default();
+        // Tilted to the side by 45 degrees, gravity is measured along the x and z axes
+        let component = std::f32::consts::FRAC_1_SQRT_2;
+        for _ in 0..2000 {
+            filter.update([0.0; 3], [component, 0.0, component], 0.01);
+        }
+        let (roll, pitch, _) = filter.orientation().euler_angles();
+        assert!((roll.abs() - std::f32::consts::FRAC_PI_4).abs() < 1e-2);
+        assert!(pitch.abs() < 1e-2);
+    }
+}
@@ -1,3 +1,11 @@
+use std::marker::PhantomData;
+use std::time::Instant;
+
+use crate::ir::{self, IrDots};
+use crate::output::{HasAccelerometer, HasButtons, HasExtension, HasIr, ReportingMode};
+use crate::output::{
+    Mode0x32, Mode0x33, Mode0x34, Mode0x35, Mode0x36, Mode0x37, Mode0x3D, Mode0x3E, Mode0x3F,
+};
 use crate::prelude::*;
 use bitflags::bitflags;
 
@@ -20,7 +28,7 @@ bitflags! {
 }
 
 bitflags! {
-    #[derive(Debug, Clone, Copy)]
+    #[derive(Debug, Clone, Copy, PartialEq, Eq)]
     pub struct ButtonData: u16 {
         const LEFT = 1 << 0;
         const RIGHT = 1 << 1;
@@ -39,7 +47,7 @@ bitflags! {
 }
 
 #[repr(C, packed)]
-#[derive(Debug)]
+#[derive(Debug, Clone, Copy)]
 pub struct StatusData {
     buttons: ButtonData,
     flags: StatusFlags,
@@ -68,7 +76,7 @@ impl StatusData {
 }
 
 #[repr(C, packed)]
-#[derive(Debug)]
+#[derive(Debug, Clone, Copy)]
 pub struct MemoryData {
     buttons: ButtonData,
     size_error_flags: u8,
@@ -108,7 +116,7 @@ impl MemoryData {
 }
 
 #[repr(C, packed)]
-#[derive(Debug)]
+#[derive(Debug, Clone, Copy)]
 pub struct AcknowledgeData {
     buttons: ButtonData,
     report_number: u8,
@@ -136,7 +144,7 @@ impl AcknowledgeData {
 }
 
 #[repr(C, packed)]
-#[derive(Debug)]
+#[derive(Debug, Clone, Copy)]
 pub struct WiimoteData {
     pub data: [u8; 21],
 }
@@ -150,6 +158,22 @@ impl WiimoteData {
         let bits = u16::from_le_bytes([self.data[0], self.data[1]]);
         ButtonData::from_bits_retain(bits)
     }
+
+    /// Returns a borrowed view of the data report with reporting mode `mode`.
+    #[must_use]
+    pub const fn view(&self, mode: u8) -> DataReportRef<'_> {
+        DataReportRef {
+            mode,
+            data: &self.data,
+        }
+    }
+
+    /// Returns the decoded IR camera dots of the data report with reporting mode `mode`,
+    /// see `DataReportRef::ir_dots`.
+    #[must_use]
+    pub fn ir_dots(&self, mode: u8) -> Option<IrDots> {
+        self.view(mode).ir_dots()
+    }
 }
 
 /// An input report represents the data sent from the Wii remote to the computer.
@@ -184,42 +208,378 @@ pub enum InputReport {
     DataReport(u8, WiimoteData),
 }
 
-macro_rules! transmute_data {
-    ($value:expr, $type:ident) => {{
-        const DATA_SIZE: usize = std::mem::size_of::<$type>();
-        if $value.len() < DATA_SIZE {
-            return Err(WiimoteDeviceError::InvalidData.into());
+impl InputReport {
+    /// Returns a borrowed view of the report.
+    #[must_use]
+    pub const fn view(&self) -> InputReportRef<'_> {
+        match self {
+            Self::StatusInformation(data) => InputReportRef::StatusInformation(data),
+            Self::ReadMemory(data) => InputReportRef::ReadMemory(data),
+            Self::Acknowledge(data) => InputReportRef::Acknowledge(data),
+            Self::DataReport(mode, data) => InputReportRef::DataReport(*mode, data.view(*mode)),
         }
-        let mut slice = [0u8; DATA_SIZE];
-        slice.copy_from_slice(&$value[1..=DATA_SIZE]);
+    }
+}
 
-        unsafe { std::mem::transmute::<[u8; DATA_SIZE], $type>(slice) }
-    }};
+/// A borrowed view of an input report, the fields are read directly from the received bytes.
+///
+/// Can be converted to an `InputReport` to keep the report independent of the buffer.
+#[derive(Debug, Clone, Copy)]
+pub enum InputReportRef<'a> {
+    /// Status information report (ID 0x20), see `InputReport::StatusInformation`.
+    StatusInformation(&'a StatusData),
+    /// Read memory data report (ID 0x21), see `InputReport::ReadMemory`.
+    ReadMemory(&'a MemoryData),
+    /// Acknowledge report (ID 0x22), see `InputReport::Acknowledge`.
+    Acknowledge(&'a AcknowledgeData),
+    /// Data report (IDs 0x30-0x3F), see `InputReport::DataReport`.
+    DataReport(u8, DataReportRef<'a>),
 }
 
-impl InputReport {
-    fn from_status_information(value: &[u8]) -> WiimoteResult<Self> {
-        let data = transmute_data!(value, StatusData);
-        Ok(Self::StatusInformation(data))
+impl InputReportRef<'_> {
+    /// Returns the core button data.
+    ///
+    /// Returns `None` for data report 0x3d that only contains extension data.
+    #[must_use]
+    pub fn buttons(&self) -> Option<ButtonData> {
+        match self {
+            Self::StatusInformation(data) => Some(data.buttons()),
+            Self::ReadMemory(data) => Some(data.buttons()),
+            Self::Acknowledge(data) => Some(data.buttons()),
+            Self::DataReport(0x3D, _) => None,
+            Self::DataReport(_, data) => Some(data.buttons()),
+        }
     }
+}
 
-    fn from_read_memory_data(value: &[u8]) -> WiimoteResult<Self> {
-        let data = transmute_data!(value, MemoryData);
-        Ok(Self::ReadMemory(data))
+/// Report data that can be read directly from the received bytes.
+///
+/// # Safety
+///
+/// The type must have an alignment of 1 and be valid for any bit pattern.
+unsafe trait PackedReportData: Sized {}
+
+unsafe impl PackedReportData for StatusData {}
+unsafe impl PackedReportData for MemoryData {}
+unsafe impl PackedReportData for AcknowledgeData {}
+
+/// Reinterprets the bytes following the report ID as report data.
+fn cast_report_data<T: PackedReportData>(value: &[u8]) -> WiimoteResult<&T> {
+    if value.len() < 1 + std::mem::size_of::<T>() {
+        return Err(WiimoteDeviceError::InvalidData.into());
     }
+    // SAFETY: the slice contains `size_of::<T>()` bytes after the report ID,
+    // `T` has an alignment of 1 and is valid for any bit pattern.
+    Ok(unsafe { &*value[1..].as_ptr().cast::<T>() })
+}
+
+impl<'a> TryFrom<&'a [u8]> for InputReportRef<'a> {
+    type Error = WiimoteError;
 
-    fn from_acknowledge(value: &[u8]) -> WiimoteResult<Self> {
-        let data = transmute_data!(value, AcknowledgeData);
-        Ok(Self::Acknowledge(data))
+    fn try_from(value: &'a [u8]) -> Result<Self, Self::Error> {
+        let Some(&report_id) = value.first() else {
+            return Err(WiimoteDeviceError::MissingData.into());
+        };
+        match report_id {
+            STATUS_ID => cast_report_data(value).map(Self::StatusInformation),
+            READ_MEMORY_ID => cast_report_data(value).map(Self::ReadMemory),
+            ACKNOWLEDGE_ID => cast_report_data(value).map(Self::Acknowledge),
+            0x30..=0x3F => Ok(Self::DataReport(
+                report_id,
+                DataReportRef {
+                    mode: report_id,
+                    data: &value[1..],
+                },
+            )),
+            _ => Err(WiimoteDeviceError::InvalidData.into()),
+        }
     }
+}
 
-    fn from_data_report(value: &[u8]) -> Self {
-        const DATA_SIZE: usize = 21;
-        let mut data = [0u8; DATA_SIZE];
-        let bytes_to_copy = usize::min(value.len() - 1, DATA_SIZE);
-        data[..bytes_to_copy].copy_from_slice(&value[1..=bytes_to_copy]);
+/// A borrowed view of a data report (IDs 0x30-0x3F).
+///
+/// The accessors return `None` if the reporting mode does not contain the data.
+///
+/// WiiBrew Documentation: <https://www.wiibrew.org/wiki/Wiimote#Data_Reporting>
+#[derive(Debug, Clone, Copy)]
+pub struct DataReportRef<'a> {
+    mode: u8,
+    data: &'a [u8],
+}
 
-        Self::DataReport(value[0], WiimoteData { data })
+impl<'a> DataReportRef<'a> {
+    /// Returns the data reporting mode (report ID) of the report.
+    #[must_use]
+    pub const fn mode(&self) -> u8 {
+        self.mode
+    }
+
+    /// Returns the bytes of the report following the report ID.
+    #[must_use]
+    pub const fn data(&self) -> &'a [u8] {
+        self.data
+    }
+
+    /// Returns the core button data.
+    ///
+    /// This is invalid for report type 0x3d that only contains extension data.
+    #[must_use]
+    pub const fn buttons(&self) -> ButtonData {
+        match self.data {
+            [first, second, ..] => {
+                ButtonData::from_bits_retain(u16::from_le_bytes([*first, *second]))
+            }
+            _ => ButtonData::empty(),
+        }
+    }
+
+    /// Returns the accelerometer data of reporting modes 0x31, 0x33, 0x35 and 0x37.
+    #[must_use]
+    pub const fn accelerometer(&self) -> Option<AccelerometerData> {
+        match self.mode {
+            0x31 | 0x33 | 0x35 | 0x37 if self.data.len() >= 5 => {
+                Some(AccelerometerData::from_normal_reporting(self.data))
+            }
+            _ => None,
+        }
+    }
+
+    /// Returns the IR camera bytes of reporting modes 0x33, 0x36, 0x37, 0x3e and 0x3f.
+    #[must_use]
+    pub fn ir_bytes(&self) -> Option<&'a [u8]> {
+        let (offset, size) = match self.mode {
+            0x33 => (Mode0x33::IR_OFFSET, Mode0x33::IR_SIZE),
+            0x36 => (Mode0x36::IR_OFFSET, Mode0x36::IR_SIZE),
+            0x37 => (Mode0x37::IR_OFFSET, Mode0x37::IR_SIZE),
+            0x3E => (Mode0x3E::IR_OFFSET, Mode0x3E::IR_SIZE),
+            0x3F => (Mode0x3F::IR_OFFSET, Mode0x3F::IR_SIZE),
+            _ => return None,
+        };
+        self.data.get(offset..offset + size)
+    }
+
+    /// Returns the decoded IR camera dots of reporting modes 0x33, 0x36, 0x37, 0x3e and 0x3f.
+    /// The IR camera must be enabled with the matching `IrMode`, see `ir::decode`.
+    #[must_use]
+    pub fn ir_dots(&self) -> Option<IrDots> {
+        ir::decode(self.mode, self.ir_bytes()?)
+    }
+
+    /// Returns the extension bytes of reporting modes 0x32, 0x34, 0x35, 0x36, 0x37 and 0x3d.
+    #[must_use]
+    pub fn extension_bytes(&self) -> Option<&'a [u8]> {
+        let (offset, size) = match self.mode {
+            0x32 => (Mode0x32::EXTENSION_OFFSET, Mode0x32::EXTENSION_SIZE),
+            0x34 => (Mode0x34::EXTENSION_OFFSET, Mode0x34::EXTENSION_SIZE),
+            0x35 => (Mode0x35::EXTENSION_OFFSET, Mode0x35::EXTENSION_SIZE),
+            0x36 => (Mode0x36::EXTENSION_OFFSET, Mode0x36::EXTENSION_SIZE),
+            0x37 => (Mode0x37::EXTENSION_OFFSET, Mode0x37::EXTENSION_SIZE),
+            0x3D => (Mode0x3D::EXTENSION_OFFSET, Mode0x3D::EXTENSION_SIZE),
+            _ => return None,
+        };
+        self.data.get(offset..offset + size)
+    }
+
+    /// Returns the report as data report of the reporting mode `M` or `None` if the report has a different mode.
+    #[must_use]
+    pub fn as_mode<M: ReportingMode>(&self) -> Option<Report<'a, M>> {
+        if self.mode == M::ID {
+            Report::from_data(self.data)
+        } else {
+            None
+        }
+    }
+}
+
+/// A data report of the reporting mode `M` known at compile time.
+///
+/// The size of the report is checked once on construction,
+/// the accessors read the fields at fixed offsets without checking the mode or bounds.
+///
+/// WiiBrew Documentation: <https://www.wiibrew.org/wiki/Wiimote#Data_Reporting>
+#[derive(Debug)]
+pub struct Report<'a, M: ReportingMode> {
+    /// The bytes following the report ID, contains at least `M::SIZE` bytes.
+    data: &'a [u8],
+    mode: PhantomData<M>,
+}
+
+impl<M: ReportingMode> Clone for Report<'_, M> {
+    fn clone(&self) -> Self {
+        *self
+    }
+}
+
+impl<M: ReportingMode> Copy for Report<'_, M> {}
+
+impl<'a, M: ReportingMode> Report<'a, M> {
+    /// Creates the report from the bytes of a report starting with the report ID.
+    ///
+    /// Returns `None` if the report ID does not match `M` or the report is too short.
+    #[must_use]
+    pub fn new(report: &'a [u8]) -> Option<Self> {
+        match report.split_first() {
+            Some((&report_id, data)) if report_id == M::ID => Self::from_data(data),
+            _ => None,
+        }
+    }
+
+    fn from_data(data: &'a [u8]) -> Option<Self> {
+        if data.len() < M::SIZE {
+            return None;
+        }
+        Some(Self {
+            data,
+            mode: PhantomData,
+        })
+    }
+
+    /// Returns the bytes of the report following the report ID.
+    #[must_use]
+    pub fn data(&self) -> &'a [u8] {
+        // SAFETY: `from_data` only creates reports with at least `M::SIZE` bytes.
+        unsafe { self.data.get_unchecked(..M::SIZE) }
+    }
+
+    /// Returns `size` bytes at `offset`, the data of all reporting modes is within `M::SIZE`.
+    fn bytes_at(&self, offset: usize, size: usize) -> &'a [u8] {
+        debug_assert!(offset + size <= M::SIZE);
+        // SAFETY: `ReportingMode` is sealed and the fields of every reporting mode are asserted
+        // to be within `M::SIZE` at compile time, `from_data` checked that `M::SIZE` bytes are available.
+        unsafe { self.data.get_unchecked(offset..offset + size) }
+    }
+}
+
+impl<M: HasButtons> Report<'_, M> {
+    /// Returns the core button data.
+    #[must_use]
+    pub fn buttons(&self) -> ButtonData {
+        let bytes = self.bytes_at(0, 2);
+        ButtonData::from_bits_retain(u16::from_le_bytes([bytes[0], bytes[1]]))
+    }
+}
+
+impl<M: HasAccelerometer> Report<'_, M> {
+    /// Returns the accelerometer data.
+    #[must_use]
+    pub fn accelerometer(&self) -> AccelerometerData {
+        AccelerometerData::from_normal_reporting(self.bytes_at(0, 5))
+    }
+}
+
+impl<'a, M: HasIr> Report<'a, M> {
+    /// Returns the `M::IR_SIZE` bytes of IR camera data.
+    #[must_use]
+    pub fn ir(&self) -> &'a [u8] {
+        self.bytes_at(M::IR_OFFSET, M::IR_SIZE)
+    }
+
+    /// Returns the decoded IR camera dots, see `ir::decode`.
+    #[must_use]
+    pub fn ir_dots(&self) -> IrDots {
+        ir::decode(M::ID, self.ir()).unwrap_or_default()
+    }
+}
+
+impl<'a, M: HasExtension> Report<'a, M> {
+    /// Returns the `M::EXTENSION_SIZE` bytes of extension data.
+    #[must_use]
+    pub fn extension(&self) -> &'a [u8] {
+        self.bytes_at(M::EXTENSION_OFFSET, M::EXTENSION_SIZE)
+    }
+}
+
+impl From<InputReportRef<'_>> for InputReport {
+    fn from(value: InputReportRef<'_>) -> Self {
+        match value {
+            InputReportRef::StatusInformation(data) => Self::StatusInformation(*data),
+            InputReportRef::ReadMemory(data) => Self::ReadMemory(*data),
+            InputReportRef::Acknowledge(data) => Self::Acknowledge(*data),
+            InputReportRef::DataReport(mode, report) => {
+                let mut data = [0u8; 21];
+                let bytes_to_copy = usize::min(report.data.len(), data.len());
+                data[..bytes_to_copy].copy_from_slice(&report.data[..bytes_to_copy]);
+                Self::DataReport(mode, WiimoteData { data })
+            }
+        }
+    }
+}
+
+/// A report as received from the Wii remote, used to receive many reports without decoding them.
+///
+/// The report can be viewed in place with `RawReport::view` or decoded with `RawReport::decode`.
+#[derive(Debug, Clone, Copy)]
+pub struct RawReport {
+    /// Number of bytes in front of the report ID, the native device reads its framing into the buffer.
+    pub(crate) offset: u8,
+    pub(crate) length: u8,
+    pub(crate) data: [u8; WIIMOTE_DEFAULT_REPORT_BUFFER_SIZE],
+    /// When the native device received the report, as close to the kernel as the platform allows.
+    pub(crate) timestamp: Option<Instant>,
+}
+
+impl RawReport {
+    /// Copies the report starting with the report ID, bytes beyond `WIIMOTE_DEFAULT_REPORT_BUFFER_SIZE` are cut off.
+    #[must_use]
+    pub fn from_bytes(bytes: &[u8]) -> Self {
+        let mut report = Self::default();
+        let length = usize::min(bytes.len(), report.data.len());
+        report.data[..length].copy_from_slice(&bytes[..length]);
+        #[allow(clippy::cast_possible_truncation)]
+        {
+            report.length = length as u8;
+        }
+        report
+    }
+
+    /// Returns the bytes of the report starting with the report ID.
+    #[must_use]
+    pub fn as_bytes(&self) -> &[u8] {
+        let offset = self.offset as usize;
+        &self.data[offset..offset + self.length as usize]
+    }
+
+    /// Returns when the report was received: the kernel receive time of the L2CAP socket on Linux,
+    /// the completion time of the overlapped read on Windows.
+    /// `None` for reports that were not read from a Wii remote, e.g. created with `from_bytes`.
+    #[must_use]
+    pub const fn timestamp(&self) -> Option<Instant> {
+        self.timestamp
+    }
+
+    /// Returns a view of the report that reads its fields directly from this buffer.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the report is empty or not a valid input report.
+    pub fn view(&self) -> WiimoteResult<InputReportRef<'_>> {
+        InputReportRef::try_from(self.as_bytes())
+    }
+
+    /// Returns the report as data report of the reporting mode `M` or `None` if the report has a different mode.
+    #[must_use]
+    pub fn view_as<M: ReportingMode>(&self) -> Option<Report<'_, M>> {
+        Report::new(self.as_bytes())
+    }
+
+    /// Decodes the report as `InputReport`.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the report is empty or not a valid input report.
+    pub fn decode(&self) -> WiimoteResult<InputReport> {
+        self.view().map(InputReport::from)
+    }
+}
+
+impl Default for RawReport {
+    fn default() -> Self {
+        Self {
+            offset: 0,
+            length: 0,
+            data: [0u8; WIIMOTE_DEFAULT_REPORT_BUFFER_SIZE],
+            timestamp: None,
+        }
     }
 }
 
@@ -236,16 +596,7 @@ impl TryFrom<&[u8]> for InputReport {
     type Error = WiimoteError;
 
     fn try_from(value: &[u8]) -> Result<Self, Self::Error> {
-        if value.is_empty() {
-            return Err(WiimoteDeviceError::MissingData.into());
-        }
-        match value[0] {
-            STATUS_ID => Self::from_status_information(value),
-            READ_MEMORY_ID => Self::from_read_memory_data(value),
-            ACKNOWLEDGE_ID => Self::from_acknowledge(value),
-            0x30..=0x3F => Ok(Self::from_data_report(value)),
-            _ => Err(WiimoteDeviceError::InvalidData.into()),
-        }
+        InputReportRef::try_from(value).map(Self::from)
     }
 }
 
@@ -346,4 +697,60 @@ mod tests {
             );
         }
     }
+
+    #[test]
+    fn test_raw_report_view_skips_offset() {
+        let mut report = RawReport::default();
+        report.data[..4].copy_from_slice(&[0xA1, 0x30, 0b0000_1000, 0b0000_0000]);
+        report.offset = 1;
+        report.length = 3;
+
+        let view = report.view().unwrap();
+
+        assert!(matches!(view, InputReportRef::DataReport(0x30, _)));
+        assert_eq!(
+            view.buttons().map(|buttons| buttons.bits()),
+            Some(ButtonData::UP.bits())
+        );
+    }
+
+    #[test]
+    fn test_data_report_ref_mode_0x37() {
+        let mut data = [0u8; 22];
+        data[0] = 0x37;
+        data[3..6].copy_from_slice(&[0x80, 0x81, 0x82]); // Accelerometer
+        data[6..16].fill(0x11); // IR
+        data[16..22].fill(0x22); // Extension
+
+        let Ok(InputReportRef::DataReport(_, report)) = InputReportRef::try_from(&data[..]) else {
+            panic!("Expected data report");
+        };
+
+        assert!(report.accelerometer().is_some());
+        assert_eq!(report.ir_bytes(), Some(&[0x11; 10][..]));
+        assert_eq!(report.extension_bytes(), Some(&[0x22; 6][..]));
+    }
+
+    #[test]
+    fn test_truncated_status_report() {
+        let data: &[u8] = &[0x20, 0x00, 0x00];
+
+        assert!(InputReportRef::try_from(data).is_err());
+        assert!(InputReport::try_from(data).is_err());
+    }
+
+    #[test]
+    fn test_typed_report_mode_0x35() {
+        let mut data = [0u8; 22];
+        data[0] = 0x35;
+        data[1] = 0b0001_0000; // Plus
+        data[6..22].fill(0x33); // Extension
+
+        let report = Report::<Mode0x35>::new(&data).unwrap();
+
+        assert_eq!(report.buttons().bits(), ButtonData::PLUS.bits());
+        assert_eq!(report.extension(), &[0x33; 16][..]);
+        assert!(Report::<Mode0x37>::new(&data).is_none());
+        assert!(Report::<Mode0x35>::new(&data[..21]).is_none());
+    }
 }
@@ -0,0 +1,390 @@
+use crate::output::{Addressing, OutputReport};
+use crate::prelude::*;
+use crate::simple_io::{self, MemoryRequest};
+
+/// Width of the IR camera image, the x coordinate of a dot is within 0..1024.
+pub const IR_CAMERA_WIDTH: u16 = 1024;
+/// Height of the IR camera image, the y coordinate of a dot is within 0..768.
+pub const IR_CAMERA_HEIGHT: u16 = 768;
+
+/// The up to four dots tracked by the IR camera, `None` for dots not seen.
+pub type IrDots = [Option<IrDot>; 4];
+
+/// The data format of the IR camera, must match the data reporting mode.
+///
+/// WiiBrew Documentation: <https://www.wiibrew.org/wiki/Wiimote#Data_Formats>
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum IrMode {
+    /// Position of the dots, 10 bytes in reporting modes 0x36 and 0x37.
+    Basic,
+    /// Position and size of the dots, 12 bytes in reporting mode 0x33.
+    Extended,
+    /// Position, size, bounding box and intensity, 36 bytes in the interleaved modes 0x3e and 0x3f.
+    Full,
+}
+
+impl IrMode {
+    const fn register_value(self) -> u8 {
+        match self {
+            Self::Basic => 1,
+            Self::Extended => 3,
+            Self::Full => 5,
+        }
+    }
+}
+
+/// The sensitivity settings of the IR camera, written to the two sensitivity blocks.
+///
+/// WiiBrew Documentation: <https://www.wiibrew.org/wiki/Wiimote#Sensitivity_Settings>
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum IrSensitivity {
+    /// Least sensitive preset of the Wii.
+    Level1,
+    Level2,
+    /// Default preset of the Wii.
+    Level3,
+    Level4,
+    /// Most sensitive preset of the Wii.
+    Level5,
+    /// High sensitivity suggested by Marcan.
+    Marcan,
+    /// Custom contents of the 9 byte block at 0xB00000 and the 2 byte block at 0xB0001A.
+    Custom([u8; 9], [u8; 2]),
+}
+
+impl IrSensitivity {
+    /// Returns the contents of the two sensitivity blocks.
+    #[must_use]
+    pub const fn blocks(&self) -> ([u8; 9], [u8; 2]) {
+        match self {
+            Self::Level1 => (
+                [0x02, 0x00, 0x00, 0x71, 0x01, 0x00, 0x64, 0x00, 0xFE],
+                [0xFD, 0x05],
+            ),
+            Self::Level2 => (
+                [0x02, 0x00, 0x00, 0x71, 0x01, 0x00, 0x96, 0x00, 0xB4],
+                [0xB3, 0x04],
+            ),
+            Self::Level3 => (
+                [0x02, 0x00, 0x00, 0x71, 0x01, 0x00, 0xAA, 0x00, 0x64],
+                [0x63, 0x03],
+            ),
+            Self::Level4 => (
+                [0x02, 0x00, 0x00, 0x71, 0x01, 0x00, 0xC8, 0x00, 0x36],
+                [0x35, 0x03],
+            ),
+            Self::Level5 => (
+                [0x07, 0x00, 0x00, 0x71, 0x01, 0x00, 0x72, 0x00, 0x20],
+                [0x1F, 0x03],
+            ),
+            Self::Marcan => (
+                [0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x90, 0x00, 0xC0],
+                [0x40, 0x00],
+            ),
+            Self::Custom(first, second) => (*first, *second),
+        }
+    }
+}
+
+impl Default for IrSensitivity {
+    fn default() -> Self {
+        Self::Level3
+    }
+}
+
+/// Number of times the setup sequence is started over after a register write timed out.
+const INITIALIZATION_ATTEMPTS: usize = 5;
+
+/// Writes up to 16 bytes to the IR camera registers.
+fn register_write(address: u32, bytes: &[u8]) -> MemoryRequest {
+    let mut data = [0u8; 16];
+    data[..bytes.len()].copy_from_slice(bytes);
+    #[allow(clippy::cast_possible_truncation)]
+    MemoryRequest::Write(
+        Addressing::control_registers(address, bytes.len() as u16),
+        data,
+    )
+}
+
+/// Enables the IR camera with the data format `mode` and the `sensitivity` settings.
+/// The registers only configure the camera if they are written in order, every write is sent once the
+/// previous one was acknowledged and the whole sequence is started over if a write timed out.
+/// The data reporting mode must be set separately.
+///
+/// WiiBrew Documentation: <https://www.wiibrew.org/wiki/Wiimote#Initialization>
+///
+/// # Errors
+///
+/// This function will return an error if the Wii remote is disconnected or did not acknowledge a write.
+pub fn enable(
+    wiimote: &WiimoteDevice,
+    mode: IrMode,
+    sensitivity: IrSensitivity,
+) -> WiimoteResult<()> {
+    let (first_block, second_block) = sensitivity.blocks();
+    let requests = [
+        register_write(0xB0_0030, &[0x08]),
+        register_write(0xB0_0000, &first_block),
+        register_write(0xB0_001A, &second_block),
+        register_write(0xB0_0033, &[mode.register_value()]),
+        register_write(0xB0_0030, &[0x08]),
+    ];
+    for attempt in 0..INITIALIZATION_ATTEMPTS {
+        if attempt > 0 {
+            wiimote.connection().metrics().memory_retries.add(1);
+        }
+        wiimote.write(&OutputReport::IrCameraEnable(true))?;
+        wiimote.write(&OutputReport::IrCameraEnable2(true))?;
+        match simple_io::send_in_order(wiimote, &requests) {
+            Err(WiimoteError::Timeout) => {}
+            result => return result,
+        }
+    }
+    Err(WiimoteError::Timeout)
+}
+
+/// Disables the IR camera.
+///
+/// # Errors
+///
+/// This function will return an error if the Wii remote is disconnected.
+pub fn disable(wiimote: &WiimoteDevice) -> WiimoteResult<()> {
+    wiimote.write(&OutputReport::IrCameraEnable(false))?;
+    wiimote.write(&OutputReport::IrCameraEnable2(false))
+}
+
+/// A dot tracked by the IR camera.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct IrDot {
+    /// Horizontal position within 0..`IR_CAMERA_WIDTH`.
+    pub x: u16,
+    /// Vertical position within 0..`IR_CAMERA_HEIGHT`.
+    pub y: u16,
+    /// Rough size of the dot from 0 to 15, 0 in the basic format.
+    pub size: u8,
+    /// Intensity of the dot, only reported in the full format.
+    pub intensity: u8,
+}
+
+/// Decodes the IR bytes of a data report of reporting mode `mode`, see `DataReportRef::ir_dots`.
+///
+/// The interleaved modes 0x3e and 0x3f contain two dots each,
+/// 0x3e the first two and 0x3f the last two of the returned dots.
+#[must_use]
+pub fn decode(mode: u8, bytes: &[u8]) -> Option<IrDots> {
+    let mut dots = [None; 4];
+    match mode {
+        0x36 | 0x37 => {
+            let bytes = bytes.get(..10)?;
+            for (pair, dots) in bytes.chunks_exact(5).zip(dots.chunks_exact_mut(2)) {
+                let high = u16::from(pair[2]);
+                dots[0] = dot(
+                    u16::from(pair[0]) | (high >> 4 & 0b11) << 8,
+                    u16::from(pair[1]) | (high >> 6 & 0b11) << 8,
+                    0,
+                    0,
+                );
+                dots[1] = dot(
+                    u16::from(pair[3]) | (high & 0b11) << 8,
+                    u16::from(pair[4]) | (high >> 2 & 0b11) << 8,
+                    0,
+                    0,
+                );
+            }
+        }
+        0x33 => {
+            let bytes = bytes.get(..12)?;
+            for (object, dot) in bytes.chunks_exact(3).zip(&mut dots) {
+                *dot = extended_dot(object, 0);
+            }
+        }
+        0x3E | 0x3F => {
+            let bytes = bytes.get(..18)?;
+            let offset = if mode == 0x3E { 0 } else { 2 };
+            for (object, dot) in bytes.chunks_exact(9).zip(&mut dots[offset..]) {
+                *dot = extended_dot(&object[..3], object[8]);
+            }
+        }
+        _ => return None,
+    }
+    Some(dots)
+}
+
+/// Decodes the 3 bytes of a dot in the extended format, the first 3 bytes of the full format.
+fn extended_dot(object: &[u8], intensity: u8) -> Option<IrDot> {
+    let high = u16::from(object[2]);
+    dot(
+        u16::from(object[0]) | (high >> 4 & 0b11) << 8,
+        u16::from(object[1]) | (high >> 6 & 0b11) << 8,
+        object[2] & 0x0F,
+        intensity,
+    )
+}
+
+/// Returns the dot or `None` for the all ones position of dots that are not seen.
+const fn dot(x: u16, y: u16, size: u8, intensity: u8) -> Option<IrDot> {
+    if x == 0x3FF && y == 0x3FF {
+        None
+    } else {
+        Some(IrDot {
+            x,
+            y,
+            size,
+            intensity,
+        })
+    }
+}
+
+/// The point on the screen the Wii remote points at, computed from the two dots of the sensor bar.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct IrPointer {
+    /// Horizontal position from 0.0 (left) to 1.0 (right) when pointing within the field of view of the camera.
+    pub x: f32,
+    /// Vertical position from 0.0 (top) to 1.0 (bottom) when pointing within the field of view of the camera.
+    pub y: f32,
+    /// Rotation of the Wii remote around its long axis in radians, from the angle between the dots.
+    pub roll: f32,
+    /// Distance between the two dots in camera pixels, decreases with the distance to the sensor bar.
+    pub dot_distance: f32,
+}
+
+impl IrPointer {
+    /// Computes the pointer from the two largest visible dots, `None` if less than two dots are visible.
+    /// The roll of the Wii remote is compensated, so rotating it does not move the pointer.
+    #[must_use]
+    pub fn from_dots(dots: &IrDots) -> Option<Self> {
+        let mut first: Option<IrDot> = None;
+        let mut second: Option<IrDot> = None;
+        for dot in dots.iter().flatten() {
+            if !matches!(first, Some(first) if dot.size <= first.size) {
+                second = first;
+                first = Some(*dot);
+            } else if !matches!(second, Some(second) if dot.size <= second.size) {
+                second = Some(*dot);
+            }
+        }
+        let (mut left, mut right) = (first?, second?);
+        if left.x > right.x {
+            std::mem::swap(&mut left, &mut right);
+        }
+
+        let (dx, dy) = (
+            f32::from(right.x) - f32::from(left.x),
+            f32::from(right.y) - f32::from(left.y),
+        );
+        let roll = dy.atan2(dx);
+        let (center_x, center_y) = (
+            f32::from(IR_CAMERA_WIDTH) / 2.0,
+            f32::from(IR_CAMERA_HEIGHT) / 2.0,
+        );
+        // Rotate the midpoint of the dots around the center of the image by the roll
+        let (mx, my) = (
+            (f32::from(left.x) + f32::from(right.x)) / 2.0 - center_x,
+            (f32::from(left.y) + f32::from(right.y)) / 2.0 - center_y,
+        );
+        let (sin, cos) = (-roll).sin_cos();
+        let (rx, ry) = (mx * cos - my * sin, mx * sin + my * cos);
+
+        // The image of the sensor bar moves in the opposite direction of the pointer
+        Some(Self {
+            x: 0.5 - rx / f32::from(IR_CAMERA_WIDTH),
+            y: 0.5 - ry / f32::from(IR_CAMERA_HEIGHT),
+            roll,
+            dot_distance: dx.hypot(dy),
+        })
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_decode_basic() {
+        // Dot 1 at (0x155, 0x2AA), dot 2 at (0x3FF, 0x3FF) not seen, dot 3 at (0x012, 0x034)
+        let bytes = [
+            0x55,
+            0xAA,
+            0b1001_1111,
+            0xFF,
+            0xFF,
+            0x12,
+            0x34,
+            0b0000_1111,
+            0xFF,
+            0xFF,
+        ];
+        let dots = decode(0x37, &bytes).unwrap();
+        assert_eq!(
+            dots,
+            [
+                Some(IrDot {
+                    x: 0x155,
+                    y: 0x2AA,
+                    ..IrDot::default()
+                }),
+                None,
+                Some(IrDot {
+                    x: 0x012,
+                    y: 0x034,
+                    ..IrDot::default()
+                }),
+                None,
+            ]
+        );
+    }
+
+    #[test]
+    fn test_decode_extended_and_full() {
+        let mut bytes = [0xFFu8; 18];
+        bytes[..3].copy_from_slice(&[0x00, 0x80, 0b0110_0101]);
+        let expected = IrDot {
+            x: 0x200,
+            y: 0x180,
+            size: 5,
+            intensity: 0,
+        };
+        assert_eq!(decode(0x33, &bytes[..12]).unwrap()[0], Some(expected));
+
+        bytes[8] = 0x42;
+        let dots = decode(0x3F, &bytes).unwrap();
+        assert_eq!(dots[..2], [None, None]);
+        assert_eq!(
+            dots[2],
+            Some(IrDot {
+                intensity: 0x42,
+                ..expected
+            })
+        );
+        assert_eq!(dots[3], None);
+    }
+
+    #[test]
+    fn test_pointer_compensates_roll() {
+        let at = |x, y| {
+            Some(IrDot {
+                x,
+                y,
+                size: 3,
+                intensity: 0,
+            })
+        };
+        let level = IrPointer::from_dots(&[at(412, 384), at(612, 384), None, None]).unwrap();
+        assert!((level.x - 0.5).abs() < 1e-6 && (level.y - 0.5).abs() < 1e-6);
+        assert!(level.roll.abs() < 1e-6);
+
+        // The same dots rotated by 45 degrees around the center of the image
+        let offset = 100.0 * std::f32::consts::FRAC_1_SQRT_2;
+        #[allow(clippy::cast_possible_truncation, clippy::cast_sign_loss)]
+        let rotated = IrPointer::from_dots(&[
+            at((512.0 - offset) as u16, (384.0 - offset) as u16),
+            at((512.0 + offset) as u16, (384.0 + offset) as u16),
+            None,
+            None,
+        ])
+        .unwrap();
+        assert!((rotated.x - 0.5).abs() < 1e-2 && (rotated.y - 0.5).abs() < 1e-2);
+        assert!((rotated.roll - std::f32::consts::FRAC_PI_4).abs() < 1e-2);
+        assert!(IrPointer::from_dots(&[at(100, 100), None, None, None]).is_none());
+    }
+}
@@ -1,21 +1,57 @@
 #![allow(clippy::module_name_repetitions)]
 
+mod background;
+mod cache;
 mod calibration;
+pub mod capture;
+pub mod delta;
 mod device;
+#[cfg(feature = "async")]
+mod driver;
 pub mod extensions;
+pub mod fusion;
 pub mod input;
+pub mod ir;
 mod manager;
+#[cfg(feature = "metrics")]
+pub mod metrics;
+#[cfg(not(feature = "metrics"))]
+mod metrics;
+#[cfg(feature = "mock")]
+pub mod mock;
 mod native;
 pub mod output;
+mod pool;
+mod reactor;
 mod result;
+mod ring;
+mod scheduler;
+mod seqlock;
 mod simple_io;
+pub mod speaker;
+mod transaction;
 
 pub const WIIMOTE_DEFAULT_REPORT_BUFFER_SIZE: usize = 32;
 
+// Only exported for the benchmarks
+#[doc(hidden)]
+pub use crate::calibration::normalize;
+
 pub mod prelude {
+    pub use crate::background::BackgroundIo;
+    pub use crate::cache::CalibrationCache;
+    pub use crate::calibration::{
+        fixed_point_to_f32, AxisScale, FixedPointScale, FIXED_POINT_BITS,
+    };
     pub use crate::device::{AccelerometerCalibration, AccelerometerData, WiimoteDevice};
+    #[cfg(feature = "async")]
+    pub use crate::driver::{OutputWrite, ReportStream};
     pub use crate::extensions::motion_plus::*;
-    pub use crate::manager::WiimoteManager;
+    pub use crate::manager::{ScanMode, WiimoteManager};
+    pub use crate::pool::{player_led, DevicePool, PoolSnapshot, POOL_SLOTS};
+    pub use crate::reactor::{ReactorEvent, WiimoteReactor};
     pub use crate::result::*;
+    pub use crate::scheduler::{OutputBudget, OutputScheduler};
+    pub use crate::transaction::{MemoryTransaction, TransactionResult};
     pub use crate::WIIMOTE_DEFAULT_REPORT_BUFFER_SIZE;
 }
@@ -1,19 +1,47 @@
 use std::collections::HashMap;
-use std::sync::{Arc, Mutex};
+use std::sync::{Arc, Mutex, MutexGuard};
+use std::thread::JoinHandle;
 use std::time::Duration;
 
 use once_cell::sync::Lazy;
 
+use crate::cache::CalibrationCache;
 use crate::device::WiimoteDevice;
-use crate::native::{wiimotes_scan, wiimotes_scan_cleanup, NativeWiimote};
+use crate::metrics::{Timer, SCAN_METRICS};
+use crate::native::{
+    wiimotes_scan, wiimotes_scan_cleanup, NativeHotplug, NativeWiimote, NativeWiimoteDevice,
+    NativeWiimoteHotplug,
+};
+
+/// Interval of the fallback scan in every `ScanMode` while hotplug notifications are available,
+/// other scans only run when the platform notifies of a Wii remote.
+const HOTPLUG_FALLBACK_INTERVAL: Duration = Duration::from_secs(5);
 
 type MutexWiimoteDevice = Arc<Mutex<WiimoteDevice>>;
+type NewDevicesSender = crossbeam_channel::Sender<MutexWiimoteDevice>;
+
+/// How the `WiimoteManager` scans for Wii remotes.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub enum ScanMode {
+    /// Search for nearby Wii remotes with Bluetooth inquiries.
+    #[default]
+    Discover,
+    /// Only reconnect disconnected Wii remotes that were connected before, without an inquiry.
+    FastReconnect,
+}
 
 /// Manages connections to Wii remotes.
-/// Periodically checks for new connections of Wii remotes.
+/// Periodically checks for new connections of Wii remotes, and immediately when the platform
+/// notifies of a Wii remote becoming available.
+///
+/// The scan runs without locking the manager, found Wii remotes are connected and sent to
+/// `new_devices_receiver` as soon as they are initialized.
 pub struct WiimoteManager {
-    seen_devices: HashMap<String, MutexWiimoteDevice>,
+    /// The devices by identifier, the key is shared with the `WiimoteDevice`.
+    seen_devices: HashMap<Arc<str>, MutexWiimoteDevice>,
     scan_interval: Duration,
+    scan_mode: ScanMode,
+    calibration_cache: Option<Arc<CalibrationCache>>,
     new_devices_receiver: crossbeam_channel::Receiver<MutexWiimoteDevice>,
 }
 
@@ -39,16 +67,35 @@ impl WiimoteManager {
     }
 
     /// Set the interval at which the manager scans for Wii remotes.
+    /// With hotplug notifications, Wii remotes are connected on notification
+    /// and the periodic scan is only a fallback of at least 5 seconds in every `ScanMode`.
     pub fn set_scan_interval(&mut self, scan_interval: Duration) {
         self.scan_interval = scan_interval;
     }
 
+    /// Set how the manager scans for Wii remotes.
+    pub fn set_scan_mode(&mut self, scan_mode: ScanMode) {
+        self.scan_mode = scan_mode;
+    }
+
+    /// Set the cache for the calibration and extension identity of the Wii remotes.
+    /// Reconnects of cached Wii remotes use the cached data instead of waiting for the Wii remote.
+    pub fn set_calibration_cache(&mut self, calibration_cache: Option<Arc<CalibrationCache>>) {
+        self.calibration_cache = calibration_cache;
+    }
+
     /// Collection of Wii remotes that are connected or have been connected previously.
+    /// Allocates a new `Vec` on every call, see `seen_devices_iter`.
     #[must_use]
     pub fn seen_devices(&self) -> Vec<MutexWiimoteDevice> {
         self.seen_devices.values().map(Arc::clone).collect()
     }
 
+    /// Iterates the Wii remotes that are connected or have been connected previously, without allocating.
+    pub fn seen_devices_iter(&self) -> impl Iterator<Item = &MutexWiimoteDevice> + '_ {
+        self.seen_devices.values()
+    }
+
     /// Receiver of newly connected Wii remotes.
     #[must_use]
     pub fn new_devices_receiver(&self) -> crossbeam_channel::Receiver<MutexWiimoteDevice> {
@@ -56,38 +103,42 @@ impl WiimoteManager {
     }
 
     fn new_with_interval(scan_interval: Duration) -> Arc<Mutex<Self>> {
-        let (new_devices_sender, new_devices_receiver) = crossbeam_channel::unbounded();
-
-        let manager = Arc::new(Mutex::new(Self {
-            seen_devices: HashMap::new(),
-            scan_interval,
-            new_devices_receiver,
-        }));
+        let (manager, new_devices_sender) = Self::new_unstarted(scan_interval);
 
         let weak_manager = Arc::downgrade(&manager);
         std::thread::Builder::new()
             .name("wii-remote-scan".to_string())
             .spawn(move || {
+                let mut hotplug = match NativeWiimoteHotplug::new() {
+                    Ok(hotplug) => Some(hotplug),
+                    Err(error) => {
+                        eprintln!(
+                            "Failed to listen for Wii remotes, scanning periodically: {error}"
+                        );
+                        None
+                    }
+                };
+                let mut buffers = ScanBuffers::default();
                 while let Some(manager) = weak_manager.upgrade() {
+                    if !Self::scan_once(&manager, &mut buffers, &new_devices_sender) {
+                        // Channel is disconnected, end scan thread
+                        return;
+                    }
+
                     let interval = {
-                        let mut manager = match manager.lock() {
-                            Ok(m) => m,
-                            Err(m) => m.into_inner(),
-                        };
-
-                        let new_devices = manager.scan();
-                        let send_result = new_devices
-                            .into_iter()
-                            .try_for_each(|device| new_devices_sender.send(device));
-                        if send_result.is_err() {
-                            // Channel is disconnected, end scan thread
-                            return;
+                        let manager = lock_manager(&manager);
+                        if hotplug.is_some() {
+                            manager.scan_interval.max(HOTPLUG_FALLBACK_INTERVAL)
+                        } else {
+                            manager.scan_interval
                         }
-
-                        manager.scan_interval
                     };
-
-                    std::thread::sleep(interval);
+                    drop(manager);
+                    match &mut hotplug {
+                        // Scans again early when a Wii remote became available
+                        Some(hotplug) => _ = hotplug.wait(interval),
+                        None => std::thread::sleep(interval),
+                    }
                 }
             })
             .expect("Failed to spawn Wii remote scan thread");
@@ -95,32 +146,292 @@ impl WiimoteManager {
         manager
     }
 
-    /// Scan for connected Wii remotes.
-    fn scan(&mut self) -> Vec<MutexWiimoteDevice> {
-        let mut native_devices = Vec::new();
-        wiimotes_scan(&mut native_devices);
+    /// Creates the manager without starting the scan thread.
+    fn new_unstarted(scan_interval: Duration) -> (Arc<Mutex<Self>>, NewDevicesSender) {
+        let (new_devices_sender, new_devices_receiver) = crossbeam_channel::unbounded();
+        let manager = Arc::new(Mutex::new(Self {
+            seen_devices: HashMap::new(),
+            scan_interval,
+            scan_mode: ScanMode::default(),
+            calibration_cache: None,
+            new_devices_receiver,
+        }));
+        (manager, new_devices_sender)
+    }
+
+    /// Runs a single scan with the current scan mode, returns `false` if the new devices channel is disconnected.
+    fn scan_once(
+        manager: &Arc<Mutex<Self>>,
+        buffers: &mut ScanBuffers,
+        new_devices_sender: &NewDevicesSender,
+    ) -> bool {
+        let scan_mode = {
+            let manager = lock_manager(manager);
+            manager.disconnected_identifiers(&mut buffers.known_identifiers);
+            manager.stale_devices(&mut buffers.stale_devices);
+            manager.scan_mode
+        };
+        Self::refresh(&mut buffers.stale_devices);
 
-        let mut new_devices = Vec::new();
+        let timer = Timer::start();
+        let is_connected = Self::scan(manager, scan_mode, buffers, new_devices_sender);
+        SCAN_METRICS.scans.increment();
+        SCAN_METRICS.scan.record(timer);
+        is_connected
+    }
+
+    /// Replaces `identifiers` with the identifiers of the seen Wii remotes that are currently disconnected.
+    fn disconnected_identifiers(&self, identifiers: &mut Vec<Arc<str>>) {
+        identifiers.clear();
+        identifiers.extend(
+            self.seen_devices
+                .iter()
+                // A locked device is in use, so it is connected
+                .filter(
+                    |(_, device)| matches!(device.try_lock(), Ok(device) if !device.is_connected()),
+                )
+                .map(|(identifier, _)| Arc::clone(identifier)),
+        );
+    }
 
-        for native_wiimote in native_devices {
-            let identifier = native_wiimote.identifier();
-            if let Some(existing_device) = self.seen_devices.get(&identifier) {
-                let result = existing_device.lock().unwrap().reconnect(native_wiimote);
-                if let Err(error) = result {
-                    eprintln!("Failed to reconnect wiimote: {error:?}");
+    /// Replaces `devices` with the seen Wii remotes whose cached data no longer matched.
+    fn stale_devices(&self, devices: &mut Vec<MutexWiimoteDevice>) {
+        devices.clear();
+        devices.extend(
+            self.seen_devices
+                .values()
+                .filter(|device| matches!(device.try_lock(), Ok(device) if device.needs_refresh()))
+                .map(Arc::clone),
+        );
+    }
+
+    /// Reads the calibration and extension identity of the stale Wii remotes again without locking the manager.
+    fn refresh(devices: &mut Vec<MutexWiimoteDevice>) {
+        for device in devices.drain(..) {
+            // A locked device is in use, it is refreshed by a later scan
+            let Ok(mut device) = device.try_lock() else {
+                continue;
+            };
+            if device.needs_refresh() {
+                if let Err(error) = device.refresh() {
+                    eprintln!("Failed to refresh wiimote: {error:?}");
                 }
-            } else {
-                match WiimoteDevice::new(native_wiimote) {
-                    Ok(device) => {
-                        let new_device = Arc::new(Mutex::new(device));
-                        new_devices.push(Arc::clone(&new_device));
-                        self.seen_devices.insert(identifier, new_device);
-                    }
-                    Err(error) => eprintln!("Failed to connect to wiimote: {error:?}"),
+            }
+        }
+    }
+
+    /// Scan for connected Wii remotes without locking the manager.
+    /// The found Wii remotes are initialized concurrently, each initialization waits for several round-trips.
+    ///
+    /// Returns `false` if the new devices channel is disconnected.
+    fn scan(
+        manager: &Arc<Mutex<Self>>,
+        scan_mode: ScanMode,
+        buffers: &mut ScanBuffers,
+        new_devices_sender: &NewDevicesSender,
+    ) -> bool {
+        let ScanBuffers {
+            known_identifiers,
+            connections,
+            ..
+        } = buffers;
+        // Threads are only started for found Wii remotes, a scan without new Wii remotes does not allocate
+        wiimotes_scan(scan_mode, known_identifiers, &mut |native_wiimote| {
+            let manager = Arc::clone(manager);
+            let new_devices_sender = new_devices_sender.clone();
+            connections.push(std::thread::spawn(move || {
+                match Self::connect(&manager, native_wiimote) {
+                    Some(device) => new_devices_sender.send(device).is_ok(),
+                    None => true,
                 }
+            }));
+        });
+        connections
+            .drain(..)
+            .fold(true, |is_connected, connection| {
+                connection.join().unwrap_or(true) && is_connected
+            })
+    }
+
+    /// Reconnects a seen Wii remote or initializes a new one, returns the new device.
+    fn connect(
+        manager: &Mutex<Self>,
+        native_wiimote: NativeWiimoteDevice,
+    ) -> Option<MutexWiimoteDevice> {
+        let (existing_device, calibration_cache) = {
+            let manager = lock_manager(manager);
+            (
+                manager
+                    .seen_devices
+                    .get(native_wiimote.identifier())
+                    .map(Arc::clone),
+                manager.calibration_cache.clone(),
+            )
+        };
+
+        if let Some(existing_device) = existing_device {
+            let mut existing_device = existing_device.lock().unwrap();
+            existing_device.set_calibration_cache(calibration_cache);
+            let result = existing_device.reconnect(native_wiimote);
+            if let Err(error) = result {
+                SCAN_METRICS.connect_errors.increment();
+                eprintln!("Failed to reconnect wiimote: {error:?}");
+            }
+            return None;
+        }
+
+        match WiimoteDevice::new(native_wiimote, calibration_cache) {
+            Ok(device) => {
+                let identifier = device.shared_identifier();
+                let new_device = Arc::new(Mutex::new(device));
+                lock_manager(manager)
+                    .seen_devices
+                    .insert(identifier, Arc::clone(&new_device));
+                Some(new_device)
+            }
+            Err(error) => {
+                SCAN_METRICS.connect_errors.increment();
+                eprintln!("Failed to connect to wiimote: {error:?}");
+                None
             }
         }
+    }
+}
+
+/// Buffers of the scan thread, reused by every scan.
+#[derive(Default)]
+struct ScanBuffers {
+    known_identifiers: Vec<Arc<str>>,
+    /// The seen Wii remotes that are refreshed before the current scan.
+    stale_devices: Vec<MutexWiimoteDevice>,
+    /// The threads initializing the Wii remotes found by the current scan.
+    connections: Vec<JoinHandle<bool>>,
+}
+
+fn lock_manager(manager: &Mutex<WiimoteManager>) -> MutexGuard<'_, WiimoteManager> {
+    match manager.lock() {
+        Ok(m) => m,
+        Err(m) => m.into_inner(),
+    }
+}
+
+#[cfg(all(test, feature = "mock"))]
+mod tests {
+    use std::alloc::{GlobalAlloc, Layout, System};
+    use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+
+    use super::*;
+    use crate::input::RawReport;
+    use crate::mock::MockWiimote;
+    use crate::output::OutputReport;
+
+    /// Counts the allocations of every thread while `COUNTING` is set, including background threads.
+    struct CountingAllocator;
+
+    static COUNTING: AtomicBool = AtomicBool::new(false);
+    static ALLOCATIONS: AtomicUsize = AtomicUsize::new(0);
+
+    impl CountingAllocator {
+        fn count() {
+            if COUNTING.load(Ordering::Relaxed) {
+                ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+            }
+        }
+    }
+
+    unsafe impl GlobalAlloc for CountingAllocator {
+        unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+            Self::count();
+            System.alloc(layout)
+        }
+
+        unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+            System.dealloc(ptr, layout);
+        }
 
-        new_devices
+        unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+            Self::count();
+            System.realloc(ptr, layout, new_size)
+        }
+    }
+
+    #[global_allocator]
+    static ALLOCATOR: CountingAllocator = CountingAllocator;
+
+    /// Set in the test process started by `in_own_process`.
+    const OWN_PROCESS_VARIABLE: &str = "WIIMOTE_TEST_OWN_PROCESS";
+
+    /// Returns whether the caller is the test process started for `test`, otherwise runs only `test`
+    /// in a new process of the test binary and asserts it passed.
+    /// Allocations are counted process wide, the tests running in parallel would be counted too.
+    fn in_own_process(test: &str) -> bool {
+        if std::env::var_os(OWN_PROCESS_VARIABLE).is_some() {
+            return true;
+        }
+        let status = std::process::Command::new(std::env::current_exe().unwrap())
+            .args([test, "--exact", "--test-threads=1"])
+            .env(OWN_PROCESS_VARIABLE, "1")
+            .status()
+            .unwrap();
+        assert!(status.success(), "{test} failed in its own process");
+        false
+    }
+
+    /// Returns the number of allocations of every thread made while `f` runs.
+    fn count_allocations(f: impl FnOnce()) -> usize {
+        let before = ALLOCATIONS.load(Ordering::Relaxed);
+        COUNTING.store(true, Ordering::SeqCst);
+        f();
+        COUNTING.store(false, Ordering::SeqCst);
+        ALLOCATIONS.load(Ordering::Relaxed) - before
+    }
+
+    #[test]
+    fn test_steady_state_does_not_allocate() {
+        if !in_own_process("manager::tests::test_steady_state_does_not_allocate") {
+            return;
+        }
+        let (manager, new_devices_sender) = WiimoteManager::new_unstarted(Duration::from_secs(1));
+        lock_manager(&manager).set_scan_mode(ScanMode::FastReconnect);
+
+        let mock = MockWiimote::connect("allocations-connected");
+        let native = NativeWiimoteDevice::take(&mock);
+        let device = WiimoteManager::connect(&manager, native).unwrap();
+        let disconnected_mock = MockWiimote::connect("allocations-disconnected");
+        let native = NativeWiimoteDevice::take(&disconnected_mock);
+        let disconnected = WiimoteManager::connect(&manager, native).unwrap();
+        disconnected_mock.disconnect();
+        assert!(disconnected.lock().unwrap().read_timeout(0).is_err());
+
+        let poll = |buffers: &mut ScanBuffers, reports: &mut [RawReport]| {
+            assert!(WiimoteManager::scan_once(
+                &manager,
+                buffers,
+                &new_devices_sender
+            ));
+            let manager = lock_manager(&manager);
+            assert_eq!(manager.seen_devices_iter().count(), 2);
+            for device in manager.seen_devices_iter() {
+                assert!(!device.lock().unwrap().identifier().is_empty());
+            }
+
+            let device = device.lock().unwrap();
+            assert!(mock.send_report(&[0x30, 0x00, 0x08]));
+            assert_eq!(device.read_batch(reports).unwrap(), 1);
+            device.write(&OutputReport::StatusRequest).unwrap();
+            assert_eq!(device.read_batch(reports).unwrap(), 1);
+        };
+
+        let mut buffers = ScanBuffers::default();
+        let mut reports = [RawReport::default(); 4];
+        // The first iteration fills the reused buffers
+        poll(&mut buffers, &mut reports);
+        let allocations = count_allocations(|| {
+            for _ in 0..10 {
+                poll(&mut buffers, &mut reports);
+            }
+        });
+        assert_eq!(allocations, 0);
+        assert_eq!(buffers.known_identifiers.len(), 1);
     }
 }
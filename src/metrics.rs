@@ -0,0 +1,330 @@
+#[cfg(feature = "metrics")]
+use std::sync::atomic::{AtomicU64, Ordering};
+#[cfg(feature = "metrics")]
+use std::time::{Duration, Instant};
+
+use once_cell::sync::Lazy;
+
+/// Bits of the value kept in every bucket, the relative error of a recorded duration is below 2^-3.
+#[cfg(feature = "metrics")]
+const SUB_BUCKET_BITS: u32 = 3;
+/// Durations are recorded in microseconds up to 2^32 µs (about 71 minutes).
+#[cfg(feature = "metrics")]
+const MAX_VALUE_BITS: u32 = 32;
+/// Buckets of exact values below 2^SUB_BUCKET_BITS, then 2^SUB_BUCKET_BITS buckets per power of two.
+#[cfg(feature = "metrics")]
+pub const HISTOGRAM_BUCKETS: usize =
+    ((MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) as usize;
+
+/// Counts events, compiles to nothing without the `metrics` feature.
+#[derive(Debug, Default)]
+pub(crate) struct Counter(#[cfg(feature = "metrics")] AtomicU64);
+
+impl Counter {
+    #[inline]
+    pub(crate) fn add(&self, value: usize) {
+        #[cfg(feature = "metrics")]
+        self.0.fetch_add(value as u64, Ordering::Relaxed);
+        #[cfg(not(feature = "metrics"))]
+        let _ = value;
+    }
+
+    #[inline]
+    pub(crate) fn increment(&self) {
+        self.add(1);
+    }
+
+    #[cfg(feature = "metrics")]
+    fn get(&self) -> u64 {
+        self.0.load(Ordering::Relaxed)
+    }
+}
+
+/// The start of a measured duration, compiles to nothing without the `metrics` feature.
+#[derive(Debug, Clone, Copy)]
+pub(crate) struct Timer(#[cfg(feature = "metrics")] Instant);
+
+impl Timer {
+    #[inline]
+    pub(crate) fn start() -> Self {
+        Self(
+            #[cfg(feature = "metrics")]
+            Instant::now(),
+        )
+    }
+}
+
+/// Records durations into logarithmic buckets like an HDR histogram,
+/// compiles to nothing without the `metrics` feature.
+#[derive(Debug)]
+pub(crate) struct Histogram {
+    #[cfg(feature = "metrics")]
+    buckets: [AtomicU64; HISTOGRAM_BUCKETS],
+    #[cfg(feature = "metrics")]
+    sum_micros: AtomicU64,
+}
+
+#[cfg_attr(not(feature = "metrics"), allow(clippy::derivable_impls))]
+impl Default for Histogram {
+    fn default() -> Self {
+        Self {
+            #[cfg(feature = "metrics")]
+            buckets: std::array::from_fn(|_| AtomicU64::new(0)),
+            #[cfg(feature = "metrics")]
+            sum_micros: AtomicU64::new(0),
+        }
+    }
+}
+
+impl Histogram {
+    /// Records the time since `timer` was started.
+    #[inline]
+    pub(crate) fn record(&self, timer: Timer) {
+        #[cfg(feature = "metrics")]
+        self.record_duration(timer.0.elapsed());
+        #[cfg(not(feature = "metrics"))]
+        let _ = timer;
+    }
+
+    #[cfg(feature = "metrics")]
+    fn record_duration(&self, duration: Duration) {
+        let micros = u64::try_from(duration.as_micros()).unwrap_or(u64::MAX);
+        self.buckets[bucket_index(micros)].fetch_add(1, Ordering::Relaxed);
+        self.sum_micros.fetch_add(micros, Ordering::Relaxed);
+    }
+
+    #[cfg(feature = "metrics")]
+    fn snapshot(&self) -> HistogramSnapshot {
+        HistogramSnapshot {
+            buckets: std::array::from_fn(|index| self.buckets[index].load(Ordering::Relaxed)),
+            sum_micros: self.sum_micros.load(Ordering::Relaxed),
+        }
+    }
+}
+
+#[cfg(feature = "metrics")]
+fn bucket_index(micros: u64) -> usize {
+    let micros = micros.min((1 << MAX_VALUE_BITS) - 1);
+    if micros < 1 << SUB_BUCKET_BITS {
+        return micros as usize;
+    }
+    let exponent = u64::BITS - 1 - micros.leading_zeros();
+    let mantissa = (micros >> (exponent - SUB_BUCKET_BITS)) & ((1 << SUB_BUCKET_BITS) - 1);
+    (((exponent - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) as usize) | mantissa as usize
+}
+
+/// Returns the smallest value in microseconds recorded into the bucket.
+#[cfg(feature = "metrics")]
+const fn bucket_lower_bound(index: usize) -> u64 {
+    let sub_buckets = 1 << SUB_BUCKET_BITS;
+    if index < sub_buckets {
+        return index as u64;
+    }
+    let exponent = (index >> SUB_BUCKET_BITS) as u32 + SUB_BUCKET_BITS - 1;
+    let mantissa = (index & (sub_buckets - 1)) as u64;
+    (sub_buckets as u64 + mantissa) << (exponent - SUB_BUCKET_BITS)
+}
+
+/// The counters and latencies of a Wii remote, shared by all handles of its connection.
+#[derive(Debug, Default)]
+pub(crate) struct DeviceMetrics {
+    /// Reports returned by reads, excluding replies to memory transactions.
+    pub(crate) reports_read: Counter,
+    pub(crate) reports_written: Counter,
+    /// Output reports that failed to be written, disconnecting the Wii remote.
+    pub(crate) write_errors: Counter,
+    /// Memory requests sent again by `simple_io::transfer` after a timeout.
+    pub(crate) memory_retries: Counter,
+    /// Memory requests of `simple_io::transfer` without reply after all retries.
+    pub(crate) memory_timeouts: Counter,
+    /// Duration of reads including the wait for the first report.
+    pub(crate) read: Histogram,
+    pub(crate) write: Histogram,
+    /// Duration of the initialization on connect and reconnect.
+    pub(crate) initialize: Histogram,
+    /// Time spent waiting for the device mutex.
+    pub(crate) lock_wait: Histogram,
+}
+
+#[cfg(feature = "metrics")]
+impl DeviceMetrics {
+    pub(crate) fn snapshot(&self) -> DeviceMetricsSnapshot {
+        DeviceMetricsSnapshot {
+            reports_read: self.reports_read.get(),
+            reports_written: self.reports_written.get(),
+            write_errors: self.write_errors.get(),
+            memory_retries: self.memory_retries.get(),
+            memory_timeouts: self.memory_timeouts.get(),
+            read: self.read.snapshot(),
+            write: self.write.snapshot(),
+            initialize: self.initialize.snapshot(),
+            lock_wait: self.lock_wait.snapshot(),
+        }
+    }
+}
+
+/// The counters and latencies of the scans for Wii remotes of all managers.
+#[derive(Debug, Default)]
+pub(crate) struct ScanMetrics {
+    pub(crate) scans: Counter,
+    /// Wii remotes that failed to connect or reconnect.
+    pub(crate) connect_errors: Counter,
+    /// Duration of scans including the initialization of the found Wii remotes.
+    pub(crate) scan: Histogram,
+}
+
+pub(crate) static SCAN_METRICS: Lazy<ScanMetrics> = Lazy::new(ScanMetrics::default);
+
+/// A copy of the buckets of a latency histogram.
+#[cfg(feature = "metrics")]
+#[derive(Debug, Clone)]
+pub struct HistogramSnapshot {
+    buckets: [u64; HISTOGRAM_BUCKETS],
+    sum_micros: u64,
+}
+
+#[cfg(feature = "metrics")]
+impl HistogramSnapshot {
+    /// Returns the number of recorded durations.
+    #[must_use]
+    pub fn count(&self) -> u64 {
+        self.buckets.iter().sum()
+    }
+
+    /// Returns the sum of the recorded durations.
+    #[must_use]
+    pub const fn sum(&self) -> Duration {
+        Duration::from_micros(self.sum_micros)
+    }
+
+    /// Returns the number of durations recorded into every bucket, see `bucket_lower_bound`.
+    #[must_use]
+    pub const fn buckets(&self) -> &[u64; HISTOGRAM_BUCKETS] {
+        &self.buckets
+    }
+
+    /// Returns the smallest duration recorded into the bucket at `index`.
+    #[must_use]
+    pub const fn bucket_lower_bound(index: usize) -> Duration {
+        Duration::from_micros(bucket_lower_bound(index))
+    }
+
+    /// Returns the duration below which the fraction `quantile` of the recorded durations lie,
+    /// rounded down to the lower bound of its bucket. Zero if nothing was recorded.
+    #[must_use]
+    pub fn quantile(&self, quantile: f64) -> Duration {
+        let count = self.count();
+        #[allow(
+            clippy::cast_possible_truncation,
+            clippy::cast_sign_loss,
+            clippy::cast_precision_loss
+        )]
+        let rank = ((quantile.clamp(0.0, 1.0) * count as f64).ceil() as u64).max(1);
+        let mut seen = 0;
+        for (index, bucket) in self.buckets.iter().enumerate() {
+            seen += bucket;
+            if seen >= rank {
+                return Self::bucket_lower_bound(index);
+            }
+        }
+        Duration::ZERO
+    }
+
+    /// Returns the differences of the bucket counts since `earlier`, e.g. to export per interval.
+    #[must_use]
+    pub fn since(&self, earlier: &Self) -> Self {
+        Self {
+            buckets: std::array::from_fn(|index| {
+                self.buckets[index].saturating_sub(earlier.buckets[index])
+            }),
+            sum_micros: self.sum_micros.saturating_sub(earlier.sum_micros),
+        }
+    }
+}
+
+/// The counters and latencies of a Wii remote since it was first connected,
+/// returned by `WiimoteDevice::metrics`.
+#[cfg(feature = "metrics")]
+#[derive(Debug, Clone)]
+pub struct DeviceMetricsSnapshot {
+    /// Reports returned by reads, excluding replies to memory transactions.
+    pub reports_read: u64,
+    pub reports_written: u64,
+    /// Output reports that failed to be written, disconnecting the Wii remote.
+    pub write_errors: u64,
+    /// Memory requests sent again after receiving no reply in time.
+    pub memory_retries: u64,
+    /// Memory requests without reply after all retries.
+    pub memory_timeouts: u64,
+    /// Duration of reads including the wait for the first report.
+    pub read: HistogramSnapshot,
+    pub write: HistogramSnapshot,
+    /// Duration of the initialization on connect and reconnect.
+    pub initialize: HistogramSnapshot,
+    /// Time spent waiting for the device to be available to this thread.
+    pub lock_wait: HistogramSnapshot,
+}
+
+/// The counters and latencies of the scans for Wii remotes, returned by `scan_metrics`.
+#[cfg(feature = "metrics")]
+#[derive(Debug, Clone)]
+pub struct ScanMetricsSnapshot {
+    pub scans: u64,
+    /// Wii remotes that failed to connect or reconnect.
+    pub connect_errors: u64,
+    /// Duration of scans including the initialization of the found Wii remotes.
+    pub scan: HistogramSnapshot,
+}
+
+/// Returns the counters and latencies of the scans of all `WiimoteManager`s.
+#[cfg(feature = "metrics")]
+#[must_use]
+pub fn scan_metrics() -> ScanMetricsSnapshot {
+    ScanMetricsSnapshot {
+        scans: SCAN_METRICS.scans.get(),
+        connect_errors: SCAN_METRICS.connect_errors.get(),
+        scan: SCAN_METRICS.scan.snapshot(),
+    }
+}
+
+#[cfg(all(test, feature = "metrics"))]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_bucket_bounds() {
+        for micros in [
+            0,
+            1,
+            7,
+            8,
+            9,
+            15,
+            16,
+            17,
+            1000,
+            123_456,
+            u64::from(u32::MAX),
+        ] {
+            let index = bucket_index(micros);
+            assert!(bucket_lower_bound(index) <= micros);
+            assert!(index + 1 == HISTOGRAM_BUCKETS || bucket_lower_bound(index + 1) > micros);
+        }
+        assert_eq!(bucket_index(u64::MAX), HISTOGRAM_BUCKETS - 1);
+    }
+
+    #[test]
+    fn test_quantiles() {
+        let histogram = Histogram::default();
+        for millis in 1..=100 {
+            histogram.record_duration(Duration::from_millis(millis));
+        }
+        let snapshot = histogram.snapshot();
+        assert_eq!(snapshot.count(), 100);
+        assert_eq!(snapshot.sum(), Duration::from_millis(5050));
+        let median = snapshot.quantile(0.5);
+        assert!(median <= Duration::from_millis(50) && median > Duration::from_millis(43));
+        assert!(snapshot.quantile(1.0) > Duration::from_millis(87));
+        assert_eq!(snapshot.since(&snapshot).count(), 0);
+    }
+}
@@ -0,0 +1,6 @@
+//! Simulated Wii remotes for tests and benchmarks without a Bluetooth adapter.
+//!
+//! Enabled by the `mock` feature, which adds to the platform backend:
+//! the `WiimoteManager` also finds the Wii remotes created with `MockWiimote::connect`.
+
+pub use crate::native::{MockReplay, MockWiimote, ReplayOptions, ReplayStats};
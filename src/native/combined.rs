@@ -0,0 +1,271 @@
+use std::io;
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+use super::mock::{self, MockHotplug, MockNativeReactor, MockNativeWiimote};
+use super::{
+    platform_wiimotes_scan, platform_wiimotes_scan_cleanup, InputWaiter, NativeHotplug,
+    NativeReactor, NativeWiimote, PlatformHotplug, PlatformReactor, PlatformWiimote,
+};
+use crate::input::RawReport;
+use crate::manager::ScanMode;
+
+/// Longest time a simulated Wii remote waits to be noticed while the platform hotplug is waited for.
+const MOCK_ARRIVAL_INTERVAL: Duration = Duration::from_millis(20);
+
+/// Scans for Wii remotes of the platform backend, then for simulated Wii remotes.
+pub fn wiimotes_scan(
+    mode: ScanMode,
+    known_identifiers: &[Arc<str>],
+    found: &mut dyn FnMut(CombinedNativeWiimote),
+) {
+    platform_wiimotes_scan(mode, known_identifiers, &mut |device| {
+        found(CombinedNativeWiimote::Platform(device));
+    });
+    mock::wiimotes_scan(mode, known_identifiers, &mut |device| {
+        found(CombinedNativeWiimote::Mock(device));
+    });
+}
+
+pub fn wiimotes_scan_cleanup() {
+    platform_wiimotes_scan_cleanup();
+    mock::wiimotes_scan_cleanup();
+}
+
+/// A Wii remote of the platform backend or a simulated Wii remote of the `mock` feature.
+pub enum CombinedNativeWiimote {
+    Platform(PlatformWiimote),
+    Mock(MockNativeWiimote),
+}
+
+impl CombinedNativeWiimote {
+    /// Takes the simulated Wii remote before it is found by a scan.
+    #[cfg(test)]
+    pub(crate) fn take(mock: &mock::MockWiimote) -> Self {
+        Self::Mock(MockNativeWiimote::take(mock))
+    }
+}
+
+macro_rules! dispatch {
+    ($self:expr, $device:ident => $call:expr) => {
+        match $self {
+            Self::Platform($device) => $call,
+            Self::Mock($device) => $call,
+        }
+    };
+}
+
+impl NativeWiimote for CombinedNativeWiimote {
+    fn read(&mut self, buffer: &mut [u8]) -> Option<usize> {
+        dispatch!(self, device => device.read(buffer))
+    }
+
+    fn read_timeout(&mut self, buffer: &mut [u8], timeout_millis: usize) -> Option<usize> {
+        dispatch!(self, device => device.read_timeout(buffer, timeout_millis))
+    }
+
+    fn write(&mut self, buffer: &[u8]) -> Option<usize> {
+        dispatch!(self, device => device.write(buffer))
+    }
+
+    fn identifier(&self) -> &str {
+        dispatch!(self, device => device.identifier())
+    }
+
+    fn adapter(&self) -> Option<String> {
+        dispatch!(self, device => device.adapter())
+    }
+
+    fn write_nonblocking(&mut self, buffer: &[u8]) -> Option<usize> {
+        dispatch!(self, device => device.write_nonblocking(buffer))
+    }
+
+    fn input_waiter(&self) -> Option<Arc<dyn InputWaiter>> {
+        dispatch!(self, device => device.input_waiter())
+    }
+
+    fn last_read_completion(&self) -> Option<Instant> {
+        dispatch!(self, device => device.last_read_completion())
+    }
+
+    fn read_report(
+        &mut self,
+        report: &mut RawReport,
+        timeout_millis: Option<usize>,
+    ) -> Option<usize> {
+        dispatch!(self, device => device.read_report(report, timeout_millis))
+    }
+
+    fn read_batch(&mut self, reports: &mut [RawReport]) -> Option<usize> {
+        dispatch!(self, device => device.read_batch(reports))
+    }
+}
+
+/// Waits for the Wii remotes of the platform backend and the simulated Wii remotes.
+///
+/// Notifications of simulated Wii remotes wake the platform reactor,
+/// their tokens are collected after waiting for the platform reactor.
+pub struct CombinedNativeReactor {
+    /// `None` if the platform has no reactor.
+    platform: Option<Arc<PlatformReactor>>,
+    mock: MockNativeReactor,
+}
+
+impl CombinedNativeReactor {
+    fn platform(&self) -> io::Result<&PlatformReactor> {
+        self.platform
+            .as_deref()
+            .ok_or_else(|| io::ErrorKind::Unsupported.into())
+    }
+}
+
+impl NativeReactor for CombinedNativeReactor {
+    type Device = CombinedNativeWiimote;
+
+    fn new() -> io::Result<Self> {
+        let platform = PlatformReactor::new().ok().map(Arc::new);
+        let mock = match &platform {
+            Some(platform) => {
+                let platform = Arc::downgrade(platform);
+                MockNativeReactor::with_waker(move || {
+                    if let Some(platform) = platform.upgrade() {
+                        _ = platform.wake();
+                    }
+                })
+            }
+            None => MockNativeReactor::new()?,
+        };
+        Ok(Self { platform, mock })
+    }
+
+    fn register(&self, device: &CombinedNativeWiimote, token: usize) -> io::Result<()> {
+        match device {
+            CombinedNativeWiimote::Platform(device) => self.platform()?.register(device, token),
+            CombinedNativeWiimote::Mock(device) => self.mock.register(device, token),
+        }
+    }
+
+    fn register_oneshot(
+        &self,
+        device: &CombinedNativeWiimote,
+        token: usize,
+        writable: bool,
+    ) -> io::Result<()> {
+        match device {
+            CombinedNativeWiimote::Platform(device) => {
+                self.platform()?.register_oneshot(device, token, writable)
+            }
+            CombinedNativeWiimote::Mock(device) => {
+                self.mock.register_oneshot(device, token, writable)
+            }
+        }
+    }
+
+    fn rearm(
+        &self,
+        device: &CombinedNativeWiimote,
+        token: usize,
+        writable: bool,
+    ) -> io::Result<()> {
+        match device {
+            CombinedNativeWiimote::Platform(device) => {
+                self.platform()?.rearm(device, token, writable)
+            }
+            CombinedNativeWiimote::Mock(device) => self.mock.rearm(device, token, writable),
+        }
+    }
+
+    fn deregister(&self, device: &CombinedNativeWiimote) {
+        match device {
+            CombinedNativeWiimote::Platform(device) => {
+                if let Some(platform) = &self.platform {
+                    platform.deregister(device);
+                }
+            }
+            CombinedNativeWiimote::Mock(device) => self.mock.deregister(device),
+        }
+    }
+
+    fn wake(&self) -> io::Result<()> {
+        match &self.platform {
+            Some(platform) => platform.wake(),
+            None => self.mock.wake(),
+        }
+    }
+
+    fn wait(&self, ready: &mut Vec<usize>, timeout_millis: Option<usize>) -> io::Result<()> {
+        let Some(platform) = &self.platform else {
+            return self.mock.wait(ready, timeout_millis);
+        };
+        let ready_before = ready.len();
+        self.mock.wait(ready, Some(0))?;
+        if ready.len() > ready_before {
+            return Ok(());
+        }
+        // A simulated Wii remote notified in the meantime wakes the platform reactor
+        platform.wait(ready, timeout_millis)?;
+        self.mock.wait(ready, Some(0))
+    }
+}
+
+/// Notifies of Wii remotes of the platform backend and of simulated Wii remotes.
+pub struct CombinedHotplug {
+    /// `None` if the platform has no hotplug notifications.
+    platform: Option<PlatformHotplug>,
+    mock: MockHotplug,
+}
+
+impl NativeHotplug for CombinedHotplug {
+    fn new() -> io::Result<Self> {
+        Ok(Self {
+            platform: PlatformHotplug::new().ok(),
+            mock: MockHotplug::new()?,
+        })
+    }
+
+    fn wait(&mut self, timeout: Duration) -> bool {
+        let Some(platform) = &mut self.platform else {
+            return self.mock.wait(timeout);
+        };
+        // The platform hotplug cannot be woken, it is waited for in slices to notice simulated Wii remotes
+        let deadline = Instant::now() + timeout;
+        loop {
+            if self.mock.wait(Duration::ZERO) {
+                return true;
+            }
+            let remaining = deadline.saturating_duration_since(Instant::now());
+            if remaining.is_zero() {
+                return false;
+            }
+            if platform.wait(remaining.min(MOCK_ARRIVAL_INTERVAL)) {
+                return true;
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_simulated_report_wakes_reactor() {
+        let mock = mock::MockWiimote::connect("combined-reactor");
+        let device = CombinedNativeWiimote::take(&mock);
+        let reactor = CombinedNativeReactor::new().unwrap();
+        reactor.register(&device, 7).unwrap();
+
+        let thread = std::thread::spawn(move || {
+            std::thread::sleep(Duration::from_millis(20));
+            assert!(mock.send_report(&[0x30, 0x00, 0x00]));
+            mock
+        });
+        let mut ready = Vec::new();
+        while ready.is_empty() {
+            reactor.wait(&mut ready, Some(10_000)).unwrap();
+        }
+        assert_eq!(ready, [7]);
+        _ = thread.join().unwrap();
+        reactor.deregister(&device);
+    }
+}
@@ -1,6 +1,8 @@
 // Some functions are unused on certain platforms
 #![allow(dead_code)]
 
+use std::collections::HashMap;
+
 const WIIMOTE_VENDOR_ID: u16 = 0x057E;
 const WIIMOTE_PRODUCT_ID: u16 = 0x0306;
 const WIIMOTE_PLUS_PRODUCT_ID: u16 = 0x0330;
@@ -13,3 +15,107 @@ pub(super) const fn is_wiimote(vendor_id: u16, product_id: u16) -> bool {
 pub(super) fn is_wiimote_device_name(name: &str) -> bool {
     name == "Nintendo RVL-CNT-01" || name == "Nintendo RVL-CNT-01-TR"
 }
+
+/// Same as `is_wiimote_device_name` for a null terminated UTF-16 name, without converting it.
+pub(super) fn is_wiimote_device_wide_name(name: &[u16]) -> bool {
+    let length = name.iter().position(|&c| c == 0).unwrap_or(name.len());
+    ["Nintendo RVL-CNT-01", "Nintendo RVL-CNT-01-TR"]
+        .iter()
+        .any(|expected| expected.encode_utf16().eq(name[..length].iter().copied()))
+}
+
+/// Formats a Bluetooth address stored least significant byte first as `AA:BB:CC:DD:EE:FF`.
+pub(super) fn format_address(address: u64) -> String {
+    let bytes = address.to_le_bytes();
+    bytes[..6]
+        .iter()
+        .rev()
+        .map(|byte| format!("{byte:02X}"))
+        .collect::<Vec<_>>()
+        .join(":")
+}
+
+/// Parses a Bluetooth address formatted like `format_address`, in upper or lower case.
+pub(super) fn parse_address(address: &str) -> Option<u64> {
+    let mut bytes = [0u8; 8];
+    let mut parts = address.split(':');
+    for byte in bytes[..6].iter_mut().rev() {
+        let part = parts
+            .next()
+            .filter(|part| part.len() == 2 && part.bytes().all(|c| c.is_ascii_hexdigit()))?;
+        *byte = u8::from_str_radix(part, 16).ok()?;
+    }
+    parts.next().is_none().then(|| u64::from_le_bytes(bytes))
+}
+
+/// Counts the Wii remotes connected through every Bluetooth adapter by adapter address,
+/// new connections are placed on the least loaded adapter to share the links and bandwidth of all radios.
+#[derive(Debug, Default)]
+pub(super) struct AdapterLoads {
+    connections: HashMap<u64, usize>,
+}
+
+impl AdapterLoads {
+    /// Returns the adapter with the fewest connected Wii remotes, the first of `adapters` on ties.
+    pub(super) fn least_loaded(&self, adapters: impl IntoIterator<Item = u64>) -> Option<u64> {
+        adapters
+            .into_iter()
+            .min_by_key(|adapter| self.load(*adapter))
+    }
+
+    pub(super) fn load(&self, adapter: u64) -> usize {
+        self.connections.get(&adapter).copied().unwrap_or(0)
+    }
+
+    pub(super) fn add(&mut self, adapter: u64) {
+        *self.connections.entry(adapter).or_insert(0) += 1;
+    }
+
+    pub(super) fn remove(&mut self, adapter: u64) {
+        if let Some(connections) = self.connections.get_mut(&adapter) {
+            *connections -= 1;
+            if *connections == 0 {
+                self.connections.remove(&adapter);
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_connections_spread_over_adapters() {
+        let adapters = [0x0A, 0x0B, 0x0C];
+        let mut loads = AdapterLoads::default();
+        loads.add(0x0B);
+
+        let placed = (0..5)
+            .map(|_| {
+                let adapter = loads.least_loaded(adapters).unwrap();
+                loads.add(adapter);
+                adapter
+            })
+            .collect::<Vec<_>>();
+        assert_eq!(placed, [0x0A, 0x0C, 0x0A, 0x0B, 0x0C]);
+
+        loads.remove(0x0A);
+        loads.remove(0x0A);
+        assert_eq!(loads.least_loaded(adapters), Some(0x0A));
+        assert_eq!(loads.least_loaded([]), None);
+        assert_eq!(format_address(0x0019_1D2A_3B4C), "00:19:1D:2A:3B:4C");
+    }
+
+    #[test]
+    fn test_parse_address() {
+        assert_eq!(parse_address("00:19:1D:2A:3B:4C"), Some(0x0019_1D2A_3B4C));
+        assert_eq!(parse_address("00:19:1d:2a:3b:4c"), Some(0x0019_1D2A_3B4C));
+        assert_eq!(parse_address("00:19:1D:2A:3B"), None);
+        assert_eq!(parse_address("00:19:1D:2A:3B:4C:5D"), None);
+        assert_eq!(parse_address("00:19:1D:2A:3B:+C"), None);
+        let name = "Nintendo RVL-CNT-01\0\0".encode_utf16().collect::<Vec<_>>();
+        assert!(is_wiimote_device_wide_name(&name));
+        assert!(!is_wiimote_device_wide_name(&name[..10]));
+    }
+}
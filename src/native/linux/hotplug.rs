@@ -0,0 +1,191 @@
+use std::ffi::c_int;
+use std::io;
+use std::time::Duration;
+
+use nix::libc::{
+    poll, pollfd, recv, setsockopt, socklen_t, MSG_DONTWAIT, POLLERR, POLLHUP, POLLIN, POLLNVAL,
+};
+use nix::unistd::close;
+
+use super::bindings::{
+    hci_filter, hci_open_dev, ACL_LINK, EVT_CONN_REQUEST, HCI_EVENT_PKT, HCI_FILTER, SOL_HCI,
+};
+use super::listener::Listener;
+use super::{lock_paging_devices, read_adapters, Adapter};
+use crate::native::NativeHotplug;
+
+/// Largest HCI event packet, the packet type, the event header and up to 255 parameter bytes.
+const MAX_EVENT_SIZE: usize = 258;
+
+/// Accepts the channels of paired Wii remotes reconnecting after a button press with the `Listener`.
+/// If the HID PSMs cannot be bound, listens for devices paging the adapters instead with a raw HCI
+/// socket per adapter that only receives Connection Request events, the scan then connects to them.
+pub struct LinuxHotplug {
+    listener: Option<Listener>,
+    /// The event socket of every adapter that is up, by HCI device id.
+    sockets: Vec<(c_int, c_int)>,
+    /// Reused by every wait.
+    adapters: Vec<Adapter>,
+    fds: Vec<pollfd>,
+}
+
+impl LinuxHotplug {
+    /// Listens on adapters that came up, the sockets of removed adapters are closed by `wait`.
+    fn refresh(&mut self) {
+        // Connecting to a Wii remote would race the channels it connects to the listener
+        if self.listener.is_some() {
+            return;
+        }
+        read_adapters(&mut self.adapters);
+        for adapter in &self.adapters {
+            if self.sockets.iter().any(|&(id, _)| id == adapter.id) {
+                continue;
+            }
+            match unsafe { open_event_socket(adapter.id) } {
+                Ok(socket) => self.sockets.push((adapter.id, socket)),
+                Err(error) => eprintln!(
+                    "Failed to listen for connections on bluetooth adapter hci{}: {error}",
+                    adapter.id
+                ),
+            }
+        }
+    }
+}
+
+/// Opens a raw HCI socket bound to the adapter that receives Connection Request events.
+unsafe fn open_event_socket(adapter_id: c_int) -> io::Result<c_int> {
+    let socket = hci_open_dev(adapter_id);
+    if socket < 0 {
+        return Err(io::Error::last_os_error());
+    }
+
+    let mut filter = std::mem::zeroed::<hci_filter>();
+    filter.type_mask = 1 << HCI_EVENT_PKT;
+    filter.event_mask[0] = 1 << EVT_CONN_REQUEST;
+    if setsockopt(
+        socket,
+        SOL_HCI as _,
+        HCI_FILTER as _,
+        std::ptr::addr_of!(filter).cast(),
+        std::mem::size_of_val(&filter) as socklen_t,
+    ) < 0
+    {
+        let error = io::Error::last_os_error();
+        _ = close(socket);
+        return Err(error);
+    }
+    Ok(socket)
+}
+
+/// Records the devices of the received Connection Request events for the next scan,
+/// returns whether a device paged the adapter.
+fn receive_connection_requests(socket: c_int) -> bool {
+    let mut is_paged = false;
+    let mut packet = [0u8; MAX_EVENT_SIZE];
+    loop {
+        let size = unsafe {
+            recv(
+                socket,
+                packet.as_mut_ptr().cast(),
+                packet.len(),
+                MSG_DONTWAIT,
+            )
+        };
+        if size <= 0 {
+            return is_paged;
+        }
+        // Packet type, event code, parameter length, address, class of device and link type
+        #[allow(clippy::cast_sign_loss)]
+        if let [packet_type, event, _, b0, b1, b2, b3, b4, b5, _, _, _, link_type, ..] =
+            packet[..size as usize]
+        {
+            if u32::from(packet_type) == HCI_EVENT_PKT
+                && u32::from(event) == EVT_CONN_REQUEST
+                && u32::from(link_type) == ACL_LINK
+            {
+                let address = [b0, b1, b2, b3, b4, b5];
+                let mut paging_devices = lock_paging_devices();
+                if !paging_devices.contains(&address) {
+                    paging_devices.push(address);
+                }
+                is_paged = true;
+            }
+        }
+    }
+}
+
+impl NativeHotplug for LinuxHotplug {
+    fn new() -> io::Result<Self> {
+        let listener = Listener::new()
+            .map_err(|error| {
+                eprintln!(
+                    "Failed to listen for connecting Wii remotes, connecting to paging Wii remotes instead: {error}"
+                );
+            })
+            .ok();
+        let mut hotplug = Self {
+            listener,
+            sockets: Vec::new(),
+            adapters: Vec::new(),
+            fds: Vec::new(),
+        };
+        hotplug.refresh();
+        Ok(hotplug)
+    }
+
+    fn wait(&mut self, timeout: Duration) -> bool {
+        self.refresh();
+        let listener_sockets = self
+            .listener
+            .iter()
+            .flat_map(|listener| [listener.control_socket, listener.data_socket]);
+        let fds = &mut self.fds;
+        fds.clear();
+        fds.extend(
+            listener_sockets
+                .chain(self.sockets.iter().map(|&(_, socket)| socket))
+                .map(|socket| pollfd {
+                    fd: socket,
+                    events: POLLIN,
+                    revents: 0,
+                }),
+        );
+        let timeout_millis = i32::try_from(timeout.as_millis()).unwrap_or(i32::MAX);
+        let result = unsafe { poll(fds.as_mut_ptr(), fds.len() as _, timeout_millis) };
+        // Also accepts after a timeout to close control channels without a data channel
+        if let Some(listener) = &mut self.listener {
+            if listener.accept() {
+                return true;
+            }
+        }
+        if result <= 0 {
+            return false;
+        }
+
+        let mut is_paged = false;
+        for fd in fds.iter() {
+            if fd.revents & POLLIN != 0 {
+                is_paged |= receive_connection_requests(fd.fd);
+            }
+        }
+        // The socket of a removed adapter is reopened once an adapter with its id is up again
+        self.sockets.retain(|&(_, socket)| {
+            let is_closed = fds
+                .iter()
+                .any(|fd| fd.fd == socket && fd.revents & (POLLERR | POLLHUP | POLLNVAL) != 0);
+            if is_closed {
+                _ = close(socket);
+            }
+            !is_closed
+        });
+        is_paged
+    }
+}
+
+impl Drop for LinuxHotplug {
+    fn drop(&mut self) {
+        for &(_, socket) in &self.sockets {
+            _ = close(socket);
+        }
+    }
+}
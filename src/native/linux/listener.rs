@@ -0,0 +1,165 @@
+use std::ffi::c_int;
+use std::io;
+use std::time::{Duration, Instant};
+
+use nix::libc::{
+    accept, bind, getsockname, listen, sockaddr, socket, socklen_t, AF_BLUETOOTH, SOCK_CLOEXEC,
+    SOCK_NONBLOCK, SOCK_SEQPACKET,
+};
+use nix::unistd::close;
+
+use super::bindings::{bdaddr_t, sockaddr_l2, BTPROTO_L2CAP};
+use super::{
+    address_key, lock_accepted_wiimotes, lock_adapter_loads, wiimote_from_sockets, CONTROL_PIPE_ID,
+    DATA_PIPE_ID,
+};
+
+/// Time an accepted control channel waits for the data channel of the same Wii remote.
+const DATA_CHANNEL_TIMEOUT: Duration = Duration::from_secs(2);
+const LISTEN_BACKLOG: c_int = 8;
+
+/// A control channel accepted from a Wii remote whose data channel is not connected yet.
+struct PendingControl {
+    address: bdaddr_t,
+    socket: c_int,
+    accepted: Instant,
+}
+
+/// Server sockets on the HID control and data PSMs of all adapters, accepting the channels a paired
+/// Wii remote opens when it reconnects on a button press, without waiting for the next scan.
+pub(super) struct Listener {
+    pub(super) control_socket: c_int,
+    pub(super) data_socket: c_int,
+    pending: Vec<PendingControl>,
+}
+
+/// Opens a nonblocking server socket on the PSM of every adapter.
+/// Binding a HID PSM fails if BlueZ listens on it or without `CAP_NET_BIND_SERVICE`.
+unsafe fn listen_socket(psm: u16) -> io::Result<c_int> {
+    let socket_fd = socket(
+        AF_BLUETOOTH as _,
+        (SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC) as _,
+        BTPROTO_L2CAP as _,
+    );
+    if socket_fd < 0 {
+        return Err(io::Error::last_os_error());
+    }
+
+    // The zeroed address is `BDADDR_ANY`
+    let mut address = std::mem::zeroed::<sockaddr_l2>();
+    address.l2_family = AF_BLUETOOTH as _;
+    address.l2_psm = psm;
+    let address_ptr = std::ptr::addr_of!(address).cast::<sockaddr>();
+    let address_size = std::mem::size_of_val(&address);
+    if bind(socket_fd, address_ptr, address_size as _) < 0 || listen(socket_fd, LISTEN_BACKLOG) < 0
+    {
+        let error = io::Error::last_os_error();
+        _ = close(socket_fd);
+        return Err(error);
+    }
+    Ok(socket_fd)
+}
+
+/// Accepts a channel without blocking, returns its socket, the address of the Wii remote
+/// and the address of the adapter it connected through.
+unsafe fn accept_channel(listen_socket: c_int) -> Option<(c_int, bdaddr_t, Option<bdaddr_t>)> {
+    let mut remote = std::mem::zeroed::<sockaddr_l2>();
+    let mut length = std::mem::size_of_val(&remote) as socklen_t;
+    // The accepted socket is blocking, it does not inherit `O_NONBLOCK`
+    let socket_fd = accept(
+        listen_socket,
+        std::ptr::addr_of_mut!(remote).cast(),
+        &mut length,
+    );
+    if socket_fd < 0 {
+        return None;
+    }
+
+    let mut local = std::mem::zeroed::<sockaddr_l2>();
+    let mut length = std::mem::size_of_val(&local) as socklen_t;
+    let adapter = (getsockname(socket_fd, std::ptr::addr_of_mut!(local).cast(), &mut length) == 0)
+        .then_some(local.l2_bdaddr);
+    Some((socket_fd, remote.l2_bdaddr, adapter))
+}
+
+impl Listener {
+    pub(super) fn new() -> io::Result<Self> {
+        unsafe {
+            let control_socket = listen_socket(CONTROL_PIPE_ID)?;
+            let data_socket = match listen_socket(DATA_PIPE_ID) {
+                Ok(data_socket) => data_socket,
+                Err(error) => {
+                    _ = close(control_socket);
+                    return Err(error);
+                }
+            };
+            Ok(Self {
+                control_socket,
+                data_socket,
+                pending: Vec::new(),
+            })
+        }
+    }
+
+    /// Accepts the channels of connecting Wii remotes, a Wii remote is passed to the next scan once
+    /// both channels are connected. Returns whether a Wii remote connected.
+    pub(super) fn accept(&mut self) -> bool {
+        unsafe {
+            while let Some((socket, address, _)) = accept_channel(self.control_socket) {
+                // The control channel of a previous attempt is replaced
+                self.pending.retain(|pending| {
+                    let is_replaced = pending.address.b == address.b;
+                    if is_replaced {
+                        _ = close(pending.socket);
+                    }
+                    !is_replaced
+                });
+                self.pending.push(PendingControl {
+                    address,
+                    socket,
+                    accepted: Instant::now(),
+                });
+            }
+
+            let mut is_connected = false;
+            while let Some((data_socket, address, adapter)) = accept_channel(self.data_socket) {
+                let Some(index) = self
+                    .pending
+                    .iter()
+                    .position(|pending| pending.address.b == address.b)
+                else {
+                    // A Wii remote connects the control channel first
+                    _ = close(data_socket);
+                    continue;
+                };
+                let control = self.pending.swap_remove(index);
+                let adapter = adapter.map(|adapter| address_key(&adapter));
+                if let Some(adapter) = adapter {
+                    lock_adapter_loads().add(adapter);
+                }
+                let wiimote = wiimote_from_sockets(&address, control.socket, data_socket, adapter);
+                lock_accepted_wiimotes().push((address.b, wiimote));
+                is_connected = true;
+            }
+
+            self.pending.retain(|pending| {
+                let is_expired = pending.accepted.elapsed() > DATA_CHANNEL_TIMEOUT;
+                if is_expired {
+                    _ = close(pending.socket);
+                }
+                !is_expired
+            });
+            is_connected
+        }
+    }
+}
+
+impl Drop for Listener {
+    fn drop(&mut self) {
+        _ = close(self.control_socket);
+        _ = close(self.data_socket);
+        for pending in &self.pending {
+            _ = close(pending.socket);
+        }
+    }
+}
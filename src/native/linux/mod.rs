@@ -1,37 +1,257 @@
 mod bindings;
+mod hotplug;
+mod listener;
+mod reactor;
 
+use std::collections::HashMap;
 use std::ffi::c_int;
+use std::sync::{Arc, Mutex, MutexGuard, TryLockError};
+use std::time::{Duration, Instant, SystemTime, UNIX_EPOCH};
 
 use nix::errno::Errno;
 use nix::libc::{
-    connect, poll, pollfd, sockaddr, socket, write, AF_BLUETOOTH, POLLIN, SOCK_SEQPACKET,
+    bind, connect, fcntl, ioctl, iovec, mmsghdr, msghdr, poll, pollfd, recvmmsg, recvmsg, send,
+    setsockopt, shutdown, sockaddr, socket, socklen_t, timespec, AF_BLUETOOTH, CMSG_DATA,
+    CMSG_FIRSTHDR, CMSG_NXTHDR, EAGAIN, EWOULDBLOCK, F_DUPFD_CLOEXEC, MSG_DONTWAIT, POLLIN,
+    SCM_TIMESTAMPNS, SHUT_RDWR, SOCK_SEQPACKET, SOL_SOCKET, SO_TIMESTAMPNS,
 };
-use nix::unistd::{close, read};
+use nix::unistd::close;
+use once_cell::sync::Lazy;
 
+use crate::input::RawReport;
+use crate::manager::ScanMode;
 use crate::WIIMOTE_DEFAULT_REPORT_BUFFER_SIZE;
 
 use self::bindings::{
-    ba2str, bdaddr_t, hci_get_route, hci_inquiry, hci_open_dev, hci_read_remote_name, inquiry_info,
+    ba2str, bdaddr_t, hci_devba, hci_inquiry_req, hci_open_dev, hci_read_remote_name, inquiry_info,
     sockaddr_l2, BTPROTO_L2CAP, IREQ_CACHE_FLUSH,
 };
 
-use super::common::is_wiimote_device_name;
-use super::NativeWiimote;
+use super::common::{format_address, is_wiimote_device_name, parse_address, AdapterLoads};
+use super::{InputWaiter, NativeWiimote};
 
-const MAX_INQUIRIES: i32 = 255;
-const SCAN_SECONDS: i32 = 6;
+pub use hotplug::LinuxHotplug;
+pub use reactor::LinuxNativeReactor;
+
+const MAX_INQUIRIES: usize = 255;
+/// Length of an inquiry in units of 1.28 seconds, short inquiries return the found Wii remotes sooner.
+const INQUIRY_LENGTH: u8 = 2;
+/// The General Inquiry Access Code, the default of `hci_inquiry`.
+const GENERAL_INQUIRY_LAP: [u8; 3] = [0x33, 0x8B, 0x9E];
+/// `_IOR('H', 240, int)`, the request of `hci_inquiry`, not generated by bindgen.
+const HCIINQUIRY: u32 = 0x8004_48F0;
 const MAX_NAME_LENGTH: i32 = 250;
 
+/// Highest number of HCI adapters checked for, same as `HCI_MAX_DEV`.
+const MAX_ADAPTERS: c_int = 16;
+/// Most connections paged at once on each adapter by `connect_wiimotes`.
+const CONNECTIONS_PER_ADAPTER: usize = 2;
+
+/// Whether the device with the address is a Wii remote, by the name read from the device.
+static NAME_CACHE: Lazy<Mutex<HashMap<[u8; 6], bool>>> = Lazy::new(|| Mutex::new(HashMap::new()));
+/// Wii remotes connected through every adapter.
+static ADAPTER_LOADS: Lazy<Mutex<AdapterLoads>> = Lazy::new(|| Mutex::new(AdapterLoads::default()));
+/// Addresses of the devices that paged an adapter since the last scan, recorded by the `LinuxHotplug`.
+static PAGING_DEVICES: Lazy<Mutex<Vec<[u8; 6]>>> = Lazy::new(|| Mutex::new(Vec::new()));
+/// A Wii remote that connected to the `Listener` by its address.
+type AcceptedWiimote = ([u8; 6], LinuxNativeWiimote);
+/// Wii remotes that connected to the `Listener` since the last scan.
+static ACCEPTED_WIIMOTES: Lazy<Mutex<Vec<AcceptedWiimote>>> = Lazy::new(|| Mutex::new(Vec::new()));
+
+/// Buffers of every scan, locked for the whole scan so scans of several managers run one after another.
+static SCAN_BUFFERS: Lazy<Mutex<ScanBuffers>> = Lazy::new(|| Mutex::new(ScanBuffers::default()));
+
+/// Maximum number of reports received with a single `recvmmsg` call.
+const MAX_BATCH_SIZE: usize = 32;
+/// Ancillary data buffer of a received report, fits the `SCM_TIMESTAMPNS` message, aligned for `cmsghdr`.
+type ControlBuffer = [u64; 8];
+
 const CONTROL_PIPE_ID: u16 = 0x0011;
 const DATA_PIPE_ID: u16 = 0x0013;
 
-unsafe fn connect_socket(address: sockaddr_l2) -> Option<c_int> {
+/// A Bluetooth adapter that is up, by HCI device id and address.
+#[derive(Clone, Copy)]
+struct Adapter {
+    id: c_int,
+    address: bdaddr_t,
+}
+
+/// Replaces `adapters` with the HCI adapters that are up, `hci_devba` fails for adapters that are down.
+fn read_adapters(adapters: &mut Vec<Adapter>) {
+    adapters.clear();
+    adapters.extend((0..MAX_ADAPTERS).filter_map(|id| {
+        let mut address = unsafe { std::mem::zeroed::<bdaddr_t>() };
+        (unsafe { hci_devba(id, &mut address) } >= 0).then_some(Adapter { id, address })
+    }));
+}
+
+/// The request of the `HCIINQUIRY` ioctl followed by the space for its results.
+#[repr(C)]
+struct InquiryRequest {
+    request: hci_inquiry_req,
+    infos: [inquiry_info; MAX_INQUIRIES],
+}
+
+/// The reused inquiry results and found Wii remotes of an adapter.
+struct Inquiry {
+    request: Box<InquiryRequest>,
+    wiimotes: Vec<bdaddr_t>,
+}
+
+impl Default for Inquiry {
+    fn default() -> Self {
+        Self {
+            request: Box::new(unsafe { std::mem::zeroed() }),
+            wiimotes: Vec::new(),
+        }
+    }
+}
+
+#[derive(Default)]
+struct ScanBuffers {
+    adapters: Vec<Adapter>,
+    addresses: Vec<bdaddr_t>,
+    /// One inquiry per adapter, resized when adapters are added or removed.
+    inquiries: Vec<Inquiry>,
+    /// Threads connecting and inquiring concurrently, grown to the most that ran at once,
+    /// bounded by the number of adapters.
+    workers: Vec<ScanWorker>,
+}
+
+/// Work of a `ScanWorker`, sent back with its result so its buffers are reused by the next scan.
+enum ScanJob {
+    /// Connects to the Wii remote through the least loaded of the adapters.
+    Connect {
+        bdaddr: bdaddr_t,
+        adapters: Vec<Adapter>,
+        wiimote: Option<LinuxNativeWiimote>,
+    },
+    /// Runs a single short inquiry on the adapter.
+    Inquire { adapter: Adapter, inquiry: Inquiry },
+}
+
+impl ScanJob {
+    fn run(&mut self) {
+        match self {
+            Self::Connect {
+                bdaddr,
+                adapters,
+                wiimote,
+            } => *wiimote = unsafe { handle_wiimote(*bdaddr, adapters) },
+            Self::Inquire { adapter, inquiry } => unsafe { inquire_wiimotes(adapter, inquiry) },
+        }
+    }
+}
+
+/// A thread running a job of the scan while the scan thread waits, kept for the next scans.
+struct ScanWorker {
+    jobs: crossbeam_channel::Sender<ScanJob>,
+    done: crossbeam_channel::Receiver<ScanJob>,
+    /// Adapters passed with the next connect job.
+    adapters: Vec<Adapter>,
+}
+
+impl ScanWorker {
+    fn spawn() -> Self {
+        let (jobs, job_receiver) = crossbeam_channel::bounded::<ScanJob>(1);
+        let (done_sender, done) = crossbeam_channel::bounded(1);
+        std::thread::Builder::new()
+            .name("wii-remote-scan".to_string())
+            .spawn(move || {
+                // Stops once the worker is dropped
+                while let Ok(mut job) = job_receiver.recv() {
+                    job.run();
+                    if done_sender.send(job).is_err() {
+                        return;
+                    }
+                }
+            })
+            .expect("Failed to spawn Wii remote scan thread");
+        Self {
+            jobs,
+            done,
+            adapters: Vec::new(),
+        }
+    }
+
+    fn start(&mut self, job: ScanJob) {
+        if let Err(crossbeam_channel::SendError(job)) = self.jobs.send(job) {
+            *self = Self::spawn();
+            _ = self.jobs.send(job);
+        }
+    }
+
+    /// Waits for the started job, `None` if the job panicked.
+    fn finish(&mut self) -> Option<ScanJob> {
+        let job = self.done.recv().ok();
+        if job.is_none() {
+            *self = Self::spawn();
+        }
+        job
+    }
+}
+
+/// Returns the address as key of the `AdapterLoads`.
+const fn address_key(address: &bdaddr_t) -> u64 {
+    let [b0, b1, b2, b3, b4, b5] = address.b;
+    u64::from_le_bytes([b0, b1, b2, b3, b4, b5, 0, 0])
+}
+
+/// Returns the address of a key of the `AdapterLoads` or of `parse_address`.
+const fn key_address(key: u64) -> bdaddr_t {
+    let [b0, b1, b2, b3, b4, b5, _, _] = key.to_le_bytes();
+    bdaddr_t {
+        b: [b0, b1, b2, b3, b4, b5],
+    }
+}
+
+fn lock_adapter_loads() -> MutexGuard<'static, AdapterLoads> {
+    match ADAPTER_LOADS.lock() {
+        Ok(loads) => loads,
+        Err(loads) => loads.into_inner(),
+    }
+}
+
+fn lock_accepted_wiimotes() -> MutexGuard<'static, Vec<AcceptedWiimote>> {
+    match ACCEPTED_WIIMOTES.lock() {
+        Ok(wiimotes) => wiimotes,
+        Err(wiimotes) => wiimotes.into_inner(),
+    }
+}
+
+fn lock_paging_devices() -> MutexGuard<'static, Vec<[u8; 6]>> {
+    match PAGING_DEVICES.lock() {
+        Ok(devices) => devices,
+        Err(devices) => devices.into_inner(),
+    }
+}
+
+/// Opens an L2CAP socket through the adapter and connects it to `address`.
+unsafe fn connect_socket(address: sockaddr_l2, adapter: Option<&Adapter>) -> Option<c_int> {
     let socket_fd = socket(AF_BLUETOOTH as _, SOCK_SEQPACKET as _, BTPROTO_L2CAP as _);
     if socket_fd < 0 {
         eprintln!("Unable to open socket to Wiimote: {}", Errno::last().desc());
         return None;
     }
 
+    if let Some(adapter) = adapter {
+        // Binding to the adapter address places the connection on that radio
+        let mut local_address = std::mem::zeroed::<sockaddr_l2>();
+        local_address.l2_family = AF_BLUETOOTH as _;
+        local_address.l2_bdaddr = adapter.address;
+        let local_address_ptr = std::ptr::addr_of!(local_address).cast::<sockaddr>();
+        let local_address_size = std::mem::size_of_val(&local_address);
+        if bind(socket_fd, local_address_ptr, local_address_size as _) < 0 {
+            eprintln!(
+                "Unable to bind socket to bluetooth adapter hci{}: {}",
+                adapter.id,
+                Errno::last().desc()
+            );
+            _ = close(socket_fd);
+            return None;
+        }
+    }
+
     let address_ptr = std::ptr::addr_of!(address).cast::<sockaddr>();
     let address_size = std::mem::size_of_val(&address);
     if connect(socket_fd, address_ptr, address_size as _) < 0 {
@@ -45,107 +265,399 @@ unsafe fn connect_socket(address: sockaddr_l2) -> Option<c_int> {
     Some(socket_fd)
 }
 
-unsafe fn handle_wiimote(bdaddr: bdaddr_t) -> Option<LinuxNativeWiimote> {
+/// Connects to the Wii remote through the adapter with the fewest connected Wii remotes.
+unsafe fn handle_wiimote(bdaddr: bdaddr_t, adapters: &[Adapter]) -> Option<LinuxNativeWiimote> {
+    let adapter = {
+        let mut loads = lock_adapter_loads();
+        let adapter = loads
+            .least_loaded(adapters.iter().map(|adapter| address_key(&adapter.address)))
+            .and_then(|key| {
+                adapters
+                    .iter()
+                    .find(|adapter| address_key(&adapter.address) == key)
+            });
+        // Reserved while connecting so concurrent connections pick different adapters
+        if let Some(adapter) = adapter {
+            loads.add(address_key(&adapter.address));
+        }
+        adapter
+    };
+    let wiimote = connect_wiimote(bdaddr, adapter);
+    if wiimote.is_none() {
+        if let Some(adapter) = adapter {
+            lock_adapter_loads().remove(address_key(&adapter.address));
+        }
+    }
+    wiimote
+}
+
+unsafe fn connect_wiimote(
+    bdaddr: bdaddr_t,
+    adapter: Option<&Adapter>,
+) -> Option<LinuxNativeWiimote> {
     let mut addr = std::mem::zeroed::<sockaddr_l2>();
     addr.l2_family = AF_BLUETOOTH as _;
     addr.l2_bdaddr = bdaddr;
 
     addr.l2_psm = CONTROL_PIPE_ID;
-    let control_socket = connect_socket(addr)?;
+    let control_socket = connect_socket(addr, adapter)?;
 
     addr.l2_psm = DATA_PIPE_ID;
-    let data_socket = connect_socket(addr);
-    if data_socket.is_none() {
+    let Some(data_socket) = connect_socket(addr, adapter) else {
         _ = close(control_socket);
         return None;
-    }
-
-    let mut address_string = [0u8; 19];
-    ba2str(&bdaddr, address_string.as_mut_ptr().cast());
-
-    let address = String::from_utf8_lossy(&address_string);
-    Some(LinuxNativeWiimote::new(
-        &address,
+    };
+    Some(wiimote_from_sockets(
+        &bdaddr,
         control_socket,
-        data_socket.unwrap(),
+        data_socket,
+        adapter.map(|adapter| address_key(&adapter.address)),
     ))
 }
 
-pub fn wiimotes_scan(wiimotes: &mut Vec<LinuxNativeWiimote>) {
+/// Creates the native Wii remote of the connected control and data channels,
+/// `adapter` must already be counted in the `ADAPTER_LOADS`.
+unsafe fn wiimote_from_sockets(
+    bdaddr: &bdaddr_t,
+    control_socket: c_int,
+    data_socket: c_int,
+    adapter: Option<u64>,
+) -> LinuxNativeWiimote {
+    // Reports are timestamped by the kernel on receive, without it they are timestamped after the read
+    let enable: c_int = 1;
+    _ = setsockopt(
+        data_socket,
+        SOL_SOCKET,
+        SO_TIMESTAMPNS,
+        std::ptr::addr_of!(enable).cast(),
+        std::mem::size_of::<c_int>() as socklen_t,
+    );
+
+    let mut address_string = [0u8; 19];
+    ba2str(bdaddr, address_string.as_mut_ptr().cast());
+
+    // Without the terminating null bytes, the identifier is parsed again by `parse_address`
+    let length = address_string
+        .iter()
+        .position(|&c| c == 0)
+        .unwrap_or(address_string.len());
+    let address = String::from_utf8_lossy(&address_string[..length]);
+    LinuxNativeWiimote::new(&address, control_socket, data_socket, adapter)
+}
+
+pub fn wiimotes_scan(
+    mode: ScanMode,
+    known_identifiers: &[Arc<str>],
+    found: &mut dyn FnMut(LinuxNativeWiimote),
+) {
+    let mut buffers = match SCAN_BUFFERS.lock() {
+        Ok(buffers) => buffers,
+        Err(buffers) => buffers.into_inner(),
+    };
+    let ScanBuffers {
+        adapters,
+        addresses,
+        inquiries,
+        workers,
+    } = &mut *buffers;
+    read_adapters(adapters);
+
+    // Wii remotes that connected or paged an adapter are not discoverable, they are found in every mode
+    let mut accepted = std::mem::take(&mut *lock_accepted_wiimotes());
+    let mut paging = std::mem::take(&mut *lock_paging_devices());
     unsafe {
-        let mut infos = Vec::with_capacity(MAX_INQUIRIES as _);
-        for _ in 0..MAX_INQUIRIES {
-            infos.push(std::mem::zeroed::<inquiry_info>());
+        retain_wiimotes(adapters, &mut accepted, |(address, _)| *address);
+        retain_wiimotes(adapters, &mut paging, |address| *address);
+    }
+
+    addresses.clear();
+    addresses.extend(paging.into_iter().map(|b| bdaddr_t { b }));
+    if mode == ScanMode::FastReconnect {
+        for bdaddr in known_identifiers
+            .iter()
+            .filter_map(|identifier| parse_address(identifier).map(key_address))
+        {
+            let is_connected = accepted.iter().any(|(address, _)| *address == bdaddr.b);
+            if !is_connected && !addresses.iter().any(|paging| paging.b == bdaddr.b) {
+                addresses.push(bdaddr);
+            }
         }
+    }
 
-        let bt_device_id = hci_get_route(std::ptr::null_mut());
-        let bt_socket = hci_open_dev(bt_device_id);
-        if bt_device_id < 0 || bt_socket < 0 {
-            eprintln!(
-                "Failed to open default bluetooth device: {}",
-                Errno::last().desc()
-            );
-            return;
+    for (_, wiimote) in accepted {
+        found(wiimote);
+    }
+    connect_wiimotes(addresses, adapters, workers, found);
+    if mode == ScanMode::Discover {
+        discover_wiimotes(adapters, inquiries, workers, addresses, found);
+    }
+}
+
+/// Keeps the devices that are Wii remotes by the name of the device at the address of each.
+/// All devices are kept if no adapter can read the names.
+unsafe fn retain_wiimotes<T>(
+    adapters: &[Adapter],
+    devices: &mut Vec<T>,
+    address: impl Fn(&T) -> [u8; 6],
+) {
+    let Some(adapter) = adapters.first().filter(|_| !devices.is_empty()) else {
+        return;
+    };
+    let bt_socket = hci_open_dev(adapter.id);
+    if bt_socket < 0 {
+        return;
+    }
+    devices.retain(|device| is_wiimote(bt_socket, &bdaddr_t { b: address(device) }));
+    _ = close(bt_socket);
+}
+
+/// Runs a single short inquiry on every adapter and connects to the Wii remotes found,
+/// each Wii remote is passed to `found` as soon as it is connected.
+/// A single adapter inquires on the scan thread, several adapters inquire in parallel on the `workers`.
+fn discover_wiimotes(
+    adapters: &[Adapter],
+    inquiries: &mut Vec<Inquiry>,
+    workers: &mut Vec<ScanWorker>,
+    wiimotes: &mut Vec<bdaddr_t>,
+    found: &mut dyn FnMut(LinuxNativeWiimote),
+) {
+    if adapters.is_empty() {
+        eprintln!("Failed to find a bluetooth adapter that is up");
+        return;
+    }
+
+    inquiries.truncate(adapters.len());
+    inquiries.resize_with(adapters.len(), Inquiry::default);
+    if let [adapter] = adapters {
+        unsafe { inquire_wiimotes(adapter, &mut inquiries[0]) };
+    } else {
+        if workers.len() < adapters.len() {
+            workers.resize_with(adapters.len(), ScanWorker::spawn);
         }
+        for (worker, &adapter) in workers.iter_mut().zip(adapters) {
+            if let Some(inquiry) = inquiries.pop() {
+                worker.start(ScanJob::Inquire { adapter, inquiry });
+            }
+        }
+        for worker in &mut workers[..adapters.len()] {
+            if let Some(ScanJob::Inquire { inquiry, .. }) = worker.finish() {
+                inquiries.push(inquiry);
+            }
+        }
+    }
 
-        let device_count = hci_inquiry(
-            bt_device_id,
-            SCAN_SECONDS,
-            MAX_INQUIRIES,
-            std::ptr::null(),
-            &mut infos.as_mut_ptr(),
-            IREQ_CACHE_FLUSH as _,
-        );
-        if device_count < 0 {
-            _ = close(bt_socket);
-            eprintln!(
-                "hci_inquiry failed while scanning for bluetooth devices: {}",
-                Errno::last().desc()
-            );
-            return;
+    wiimotes.clear();
+    for inquiry in inquiries.iter() {
+        for bdaddr in &inquiry.wiimotes {
+            // Wii remotes in range of several adapters are found by every one of them
+            if !wiimotes.iter().any(|wiimote| wiimote.b == bdaddr.b) {
+                wiimotes.push(*bdaddr);
+            }
         }
+    }
+
+    for &bdaddr in wiimotes.iter() {
+        if let Some(wiimote) = unsafe { handle_wiimote(bdaddr, adapters) } {
+            found(wiimote);
+        }
+    }
+}
 
-        for info in infos.iter().take(device_count as _) {
-            let mut name = [0u8; (MAX_NAME_LENGTH + 1) as _];
+/// Runs a single short inquiry on the adapter into the reused buffer of `inquiry`,
+/// replaces the found Wii remotes of `inquiry`.
+unsafe fn inquire_wiimotes(adapter: &Adapter, inquiry: &mut Inquiry) {
+    inquiry.wiimotes.clear();
+    let bt_socket = hci_open_dev(adapter.id);
+    if bt_socket < 0 {
+        eprintln!(
+            "Failed to open bluetooth adapter hci{}: {}",
+            adapter.id,
+            Errno::last().desc()
+        );
+        return;
+    }
 
-            if hci_read_remote_name(
-                bt_socket,
-                &info.bdaddr,
-                MAX_NAME_LENGTH,
-                name.as_mut_ptr().cast(),
-                0,
-            ) < 0
-            {
-                continue;
+    // Same request as `hci_inquiry`, which allocates its results on every call
+    let request = &mut inquiry.request;
+    #[allow(clippy::cast_possible_truncation, clippy::cast_sign_loss)]
+    {
+        request.request = hci_inquiry_req {
+            dev_id: adapter.id as u16,
+            flags: IREQ_CACHE_FLUSH as u16,
+            lap: GENERAL_INQUIRY_LAP,
+            length: INQUIRY_LENGTH,
+            num_rsp: MAX_INQUIRIES as u8,
+        };
+    }
+    if ioctl(
+        bt_socket,
+        HCIINQUIRY as _,
+        std::ptr::addr_of_mut!(**request),
+    ) < 0
+    {
+        _ = close(bt_socket);
+        eprintln!(
+            "hci_inquiry failed while scanning for bluetooth devices: {}",
+            Errno::last().desc()
+        );
+        return;
+    }
+
+    let device_count = usize::from(request.request.num_rsp).min(MAX_INQUIRIES);
+    inquiry.wiimotes.extend(
+        request.infos[..device_count]
+            .iter()
+            .filter(|info| is_wiimote(bt_socket, &info.bdaddr))
+            .map(|info| info.bdaddr),
+    );
+    _ = close(bt_socket);
+}
+
+/// Returns whether the device is a Wii remote, the result is cached by address
+/// so the name of a device is only read once.
+unsafe fn is_wiimote(bt_socket: c_int, bdaddr: &bdaddr_t) -> bool {
+    if let Some(&is_wiimote) = name_cache().get(&bdaddr.b) {
+        return is_wiimote;
+    }
+
+    // The cache is not locked while the name is read, the lookup can wait for the page timeout
+    let mut name = [0u8; (MAX_NAME_LENGTH + 1) as _];
+    if hci_read_remote_name(
+        bt_socket,
+        bdaddr,
+        MAX_NAME_LENGTH,
+        name.as_mut_ptr().cast(),
+        0,
+    ) < 0
+    {
+        // Not cached, the device may be out of range for now
+        return false;
+    }
+
+    let name_length = name.iter().position(|&c| c == 0).unwrap();
+    let is_wiimote = std::str::from_utf8(&name[..name_length]).is_ok_and(is_wiimote_device_name);
+    name_cache().insert(bdaddr.b, is_wiimote);
+    is_wiimote
+}
+
+fn name_cache() -> MutexGuard<'static, HashMap<[u8; 6], bool>> {
+    match NAME_CACHE.lock() {
+        Ok(name_cache) => name_cache,
+        Err(name_cache) => name_cache.into_inner(),
+    }
+}
+
+/// Connects to the Wii remotes with the given addresses without an inquiry.
+/// The connections are made concurrently on the `workers`, at most `CONNECTIONS_PER_ADAPTER`
+/// per adapter, Wii remotes out of range only fail after the page timeout.
+/// A single Wii remote is connected on the scan thread.
+fn connect_wiimotes(
+    addresses: &[bdaddr_t],
+    adapters: &[Adapter],
+    workers: &mut Vec<ScanWorker>,
+    found: &mut dyn FnMut(LinuxNativeWiimote),
+) {
+    match addresses {
+        [] => return,
+        [bdaddr] => {
+            if let Some(wiimote) = unsafe { handle_wiimote(*bdaddr, adapters) } {
+                found(wiimote);
             }
+            return;
+        }
+        _ => {}
+    }
 
-            let name_length = name.iter().position(|&c| c == 0).unwrap();
-            let name = String::from_utf8_lossy(&name[..name_length]);
-            if is_wiimote_device_name(&name) {
-                if let Some(wiimote) = handle_wiimote(info.bdaddr) {
-                    wiimotes.push(wiimote);
+    // The extra connections wait for the previous ones instead of spawning more threads
+    let worker_count = addresses
+        .len()
+        .min(adapters.len().max(1) * CONNECTIONS_PER_ADAPTER);
+    if workers.len() < worker_count {
+        workers.resize_with(worker_count, ScanWorker::spawn);
+    }
+    for addresses in addresses.chunks(worker_count) {
+        for (worker, &bdaddr) in workers.iter_mut().zip(addresses) {
+            let mut worker_adapters = std::mem::take(&mut worker.adapters);
+            worker_adapters.clear();
+            worker_adapters.extend_from_slice(adapters);
+            worker.start(ScanJob::Connect {
+                bdaddr,
+                adapters: worker_adapters,
+                wiimote: None,
+            });
+        }
+        for worker in &mut workers[..addresses.len()] {
+            if let Some(ScanJob::Connect {
+                adapters, wiimote, ..
+            }) = worker.finish()
+            {
+                worker.adapters = adapters;
+                if let Some(wiimote) = wiimote {
+                    found(wiimote);
                 }
             }
         }
-
-        _ = close(bt_socket);
     }
 }
 
-pub const fn wiimotes_scan_cleanup() {}
+/// Stops the threads of the scan, unless a scan is running.
+pub fn wiimotes_scan_cleanup() {
+    let mut buffers = match SCAN_BUFFERS.try_lock() {
+        Ok(buffers) => buffers,
+        Err(TryLockError::Poisoned(buffers)) => buffers.into_inner(),
+        Err(TryLockError::WouldBlock) => return,
+    };
+    buffers.workers.clear();
+}
 
 pub struct LinuxNativeWiimote {
     address: String,
     control_socket: c_int,
     data_socket: c_int,
+    /// Address of the adapter the sockets are bound to, counted in the `ADAPTER_LOADS`.
+    adapter: Option<u64>,
 }
 
 impl LinuxNativeWiimote {
-    fn new(address: &str, control_socket: c_int, data_socket: c_int) -> Self {
+    fn new(address: &str, control_socket: c_int, data_socket: c_int, adapter: Option<u64>) -> Self {
         Self {
             address: address.to_string(),
             control_socket,
             data_socket,
+            adapter,
+        }
+    }
+
+    /// Waits until the data socket is readable, returns `Some(false)` on timeout.
+    fn wait_readable(&self, timeout_millis: Option<i32>) -> Option<bool> {
+        wait_readable(self.data_socket, timeout_millis)
+    }
+
+    /// Sends the output report with the `flags` of `send`, returns 0 if a nonblocking send would block.
+    fn send(&self, buffer: &[u8], flags: c_int) -> Option<usize> {
+        let mut write_buffer = [0u8; WIIMOTE_DEFAULT_REPORT_BUFFER_SIZE];
+        write_buffer[0] = OUTPUT_PREFIX;
+
+        let data_bytes = usize::min(write_buffer.len() - 1, buffer.len());
+        write_buffer[1..=data_bytes].copy_from_slice(&buffer[..data_bytes]);
+
+        let bytes_written = unsafe {
+            send(
+                self.data_socket,
+                write_buffer.as_ptr().cast(),
+                data_bytes + 1,
+                flags,
+            )
+        };
+        if bytes_written < 0 {
+            let errno = Errno::last_raw();
+            return (flags & MSG_DONTWAIT != 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                .then_some(0);
+        }
+        if bytes_written == 0 {
+            None
+        } else {
+            Some((bytes_written - 1) as _)
         }
     }
 
@@ -154,36 +666,188 @@ impl LinuxNativeWiimote {
         buffer: &mut [u8],
         timeout_millis: Option<i32>,
     ) -> Option<usize> {
-        const TIMED_OUT: i32 = 0;
-        let mut read_poll = unsafe { std::mem::zeroed::<pollfd>() };
-        read_poll.fd = self.data_socket;
-        read_poll.events = POLLIN;
-
-        let mut fds = [read_poll];
-
-        let result = unsafe { poll(fds.as_mut_ptr(), 1, timeout_millis.unwrap_or(-1)) };
-        if result == TIMED_OUT {
+        if !self.wait_readable(timeout_millis)? {
             return Some(0);
         }
-        if result < 0 {
+
+        let mut report = RawReport::default();
+        let bytes_read = self.receive(&mut report)?;
+        let bytes_to_copy = usize::min(bytes_read, buffer.len());
+        buffer[..bytes_to_copy].copy_from_slice(&report.as_bytes()[..bytes_to_copy]);
+        Some(bytes_to_copy)
+    }
+
+    /// Receives a single frame into `report` with its kernel timestamp, blocks if no frame is queued.
+    /// Returns the size of the report without the input prefix.
+    fn receive(&mut self, report: &mut RawReport) -> Option<usize> {
+        let mut io_vector = iovec {
+            iov_base: report.data.as_mut_ptr().cast(),
+            iov_len: report.data.len(),
+        };
+        let mut control: ControlBuffer = [0; 8];
+        let mut header: msghdr = unsafe { std::mem::zeroed() };
+        header.msg_iov = &mut io_vector;
+        header.msg_iovlen = 1;
+        header.msg_control = control.as_mut_ptr().cast();
+        header.msg_controllen = std::mem::size_of_val(&control) as _;
+
+        let bytes_read = unsafe { recvmsg(self.data_socket, &mut header, 0) };
+        if bytes_read <= 0 {
             return None;
         }
+        #[allow(clippy::cast_sign_loss)]
+        let bytes_read = bytes_read as usize;
+        set_received_frame(report, bytes_read);
+        report.timestamp = Some(receive_time(&header, &ReceiveClock::now()));
+        Some(bytes_read - 1)
+    }
 
-        let mut read_buffer = [0u8; WIIMOTE_DEFAULT_REPORT_BUFFER_SIZE];
+    /// Receives up to `MAX_BATCH_SIZE` reports with a single system call without waiting.
+    /// The frames are received directly into the reports, the input prefix is skipped with `RawReport::offset`.
+    fn receive_batch(&mut self, reports: &mut [RawReport]) -> Option<usize> {
+        let batch_size = usize::min(reports.len(), MAX_BATCH_SIZE);
+        let mut io_vectors: [iovec; MAX_BATCH_SIZE] = unsafe { std::mem::zeroed() };
+        let mut controls: [ControlBuffer; MAX_BATCH_SIZE] = [[0; 8]; MAX_BATCH_SIZE];
+        let mut headers: [mmsghdr; MAX_BATCH_SIZE] = unsafe { std::mem::zeroed() };
+        for (((io_vector, control), header), report) in io_vectors
+            .iter_mut()
+            .zip(controls.iter_mut())
+            .zip(headers.iter_mut())
+            .zip(reports.iter_mut())
+            .take(batch_size)
+        {
+            io_vector.iov_base = report.data.as_mut_ptr().cast();
+            io_vector.iov_len = report.data.len();
+            header.msg_hdr.msg_iov = io_vector;
+            header.msg_hdr.msg_iovlen = 1;
+            header.msg_hdr.msg_control = control.as_mut_ptr().cast();
+            header.msg_hdr.msg_controllen = std::mem::size_of_val(control) as _;
+        }
 
-        let max_data_size = usize::min(read_buffer.len() - 1, buffer.len());
-        let bytes_read = read(self.data_socket, &mut read_buffer[..max_data_size]).ok()?;
-        if bytes_read == 0 {
-            return None;
+        #[allow(clippy::cast_possible_truncation)]
+        let received = unsafe {
+            recvmmsg(
+                self.data_socket,
+                headers.as_mut_ptr(),
+                batch_size as _,
+                MSG_DONTWAIT as _,
+                std::ptr::null_mut(),
+            )
+        };
+        if received < 0 {
+            let errno = Errno::last_raw();
+            return if errno == EAGAIN || errno == EWOULDBLOCK {
+                Some(0)
+            } else {
+                None
+            };
         }
 
-        debug_assert!(read_buffer[0] == INPUT_PREFIX);
-        buffer[..bytes_read - 1].copy_from_slice(&read_buffer[1..bytes_read]);
+        let clock = ReceiveClock::now();
+        #[allow(clippy::cast_sign_loss)]
+        for (index, header) in headers.iter().take(received as usize).enumerate() {
+            let bytes_read = header.msg_len as usize;
+            if bytes_read == 0 {
+                // Connection closed, return the reports received before
+                return if index > 0 { Some(index) } else { None };
+            }
+            set_received_frame(&mut reports[index], bytes_read);
+            reports[index].timestamp = Some(receive_time(&header.msg_hdr, &clock));
+        }
+        #[allow(clippy::cast_sign_loss)]
+        Some(received as usize)
+    }
+}
 
-        Some(bytes_read - 1)
+/// Waits until the socket is readable, returns `Some(false)` on timeout.
+fn wait_readable(socket: c_int, timeout_millis: Option<i32>) -> Option<bool> {
+    const TIMED_OUT: i32 = 0;
+    let mut read_poll = unsafe { std::mem::zeroed::<pollfd>() };
+    read_poll.fd = socket;
+    read_poll.events = POLLIN;
+
+    let mut fds = [read_poll];
+
+    let result = unsafe { poll(fds.as_mut_ptr(), 1, timeout_millis.unwrap_or(-1)) };
+    if result < 0 {
+        return None;
+    }
+    Some(result != TIMED_OUT)
+}
+
+/// Waits for input on a duplicate of the data socket of a `LinuxNativeWiimote`,
+/// the socket is shut down when the Wii remote is dropped, which wakes the wait.
+struct LinuxInputWaiter {
+    socket: c_int,
+}
+
+impl InputWaiter for LinuxInputWaiter {
+    fn wait(&self, timeout_millis: Option<usize>) {
+        let timeout_millis =
+            timeout_millis.map(|timeout_millis| i32::try_from(timeout_millis).unwrap_or(i32::MAX));
+        _ = wait_readable(self.socket, timeout_millis);
+    }
+}
+
+impl Drop for LinuxInputWaiter {
+    fn drop(&mut self) {
+        _ = close(self.socket);
+    }
+}
+
+/// Marks the frame received into `report.data` as report without the input prefix.
+fn set_received_frame(report: &mut RawReport, bytes_read: usize) {
+    debug_assert!(report.data[0] == INPUT_PREFIX);
+    report.offset = 1;
+    #[allow(clippy::cast_possible_truncation)]
+    {
+        report.length = (bytes_read - 1) as u8;
+    }
+}
+
+/// The monotonic and realtime clock read at the same time, to convert kernel timestamps to `Instant`.
+struct ReceiveClock {
+    instant: Instant,
+    system: SystemTime,
+}
+
+impl ReceiveClock {
+    fn now() -> Self {
+        Self {
+            instant: Instant::now(),
+            system: SystemTime::now(),
+        }
     }
 }
 
+/// Returns the `SCM_TIMESTAMPNS` kernel receive time of the message,
+/// the time of `clock` if the message has no timestamp.
+fn receive_time(header: &msghdr, clock: &ReceiveClock) -> Instant {
+    // The kernel timestamp uses the realtime clock, it is converted by its age to be monotonic
+    let mut timestamp = None;
+    unsafe {
+        let mut message = CMSG_FIRSTHDR(header);
+        while !message.is_null() {
+            if (*message).cmsg_level == SOL_SOCKET && (*message).cmsg_type == SCM_TIMESTAMPNS {
+                timestamp = Some(CMSG_DATA(message).cast::<timespec>().read_unaligned());
+                break;
+            }
+            message = CMSG_NXTHDR(header, message);
+        }
+    }
+    let Some(timestamp) = timestamp else {
+        return clock.instant;
+    };
+    #[allow(clippy::cast_sign_loss)]
+    let received = UNIX_EPOCH
+        + Duration::new(
+            timestamp.tv_sec as u64,
+            u32::try_from(timestamp.tv_nsec).unwrap_or(0),
+        );
+    let age = clock.system.duration_since(received).unwrap_or_default();
+    clock.instant.checked_sub(age).unwrap_or(clock.instant)
+}
+
 const INPUT_PREFIX: u8 = 0xA1;
 const OUTPUT_PREFIX: u8 = 0xA2;
 
@@ -200,34 +864,97 @@ impl NativeWiimote for LinuxNativeWiimote {
     }
 
     fn write(&mut self, buffer: &[u8]) -> Option<usize> {
-        let mut write_buffer = [0u8; WIIMOTE_DEFAULT_REPORT_BUFFER_SIZE];
-        write_buffer[0] = OUTPUT_PREFIX;
+        self.send(buffer, 0)
+    }
 
-        let data_bytes = usize::min(write_buffer.len() - 1, buffer.len());
-        write_buffer[1..=data_bytes].copy_from_slice(&buffer[..data_bytes]);
+    fn write_nonblocking(&mut self, buffer: &[u8]) -> Option<usize> {
+        self.send(buffer, MSG_DONTWAIT)
+    }
 
-        let bytes_written = unsafe {
-            write(
-                self.data_socket,
-                write_buffer.as_ptr().cast(),
-                data_bytes + 1,
-            )
-        };
-        if bytes_written <= 0 {
-            None
-        } else {
-            Some((bytes_written - 1) as _)
+    fn identifier(&self) -> &str {
+        &self.address
+    }
+
+    fn adapter(&self) -> Option<String> {
+        self.adapter.map(format_address)
+    }
+
+    fn input_waiter(&self) -> Option<Arc<dyn InputWaiter>> {
+        let socket = unsafe { fcntl(self.data_socket, F_DUPFD_CLOEXEC, 0) };
+        (socket >= 0).then(|| Arc::new(LinuxInputWaiter { socket }) as Arc<dyn InputWaiter>)
+    }
+
+    fn read_report(
+        &mut self,
+        report: &mut RawReport,
+        timeout_millis: Option<usize>,
+    ) -> Option<usize> {
+        let timeout_millis = timeout_millis
+            .map(|timeout_millis| i32::try_from(timeout_millis).expect("Invalid read timeout"));
+        if !self.wait_readable(timeout_millis)? {
+            return Some(0);
         }
+        self.receive(report)
     }
 
-    fn identifier(&self) -> String {
-        self.address.clone()
+    fn read_batch(&mut self, reports: &mut [RawReport]) -> Option<usize> {
+        let mut total = 0;
+        while total < reports.len() {
+            let requested = usize::min(reports.len() - total, MAX_BATCH_SIZE);
+            match self.receive_batch(&mut reports[total..]) {
+                Some(received) => {
+                    total += received;
+                    if received < requested {
+                        // The socket has no more queued reports
+                        break;
+                    }
+                }
+                None if total > 0 => break,
+                None => return None,
+            }
+        }
+        Some(total)
     }
 }
 
 impl Drop for LinuxNativeWiimote {
     fn drop(&mut self) {
+        // Wakes the `LinuxInputWaiter`, its duplicate keeps the socket open after the close
+        _ = unsafe { shutdown(self.data_socket, SHUT_RDWR) };
         _ = close(self.control_socket);
         _ = close(self.data_socket);
+        if let Some(adapter) = self.adapter {
+            lock_adapter_loads().remove(adapter);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_scan_workers_are_reused() {
+        // Adapters that do not exist fail the inquiry without waiting
+        let adapters = [100, 101, 102].map(|id| Adapter {
+            id,
+            address: bdaddr_t { b: [0; 6] },
+        });
+        let mut inquiries = Vec::new();
+        let mut workers = Vec::new();
+        let mut wiimotes = Vec::new();
+
+        for adapter_count in [3, 2, 3] {
+            discover_wiimotes(
+                &adapters[..adapter_count],
+                &mut inquiries,
+                &mut workers,
+                &mut wiimotes,
+                &mut |_| unreachable!(),
+            );
+            assert_eq!(inquiries.len(), adapter_count);
+            assert!(wiimotes.is_empty());
+        }
+        assert_eq!(workers.len(), 3);
     }
 }
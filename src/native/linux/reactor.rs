@@ -0,0 +1,178 @@
+use std::ffi::c_int;
+use std::io;
+
+use nix::libc::{
+    epoll_create1, epoll_ctl, epoll_event, epoll_wait, eventfd, read, write, EAGAIN, EEXIST,
+    EFD_CLOEXEC, EFD_NONBLOCK, ENOENT, EPOLLIN, EPOLLONESHOT, EPOLLOUT, EPOLL_CLOEXEC,
+    EPOLL_CTL_ADD, EPOLL_CTL_DEL, EPOLL_CTL_MOD,
+};
+use nix::unistd::close;
+
+use super::LinuxNativeWiimote;
+use crate::native::{NativeReactor, WAKE_TOKEN};
+
+const MAX_EVENTS: usize = 32;
+
+/// Waits for the data sockets of all registered Wii remotes with a single epoll set.
+pub struct LinuxNativeReactor {
+    epoll_fd: c_int,
+    /// Counter in the epoll set that is incremented by `wake`.
+    wake_fd: c_int,
+}
+
+impl LinuxNativeReactor {
+    /// Adds the data socket to the epoll set or modifies the events of the socket if it was already added.
+    fn control(&self, device: &LinuxNativeWiimote, token: usize, events: c_int) -> io::Result<()> {
+        let mut event = epoll_event {
+            events: events as u32,
+            u64: token as u64,
+        };
+        unsafe {
+            if epoll_ctl(self.epoll_fd, EPOLL_CTL_ADD, device.data_socket, &mut event) == 0 {
+                return Ok(());
+            }
+            let error = io::Error::last_os_error();
+            // A reconnected Wii remote can get the socket number of its previous connection
+            if error.raw_os_error() != Some(EEXIST)
+                || epoll_ctl(self.epoll_fd, EPOLL_CTL_MOD, device.data_socket, &mut event) < 0
+            {
+                return Err(error);
+            }
+        }
+        Ok(())
+    }
+}
+
+#[cfg_attr(not(feature = "async"), allow(dead_code))]
+const fn oneshot_events(writable: bool) -> c_int {
+    if writable {
+        EPOLLIN | EPOLLOUT | EPOLLONESHOT
+    } else {
+        EPOLLIN | EPOLLONESHOT
+    }
+}
+
+impl NativeReactor for LinuxNativeReactor {
+    type Device = LinuxNativeWiimote;
+
+    fn new() -> io::Result<Self> {
+        let epoll_fd = unsafe { epoll_create1(EPOLL_CLOEXEC) };
+        if epoll_fd < 0 {
+            return Err(io::Error::last_os_error());
+        }
+        let wake_fd = unsafe { eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK) };
+        if wake_fd < 0 {
+            let error = io::Error::last_os_error();
+            _ = close(epoll_fd);
+            return Err(error);
+        }
+        // Dropped reactors close both file descriptors
+        let reactor = Self { epoll_fd, wake_fd };
+        let mut event = epoll_event {
+            events: EPOLLIN as u32,
+            u64: WAKE_TOKEN as u64,
+        };
+        if unsafe { epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &mut event) } < 0 {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(reactor)
+    }
+
+    fn register(&self, device: &LinuxNativeWiimote, token: usize) -> io::Result<()> {
+        self.control(device, token, EPOLLIN)
+    }
+
+    fn register_oneshot(
+        &self,
+        device: &LinuxNativeWiimote,
+        token: usize,
+        writable: bool,
+    ) -> io::Result<()> {
+        self.control(device, token, oneshot_events(writable))
+    }
+
+    fn rearm(&self, device: &LinuxNativeWiimote, token: usize, writable: bool) -> io::Result<()> {
+        let mut event = epoll_event {
+            events: oneshot_events(writable) as u32,
+            u64: token as u64,
+        };
+        // Modifying the events reports the socket again if it is already ready
+        let result =
+            unsafe { epoll_ctl(self.epoll_fd, EPOLL_CTL_MOD, device.data_socket, &mut event) };
+        if result == 0 {
+            return Ok(());
+        }
+        let error = io::Error::last_os_error();
+        if error.raw_os_error() == Some(ENOENT) {
+            return self.register_oneshot(device, token, writable);
+        }
+        Err(error)
+    }
+
+    fn deregister(&self, device: &LinuxNativeWiimote) {
+        unsafe {
+            epoll_ctl(
+                self.epoll_fd,
+                EPOLL_CTL_DEL,
+                device.data_socket,
+                std::ptr::null_mut(),
+            );
+        }
+    }
+
+    fn wake(&self) -> io::Result<()> {
+        let increment = 1u64;
+        let result = unsafe { write(self.wake_fd, std::ptr::addr_of!(increment).cast(), 8) };
+        if result < 0 {
+            let error = io::Error::last_os_error();
+            // The counter is at its maximum, the reactor is woken anyway
+            if error.raw_os_error() != Some(EAGAIN) {
+                return Err(error);
+            }
+        }
+        Ok(())
+    }
+
+    fn wait(&self, ready: &mut Vec<usize>, timeout_millis: Option<usize>) -> io::Result<()> {
+        let timeout =
+            timeout_millis.map_or(-1, |timeout| i32::try_from(timeout).unwrap_or(i32::MAX));
+        let mut events = [epoll_event { events: 0, u64: 0 }; MAX_EVENTS];
+        let event_count = unsafe {
+            epoll_wait(
+                self.epoll_fd,
+                events.as_mut_ptr(),
+                MAX_EVENTS as c_int,
+                timeout,
+            )
+        };
+        if event_count < 0 {
+            let error = io::Error::last_os_error();
+            return if error.kind() == io::ErrorKind::Interrupted {
+                Ok(())
+            } else {
+                Err(error)
+            };
+        }
+
+        #[allow(clippy::cast_sign_loss, clippy::cast_possible_truncation)]
+        for event in &events[..event_count as usize] {
+            if event.u64 as usize == WAKE_TOKEN {
+                // Resets the counter, a concurrent `wake` reports it again
+                let mut counter = 0u64;
+                unsafe {
+                    read(self.wake_fd, std::ptr::addr_of_mut!(counter).cast(), 8);
+                }
+            } else {
+                ready.push(event.u64 as usize);
+            }
+        }
+        Ok(())
+    }
+}
+
+impl Drop for LinuxNativeReactor {
+    fn drop(&mut self) {
+        _ = close(self.epoll_fd);
+        _ = close(self.wake_fd);
+    }
+}
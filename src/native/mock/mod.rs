@@ -0,0 +1,634 @@
+mod replay;
+
+use std::collections::{BTreeMap, VecDeque};
+use std::sync::{Arc, Condvar, Mutex, MutexGuard, Weak};
+use std::time::{Duration, Instant};
+
+use once_cell::sync::Lazy;
+
+use super::{InputWaiter, NativeHotplug, NativeReactor, NativeWiimote, WAKE_TOKEN};
+use crate::input::RawReport;
+use crate::manager::ScanMode;
+
+pub use replay::{MockReplay, ReplayOptions, ReplayStats};
+
+const STATUS_REQUEST_ID: u8 = 0x15;
+const WRITE_MEMORY_ID: u8 = 0x16;
+const READ_MEMORY_ID: u8 = 0x17;
+const SPEAKER_DATA_ID: u8 = 0x18;
+const STATUS_ID: u8 = 0x20;
+const READ_MEMORY_DATA_ID: u8 = 0x21;
+const ACKNOWLEDGE_ID: u8 = 0x22;
+
+const EEPROM_SIZE: usize = 0x1700;
+/// Error of memory reads and writes outside of the EEPROM.
+const INVALID_ADDRESS_ERROR: u8 = 8;
+/// Error of memory reads and writes to registers of a device that is not connected.
+const NOT_CONNECTED_ERROR: u8 = 7;
+
+/// Accelerometer calibration stored at 0x0016 and 0x0020 of the EEPROM,
+/// zero at 0x200 and gravity at 0x268 on every axis.
+const ACCELEROMETER_CALIBRATION: [u8; 10] = {
+    let mut calibration: [u8; 10] = [0x80, 0x80, 0x80, 0x00, 0x9A, 0x9A, 0x9A, 0x00, 0x00, 0x55];
+    let mut index = 0;
+    while index < 9 {
+        calibration[9] = calibration[9].wrapping_add(calibration[index]);
+        index += 1;
+    }
+    calibration
+};
+
+/// Simulated Wii remotes that are found by the next scan.
+static AVAILABLE: Lazy<Mutex<Vec<Arc<MockShared>>>> = Lazy::new(|| Mutex::new(Vec::new()));
+/// Number of simulated Wii remotes connected so far, the `MockHotplug` is notified on every connect.
+static ARRIVALS: Lazy<(Mutex<usize>, Condvar)> = Lazy::new(|| (Mutex::new(0), Condvar::new()));
+
+fn lock<T>(mutex: &Mutex<T>) -> MutexGuard<'_, T> {
+    match mutex.lock() {
+        Ok(guard) => guard,
+        Err(err) => err.into_inner(),
+    }
+}
+
+pub fn wiimotes_scan(
+    mode: ScanMode,
+    known_identifiers: &[Arc<str>],
+    found: &mut dyn FnMut(MockNativeWiimote),
+) {
+    loop {
+        // Found one at a time to not lock the available Wii remotes while they are connected
+        let shared = {
+            let mut available = lock(&AVAILABLE);
+            let index = available.iter().position(|shared| {
+                mode == ScanMode::Discover
+                    || known_identifiers
+                        .iter()
+                        .any(|identifier| **identifier == *shared.identifier)
+            });
+            match index {
+                Some(index) => available.remove(index),
+                None => return,
+            }
+        };
+        shared.lock().attached = true;
+        found(MockNativeWiimote { shared });
+    }
+}
+
+pub fn wiimotes_scan_cleanup() {
+    lock(&AVAILABLE).clear();
+}
+
+struct MockState {
+    connected: bool,
+    /// Whether the Wii remote was found by a scan.
+    attached: bool,
+    input: VecDeque<RawReport>,
+    eeprom: Vec<u8>,
+    registers: BTreeMap<u32, u8>,
+    speaker_reports: usize,
+    /// Reactors notified when input is queued and the tokens they were registered with.
+    reactors: Vec<(Weak<ReactorShared>, usize)>,
+}
+
+impl MockState {
+    fn push(&mut self, report: RawReport) {
+        self.input.push_back(report);
+        self.notify_reactor();
+    }
+
+    fn notify_reactor(&self) {
+        for (reactor, token) in &self.reactors {
+            if let Some(reactor) = reactor.upgrade() {
+                reactor.notify(*token);
+            }
+        }
+    }
+
+    /// Answers the output report like a Wii remote without extensions.
+    fn handle_output(&mut self, report: &[u8]) {
+        match report {
+            [STATUS_REQUEST_ID, ..] => {
+                let mut status = [0u8; 7];
+                status[0] = STATUS_ID;
+                // Battery level
+                status[6] = 0xC0;
+                self.push(RawReport::from_bytes(&status));
+            }
+            [READ_MEMORY_ID, space, a0, a1, a2, s0, s1, ..] => {
+                let address = u32::from_be_bytes([0, *a0, *a1, *a2]);
+                let size = u16::from_be_bytes([*s0, *s1]) as usize;
+                self.read_memory(*space & 0x04 != 0, address, size);
+            }
+            [WRITE_MEMORY_ID, space, a0, a1, a2, size, data @ ..] if data.len() >= 16 => {
+                let address = u32::from_be_bytes([0, *a0, *a1, *a2]);
+                let size = usize::min(*size as usize, 16);
+                let error = self.write_memory(*space & 0x04 != 0, address, &data[..size]);
+                self.push(RawReport::from_bytes(&[
+                    ACKNOWLEDGE_ID,
+                    0,
+                    0,
+                    WRITE_MEMORY_ID,
+                    error,
+                ]));
+            }
+            [SPEAKER_DATA_ID, ..] => self.speaker_reports += 1,
+            _ => {}
+        }
+    }
+
+    fn read_memory(&mut self, control_registers: bool, address: u32, size: usize) {
+        let mut reply = [0u8; 22];
+        reply[0] = READ_MEMORY_DATA_ID;
+        for chunk_start in (0..size.max(1)).step_by(16) {
+            let chunk_address = address + chunk_start as u32;
+            let chunk_size = usize::min(16, size - chunk_start);
+            let error = self.access_error(control_registers, chunk_address, chunk_size);
+            #[allow(clippy::cast_possible_truncation)]
+            {
+                reply[3] = ((chunk_size.max(1) as u8 - 1) << 4) | error;
+            }
+            reply[4..6].copy_from_slice(&(chunk_address as u16).to_be_bytes());
+            reply[6..].fill(0);
+            if error == 0 {
+                for (index, byte) in reply[6..6 + chunk_size].iter_mut().enumerate() {
+                    let byte_address = chunk_address + index as u32;
+                    *byte = if control_registers {
+                        self.registers.get(&byte_address).copied().unwrap_or(0)
+                    } else {
+                        self.eeprom[byte_address as usize]
+                    };
+                }
+            }
+            self.push(RawReport::from_bytes(&reply));
+            if error != 0 {
+                // The Wii remote stops reading at the first error
+                return;
+            }
+        }
+    }
+
+    fn write_memory(&mut self, control_registers: bool, address: u32, data: &[u8]) -> u8 {
+        let error = self.access_error(control_registers, address, data.len());
+        if error == 0 {
+            for (index, byte) in data.iter().enumerate() {
+                let byte_address = address + index as u32;
+                if control_registers {
+                    self.registers.insert(byte_address, *byte);
+                } else {
+                    self.eeprom[byte_address as usize] = *byte;
+                }
+            }
+        }
+        error
+    }
+
+    fn access_error(&self, control_registers: bool, address: u32, size: usize) -> u8 {
+        if !control_registers {
+            if address as usize + size > self.eeprom.len() {
+                return INVALID_ADDRESS_ERROR;
+            }
+            return 0;
+        }
+        // Neither an extension nor a Motion Plus is connected
+        match address >> 16 {
+            0xA4 | 0xA6 => NOT_CONNECTED_ERROR,
+            _ => 0,
+        }
+    }
+}
+
+struct MockShared {
+    identifier: String,
+    state: Mutex<MockState>,
+    input_available: Condvar,
+}
+
+impl MockShared {
+    fn lock(&self) -> MutexGuard<'_, MockState> {
+        lock(&self.state)
+    }
+
+    /// Waits for the next change of the state, `None` once `deadline` passed.
+    fn wait_input<'a>(
+        &self,
+        state: MutexGuard<'a, MockState>,
+        deadline: Option<Instant>,
+    ) -> Option<MutexGuard<'a, MockState>> {
+        let Some(deadline) = deadline else {
+            return Some(match self.input_available.wait(state) {
+                Ok(state) => state,
+                Err(err) => err.into_inner(),
+            });
+        };
+        let remaining = deadline.saturating_duration_since(Instant::now());
+        if remaining.is_zero() {
+            return None;
+        }
+        Some(match self.input_available.wait_timeout(state, remaining) {
+            Ok((state, _)) => state,
+            Err(err) => err.into_inner().0,
+        })
+    }
+}
+
+/// A simulated Wii remote without a Bluetooth adapter, enabled by the `mock` feature.
+///
+/// The Wii remote is found by the next scan of the `WiimoteManager` like a real Wii remote.
+/// Memory reads and writes are answered like a Wii remote without extensions,
+/// reports sent with `send_report` are received by the connected `WiimoteDevice`.
+#[derive(Clone)]
+pub struct MockWiimote {
+    shared: Arc<MockShared>,
+}
+
+impl MockWiimote {
+    /// Creates a simulated Wii remote that is found by the next scan.
+    /// Connecting an identifier again reconnects the `WiimoteDevice` of that identifier.
+    #[must_use]
+    pub fn connect(identifier: &str) -> Self {
+        let mut eeprom = vec![0u8; EEPROM_SIZE];
+        eeprom[0x16..0x20].copy_from_slice(&ACCELEROMETER_CALIBRATION);
+        eeprom[0x20..0x2A].copy_from_slice(&ACCELEROMETER_CALIBRATION);
+        let shared = Arc::new(MockShared {
+            identifier: identifier.to_string(),
+            state: Mutex::new(MockState {
+                connected: true,
+                attached: false,
+                input: VecDeque::new(),
+                eeprom,
+                registers: BTreeMap::new(),
+                speaker_reports: 0,
+                reactors: Vec::new(),
+            }),
+            input_available: Condvar::new(),
+        });
+        lock(&AVAILABLE).push(Arc::clone(&shared));
+        let (arrivals, arrived) = &*ARRIVALS;
+        *lock(arrivals) += 1;
+        arrived.notify_all();
+        Self { shared }
+    }
+
+    /// Returns the identifier of the Wii remote, same as `WiimoteDevice::identifier`.
+    #[must_use]
+    pub fn identifier(&self) -> &str {
+        &self.shared.identifier
+    }
+
+    /// Queues an input report starting with the report ID, returns `false` if the Wii remote is disconnected.
+    pub fn send_report(&self, report: &[u8]) -> bool {
+        let mut state = self.shared.lock();
+        if !state.connected {
+            return false;
+        }
+        state.push(RawReport::from_bytes(report));
+        drop(state);
+        self.shared.input_available.notify_all();
+        true
+    }
+
+    /// Returns the number of queued input reports that were not received yet.
+    #[must_use]
+    pub fn queued_reports(&self) -> usize {
+        self.shared.lock().input.len()
+    }
+
+    /// Returns the number of speaker data reports the Wii remote received.
+    #[must_use]
+    pub fn speaker_reports(&self) -> usize {
+        self.shared.lock().speaker_reports
+    }
+
+    /// Returns whether the Wii remote is connected.
+    #[must_use]
+    pub fn is_connected(&self) -> bool {
+        self.shared.lock().connected
+    }
+
+    /// Returns whether the Wii remote is connected and was found by a scan.
+    #[must_use]
+    pub fn is_attached(&self) -> bool {
+        let state = self.shared.lock();
+        state.connected && state.attached
+    }
+
+    /// Connects the Wii remote again after `disconnect`, it is found by the next scan.
+    #[must_use]
+    pub fn reconnect(&self) -> Self {
+        Self::connect(self.identifier())
+    }
+
+    /// Disconnects the Wii remote, the next read or write of the `WiimoteDevice` fails.
+    pub fn disconnect(&self) {
+        let mut state = self.shared.lock();
+        state.connected = false;
+        state.input.clear();
+        state.notify_reactor();
+        drop(state);
+        self.shared.input_available.notify_all();
+    }
+}
+
+/// Wakes the scan thread as soon as a simulated Wii remote is connected.
+pub struct MockHotplug {
+    /// The number of arrivals already reported by `wait`.
+    seen_arrivals: usize,
+}
+
+impl NativeHotplug for MockHotplug {
+    fn new() -> std::io::Result<Self> {
+        Ok(Self {
+            seen_arrivals: *lock(&ARRIVALS.0),
+        })
+    }
+
+    fn wait(&mut self, timeout: Duration) -> bool {
+        let (arrivals, arrived) = &*ARRIVALS;
+        let seen_arrivals = self.seen_arrivals;
+        let arrivals = match arrived.wait_timeout_while(lock(arrivals), timeout, |arrivals| {
+            *arrivals == seen_arrivals
+        }) {
+            Ok((arrivals, _)) => arrivals,
+            Err(err) => err.into_inner().0,
+        };
+        self.seen_arrivals = *arrivals;
+        self.seen_arrivals != seen_arrivals
+    }
+}
+
+pub struct MockNativeWiimote {
+    shared: Arc<MockShared>,
+}
+
+impl MockNativeWiimote {
+    /// Takes the simulated Wii remote before it is found by a scan.
+    #[cfg(test)]
+    pub(crate) fn take(mock: &MockWiimote) -> Self {
+        lock(&AVAILABLE).retain(|shared| !Arc::ptr_eq(shared, &mock.shared));
+        Self {
+            shared: Arc::clone(&mock.shared),
+        }
+    }
+}
+
+impl MockNativeWiimote {
+    fn read_impl(&mut self, buffer: &mut [u8], timeout_millis: Option<usize>) -> Option<usize> {
+        let deadline = timeout_millis
+            .map(|timeout_millis| Instant::now() + Duration::from_millis(timeout_millis as u64));
+        let mut state = self.shared.lock();
+        loop {
+            if !state.connected {
+                return None;
+            }
+            if let Some(report) = state.input.pop_front() {
+                let bytes = report.as_bytes();
+                let size = usize::min(bytes.len(), buffer.len());
+                buffer[..size].copy_from_slice(&bytes[..size]);
+                return Some(size);
+            }
+            match self.shared.wait_input(state, deadline) {
+                Some(next) => state = next,
+                None => return Some(0),
+            }
+        }
+    }
+}
+
+/// Waits for input of a simulated Wii remote, woken like the reads of the device.
+struct MockInputWaiter {
+    shared: Arc<MockShared>,
+}
+
+impl InputWaiter for MockInputWaiter {
+    fn wait(&self, timeout_millis: Option<usize>) {
+        let deadline = timeout_millis
+            .map(|timeout_millis| Instant::now() + Duration::from_millis(timeout_millis as u64));
+        let mut state = self.shared.lock();
+        while state.connected && state.input.is_empty() {
+            match self.shared.wait_input(state, deadline) {
+                Some(next) => state = next,
+                None => return,
+            }
+        }
+    }
+}
+
+impl Drop for MockNativeWiimote {
+    fn drop(&mut self) {
+        let mut state = self.shared.lock();
+        state.connected = false;
+        state.reactors.clear();
+        drop(state);
+        self.shared.input_available.notify_all();
+    }
+}
+
+impl NativeWiimote for MockNativeWiimote {
+    fn read(&mut self, buffer: &mut [u8]) -> Option<usize> {
+        self.read_impl(buffer, None)
+    }
+
+    fn read_timeout(&mut self, buffer: &mut [u8], timeout_millis: usize) -> Option<usize> {
+        self.read_impl(buffer, Some(timeout_millis))
+    }
+
+    fn write(&mut self, buffer: &[u8]) -> Option<usize> {
+        let mut state = self.shared.lock();
+        if !state.connected {
+            return None;
+        }
+        state.handle_output(buffer);
+        drop(state);
+        self.shared.input_available.notify_all();
+        Some(buffer.len())
+    }
+
+    fn identifier(&self) -> &str {
+        &self.shared.identifier
+    }
+
+    fn input_waiter(&self) -> Option<Arc<dyn InputWaiter>> {
+        Some(Arc::new(MockInputWaiter {
+            shared: Arc::clone(&self.shared),
+        }))
+    }
+}
+
+type ReactorWaker = Box<dyn Fn() + Send + Sync>;
+
+#[derive(Default)]
+struct ReactorShared {
+    ready: Mutex<Vec<usize>>,
+    ready_changed: Condvar,
+    /// Called on every notification, wakes a thread that waits for another reactor.
+    waker: Option<ReactorWaker>,
+}
+
+impl ReactorShared {
+    fn notify(&self, token: usize) {
+        lock(&self.ready).push(token);
+        self.ready_changed.notify_one();
+        if let Some(waker) = &self.waker {
+            waker();
+        }
+    }
+}
+
+/// Waits for input of the registered simulated Wii remotes.
+pub struct MockNativeReactor {
+    shared: Arc<ReactorShared>,
+}
+
+impl MockNativeReactor {
+    /// Creates a reactor that calls `waker` whenever a token becomes ready,
+    /// so the tokens can be collected with `wait` after waiting for another reactor.
+    pub fn with_waker(waker: impl Fn() + Send + Sync + 'static) -> Self {
+        Self {
+            shared: Arc::new(ReactorShared {
+                waker: Some(Box::new(waker)),
+                ..ReactorShared::default()
+            }),
+        }
+    }
+}
+
+impl NativeReactor for MockNativeReactor {
+    type Device = MockNativeWiimote;
+
+    fn new() -> std::io::Result<Self> {
+        Ok(Self {
+            shared: Arc::default(),
+        })
+    }
+
+    fn register(&self, device: &MockNativeWiimote, token: usize) -> std::io::Result<()> {
+        let mut state = device.shared.lock();
+        let reactor = Arc::downgrade(&self.shared);
+        state.reactors.retain(|(registered, _)| {
+            !registered.ptr_eq(&reactor) && registered.strong_count() > 0
+        });
+        state.reactors.push((reactor, token));
+        if !state.input.is_empty() || !state.connected {
+            state.notify_reactor();
+        }
+        Ok(())
+    }
+
+    fn register_oneshot(
+        &self,
+        device: &MockNativeWiimote,
+        token: usize,
+        writable: bool,
+    ) -> std::io::Result<()> {
+        self.register(device, token)?;
+        if writable {
+            // Writes never block
+            self.shared.notify(token);
+        }
+        Ok(())
+    }
+
+    fn rearm(
+        &self,
+        device: &MockNativeWiimote,
+        token: usize,
+        writable: bool,
+    ) -> std::io::Result<()> {
+        // Every queued report notifies the reactor, spurious notifications are allowed
+        self.register_oneshot(device, token, writable)
+    }
+
+    fn deregister(&self, device: &MockNativeWiimote) {
+        let reactor = Arc::downgrade(&self.shared);
+        device
+            .shared
+            .lock()
+            .reactors
+            .retain(|(registered, _)| !registered.ptr_eq(&reactor));
+    }
+
+    fn wake(&self) -> std::io::Result<()> {
+        self.shared.notify(WAKE_TOKEN);
+        Ok(())
+    }
+
+    fn wait(&self, ready: &mut Vec<usize>, timeout_millis: Option<usize>) -> std::io::Result<()> {
+        let mut tokens = lock(&self.shared.ready);
+        if tokens.is_empty() {
+            tokens = match timeout_millis {
+                Some(timeout_millis) => {
+                    let timeout = Duration::from_millis(timeout_millis as u64);
+                    match self
+                        .shared
+                        .ready_changed
+                        .wait_timeout_while(tokens, timeout, |tokens| tokens.is_empty())
+                    {
+                        Ok((tokens, _)) => tokens,
+                        Err(err) => err.into_inner().0,
+                    }
+                }
+                None => match self
+                    .shared
+                    .ready_changed
+                    .wait_while(tokens, |tokens| tokens.is_empty())
+                {
+                    Ok(tokens) => tokens,
+                    Err(err) => err.into_inner(),
+                },
+            };
+        }
+        ready.extend(tokens.drain(..).filter(|token| *token != WAKE_TOKEN));
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn native(identifier: &str) -> (MockWiimote, MockNativeWiimote) {
+        let mock = MockWiimote::connect(identifier);
+        let native = MockNativeWiimote::take(&mock);
+        (mock, native)
+    }
+
+    #[test]
+    fn test_read_memory_reply() {
+        let (_mock, mut native) = native("mock-read-memory");
+        let mut buffer = [0u8; 32];
+
+        assert_eq!(
+            native.write(&[READ_MEMORY_ID, 0, 0, 0, 0x16, 0, 10]),
+            Some(7)
+        );
+        assert_eq!(native.read_timeout(&mut buffer, 0), Some(22));
+        assert_eq!(buffer[..6], [READ_MEMORY_DATA_ID, 0, 0, 0x90, 0x00, 0x16]);
+        assert_eq!(buffer[6..16], ACCELEROMETER_CALIBRATION);
+        assert_eq!(native.read_timeout(&mut buffer, 0), Some(0));
+    }
+
+    #[test]
+    fn test_disconnect_fails_reads() {
+        let (mock, mut native) = native("mock-disconnect");
+        let mut buffer = [0u8; 32];
+
+        assert!(mock.send_report(&[0x30, 0x00, 0x00]));
+        assert_eq!(native.read_timeout(&mut buffer, 0), Some(3));
+        mock.disconnect();
+        assert!(!mock.send_report(&[0x30, 0x00, 0x00]));
+        assert_eq!(native.read_timeout(&mut buffer, 0), None);
+        assert_eq!(native.write(&[STATUS_REQUEST_ID, 0]), None);
+    }
+
+    #[test]
+    fn test_hotplug_woken_by_connect() {
+        let mut hotplug = MockHotplug::new().unwrap();
+        let thread = std::thread::spawn(|| {
+            std::thread::sleep(Duration::from_millis(20));
+            MockNativeWiimote::take(&MockWiimote::connect("mock-hotplug"))
+        });
+        assert!(hotplug.wait(Duration::from_secs(10)));
+        thread.join().unwrap();
+    }
+}
@@ -0,0 +1,292 @@
+use std::cmp::Reverse;
+use std::collections::BinaryHeap;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::Arc;
+use std::thread::JoinHandle;
+use std::time::{Duration, Instant};
+
+use super::MockWiimote;
+use crate::input::RawReport;
+
+/// Longest sleep of the replay thread, so a stop request is noticed quickly.
+const MAX_SLEEP: Duration = Duration::from_millis(10);
+
+/// How a report stream is replayed by `MockReplay`.
+#[derive(Debug, Clone)]
+pub struct ReplayOptions {
+    /// Reports sent per second.
+    pub rate: f64,
+    /// Time of every report since the start of the stream, replaces `rate` with the recorded intervals.
+    /// See `capture::CapturedStream`.
+    pub timestamps: Option<Arc<[Duration]>>,
+    /// Maximum random deviation of the interval between two reports.
+    pub jitter: Duration,
+    /// Probability between 0 and 1 that a report is lost instead of sent.
+    pub loss: f64,
+    /// Disconnects the Wii remote after this time connected, `None` to stay connected.
+    pub disconnect_after: Option<Duration>,
+    /// Time until a disconnected Wii remote connects again.
+    pub reconnect_after: Duration,
+    /// Starts the stream again after the last report instead of stopping.
+    pub repeat: bool,
+    /// Seed of the random jitter and loss, equal seeds replay the same way.
+    pub seed: u64,
+}
+
+impl Default for ReplayOptions {
+    fn default() -> Self {
+        Self {
+            rate: 100.0,
+            timestamps: None,
+            jitter: Duration::ZERO,
+            loss: 0.0,
+            disconnect_after: None,
+            reconnect_after: Duration::from_millis(500),
+            repeat: true,
+            seed: 0,
+        }
+    }
+}
+
+/// Counters of a replayed stream.
+#[derive(Debug, Default, Clone)]
+pub struct ReplayStats {
+    pub identifier: String,
+    /// Reports received by the simulated Wii remote.
+    pub sent: usize,
+    /// Reports dropped by `ReplayOptions::loss`.
+    pub lost: usize,
+    /// Reports skipped while the Wii remote was not attached to a `WiimoteDevice`.
+    pub skipped: usize,
+    pub disconnects: usize,
+}
+
+/// Small deterministic random number generator (SplitMix64).
+struct Random(u64);
+
+impl Random {
+    fn next_u64(&mut self) -> u64 {
+        self.0 = self.0.wrapping_add(0x9E37_79B9_7F4A_7C15);
+        let mut z = self.0;
+        z = (z ^ (z >> 30)).wrapping_mul(0xBF58_476D_1CE4_E5B9);
+        z = (z ^ (z >> 27)).wrapping_mul(0x94D0_49BB_1331_11EB);
+        z ^ (z >> 31)
+    }
+
+    /// Returns a value in `0.0..1.0`.
+    #[allow(clippy::cast_precision_loss)]
+    fn next_f64(&mut self) -> f64 {
+        (self.next_u64() >> 11) as f64 / (1u64 << 53) as f64
+    }
+}
+
+struct ReplayStream {
+    mock: MockWiimote,
+    reports: Arc<[RawReport]>,
+    options: ReplayOptions,
+    random: Random,
+    position: usize,
+    /// Time of the next disconnect while connected, of the reconnect while disconnected.
+    next_connection_change: Option<Instant>,
+    stats: ReplayStats,
+}
+
+impl ReplayStream {
+    fn new(mock: MockWiimote, reports: Arc<[RawReport]>, options: ReplayOptions) -> Self {
+        let stats = ReplayStats {
+            identifier: mock.identifier().to_string(),
+            ..ReplayStats::default()
+        };
+        Self {
+            random: Random(options.seed),
+            mock,
+            reports,
+            options,
+            position: 0,
+            next_connection_change: None,
+            stats,
+        }
+    }
+
+    /// Returns the interval until the next report, varied by up to `ReplayOptions::jitter`.
+    /// The stream restarts after the rate interval when using recorded timestamps.
+    fn next_interval(&mut self) -> Duration {
+        let interval = match &self.options.timestamps {
+            Some(timestamps) if self.position > 0 && self.position < timestamps.len() => {
+                timestamps[self.position].saturating_sub(timestamps[self.position - 1])
+            }
+            _ => Duration::from_secs_f64(1.0 / self.options.rate.max(f64::MIN_POSITIVE)),
+        };
+        if self.options.jitter.is_zero() {
+            return interval;
+        }
+        // Uniform between `interval - jitter` and `interval + jitter`
+        let offset = self.options.jitter.mul_f64(2.0 * self.random.next_f64());
+        (interval + offset).saturating_sub(self.options.jitter)
+    }
+
+    /// Sends the next report or changes the connection, returns the time of the next step
+    /// or `None` when the stream ended.
+    fn step(&mut self, now: Instant) -> Option<Instant> {
+        if let Some(change_at) = self
+            .next_connection_change
+            .filter(|change_at| now >= *change_at)
+        {
+            return Some(self.change_connection(change_at));
+        }
+        if !self.mock.is_connected() {
+            return self.next_connection_change;
+        }
+
+        if self.position == self.reports.len() {
+            if !self.options.repeat || self.reports.is_empty() {
+                return None;
+            }
+            self.position = 0;
+        }
+        let report = self.reports[self.position];
+        self.position += 1;
+
+        if !self.mock.is_attached() {
+            self.stats.skipped += 1;
+        } else if self.options.loss > 0.0 && self.random.next_f64() < self.options.loss {
+            self.stats.lost += 1;
+        } else if self.mock.send_report(report.as_bytes()) {
+            self.stats.sent += 1;
+        }
+
+        if self.next_connection_change.is_none() && self.mock.is_attached() {
+            self.next_connection_change = self.options.disconnect_after.map(|after| now + after);
+        }
+        Some(now + self.next_interval())
+    }
+
+    fn change_connection(&mut self, now: Instant) -> Instant {
+        if self.mock.is_connected() {
+            self.mock.disconnect();
+            self.stats.disconnects += 1;
+            self.next_connection_change = Some(now + self.options.reconnect_after);
+            now + self.options.reconnect_after
+        } else {
+            self.mock = self.mock.reconnect();
+            // The disconnect timer starts once the Wii remote is attached again
+            self.next_connection_change = None;
+            now
+        }
+    }
+}
+
+/// Replays report streams on simulated Wii remotes from a single thread,
+/// with configurable rate, jitter, loss and disconnects per Wii remote.
+///
+/// Reports are only sent while the Wii remote is attached to a `WiimoteDevice`,
+/// like a real Wii remote that only sends reports while connected.
+pub struct MockReplay {
+    stop: Arc<AtomicBool>,
+    thread: Option<JoinHandle<Vec<ReplayStats>>>,
+}
+
+impl MockReplay {
+    /// Starts replaying `reports`, starting with the report ID, on every simulated Wii remote.
+    #[must_use]
+    pub fn start(streams: Vec<(MockWiimote, Arc<[RawReport]>, ReplayOptions)>) -> Self {
+        let stop = Arc::new(AtomicBool::new(false));
+        let thread_stop = Arc::clone(&stop);
+        let streams = streams
+            .into_iter()
+            .map(|(mock, reports, options)| ReplayStream::new(mock, reports, options))
+            .collect();
+        let thread = std::thread::Builder::new()
+            .name("wii-remote-replay".to_string())
+            .spawn(move || run(streams, &thread_stop))
+            .expect("Failed to spawn Wii remote replay thread");
+        Self {
+            stop,
+            thread: Some(thread),
+        }
+    }
+
+    /// Stops the replay and returns the counters of every stream in the order they were started.
+    #[must_use]
+    pub fn stop(mut self) -> Vec<ReplayStats> {
+        self.stop.store(true, Ordering::Relaxed);
+        self.thread
+            .take()
+            .and_then(|thread| thread.join().ok())
+            .unwrap_or_default()
+    }
+}
+
+impl Drop for MockReplay {
+    fn drop(&mut self) {
+        self.stop.store(true, Ordering::Relaxed);
+        if let Some(thread) = self.thread.take() {
+            _ = thread.join();
+        }
+    }
+}
+
+fn run(mut streams: Vec<ReplayStream>, stop: &AtomicBool) -> Vec<ReplayStats> {
+    let start = Instant::now();
+    let mut schedule = (0..streams.len())
+        .map(|index| Reverse((start, index)))
+        .collect::<BinaryHeap<_>>();
+
+    while !stop.load(Ordering::Relaxed) {
+        let Some(&Reverse((due, index))) = schedule.peek() else {
+            break;
+        };
+        let now = Instant::now();
+        if due > now {
+            std::thread::sleep(Duration::min(due - now, MAX_SLEEP));
+            continue;
+        }
+        schedule.pop();
+        if let Some(next) = streams[index].step(now) {
+            schedule.push(Reverse((next, index)));
+        }
+    }
+    streams.into_iter().map(|stream| stream.stats).collect()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_interval_jitter_is_deterministic() {
+        let options = ReplayOptions {
+            rate: 200.0,
+            jitter: Duration::from_millis(2),
+            seed: 42,
+            ..ReplayOptions::default()
+        };
+        let mock = MockWiimote::connect("replay-jitter");
+        let reports: Arc<[RawReport]> = Arc::new([]);
+        let mut first = ReplayStream::new(mock.clone(), Arc::clone(&reports), options.clone());
+        let mut second = ReplayStream::new(mock, reports, options);
+
+        for _ in 0..100 {
+            let interval = first.next_interval();
+            assert_eq!(interval, second.next_interval());
+            assert!(interval >= Duration::from_millis(3) && interval <= Duration::from_millis(7));
+        }
+    }
+
+    #[test]
+    fn test_unattached_reports_skipped() {
+        let mock = MockWiimote::connect("replay-unattached");
+        let reports: Arc<[RawReport]> = Arc::new([RawReport::from_bytes(&[0x30, 0x00, 0x00])]);
+        let options = ReplayOptions {
+            repeat: false,
+            ..ReplayOptions::default()
+        };
+        let mut stream = ReplayStream::new(mock.clone(), reports, options);
+
+        let now = Instant::now();
+        assert!(stream.step(now).is_some());
+        assert_eq!(stream.step(now), None);
+        assert_eq!(stream.stats.skipped, 1);
+        assert_eq!(mock.queued_reports(), 0);
+    }
+}
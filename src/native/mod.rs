@@ -1,25 +1,253 @@
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+use crate::input::RawReport;
+
+#[cfg(feature = "mock")]
+mod combined;
 mod common;
 #[cfg(target_os = "linux")]
 mod linux;
+#[cfg(feature = "mock")]
+mod mock;
 #[cfg(not(any(target_os = "linux", target_os = "windows")))]
 mod null;
 #[cfg(target_os = "windows")]
 mod windows;
 
 #[cfg(target_os = "linux")]
-pub use linux::{wiimotes_scan, wiimotes_scan_cleanup, LinuxNativeWiimote as NativeWiimoteDevice};
+pub use linux::{
+    wiimotes_scan as platform_wiimotes_scan,
+    wiimotes_scan_cleanup as platform_wiimotes_scan_cleanup, LinuxHotplug as PlatformHotplug,
+    LinuxNativeReactor as PlatformReactor, LinuxNativeWiimote as PlatformWiimote,
+};
 
 #[cfg(not(any(target_os = "linux", target_os = "windows")))]
-pub use null::{wiimotes_scan, wiimotes_scan_cleanup, NullNativeWiimote as NativeWiimoteDevice};
+pub use null::{
+    wiimotes_scan as platform_wiimotes_scan,
+    wiimotes_scan_cleanup as platform_wiimotes_scan_cleanup, NullHotplug as PlatformHotplug,
+    NullNativeReactor as PlatformReactor, NullNativeWiimote as PlatformWiimote,
+};
 
 #[cfg(target_os = "windows")]
 pub use windows::{
-    wiimotes_scan, wiimotes_scan_cleanup, WindowsNativeWiimote as NativeWiimoteDevice,
+    wiimotes_scan as platform_wiimotes_scan,
+    wiimotes_scan_cleanup as platform_wiimotes_scan_cleanup, WindowsHotplug as PlatformHotplug,
+    WindowsNativeReactor as PlatformReactor, WindowsNativeWiimote as PlatformWiimote,
 };
 
+#[cfg(not(feature = "mock"))]
+pub use self::{
+    platform_wiimotes_scan as wiimotes_scan,
+    platform_wiimotes_scan_cleanup as wiimotes_scan_cleanup,
+    PlatformHotplug as NativeWiimoteHotplug, PlatformReactor as NativeWiimoteReactor,
+    PlatformWiimote as NativeWiimoteDevice,
+};
+
+// The mock feature adds simulated Wii remotes next to the platform backend
+#[cfg(feature = "mock")]
+pub use combined::{
+    wiimotes_scan, wiimotes_scan_cleanup, CombinedHotplug as NativeWiimoteHotplug,
+    CombinedNativeReactor as NativeWiimoteReactor, CombinedNativeWiimote as NativeWiimoteDevice,
+};
+#[cfg(feature = "mock")]
+pub use mock::{MockReplay, MockWiimote, ReplayOptions, ReplayStats};
+
 pub trait NativeWiimote {
     fn read(&mut self, buffer: &mut [u8]) -> Option<usize>;
     fn read_timeout(&mut self, buffer: &mut [u8], timeout_millis: usize) -> Option<usize>;
     fn write(&mut self, buffer: &[u8]) -> Option<usize>;
-    fn identifier(&self) -> String;
+    fn identifier(&self) -> &str;
+
+    /// Returns the address of the Bluetooth adapter the Wii remote is connected through, if known.
+    fn adapter(&self) -> Option<String> {
+        None
+    }
+
+    /// Writes without waiting for a previous write to complete, returns 0 if the write would block.
+    #[cfg_attr(not(feature = "async"), allow(dead_code))]
+    fn write_nonblocking(&mut self, buffer: &[u8]) -> Option<usize> {
+        self.write(buffer)
+    }
+
+    /// Returns a waiter for input of the device, so reads wait without holding the device.
+    /// Reads wait in the native read if `None`.
+    fn input_waiter(&self) -> Option<Arc<dyn InputWaiter>> {
+        None
+    }
+
+    /// Returns when the last successful read completed, if the native device tracks it.
+    /// Otherwise reports are timestamped after the read returned.
+    fn last_read_completion(&self) -> Option<Instant> {
+        None
+    }
+
+    /// Reads a single report into `report`, waits forever if `timeout_millis` is `None`.
+    /// Returns the size of the report or 0 if no report was received before the timeout.
+    fn read_report(
+        &mut self,
+        report: &mut RawReport,
+        timeout_millis: Option<usize>,
+    ) -> Option<usize> {
+        let bytes_read = match timeout_millis {
+            Some(timeout_millis) => self.read_timeout(&mut report.data, timeout_millis),
+            None => self.read(&mut report.data),
+        }?;
+        report.offset = 0;
+        #[allow(clippy::cast_possible_truncation)]
+        {
+            report.length = bytes_read as u8;
+        }
+        report.timestamp =
+            (bytes_read > 0).then(|| self.last_read_completion().unwrap_or_else(Instant::now));
+        Some(bytes_read)
+    }
+
+    /// Reads the reports that are available without waiting, returns the number of reports read.
+    fn read_batch(&mut self, reports: &mut [RawReport]) -> Option<usize> {
+        for (index, report) in reports.iter_mut().enumerate() {
+            match self.read_report(report, Some(0)) {
+                Some(0) => return Some(index),
+                Some(_) => {}
+                // Reports already read are returned, the next read fails again
+                None if index > 0 => return Some(index),
+                None => return None,
+            }
+        }
+        Some(reports.len())
+    }
+}
+
+/// Waits for input of a native device without access to the device, see `NativeWiimote::input_waiter`.
+pub trait InputWaiter: Send + Sync {
+    /// Waits until the device has input, failed or was dropped, forever if `timeout_millis` is `None`.
+    /// Returns early without input if the wait failed, the next read of the device detects the error.
+    fn wait(&self, timeout_millis: Option<usize>);
+}
+
+/// Token used by `NativeReactor::wake`, never reported by `NativeReactor::wait`.
+#[cfg_attr(
+    not(any(target_os = "linux", target_os = "windows", feature = "mock")),
+    allow(dead_code)
+)]
+const WAKE_TOKEN: usize = usize::MAX;
+
+/// Waits for input on many native Wii remotes at once (epoll on Linux, IOCP on Windows).
+pub trait NativeReactor: Sized {
+    type Device;
+
+    fn new() -> std::io::Result<Self>;
+    /// Registers the device, `wait` reports `token` when the device has input available.
+    /// On Windows a device can only be registered with one reactor, registering it with another fails.
+    fn register(&self, device: &Self::Device, token: usize) -> std::io::Result<()>;
+    /// Registers the device to report `token` once when it has input available
+    /// or, if `writable`, a write would no longer block.
+    #[cfg_attr(not(feature = "async"), allow(dead_code))]
+    fn register_oneshot(
+        &self,
+        device: &Self::Device,
+        token: usize,
+        writable: bool,
+    ) -> std::io::Result<()>;
+    /// Arms a device registered with `register_oneshot` again after `wait` reported its token.
+    /// The device must be read or written until it would block before it is armed again.
+    #[cfg_attr(not(feature = "async"), allow(dead_code))]
+    fn rearm(&self, device: &Self::Device, token: usize, writable: bool) -> std::io::Result<()>;
+    fn deregister(&self, device: &Self::Device);
+    /// Makes a thread waiting in `wait` return without a token, or the next `wait` if no thread is waiting.
+    fn wake(&self) -> std::io::Result<()>;
+    /// Waits until registered devices have input and appends their tokens to `ready`.
+    /// Tokens can be reported spuriously, reading the device must not block afterwards.
+    ///
+    /// Devices can be registered and armed by other threads while a thread is waiting.
+    fn wait(&self, ready: &mut Vec<usize>, timeout_millis: Option<usize>) -> std::io::Result<()>;
+}
+
+/// Notifies the scan thread of Wii remotes becoming available without an inquiry, e.g. a paired
+/// Wii remote reconnecting after a button press (device notifications on Windows, HCI events on Linux).
+pub trait NativeHotplug: Sized {
+    fn new() -> std::io::Result<Self>;
+    /// Waits up to `timeout` for a Wii remote to become available, returns whether one did.
+    /// The Wii remote is found by the next `wiimotes_scan`.
+    fn wait(&mut self, timeout: Duration) -> bool;
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Returns the queued reports, then no data or a read error.
+    struct QueuedWiimote {
+        reports: Vec<Vec<u8>>,
+        fail_when_empty: bool,
+    }
+
+    impl NativeWiimote for QueuedWiimote {
+        fn read(&mut self, _buffer: &mut [u8]) -> Option<usize> {
+            unreachable!()
+        }
+
+        fn read_timeout(&mut self, buffer: &mut [u8], _timeout_millis: usize) -> Option<usize> {
+            if self.reports.is_empty() {
+                return if self.fail_when_empty { None } else { Some(0) };
+            }
+            let report = self.reports.remove(0);
+            buffer[..report.len()].copy_from_slice(&report);
+            Some(report.len())
+        }
+
+        fn write(&mut self, _buffer: &[u8]) -> Option<usize> {
+            unreachable!()
+        }
+
+        fn identifier(&self) -> &str {
+            ""
+        }
+    }
+
+    #[test]
+    fn test_read_batch_stops_when_empty() {
+        let mut wiimote = QueuedWiimote {
+            reports: vec![
+                vec![0x30, 0x01, 0x00],
+                vec![0x31, 0x00, 0x02, 0x80, 0x80, 0x80],
+            ],
+            fail_when_empty: false,
+        };
+        let mut reports = [RawReport::default(); 4];
+
+        let before = Instant::now();
+        assert_eq!(wiimote.read_batch(&mut reports), Some(2));
+        assert_eq!(reports[0].as_bytes(), [0x30, 0x01, 0x00]);
+        assert_eq!(reports[1].as_bytes(), [0x31, 0x00, 0x02, 0x80, 0x80, 0x80]);
+        // Reports are timestamped after the read without a completion time of the native device
+        assert!(reports[..2].iter().all(|report| report
+            .timestamp()
+            .is_some_and(|timestamp| timestamp >= before)));
+        assert_eq!(wiimote.read_batch(&mut reports), Some(0));
+    }
+
+    #[test]
+    fn test_read_batch_returns_reports_before_error() {
+        let mut wiimote = QueuedWiimote {
+            reports: vec![vec![0x30, 0x00, 0x00]],
+            fail_when_empty: true,
+        };
+        let mut reports = [RawReport::default(); 4];
+
+        assert_eq!(wiimote.read_batch(&mut reports), Some(1));
+        assert_eq!(wiimote.read_batch(&mut reports), None);
+    }
+
+    #[test]
+    fn test_read_batch_limited_by_buffer() {
+        let mut wiimote = QueuedWiimote {
+            reports: vec![vec![0x30, 0x00, 0x00]; 3],
+            fail_when_empty: false,
+        };
+        let mut reports = [RawReport::default(); 2];
+
+        assert_eq!(wiimote.read_batch(&mut reports), Some(2));
+        assert_eq!(wiimote.read_batch(&mut reports), Some(1));
+    }
 }
@@ -1,6 +1,14 @@
-use super::NativeWiimote;
+use std::sync::Arc;
+use std::time::Duration;
 
-pub fn wiimotes_scan(_wiimotes: &mut Vec<NullNativeWiimote>) {
+use super::{NativeHotplug, NativeReactor, NativeWiimote};
+use crate::manager::ScanMode;
+
+pub fn wiimotes_scan(
+    _mode: ScanMode,
+    _known_identifiers: &[Arc<str>],
+    _found: &mut dyn FnMut(NullNativeWiimote),
+) {
     static mut WARNING_PRINTED: bool = false;
     unsafe {
         if !WARNING_PRINTED {
@@ -27,7 +35,7 @@ impl NativeWiimote for NullNativeWiimote {
         unreachable!()
     }
 
-    fn identifier(&self) -> String {
+    fn identifier(&self) -> &str {
         unreachable!()
     }
 }
@@ -37,3 +45,59 @@ impl Drop for NullNativeWiimote {
         unreachable!()
     }
 }
+
+pub struct NullNativeReactor;
+
+impl NativeReactor for NullNativeReactor {
+    type Device = NullNativeWiimote;
+
+    fn new() -> std::io::Result<Self> {
+        Err(std::io::ErrorKind::Unsupported.into())
+    }
+
+    fn register(&self, _device: &NullNativeWiimote, _token: usize) -> std::io::Result<()> {
+        unreachable!()
+    }
+
+    fn register_oneshot(
+        &self,
+        _device: &NullNativeWiimote,
+        _token: usize,
+        _writable: bool,
+    ) -> std::io::Result<()> {
+        unreachable!()
+    }
+
+    fn rearm(
+        &self,
+        _device: &NullNativeWiimote,
+        _token: usize,
+        _writable: bool,
+    ) -> std::io::Result<()> {
+        unreachable!()
+    }
+
+    fn deregister(&self, _device: &NullNativeWiimote) {
+        unreachable!()
+    }
+
+    fn wake(&self) -> std::io::Result<()> {
+        unreachable!()
+    }
+
+    fn wait(&self, _ready: &mut Vec<usize>, _timeout_millis: Option<usize>) -> std::io::Result<()> {
+        unreachable!()
+    }
+}
+
+pub struct NullHotplug;
+
+impl NativeHotplug for NullHotplug {
+    fn new() -> std::io::Result<Self> {
+        Err(std::io::ErrorKind::Unsupported.into())
+    }
+
+    fn wait(&mut self, _timeout: Duration) -> bool {
+        unreachable!()
+    }
+}
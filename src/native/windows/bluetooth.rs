@@ -1,6 +1,6 @@
 use std::collections::HashMap;
 use std::mem;
-use std::sync::Mutex;
+use std::sync::{Mutex, MutexGuard};
 
 use once_cell::sync::Lazy;
 use windows::Win32::Devices::Bluetooth::{
@@ -12,15 +12,55 @@ use windows::Win32::Devices::Bluetooth::{
 };
 use windows::Win32::Foundation::{CloseHandle, ERROR_SUCCESS, HANDLE, TRUE};
 
-use crate::native::common::is_wiimote_device_name;
-
-use super::from_wstring;
+use crate::native::common::{is_wiimote_device_wide_name, AdapterLoads};
 
 const HUMAN_INTERFACE_DEVICE_SERVICE_CLASS_ID: u128 = 0x1124_0000_1000_8000_0080_5F9B_34FB;
 
-static mut CONNECTED_WIIMOTES: Lazy<Mutex<HashMap<String, BLUETOOTH_DEVICE_INFO>>> =
+/// The Wii remotes registered as HID devices by address and the address of the radio they were registered with.
+static mut CONNECTED_WIIMOTES: Lazy<Mutex<HashMap<u64, (BLUETOOTH_DEVICE_INFO, u64)>>> =
     Lazy::new(|| Mutex::new(HashMap::new()));
 
+/// Buffers of every registration, locked for the whole registration.
+static REGISTER_BUFFERS: Lazy<Mutex<RegisterBuffers>> =
+    Lazy::new(|| Mutex::new(RegisterBuffers::default()));
+
+/// A Wii remote found by a radio, a Wii remote in range of several radios is found by every one of them.
+struct Sighting {
+    address: u64,
+    device_info: BLUETOOTH_DEVICE_INFO,
+    radio: u64,
+}
+
+#[derive(Default)]
+struct RegisterBuffers {
+    /// The unregistered Wii remotes found by the last registration, sorted by address.
+    sightings: Vec<Sighting>,
+    /// The radio every new Wii remote is registered with.
+    assignments: Vec<(u64, BLUETOOTH_DEVICE_INFO)>,
+}
+
+fn device_address(device_info: &BLUETOOTH_DEVICE_INFO) -> u64 {
+    unsafe { device_info.Address.Anonymous.ullLong }
+}
+
+/// Returns the address of an identifier, the serial number of a Wii remote is its address in hex.
+fn identifier_address(identifier: &str) -> Option<u64> {
+    u64::from_str_radix(identifier, 16).ok()
+}
+
+fn lock_connected_wiimotes() -> MutexGuard<'static, HashMap<u64, (BLUETOOTH_DEVICE_INFO, u64)>> {
+    unsafe {
+        match CONNECTED_WIIMOTES.lock() {
+            Ok(connected_wiimotes) => connected_wiimotes,
+            Err(connected_wiimotes) => connected_wiimotes.into_inner(),
+        }
+    }
+}
+
+fn radio_address(radio_info: &BLUETOOTH_RADIO_INFO) -> u64 {
+    unsafe { radio_info.address.Anonymous.ullLong }
+}
+
 unsafe fn enumerate_bluetooth_radios<F>(mut callback: F) -> Result<(), String>
 where
     F: FnMut(HANDLE, &BLUETOOTH_RADIO_INFO),
@@ -51,10 +91,10 @@ where
 
 unsafe fn enumerate_bluetooth_devices<F>(
     search: &mut BLUETOOTH_DEVICE_SEARCH_PARAMS,
-    callback: F,
+    mut callback: F,
 ) -> Result<(), String>
 where
-    F: Fn(HANDLE, &BLUETOOTH_RADIO_INFO, &BLUETOOTH_DEVICE_INFO),
+    F: FnMut(HANDLE, &BLUETOOTH_RADIO_INFO, &BLUETOOTH_DEVICE_INFO),
 {
     enumerate_bluetooth_radios(|radio, radio_info| {
         search.hRadio = radio;
@@ -77,24 +117,9 @@ where
 
 unsafe fn register_as_hid_device(
     radio: HANDLE,
+    radio_address: u64,
     device_info: &BLUETOOTH_DEVICE_INFO,
 ) -> Result<(), String> {
-    let device_id = format!("{:x}", device_info.Address.Anonymous.ullLong);
-    let mut connected = match CONNECTED_WIIMOTES.lock() {
-        Ok(connected) => connected,
-        Err(connected) => connected.into_inner(),
-    };
-    if connected.contains_key(&device_id) {
-        return Ok(());
-    }
-
-    if !device_info.fConnected.as_bool() && device_info.fRemembered.as_bool() {
-        BluetoothRemoveDevice(&device_info.Address);
-    }
-    if device_info.fConnected.as_bool() || device_info.fRemembered.as_bool() {
-        return Ok(());
-    }
-
     let hid_serivce_class_guid = HUMAN_INTERFACE_DEVICE_SERVICE_CLASS_ID.into();
 
     let result = BluetoothSetServiceState(
@@ -109,25 +134,89 @@ unsafe fn register_as_hid_device(
         ));
     }
 
-    connected.insert(device_id, *device_info);
+    lock_connected_wiimotes().insert(device_address(device_info), (*device_info, radio_address));
     Ok(())
 }
 
-pub(super) fn register_wiimotes_as_hid_devices() -> Result<(), String> {
+/// Registers the found Wii remotes as HID devices, `issue_inquiry` also searches for Wii remotes not seen before.
+/// Without new Wii remotes, only the device enumeration of the radios runs and nothing is allocated.
+pub(super) fn register_wiimotes_as_hid_devices(issue_inquiry: bool) -> Result<(), String> {
     let mut search = BLUETOOTH_DEVICE_SEARCH_PARAMS::default();
     search.dwSize = mem::size_of_val(&search) as u32;
     search.fReturnAuthenticated = TRUE;
     search.fReturnRemembered = TRUE;
     search.fReturnUnknown = TRUE;
     search.fReturnConnected = TRUE;
-    search.fIssueInquiry = TRUE;
+    search.fIssueInquiry = issue_inquiry.into();
     search.cTimeoutMultiplier = 2;
 
+    let mut buffers = match REGISTER_BUFFERS.lock() {
+        Ok(buffers) => buffers,
+        Err(buffers) => buffers.into_inner(),
+    };
+    let RegisterBuffers {
+        sightings,
+        assignments,
+    } = &mut *buffers;
+    sightings.clear();
+    assignments.clear();
+    unsafe {
+        enumerate_bluetooth_devices(&mut search, |_radio, radio_info, device_info| {
+            let address = device_address(device_info);
+            if is_wiimote_device_wide_name(&device_info.szName)
+                && !lock_connected_wiimotes().contains_key(&address)
+            {
+                sightings.push(Sighting {
+                    address,
+                    device_info: *device_info,
+                    radio: radio_address(radio_info),
+                });
+            }
+        })?;
+    }
+    sightings.sort_unstable_by_key(|sighting| sighting.address);
+
+    // Place every new Wii remote on the radio with the fewest registered Wii remotes that found it
+    let mut loads = None;
+    let mut start = 0;
+    while start < sightings.len() {
+        let address = sightings[start].address;
+        let count = sightings[start..]
+            .iter()
+            .take_while(|sighting| sighting.address == address)
+            .count();
+        let wiimote_sightings = &sightings[start..start + count];
+        start += count;
+
+        let device_info = &wiimote_sightings[0].device_info;
+        if !device_info.fConnected.as_bool() && device_info.fRemembered.as_bool() {
+            unsafe {
+                BluetoothRemoveDevice(&device_info.Address);
+            }
+        }
+        if device_info.fConnected.as_bool() || device_info.fRemembered.as_bool() {
+            continue;
+        }
+
+        let loads = loads.get_or_insert_with(radio_loads);
+        let radios = wiimote_sightings.iter().map(|sighting| sighting.radio);
+        if let Some(radio) = loads.least_loaded(radios) {
+            loads.add(radio);
+            assignments.push((radio, *device_info));
+        }
+    }
+    if assignments.is_empty() {
+        return Ok(());
+    }
+
     unsafe {
-        enumerate_bluetooth_devices(&mut search, |radio, _radio_info, device_info| {
-            let name = from_wstring(&device_info.szName);
-            if is_wiimote_device_name(&name) {
-                if let Err(error) = register_as_hid_device(radio, device_info) {
+        enumerate_bluetooth_radios(|radio, radio_info| {
+            let address = radio_address(radio_info);
+            for (_, device_info) in assignments
+                .iter()
+                .filter(|(assigned, _)| *assigned == address)
+            {
+                if let Err(error) = register_as_hid_device(radio, address, device_info) {
                     eprintln!("Failed to register wiimote as interface device: {error}");
                 }
             }
@@ -135,24 +224,39 @@ pub(super) fn register_wiimotes_as_hid_devices() -> Result<(), String> {
     }
 }
 
+/// Counts the registered Wii remotes of every radio.
+fn radio_loads() -> AdapterLoads {
+    let connected_wiimotes = lock_connected_wiimotes();
+    let mut loads = AdapterLoads::default();
+    for (_, radio) in connected_wiimotes.values() {
+        loads.add(*radio);
+    }
+    loads
+}
+
+/// Returns the address of the radio the Wii remote was registered with.
+pub(super) fn wiimote_radio(identifier: &str) -> Option<u64> {
+    let address = identifier_address(identifier)?;
+    lock_connected_wiimotes()
+        .get(&address)
+        .map(|(_, radio)| *radio)
+}
+
 pub(super) fn forget_wiimote(identifier: &str) {
-    unsafe {
-        let mut connected_wiimotes = match CONNECTED_WIIMOTES.lock() {
-            Ok(connected_wiimotes) => connected_wiimotes,
-            Err(connected_wiimotes) => connected_wiimotes.into_inner(),
-        };
-        connected_wiimotes.remove(identifier);
+    if let Some(address) = identifier_address(identifier) {
+        lock_connected_wiimotes().remove(&address);
     }
 }
 
 pub(super) unsafe fn disconnect_wiimotes() {
-    _ = enumerate_bluetooth_radios(|radio, _radio_info| {
-        let connected_wiimotes = match CONNECTED_WIIMOTES.lock() {
-            Ok(connected_wiimotes) => connected_wiimotes,
-            Err(connected_wiimotes) => connected_wiimotes.into_inner(),
-        };
+    _ = enumerate_bluetooth_radios(|radio, radio_info| {
+        let address = radio_address(radio_info);
+        let connected_wiimotes = lock_connected_wiimotes();
         let hid_guid = HUMAN_INTERFACE_DEVICE_SERVICE_CLASS_ID.into();
-        for (_device_id, connected_wiimote) in connected_wiimotes.iter() {
+        for (connected_wiimote, _) in connected_wiimotes
+            .values()
+            .filter(|(_, radio)| *radio == address)
+        {
             BluetoothSetServiceState(
                 radio,
                 connected_wiimote,
@@ -162,9 +266,5 @@ pub(super) unsafe fn disconnect_wiimotes() {
         }
     });
 
-    let mut connected_wiimotes = match CONNECTED_WIIMOTES.lock() {
-        Ok(connected_wiimotes) => connected_wiimotes,
-        Err(connected_wiimotes) => connected_wiimotes.into_inner(),
-    };
-    connected_wiimotes.clear();
+    lock_connected_wiimotes().clear();
 }
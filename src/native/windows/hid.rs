@@ -1,6 +1,6 @@
-use std::collections::HashSet;
+use std::collections::{HashMap, HashSet};
 use std::ffi::c_void;
-use std::{iter, mem};
+use std::mem;
 
 use once_cell::sync::Lazy;
 use windows::core::PCWSTR;
@@ -45,7 +45,7 @@ impl DeviceInfo {
         &self.capabilities
     }
 
-    unsafe fn from_device_path(device_path: &str) -> Option<Self> {
+    unsafe fn from_device_path(device_path: &[u16]) -> Option<Self> {
         let device_handle = open_wiimote_device(device_path, 0).ok()?;
         let mut attributes = HIDD_ATTRIBUTES {
             Size: mem::size_of::<HIDD_ATTRIBUTES>() as u32,
@@ -78,14 +78,14 @@ impl DeviceInfo {
     }
 }
 
+/// Opens the device at the null terminated `device_path`.
 pub(super) unsafe fn open_wiimote_device(
-    device_path: &str,
+    device_path: &[u16],
     access: u32,
 ) -> Result<HANDLE, windows::core::Error> {
     let share_read_write = FILE_SHARE_READ | FILE_SHARE_WRITE;
-    let device_path_utf16: Vec<u16> = device_path.encode_utf16().chain(iter::once(0)).collect();
     CreateFileW(
-        PCWSTR(device_path_utf16.as_ptr()),
+        PCWSTR(device_path.as_ptr()),
         access,
         share_read_write,
         None,
@@ -95,11 +95,27 @@ pub(super) unsafe fn open_wiimote_device(
     )
 }
 
+/// Buffers of every enumeration, the device paths are null terminated.
+#[derive(Default)]
+struct EnumerationBuffers {
+    device_list: Vec<u16>,
+    unrelated_devices: HashSet<Vec<u16>>,
+    /// The Wii remotes seen before, their path only changes when they reconnect.
+    wiimotes: HashMap<Vec<u16>, DeviceInfo>,
+}
+
+/// Calls `callback` with every Wii remote and its null terminated device path.
+/// Only devices not seen before are opened and allocate.
 pub(super) unsafe fn enumerate_wiimote_hid_devices<F>(mut callback: F) -> Result<(), String>
 where
-    F: FnMut(&DeviceInfo, &str),
+    F: FnMut(&DeviceInfo, &[u16]),
 {
-    static mut UNRELATED_DEVICES: Lazy<HashSet<String>> = Lazy::new(HashSet::new);
+    static mut BUFFERS: Lazy<EnumerationBuffers> = Lazy::new(EnumerationBuffers::default);
+    let EnumerationBuffers {
+        device_list,
+        unrelated_devices,
+        wiimotes,
+    } = &mut *BUFFERS;
 
     let hid_id = HidD_GetHidGuid();
 
@@ -114,11 +130,12 @@ where
         return Err(String::from("Failed to get HID device list size"));
     }
 
-    let mut device_list = vec![0u16; length as usize];
+    device_list.clear();
+    device_list.resize(length as usize, 0);
     let config_ret = CM_Get_Device_Interface_ListW(
         &hid_id,
         PCWSTR(std::ptr::null()),
-        &mut device_list,
+        device_list,
         CM_GET_DEVICE_INTERFACE_LIST_PRESENT,
     );
     if config_ret != CR_SUCCESS {
@@ -133,17 +150,21 @@ where
         let end_index = start_index + device_path_length + 1;
 
         let device_path = &device_list[start_index..end_index];
-        let device_path_string = from_wstring(device_path);
         start_index = end_index;
-        if UNRELATED_DEVICES.contains(&device_path_string) {
+        if unrelated_devices.contains(device_path) {
+            continue;
+        }
+        if let Some(device_info) = wiimotes.get(device_path) {
+            callback(device_info, device_path);
             continue;
         }
 
-        if let Some(device_info) = DeviceInfo::from_device_path(&device_path_string) {
+        if let Some(device_info) = DeviceInfo::from_device_path(device_path) {
             if is_wiimote(device_info.vendor_id(), device_info.product_id()) {
-                callback(&device_info, &device_path_string);
+                callback(&device_info, device_path);
+                wiimotes.insert(device_path.to_vec(), device_info);
             } else {
-                UNRELATED_DEVICES.insert(device_path_string);
+                unrelated_devices.insert(device_path.to_vec());
             }
         }
     }
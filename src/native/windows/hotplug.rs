@@ -0,0 +1,112 @@
+use std::ffi::c_void;
+use std::io;
+use std::sync::atomic::Ordering;
+use std::sync::{Arc, Condvar, Mutex};
+use std::time::Duration;
+
+use windows::Win32::Devices::DeviceAndDriverInstallation::{
+    CM_Register_Notification, CM_Unregister_Notification, CM_NOTIFY_ACTION,
+    CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL, CM_NOTIFY_EVENT_DATA, CM_NOTIFY_FILTER,
+    CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE, CR_SUCCESS, HCMNOTIFICATION,
+};
+use windows::Win32::Devices::HumanInterfaceDevice::HidD_GetHidGuid;
+use windows::Win32::Foundation::ERROR_SUCCESS;
+
+use super::HID_ARRIVAL;
+use crate::native::NativeHotplug;
+
+/// Number of HID device interfaces that arrived, incremented by the notification callback.
+#[derive(Default)]
+struct Arrivals {
+    count: Mutex<usize>,
+    arrived: Condvar,
+}
+
+/// Wakes the scan thread when a HID device interface arrives, e.g. a paired Wii remote that
+/// connected after a button press or a Wii remote registered as HID device by the previous scan.
+pub struct WindowsHotplug {
+    notification: HCMNOTIFICATION,
+    arrivals: Arc<Arrivals>,
+    seen_arrivals: usize,
+}
+
+// The notification is only unregistered by the owner, the callback only uses the shared arrivals.
+unsafe impl Send for WindowsHotplug {}
+
+unsafe extern "system" fn on_device_change(
+    _notification: HCMNOTIFICATION,
+    context: *const c_void,
+    action: CM_NOTIFY_ACTION,
+    _event_data: *const CM_NOTIFY_EVENT_DATA,
+    _event_data_size: u32,
+) -> u32 {
+    if action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL {
+        let arrivals = &*context.cast::<Arrivals>();
+        let mut count = match arrivals.count.lock() {
+            Ok(count) => count,
+            Err(count) => count.into_inner(),
+        };
+        *count += 1;
+        HID_ARRIVAL.store(true, Ordering::Relaxed);
+        arrivals.arrived.notify_all();
+    }
+    ERROR_SUCCESS.0
+}
+
+impl NativeHotplug for WindowsHotplug {
+    fn new() -> io::Result<Self> {
+        let arrivals = Arc::new(Arrivals::default());
+        let mut notification = HCMNOTIFICATION::default();
+        unsafe {
+            let mut filter = std::mem::zeroed::<CM_NOTIFY_FILTER>();
+            filter.cbSize = std::mem::size_of::<CM_NOTIFY_FILTER>() as u32;
+            filter.FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+            filter.u.DeviceInterface.ClassGuid = HidD_GetHidGuid();
+
+            // The arrivals outlive the notification, unregistering waits for running callbacks
+            let config_ret = CM_Register_Notification(
+                &filter,
+                Some(Arc::as_ptr(&arrivals).cast()),
+                Some(on_device_change),
+                &mut notification,
+            );
+            if config_ret != CR_SUCCESS {
+                return Err(io::Error::new(
+                    io::ErrorKind::Other,
+                    format!("CM_Register_Notification failed with {}", config_ret.0),
+                ));
+            }
+        }
+        Ok(Self {
+            notification,
+            arrivals,
+            seen_arrivals: 0,
+        })
+    }
+
+    fn wait(&mut self, timeout: Duration) -> bool {
+        let seen_arrivals = self.seen_arrivals;
+        let count = match self.arrivals.count.lock() {
+            Ok(count) => count,
+            Err(count) => count.into_inner(),
+        };
+        let count = match self
+            .arrivals
+            .arrived
+            .wait_timeout_while(count, timeout, |count| *count == seen_arrivals)
+        {
+            Ok((count, _)) => count,
+            Err(err) => err.into_inner().0,
+        };
+        self.seen_arrivals = *count;
+        self.seen_arrivals != seen_arrivals
+    }
+}
+
+impl Drop for WindowsHotplug {
+    fn drop(&mut self) {
+        unsafe {
+            _ = CM_Unregister_Notification(self.notification);
+        }
+    }
+}
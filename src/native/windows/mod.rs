@@ -1,24 +1,38 @@
 mod bluetooth;
 mod hid;
+mod hotplug;
+mod reactor;
 
 use std::collections::HashSet;
-use std::sync::Mutex;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Arc, Mutex, MutexGuard};
+use std::time::Instant;
 
 use once_cell::sync::Lazy;
 use windows::Win32::Devices::HumanInterfaceDevice::HIDP_CAPS;
 use windows::Win32::Foundation::{
-    CloseHandle, GetLastError, ERROR_IO_PENDING, GENERIC_READ, GENERIC_WRITE, HANDLE, WAIT_FAILED,
-    WAIT_OBJECT_0, WAIT_TIMEOUT,
+    CloseHandle, GetLastError, ERROR_IO_INCOMPLETE, ERROR_IO_PENDING, GENERIC_READ, GENERIC_WRITE,
+    HANDLE, WAIT_FAILED, WAIT_OBJECT_0, WAIT_TIMEOUT,
 };
 use windows::Win32::Globalization::{WideCharToMultiByte, CP_UTF8};
 use windows::Win32::Storage::FileSystem::{ReadFile, WriteFile};
 use windows::Win32::System::Threading::{CreateEventW, ResetEvent, WaitForSingleObject, INFINITE};
 use windows::Win32::System::IO::{GetOverlappedResult, OVERLAPPED};
 
-use self::bluetooth::{disconnect_wiimotes, forget_wiimote, register_wiimotes_as_hid_devices};
+use self::bluetooth::{
+    disconnect_wiimotes, forget_wiimote, register_wiimotes_as_hid_devices, wiimote_radio,
+};
 use self::hid::{enumerate_wiimote_hid_devices, open_wiimote_device};
 
+use super::common::format_address;
 use super::NativeWiimote;
+use crate::manager::ScanMode;
+
+pub use hotplug::WindowsHotplug;
+pub use reactor::WindowsNativeReactor;
+
+/// Whether a HID device interface arrived since the last scan, set by the `WindowsHotplug`.
+static HID_ARRIVAL: AtomicBool = AtomicBool::new(false);
 
 static mut WIIMOTES_HANDLED: Lazy<Mutex<HashSet<String>>> =
     Lazy::new(|| Mutex::new(HashSet::new()));
@@ -39,25 +53,41 @@ unsafe fn from_wstring(wstr: &[u16]) -> String {
     String::from_utf8_unchecked(result)
 }
 
-pub fn wiimotes_scan(wiimotes: &mut Vec<WindowsNativeWiimote>) {
+pub fn wiimotes_scan(
+    mode: ScanMode,
+    known_identifiers: &[Arc<str>],
+    found: &mut dyn FnMut(WindowsNativeWiimote),
+) {
     unsafe {
-        _ = register_wiimotes_as_hid_devices();
+        // Fast reconnects only register remembered Wii remotes without an inquiry,
+        // the scan after a HID device arrived opens the device without waiting for an inquiry.
+        // With hotplug notifications the other scans are the slow fallback of the manager.
+        let is_arrival = HID_ARRIVAL.swap(false, Ordering::Relaxed);
+        _ = register_wiimotes_as_hid_devices(mode == ScanMode::Discover && !is_arrival);
 
         _ = enumerate_wiimote_hid_devices(|device_info, device_path| {
+            let serial_number = device_info.serial_number();
+            if mode == ScanMode::FastReconnect
+                && !known_identifiers
+                    .iter()
+                    .any(|identifier| &**identifier == serial_number)
+            {
+                return;
+            }
+
             let mut wiimotes_handled = match WIIMOTES_HANDLED.lock() {
                 Ok(wiimotes_handled) => wiimotes_handled,
                 Err(wiimotes_handled) => wiimotes_handled.into_inner(),
             };
 
-            if !wiimotes_handled.contains(device_info.serial_number()) {
+            if !wiimotes_handled.contains(serial_number) {
                 open_wiimote_device(device_path, (GENERIC_READ | GENERIC_WRITE).0).map_or_else(
                     |_| {
                         eprintln!("Failed to connect to wiimote");
                     },
                     |wiimote_handle| {
-                        let serial_number = device_info.serial_number();
                         wiimotes_handled.insert(serial_number.to_string());
-                        wiimotes.push(WindowsNativeWiimote::new(
+                        found(WindowsNativeWiimote::new(
                             wiimote_handle,
                             serial_number.to_string(),
                             device_info.capabilities(),
@@ -75,17 +105,36 @@ pub fn wiimotes_scan_cleanup() {
     }
 }
 
+/// When a `WindowsNativeReactor` last dequeued the completion of an overlapped read of the device.
+type ReadDequeued = Arc<Mutex<Option<Instant>>>;
+
+fn lock_read_dequeued(read_dequeued: &ReadDequeued) -> MutexGuard<'_, Option<Instant>> {
+    match read_dequeued.lock() {
+        Ok(dequeued) => dequeued,
+        Err(err) => err.into_inner(),
+    }
+}
+
 pub struct WindowsNativeWiimote {
     handle: HANDLE,
     identifier: String,
     read_pending: bool,
     write_pending: bool,
-    overlapped_read: OVERLAPPED,
-    overlapped_write: OVERLAPPED,
+    /// Boxed so completions dequeued by a reactor can be matched by their address.
+    overlapped_read: Box<OVERLAPPED>,
+    overlapped_write: Box<OVERLAPPED>,
     read_buffer: Vec<u8>,
     write_buffer: Vec<u8>,
+    /// When the pending overlapped read was started.
+    read_started: Instant,
+    read_dequeued: ReadDequeued,
+    /// When the last overlapped read completed.
+    read_completion: Option<Instant>,
 }
 
+// The handles and events are only used by the owner of the device, the device is only moved before a read is started.
+unsafe impl Send for WindowsNativeWiimote {}
+
 impl WindowsNativeWiimote {
     fn new(handle: HANDLE, identifier: String, capabilities: &HIDP_CAPS) -> Self {
         let read_buffer_size = capabilities.InputReportByteLength as usize;
@@ -95,10 +144,13 @@ impl WindowsNativeWiimote {
             identifier,
             read_pending: false,
             write_pending: false,
-            overlapped_read: OVERLAPPED::default(),
-            overlapped_write: OVERLAPPED::default(),
+            overlapped_read: Box::default(),
+            overlapped_write: Box::default(),
             read_buffer: vec![0; read_buffer_size],
             write_buffer: vec![0; write_buffer_size],
+            read_started: Instant::now(),
+            read_dequeued: ReadDequeued::default(),
+            read_completion: None,
         };
         wiimote.overlapped_read.hEvent = unsafe { CreateEventW(None, true, false, None).unwrap() };
         wiimote.overlapped_write.hEvent = unsafe { CreateEventW(None, true, false, None).unwrap() };
@@ -115,11 +167,12 @@ impl WindowsNativeWiimote {
         if !self.read_pending {
             _ = ResetEvent(self.overlapped_read.hEvent);
             self.read_buffer.fill(0);
+            self.read_started = Instant::now();
             did_read = ReadFile(
                 self.handle,
                 Some(&mut self.read_buffer),
                 None,
-                Some(&mut self.overlapped_read),
+                Some(&mut *self.overlapped_read),
             )
             .is_ok();
             if !did_read && GetLastError() != ERROR_IO_PENDING {
@@ -129,6 +182,7 @@ impl WindowsNativeWiimote {
             self.read_pending = true;
         }
 
+        let mut signaled = None;
         if !did_read && timeout_millis.is_some() {
             let wait_result =
                 WaitForSingleObject(self.overlapped_read.hEvent, timeout_millis.unwrap() as u32);
@@ -139,11 +193,21 @@ impl WindowsNativeWiimote {
                 // Wait failed
                 return None;
             }
+            signaled = Some(Instant::now());
         }
 
         let mut bytes_read = 0;
         let result =
-            GetOverlappedResult(self.handle, &self.overlapped_read, &mut bytes_read, true).is_ok();
+            GetOverlappedResult(self.handle, &*self.overlapped_read, &mut bytes_read, true).is_ok();
+        let observed = signaled.unwrap_or_else(Instant::now);
+        // The reactor dequeued the completion before this read observed it, unless that completion
+        // was of an earlier read or is still queued
+        let dequeued = *lock_read_dequeued(&self.read_dequeued);
+        self.read_completion = Some(
+            dequeued
+                .filter(|dequeued| *dequeued >= self.read_started && *dequeued <= observed)
+                .unwrap_or(observed),
+        );
         self.read_pending = false;
         if result {
             let bytes_to_copy = usize::min(bytes_read as usize, buffer_size);
@@ -168,7 +232,7 @@ impl WindowsNativeWiimote {
             self.handle,
             Some(&self.write_buffer),
             None,
-            Some(&mut self.overlapped_write),
+            Some(&mut *self.overlapped_write),
         )
         .is_err()
         {
@@ -190,7 +254,7 @@ impl WindowsNativeWiimote {
         let mut bytes_written = 0;
         if GetOverlappedResult(
             self.handle,
-            &self.overlapped_write,
+            &*self.overlapped_write,
             &mut bytes_written,
             true,
         )
@@ -201,6 +265,47 @@ impl WindowsNativeWiimote {
             Some(bytes_written as usize)
         }
     }
+
+    unsafe fn write_nonblocking_impl(&mut self, buffer: &[u8]) -> Option<usize> {
+        if self.write_pending {
+            let mut bytes_written = 0;
+            if GetOverlappedResult(
+                self.handle,
+                &*self.overlapped_write,
+                &mut bytes_written,
+                false,
+            )
+            .is_err()
+            {
+                if GetLastError() == ERROR_IO_INCOMPLETE {
+                    return Some(0);
+                }
+                self.write_pending = false;
+                return None;
+            }
+            self.write_pending = false;
+        }
+
+        let data_size = usize::min(buffer.len(), self.write_buffer.len());
+        self.write_buffer[..data_size].copy_from_slice(&buffer[..data_size]);
+        self.write_buffer[data_size..].fill(0);
+
+        if WriteFile(
+            self.handle,
+            Some(&self.write_buffer),
+            None,
+            Some(&mut *self.overlapped_write),
+        )
+        .is_err()
+        {
+            if GetLastError() != ERROR_IO_PENDING {
+                return None;
+            }
+            // Checked by the next write, the write buffer is in use until the write completed
+            self.write_pending = true;
+        }
+        Some(data_size)
+    }
 }
 
 impl NativeWiimote for WindowsNativeWiimote {
@@ -216,8 +321,20 @@ impl NativeWiimote for WindowsNativeWiimote {
         unsafe { self.write_impl(buffer) }
     }
 
-    fn identifier(&self) -> String {
-        self.identifier.clone()
+    fn write_nonblocking(&mut self, buffer: &[u8]) -> Option<usize> {
+        unsafe { self.write_nonblocking_impl(buffer) }
+    }
+
+    fn identifier(&self) -> &str {
+        &self.identifier
+    }
+
+    fn last_read_completion(&self) -> Option<Instant> {
+        self.read_completion
+    }
+
+    fn adapter(&self) -> Option<String> {
+        wiimote_radio(&self.identifier).map(format_address)
     }
 }
 
@@ -0,0 +1,175 @@
+use std::collections::HashMap;
+use std::io;
+use std::sync::{Mutex, MutexGuard};
+use std::time::Instant;
+
+use windows::core::HRESULT;
+use windows::Win32::Foundation::{CloseHandle, HANDLE, INVALID_HANDLE_VALUE, WAIT_TIMEOUT};
+use windows::Win32::System::Threading::INFINITE;
+use windows::Win32::System::IO::{
+    CreateIoCompletionPort, GetQueuedCompletionStatusEx, PostQueuedCompletionStatus,
+    OVERLAPPED_ENTRY,
+};
+
+use super::{lock_read_dequeued, ReadDequeued, WindowsNativeWiimote};
+use crate::native::{NativeReactor, WAKE_TOKEN};
+
+const MAX_EVENTS: usize = 32;
+
+/// A registered device, its completions are matched by the address of their `OVERLAPPED`.
+struct Registration {
+    read: usize,
+    write: usize,
+    /// Whether write completions are reported, only while a oneshot registration waits to write.
+    writable: bool,
+    read_dequeued: ReadDequeued,
+}
+
+/// Collects the overlapped read completions of all registered Wii remotes on one I/O completion port.
+///
+/// A handle can only be associated with one completion port, a Wii remote can only be registered
+/// with one reactor. Registering it with another reactor fails.
+pub struct WindowsNativeReactor {
+    port: HANDLE,
+    /// The registered devices by token.
+    registrations: Mutex<HashMap<usize, Registration>>,
+}
+
+impl WindowsNativeReactor {
+    fn registrations(&self) -> MutexGuard<'_, HashMap<usize, Registration>> {
+        match self.registrations.lock() {
+            Ok(registrations) => registrations,
+            Err(err) => err.into_inner(),
+        }
+    }
+
+    fn register_with(
+        &self,
+        device: &WindowsNativeWiimote,
+        token: usize,
+        writable: bool,
+    ) -> io::Result<()> {
+        // The association ends when the device handle is closed.
+        // Fails if the handle is associated with the port of another reactor.
+        unsafe { CreateIoCompletionPort(device.handle, self.port, token, 0) }?;
+        self.registrations().insert(
+            token,
+            Registration {
+                read: std::ptr::addr_of!(*device.overlapped_read) as usize,
+                write: std::ptr::addr_of!(*device.overlapped_write) as usize,
+                writable,
+                read_dequeued: ReadDequeued::clone(&device.read_dequeued),
+            },
+        );
+        Ok(())
+    }
+}
+
+// Completion ports can be associated and waited on from any thread.
+unsafe impl Send for WindowsNativeReactor {}
+unsafe impl Sync for WindowsNativeReactor {}
+
+impl NativeReactor for WindowsNativeReactor {
+    type Device = WindowsNativeWiimote;
+
+    fn new() -> io::Result<Self> {
+        let port =
+            unsafe { CreateIoCompletionPort(INVALID_HANDLE_VALUE, HANDLE::default(), 0, 1) }?;
+        Ok(Self {
+            port,
+            registrations: Mutex::new(HashMap::new()),
+        })
+    }
+
+    fn register(&self, device: &WindowsNativeWiimote, token: usize) -> io::Result<()> {
+        self.register_with(device, token, false)
+    }
+
+    fn register_oneshot(
+        &self,
+        device: &WindowsNativeWiimote,
+        token: usize,
+        writable: bool,
+    ) -> io::Result<()> {
+        // Every overlapped read and write completes once, a read is only started again once the device is drained
+        // and a write is only started once the previous write completed.
+        self.register_with(device, token, writable)
+    }
+
+    fn rearm(
+        &self,
+        _device: &WindowsNativeWiimote,
+        token: usize,
+        writable: bool,
+    ) -> io::Result<()> {
+        // The pending read or write that made the device block completes to the port
+        if let Some(registration) = self.registrations().get_mut(&token) {
+            registration.writable = writable;
+        }
+        Ok(())
+    }
+
+    fn deregister(&self, device: &WindowsNativeWiimote) {
+        // Completion port associations cannot be removed, remaining completions are ignored.
+        let read = std::ptr::addr_of!(*device.overlapped_read) as usize;
+        self.registrations()
+            .retain(|_, registration| registration.read != read);
+    }
+
+    fn wake(&self) -> io::Result<()> {
+        unsafe { PostQueuedCompletionStatus(self.port, 0, WAKE_TOKEN, None) }?;
+        Ok(())
+    }
+
+    fn wait(&self, ready: &mut Vec<usize>, timeout_millis: Option<usize>) -> io::Result<()> {
+        let timeout = timeout_millis.map_or(INFINITE, |timeout| {
+            u32::try_from(timeout).unwrap_or(INFINITE - 1)
+        });
+        let mut entries = [OVERLAPPED_ENTRY::default(); MAX_EVENTS];
+        let mut entries_removed = 0u32;
+        let result = unsafe {
+            GetQueuedCompletionStatusEx(
+                self.port,
+                &mut entries,
+                &mut entries_removed,
+                timeout,
+                false,
+            )
+        };
+        match result {
+            Ok(()) => {
+                // Read completions are timestamped when they are dequeued, not when the device reads them
+                let dequeued_at = Instant::now();
+                let registrations = self.registrations();
+                for entry in &entries[..entries_removed as usize] {
+                    let token = entry.lpCompletionKey;
+                    if token == WAKE_TOKEN {
+                        continue;
+                    }
+                    // Completions of unregistered devices and writes nobody waits for are not reported
+                    let Some(registration) = registrations.get(&token) else {
+                        continue;
+                    };
+                    let overlapped = entry.lpOverlapped as usize;
+                    if overlapped == registration.read {
+                        *lock_read_dequeued(&registration.read_dequeued) = Some(dequeued_at);
+                        ready.push(token);
+                    } else if overlapped == registration.write && registration.writable {
+                        ready.push(token);
+                    }
+                }
+                Ok(())
+            }
+            Err(error) if error.code() == HRESULT::from_win32(WAIT_TIMEOUT.0) => Ok(()),
+            Err(error) => Err(error.into()),
+        }
+    }
+}
+
+impl Drop for WindowsNativeReactor {
+    fn drop(&mut self) {
+        unsafe {
+            _ = CloseHandle(self.port);
+        }
+    }
+}
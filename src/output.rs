@@ -29,7 +29,159 @@ pub struct DataReporingMode {
     pub mode: u8,
 }
 
-#[derive(Debug)]
+impl DataReporingMode {
+    /// Creates the data reporting mode for the reporting mode type `M`.
+    #[must_use]
+    pub const fn of<M: ReportingMode>(continuous: bool) -> Self {
+        Self {
+            continuous,
+            mode: M::ID,
+        }
+    }
+}
+
+mod sealed {
+    /// Keeps the reporting modes to the ones defined here,
+    /// `input::Report` reads their fields without bounds checks.
+    pub trait Sealed {}
+}
+
+/// A data reporting mode known at compile time, see `input::Report`.
+/// The trait is sealed, the reporting modes are the types defined in this module.
+///
+/// WiiBrew Documentation: <https://www.wiibrew.org/wiki/Wiimote#Data_Reporting>
+pub trait ReportingMode: sealed::Sealed {
+    /// The report ID of the data reports.
+    const ID: u8;
+    /// The number of bytes following the report ID.
+    const SIZE: usize;
+}
+
+/// A reporting mode that contains the core buttons in the first two bytes.
+pub trait HasButtons: ReportingMode {}
+
+/// A reporting mode that contains the accelerometer data following the core buttons.
+pub trait HasAccelerometer: HasButtons {}
+
+/// A reporting mode that contains IR camera data.
+pub trait HasIr: ReportingMode {
+    /// Offset of the IR camera data following the report ID.
+    const IR_OFFSET: usize;
+    /// The number of IR camera bytes.
+    const IR_SIZE: usize;
+}
+
+/// A reporting mode that contains extension data.
+pub trait HasExtension: ReportingMode {
+    /// Offset of the extension data following the report ID.
+    const EXTENSION_OFFSET: usize;
+    /// The number of extension bytes.
+    const EXTENSION_SIZE: usize;
+}
+
+macro_rules! reporting_modes {
+    ($($(#[$attr:meta])* $name:ident = $id:literal, $size:literal;)*) => {
+        $(
+            $(#[$attr])*
+            #[derive(Debug, Clone, Copy)]
+            pub struct $name;
+
+            impl sealed::Sealed for $name {}
+
+            impl ReportingMode for $name {
+                const ID: u8 = $id;
+                const SIZE: usize = $size;
+            }
+        )*
+    };
+}
+
+macro_rules! core_data {
+    ($trait:ident, $size:literal: $($name:ident),* $(,)?) => {
+        $(
+            impl $trait for $name {}
+            const _: () = assert!($size <= $name::SIZE);
+        )*
+    };
+}
+
+macro_rules! ir_data {
+    ($($name:ident: $offset:literal, $size:literal;)*) => {
+        $(
+            impl HasIr for $name {
+                const IR_OFFSET: usize = $offset;
+                const IR_SIZE: usize = $size;
+            }
+            const _: () = assert!($offset + $size <= $name::SIZE);
+        )*
+    };
+}
+
+macro_rules! extension_data {
+    ($($name:ident: $offset:literal, $size:literal;)*) => {
+        $(
+            impl HasExtension for $name {
+                const EXTENSION_OFFSET: usize = $offset;
+                const EXTENSION_SIZE: usize = $size;
+            }
+            const _: () = assert!($offset + $size <= $name::SIZE);
+        )*
+    };
+}
+
+reporting_modes! {
+    /// Core buttons.
+    Mode0x30 = 0x30, 2;
+    /// Core buttons and accelerometer.
+    Mode0x31 = 0x31, 5;
+    /// Core buttons with 8 extension bytes.
+    Mode0x32 = 0x32, 10;
+    /// Core buttons and accelerometer with 12 IR bytes.
+    Mode0x33 = 0x33, 17;
+    /// Core buttons with 19 extension bytes.
+    Mode0x34 = 0x34, 21;
+    /// Core buttons and accelerometer with 16 extension bytes.
+    Mode0x35 = 0x35, 21;
+    /// Core buttons with 10 IR bytes and 9 extension bytes.
+    Mode0x36 = 0x36, 21;
+    /// Core buttons and accelerometer with 10 IR bytes and 6 extension bytes.
+    Mode0x37 = 0x37, 21;
+    /// 21 extension bytes.
+    Mode0x3D = 0x3D, 21;
+    /// Interleaved core buttons and accelerometer with 36 IR bytes, first half.
+    Mode0x3E = 0x3E, 21;
+    /// Interleaved core buttons and accelerometer with 36 IR bytes, second half.
+    Mode0x3F = 0x3F, 21;
+}
+
+// The fields read by `input::Report` are within the size of every reporting mode
+core_data! {
+    HasButtons, 2: Mode0x30, Mode0x31, Mode0x32, Mode0x33, Mode0x34,
+    Mode0x35, Mode0x36, Mode0x37, Mode0x3E, Mode0x3F,
+}
+
+core_data! {
+    HasAccelerometer, 5: Mode0x31, Mode0x33, Mode0x35, Mode0x37,
+}
+
+ir_data! {
+    Mode0x33: 5, 12;
+    Mode0x36: 2, 10;
+    Mode0x37: 5, 10;
+    Mode0x3E: 3, 18;
+    Mode0x3F: 3, 18;
+}
+
+extension_data! {
+    Mode0x32: 2, 8;
+    Mode0x34: 2, 19;
+    Mode0x35: 5, 16;
+    Mode0x36: 12, 9;
+    Mode0x37: 15, 6;
+    Mode0x3D: 0, 21;
+}
+
+#[derive(Debug, Clone, Copy)]
 pub struct Addressing {
     /// If true, read from control registers, otherwise from EEPROM.
     control_registers: bool,
@@ -55,6 +207,16 @@ impl Addressing {
             size,
         }
     }
+
+    /// Returns the addressing of `size` bytes starting `offset` bytes after this address.
+    #[must_use]
+    pub(crate) const fn offset(&self, offset: u32, size: u16) -> Self {
+        Self {
+            control_registers: self.control_registers,
+            address: self.address + offset,
+            size,
+        }
+    }
 }
 
 /// An output report represents the data sent from the computer to the Wii remote.
@@ -0,0 +1,395 @@
+use std::sync::{Arc, Mutex, MutexGuard, TryLockError};
+
+use crate::extensions::ExtensionData;
+use crate::input::{ButtonData, DataReportRef, InputReportRef, RawReport};
+use crate::output::{OutputReport, PlayerLedFlags};
+use crate::prelude::*;
+use crate::seqlock::SeqLock;
+
+/// Number of slots of a `DevicePool`, one per player LED.
+pub const POOL_SLOTS: usize = 4;
+/// Words of the `SeqLock` holding a `PoolSnapshot`, 49 packed 16 bit values.
+const STATE_WORDS: usize = 13;
+
+/// The latest state of the Wii remotes of a `DevicePool`, one array per field indexed by slot.
+///
+/// The raw values are kept like they are received, see `AccelerometerCalibration` and
+/// `MotionPlusCalibration` for the conversion.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct PoolSnapshot {
+    /// Bit `slot` is set for the slots with a Wii remote.
+    pub occupied: u8,
+    /// Number of times a Wii remote was inserted into or removed from every slot, wrapping.
+    pub generations: [u16; POOL_SLOTS],
+    /// Number of reports recorded into every slot, wrapping. A changed value means new state.
+    pub sequences: [u16; POOL_SLOTS],
+    pub buttons: [ButtonData; POOL_SLOTS],
+    /// The raw 10 bit x, y and z accelerometer values.
+    pub accelerometer: [[u16; 3]; POOL_SLOTS],
+    /// The raw 14 bit yaw, roll and pitch values of the Motion Plus.
+    pub gyro: [[u16; 3]; POOL_SLOTS],
+    /// The extension bytes of the latest report with data of an extension other than the Motion Plus.
+    pub extension: [[u8; 6]; POOL_SLOTS],
+}
+
+impl Default for PoolSnapshot {
+    fn default() -> Self {
+        Self {
+            occupied: 0,
+            generations: [0; POOL_SLOTS],
+            sequences: [0; POOL_SLOTS],
+            buttons: [ButtonData::empty(); POOL_SLOTS],
+            accelerometer: [[0; 3]; POOL_SLOTS],
+            gyro: [[0; 3]; POOL_SLOTS],
+            extension: [[0; 6]; POOL_SLOTS],
+        }
+    }
+}
+
+impl PoolSnapshot {
+    /// Returns whether a Wii remote is in the slot.
+    #[must_use]
+    pub const fn is_occupied(&self, slot: u8) -> bool {
+        (slot as usize) < POOL_SLOTS && self.occupied & (1 << slot) != 0
+    }
+
+    /// Returns the fields as 16 bit values in the order they are packed.
+    fn values(&self) -> impl Iterator<Item = u16> + '_ {
+        let extension = self.extension.iter().flat_map(|bytes| {
+            bytes
+                .chunks_exact(2)
+                .map(|pair| u16::from_le_bytes([pair[0], pair[1]]))
+        });
+        std::iter::once(u16::from(self.occupied))
+            .chain(self.generations.iter().copied())
+            .chain(self.sequences.iter().copied())
+            .chain(self.buttons.iter().map(|buttons| buttons.bits()))
+            .chain(self.accelerometer.iter().flatten().copied())
+            .chain(self.gyro.iter().flatten().copied())
+            .chain(extension)
+    }
+
+    /// Packs the snapshot into words to be stored in a `SeqLock`.
+    fn to_words(self) -> [u64; STATE_WORDS] {
+        let mut words = [0; STATE_WORDS];
+        for (index, value) in self.values().enumerate() {
+            words[index / 4] |= u64::from(value) << (index % 4 * 16);
+        }
+        words
+    }
+
+    #[allow(clippy::cast_possible_truncation)]
+    fn from_words(words: [u64; STATE_WORDS]) -> Self {
+        let mut values = words
+            .into_iter()
+            .flat_map(|word| [0, 16, 32, 48].map(|shift| (word >> shift) as u16));
+        let mut next = || values.next().unwrap_or(0);
+        Self {
+            occupied: next() as u8,
+            generations: std::array::from_fn(|_| next()),
+            sequences: std::array::from_fn(|_| next()),
+            buttons: std::array::from_fn(|_| ButtonData::from_bits_retain(next())),
+            accelerometer: std::array::from_fn(|_| std::array::from_fn(|_| next())),
+            gyro: std::array::from_fn(|_| std::array::from_fn(|_| next())),
+            extension: std::array::from_fn(|_| {
+                let mut bytes = [0; 6];
+                for pair in bytes.chunks_exact_mut(2) {
+                    pair.copy_from_slice(&next().to_le_bytes());
+                }
+                bytes
+            }),
+        }
+    }
+}
+
+struct PoolSlot {
+    device: Arc<Mutex<WiimoteDevice>>,
+    identifier: Arc<str>,
+    /// Connection generation the player LED was last set for, the LEDs turn off on reconnect.
+    led_generation: Option<usize>,
+}
+
+/// A fixed set of Wii remotes in slots with stable indices, the slot of a Wii remote is its player LED.
+///
+/// The latest state of all Wii remotes is stored in one small `PoolSnapshot`. `snapshot` copies it
+/// without locking and without touching the devices, e.g. to process all players once per frame,
+/// while `record` or `pump` update it from the received reports.
+pub struct DevicePool {
+    slots: Mutex<[Option<PoolSlot>; POOL_SLOTS]>,
+    state: SeqLock<STATE_WORDS>,
+}
+
+impl Default for DevicePool {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl DevicePool {
+    /// Creates a pool with all slots free.
+    #[must_use]
+    pub fn new() -> Self {
+        Self {
+            slots: Mutex::new(std::array::from_fn(|_| None)),
+            state: SeqLock::new(PoolSnapshot::default().to_words()),
+        }
+    }
+
+    fn lock(&self) -> MutexGuard<'_, [Option<PoolSlot>; POOL_SLOTS]> {
+        match self.slots.lock() {
+            Ok(slots) => slots,
+            Err(err) => err.into_inner(),
+        }
+    }
+
+    /// Adds the Wii remote to the free slot with the lowest index, its player LED is set by the next `pump`.
+    ///
+    /// Returns the slot, the current slot if the Wii remote is already in the pool
+    /// or `None` if all slots are taken.
+    pub fn insert(&self, device: Arc<Mutex<WiimoteDevice>>) -> Option<u8> {
+        let mut slots = self.lock();
+        let current = slots
+            .iter()
+            .position(|slot| matches!(slot, Some(slot) if Arc::ptr_eq(&slot.device, &device)));
+        if let Some(index) = current {
+            return u8::try_from(index).ok();
+        }
+
+        let index = slots.iter().position(Option::is_none)?;
+        let identifier = match device.lock() {
+            Ok(device) => device.shared_identifier(),
+            Err(err) => err.into_inner().shared_identifier(),
+        };
+        slots[index] = Some(PoolSlot {
+            device,
+            identifier,
+            led_generation: None,
+        });
+        self.reset_state(index, true);
+        u8::try_from(index).ok()
+    }
+
+    /// Removes the Wii remote from the slot, the slot is free for the next `insert`.
+    pub fn remove(&self, slot: u8) -> Option<Arc<Mutex<WiimoteDevice>>> {
+        let index = usize::from(slot);
+        let removed = self.lock().get_mut(index)?.take()?;
+        self.reset_state(index, false);
+        Some(removed.device)
+    }
+
+    /// Returns the Wii remote in the slot.
+    #[must_use]
+    pub fn device(&self, slot: u8) -> Option<Arc<Mutex<WiimoteDevice>>> {
+        let slots = self.lock();
+        let slot = slots.get(usize::from(slot))?.as_ref()?;
+        Some(Arc::clone(&slot.device))
+    }
+
+    /// Returns the slot of the Wii remote with the identifier, same as `WiimoteDevice::identifier`.
+    #[must_use]
+    pub fn slot_of(&self, identifier: &str) -> Option<u8> {
+        let index = self
+            .lock()
+            .iter()
+            .position(|slot| matches!(slot, Some(slot) if &*slot.identifier == identifier))?;
+        u8::try_from(index).ok()
+    }
+
+    /// Returns a consistent copy of the latest state of all Wii remotes, without locking.
+    #[must_use]
+    pub fn snapshot(&self) -> PoolSnapshot {
+        PoolSnapshot::from_words(self.state.read())
+    }
+
+    /// Records the data report received from `device` into its slot.
+    /// The extension bytes are decoded with the connected extension and Motion Plus mode of `device`.
+    /// The report is discarded if the Wii remote is removed or replaced in the meantime.
+    pub fn record(&self, slot: u8, device: &WiimoteDevice, report: &DataReportRef<'_>) {
+        let index = usize::from(slot);
+        if index >= POOL_SLOTS {
+            return;
+        }
+        let generation = self.snapshot().generations[index];
+
+        // The unused bits carry the lowest accelerometer bits in some reporting modes
+        let buttons = (report.mode() != 0x3D)
+            .then(|| ButtonData::from_bits_truncate(report.buttons().bits()));
+        let accelerometer = report
+            .accelerometer()
+            .map(|accelerometer| [accelerometer.x(), accelerometer.y(), accelerometer.z()]);
+        let gyro = match device.decode_extension(report) {
+            Some(ExtensionData::MotionPlus(data)) => Some([data.yaw, data.roll, data.pitch]),
+            _ => None,
+        };
+        let extension = report
+            .extension_bytes()
+            .and_then(|bytes| bytes.get(..6))
+            .and_then(|bytes| <[u8; 6]>::try_from(bytes).ok());
+
+        self.state.update(|words| {
+            let mut state = PoolSnapshot::from_words(words);
+            // The Wii remote was removed or replaced while the report was decoded
+            if !state.is_occupied(slot) || state.generations[index] != generation {
+                return words;
+            }
+            state.sequences[index] = state.sequences[index].wrapping_add(1);
+            if let Some(buttons) = buttons {
+                state.buttons[index] = buttons;
+            }
+            if let Some(accelerometer) = accelerometer {
+                state.accelerometer[index] = accelerometer;
+            }
+            match (gyro, extension) {
+                (Some(gyro), _) => state.gyro[index] = gyro,
+                (None, Some(extension)) => state.extension[index] = extension,
+                (None, None) => {}
+            }
+            state.to_words()
+        });
+    }
+
+    /// Reads the reports queued by every Wii remote in the pool without waiting into `reports`
+    /// and records the data reports. Sets the player LED of Wii remotes that were added or reconnected.
+    ///
+    /// Wii remotes that are disconnected or locked by another thread are skipped.
+    /// Returns the number of recorded reports.
+    pub fn pump(&self, reports: &mut [RawReport]) -> usize {
+        let mut recorded = 0;
+        let mut slots = self.lock();
+        for (index, slot) in slots.iter_mut().enumerate() {
+            let Some(slot) = slot else {
+                continue;
+            };
+            let device = match slot.device.try_lock() {
+                Ok(device) => device,
+                Err(TryLockError::Poisoned(err)) => err.into_inner(),
+                Err(TryLockError::WouldBlock) => continue,
+            };
+            if !device.is_connected() {
+                continue;
+            }
+
+            #[allow(clippy::cast_possible_truncation)]
+            let slot_id = index as u8;
+            let generation = device.connection_generation();
+            if slot.led_generation != Some(generation)
+                && device
+                    .write(&OutputReport::PlayerLed(player_led(slot_id)))
+                    .is_ok()
+            {
+                slot.led_generation = Some(generation);
+            }
+
+            while let Ok(count) = device.read_batch(reports) {
+                for report in &reports[..count] {
+                    if let Ok(InputReportRef::DataReport(_, data)) = report.view() {
+                        self.record(slot_id, &device, &data);
+                        recorded += 1;
+                    }
+                }
+                if count < reports.len() {
+                    break;
+                }
+            }
+        }
+        recorded
+    }
+
+    /// Clears the state of the slot and marks it as `occupied`.
+    fn reset_state(&self, index: usize, occupied: bool) {
+        self.state.update(|words| {
+            let mut state = PoolSnapshot::from_words(words);
+            let empty = PoolSnapshot::default();
+            state.generations[index] = state.generations[index].wrapping_add(1);
+            state.sequences[index] = empty.sequences[index];
+            state.buttons[index] = empty.buttons[index];
+            state.accelerometer[index] = empty.accelerometer[index];
+            state.gyro[index] = empty.gyro[index];
+            state.extension[index] = empty.extension[index];
+            if occupied {
+                state.occupied |= 1 << index;
+            } else {
+                state.occupied &= !(1 << index);
+            }
+            state.to_words()
+        });
+    }
+}
+
+/// Returns the player LED of the slot, `LED_1` for slot 0.
+#[must_use]
+pub const fn player_led(slot: u8) -> PlayerLedFlags {
+    PlayerLedFlags::from_bits_truncate(PlayerLedFlags::LED_1.bits() << (slot % POOL_SLOTS as u8))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_snapshot_words_round_trip() {
+        let mut snapshot = PoolSnapshot {
+            occupied: 0b1010,
+            ..PoolSnapshot::default()
+        };
+        for slot in 0..POOL_SLOTS {
+            let value = u16::try_from(slot).unwrap() * 100;
+            snapshot.generations[slot] = value + 7;
+            snapshot.sequences[slot] = u16::MAX - value;
+            snapshot.buttons[slot] = ButtonData::from_bits_truncate(0x1F9F >> slot);
+            snapshot.accelerometer[slot] = [value, value + 1, 0x3FF];
+            snapshot.gyro[slot] = [value + 2, 0x3FFF, value + 3];
+            snapshot.extension[slot] = [0xFF, 1, 2, 3, 4, value.to_le_bytes()[0]];
+        }
+        assert_eq!(PoolSnapshot::from_words(snapshot.to_words()), snapshot);
+        assert!(snapshot.is_occupied(3) && !snapshot.is_occupied(2) && !snapshot.is_occupied(4));
+        assert_eq!(player_led(2).bits(), PlayerLedFlags::LED_3.bits());
+    }
+
+    #[cfg(feature = "mock")]
+    #[test]
+    fn test_pool_records_reports_by_slot() {
+        use crate::mock::MockWiimote;
+        use crate::native::NativeWiimoteDevice;
+
+        let pool = DevicePool::new();
+        let connect = |identifier| {
+            let mock = MockWiimote::connect(identifier);
+            let device = WiimoteDevice::new(NativeWiimoteDevice::take(&mock), None).unwrap();
+            (mock, Arc::new(Mutex::new(device)))
+        };
+        let (first_mock, first) = connect("pool-first");
+        let (second_mock, second) = connect("pool-second");
+        assert_eq!(pool.insert(Arc::clone(&first)), Some(0));
+        assert_eq!(pool.insert(Arc::clone(&second)), Some(1));
+        assert_eq!(pool.insert(Arc::clone(&first)), Some(0));
+        assert_eq!(pool.slot_of("pool-second"), Some(1));
+
+        let mut reports = [RawReport::default(); 2];
+        // Buttons A and B, accelerometer x, y and z
+        assert!(second_mock.send_report(&[0x31, 0x00, 0x0C, 0x80, 0x81, 0x9A]));
+        // Button home, extension bytes
+        assert!(first_mock.send_report(&[0x32, 0x00, 0x80, 1, 2, 3, 4, 5, 6, 7, 8]));
+        for _ in 0..3 {
+            assert!(second_mock.send_report(&[0x30, 0x00, 0x04]));
+        }
+        // The status replies to the player LED reports are not recorded
+        assert_eq!(pool.pump(&mut reports), 5);
+
+        let snapshot = pool.snapshot();
+        assert_eq!(snapshot.occupied, 0b11);
+        assert_eq!(snapshot.sequences, [1, 4, 0, 0]);
+        assert_eq!(snapshot.buttons[0], ButtonData::HOME);
+        assert_eq!(snapshot.buttons[1], ButtonData::B);
+        assert_eq!(snapshot.accelerometer[1], [0x200, 0x204, 0x268]);
+        assert_eq!(snapshot.extension[0], [1, 2, 3, 4, 5, 6]);
+
+        assert!(Arc::ptr_eq(&pool.remove(0).unwrap(), &first));
+        let snapshot = pool.snapshot();
+        assert_eq!(snapshot.occupied, 0b10);
+        assert_eq!(snapshot.generations, [2, 1, 0, 0]);
+        assert_eq!(snapshot.sequences[0], 0);
+        assert_eq!(pool.insert(first), Some(0));
+        assert_eq!(pool.snapshot().generations[0], 3);
+    }
+}
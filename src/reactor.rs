@@ -0,0 +1,270 @@
+use std::sync::{Arc, Mutex};
+use std::time::{Duration, Instant};
+
+use crate::fusion::{MahonyFilter, Quaternion};
+use crate::input::{InputReport, InputReportRef, RawReport};
+use crate::native::{NativeReactor, NativeWiimoteReactor};
+use crate::prelude::*;
+
+/// Maximum number of reports read from one Wii remote per wakeup,
+/// prevents a single busy Wii remote from starving the others.
+const MAX_REPORTS_PER_WAKEUP: usize = 64;
+/// Shortest interval of reports in continuous reporting, used to spread the timestamps of reports read at once.
+const REPORT_INTERVAL: Duration = Duration::from_millis(5);
+
+/// An input report received by the `WiimoteReactor`, tagged with the Wii remote it came from.
+#[derive(Debug)]
+pub struct ReactorEvent {
+    /// The identifier of the Wii remote, same as `WiimoteDevice::identifier`.
+    pub identifier: Arc<str>,
+    /// When the report was received, see `RawReport::timestamp`. Reports without a receive time
+    /// that were read at once are spread evenly since the previous read.
+    pub timestamp: Instant,
+    /// The received report or `WiimoteError::Disconnected` when the Wii remote disconnected.
+    pub report: WiimoteResult<InputReport>,
+    /// The orientation after this report if an orientation filter is set for the Wii remote
+    /// and the report contains accelerometer and Motion Plus data.
+    pub orientation: Option<Quaternion>,
+}
+
+struct ReactorSlot {
+    device: Arc<Mutex<WiimoteDevice>>,
+    identifier: Arc<str>,
+    /// Connection generation of the registered native device.
+    registered_generation: Option<usize>,
+    last_read: Option<Instant>,
+    filter: Option<MahonyFilter>,
+}
+
+/// Receives the input reports of many Wii remotes on a single thread.
+///
+/// All data sockets share one epoll set on Linux, all HID handles share one I/O completion port on Windows,
+/// so the number of threads and wakeups does not grow with the number of Wii remotes.
+pub struct WiimoteReactor {
+    native: NativeWiimoteReactor,
+    slots: Vec<Option<ReactorSlot>>,
+    ready: Vec<usize>,
+    batch: Box<[RawReport]>,
+    /// Devices that still had reports queued when `MAX_REPORTS_PER_WAKEUP` was reached.
+    pending: Vec<usize>,
+}
+
+impl WiimoteReactor {
+    /// Creates a reactor without any registered Wii remotes.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the native reactor could not be created.
+    pub fn new() -> WiimoteResult<Self> {
+        Ok(Self {
+            native: NativeWiimoteReactor::new()?,
+            slots: Vec::new(),
+            ready: Vec::new(),
+            batch: vec![RawReport::default(); MAX_REPORTS_PER_WAKEUP].into_boxed_slice(),
+            pending: Vec::new(),
+        })
+    }
+
+    /// Registers the Wii remote with the reactor.
+    /// Reconnects of the Wii remote are picked up automatically.
+    ///
+    /// On Windows the Wii remote must not be used with another reactor, its background I/O or asynchronously,
+    /// its handle can only be associated with one I/O completion port. Registering it then fails.
+    pub fn register(&mut self, device: Arc<Mutex<WiimoteDevice>>) {
+        let identifier = {
+            let device = match device.lock() {
+                Ok(device) => device,
+                Err(err) => err.into_inner(),
+            };
+            Arc::from(device.identifier())
+        };
+        let slot = ReactorSlot {
+            device,
+            identifier,
+            registered_generation: None,
+            last_read: None,
+            filter: None,
+        };
+
+        if let Some(free_slot) = self.slots.iter_mut().find(|slot| slot.is_none()) {
+            *free_slot = Some(slot);
+        } else {
+            self.slots.push(Some(slot));
+        }
+    }
+
+    /// Stops receiving reports from the Wii remote with the given identifier.
+    pub fn deregister(&mut self, identifier: &str) {
+        for slot in &mut self.slots {
+            if !matches!(slot, Some(slot) if &*slot.identifier == identifier) {
+                continue;
+            }
+
+            if let Some(slot) = slot.take() {
+                let device = match slot.device.lock() {
+                    Ok(device) => device,
+                    Err(err) => err.into_inner(),
+                };
+                if slot.registered_generation == Some(device.connection_generation()) {
+                    device.with_native_device(|native| self.native.deregister(native));
+                }
+            }
+        }
+    }
+
+    /// Sets the filter that estimates the orientation of the Wii remote from its reports
+    /// or removes it with `None`, see `ReactorEvent::orientation`.
+    ///
+    /// The Motion Plus must be initialized and active, the reporting mode must be 0x35 or 0x37.
+    pub fn set_orientation_filter(&mut self, identifier: &str, filter: Option<MahonyFilter>) {
+        for slot in self.slots.iter_mut().flatten() {
+            if &*slot.identifier == identifier {
+                slot.filter = filter;
+            }
+        }
+    }
+
+    /// Returns the current orientation of the Wii remote if an orientation filter is set.
+    #[must_use]
+    pub fn orientation(&self, identifier: &str) -> Option<Quaternion> {
+        self.slots
+            .iter()
+            .flatten()
+            .find(|slot| &*slot.identifier == identifier)
+            .and_then(|slot| slot.filter.as_ref())
+            .map(MahonyFilter::orientation)
+    }
+
+    /// Waits up to `timeout` (or forever if `None`) for reports of the registered Wii remotes
+    /// and appends them to `events`.
+    ///
+    /// Returns the number of events appended.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if waiting for the native devices failed.
+    pub fn poll(
+        &mut self,
+        events: &mut Vec<ReactorEvent>,
+        timeout: Option<Duration>,
+    ) -> WiimoteResult<usize> {
+        self.ready.clear();
+        self.ready.append(&mut self.pending);
+        self.refresh_registrations();
+
+        let timeout_millis = if self.ready.is_empty() {
+            timeout.map(|timeout| usize::try_from(timeout.as_millis()).unwrap_or(usize::MAX))
+        } else {
+            Some(0)
+        };
+        self.native.wait(&mut self.ready, timeout_millis)?;
+
+        self.ready.sort_unstable();
+        self.ready.dedup();
+
+        let events_before = events.len();
+        for &token in &self.ready {
+            let Some(Some(slot)) = self.slots.get_mut(token) else {
+                continue;
+            };
+            let device = match slot.device.lock() {
+                Ok(device) => device,
+                Err(err) => err.into_inner(),
+            };
+
+            match device.read_batch(&mut self.batch) {
+                Ok(reports_read) => {
+                    let timestamps = spread_timestamps(&mut slot.last_read, reports_read);
+                    let motion_plus_calibration = slot
+                        .filter
+                        .and(device.motion_plus())
+                        .map(MotionPlus::calibration);
+                    for (report, spread_timestamp) in
+                        self.batch[..reports_read].iter().zip(timestamps)
+                    {
+                        let timestamp = report.timestamp().unwrap_or(spread_timestamp);
+                        let orientation = slot
+                            .filter
+                            .as_mut()
+                            .zip(motion_plus_calibration.as_ref())
+                            .and_then(|(filter, motion_plus_calibration)| match report.view() {
+                                Ok(InputReportRef::DataReport(_, data)) => filter.update_report(
+                                    &data,
+                                    timestamp,
+                                    device.accelerometer_calibration(),
+                                    motion_plus_calibration,
+                                ),
+                                _ => None,
+                            });
+                        events.push(ReactorEvent {
+                            identifier: Arc::clone(&slot.identifier),
+                            timestamp,
+                            report: report.decode(),
+                            orientation,
+                        });
+                    }
+                    if reports_read == self.batch.len() {
+                        // Windows only queues a new read once the device is drained, it must be continued in the next poll.
+                        self.pending.push(token);
+                    }
+                }
+                Err(error) => events.push(ReactorEvent {
+                    identifier: Arc::clone(&slot.identifier),
+                    timestamp: Instant::now(),
+                    report: Err(error),
+                    orientation: None,
+                }),
+            }
+        }
+        Ok(events.len() - events_before)
+    }
+
+    /// Registers native devices of newly connected or reconnected Wii remotes.
+    /// Newly registered devices are added to the ready list to receive already queued reports.
+    fn refresh_registrations(&mut self) {
+        for (token, slot) in self.slots.iter_mut().enumerate() {
+            let Some(slot) = slot else {
+                continue;
+            };
+            let device = match slot.device.lock() {
+                Ok(device) => device,
+                Err(err) => err.into_inner(),
+            };
+            let generation = device.connection_generation();
+            if slot.registered_generation == Some(generation) {
+                continue;
+            }
+
+            let result = device.with_native_device(|native| self.native.register(native, token));
+            match result {
+                Some(Ok(())) => {
+                    slot.registered_generation = Some(generation);
+                    self.ready.push(token);
+                }
+                Some(Err(error)) => {
+                    slot.registered_generation = Some(generation);
+                    eprintln!("Failed to register wiimote with reactor: {error}");
+                }
+                // Still disconnected, try again after the next reconnect
+                None => {}
+            }
+        }
+    }
+}
+
+/// Returns the timestamps of `count` reports read now, spread evenly since the previous read
+/// but at most `REPORT_INTERVAL` apart.
+fn spread_timestamps(
+    last_read: &mut Option<Instant>,
+    count: usize,
+) -> impl Iterator<Item = Instant> {
+    let now = Instant::now();
+    let count = u32::try_from(count).unwrap_or(u32::MAX);
+    let earliest = now.checked_sub(REPORT_INTERVAL * count).unwrap_or(now);
+    let start = last_read.map_or(earliest, |last_read| last_read.max(earliest));
+    if count > 0 {
+        *last_read = Some(now);
+    }
+    let interval = now.saturating_duration_since(start);
+    (1..=count).map(move |index| start + interval * index / count)
+}
@@ -2,6 +2,9 @@
 pub enum WiimoteError {
     WiimoteDeviceError(WiimoteDeviceError),
     Disconnected,
+    QueueFull,
+    Timeout,
+    Io(std::io::Error),
 }
 
 #[derive(Debug)]
@@ -11,6 +14,8 @@ pub enum WiimoteDeviceError {
     MissingData,
     InvalidChecksum,
     InvalidData,
+    /// Error flag of a read memory reply or error code of a write acknowledge.
+    MemoryAccess(u8),
 }
 
 impl From<WiimoteDeviceError> for WiimoteError {
@@ -19,4 +24,10 @@ impl From<WiimoteDeviceError> for WiimoteError {
     }
 }
 
+impl From<std::io::Error> for WiimoteError {
+    fn from(e: std::io::Error) -> Self {
+        Self::Io(e)
+    }
+}
+
 pub type WiimoteResult<T> = Result<T, WiimoteError>;
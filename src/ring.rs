@@ -0,0 +1,154 @@
+use std::cell::UnsafeCell;
+use std::mem::MaybeUninit;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Arc;
+
+/// A bounded lock-free single-producer/single-consumer queue.
+struct Ring<T> {
+    slots: Box<[UnsafeCell<MaybeUninit<T>>]>,
+    mask: usize,
+    /// Index of the next slot to read, only written by the consumer.
+    head: AtomicUsize,
+    /// Index of the next slot to write, only written by the producer.
+    tail: AtomicUsize,
+}
+
+// Every slot is accessed by either the producer or the consumer, never both at the same time.
+unsafe impl<T: Send> Sync for Ring<T> {}
+
+/// Creates a ring holding at least `capacity` values, rounded up to the next power of two.
+pub(crate) fn spsc_ring<T: Copy + Send>(capacity: usize) -> (RingProducer<T>, RingConsumer<T>) {
+    let capacity = capacity.max(1).next_power_of_two();
+    let ring = Arc::new(Ring {
+        slots: (0..capacity)
+            .map(|_| UnsafeCell::new(MaybeUninit::uninit()))
+            .collect(),
+        mask: capacity - 1,
+        head: AtomicUsize::new(0),
+        tail: AtomicUsize::new(0),
+    });
+    (
+        RingProducer {
+            ring: Arc::clone(&ring),
+            cached_head: 0,
+        },
+        RingConsumer {
+            ring,
+            cached_tail: 0,
+        },
+    )
+}
+
+pub(crate) struct RingProducer<T> {
+    ring: Arc<Ring<T>>,
+    /// Last known head, only reloaded when the ring seems full.
+    cached_head: usize,
+}
+
+impl<T: Copy> RingProducer<T> {
+    /// Appends the value, returns it back if the ring is full.
+    pub(crate) fn push(&mut self, value: T) -> Result<(), T> {
+        let tail = self.ring.tail.load(Ordering::Relaxed);
+        if tail.wrapping_sub(self.cached_head) > self.ring.mask {
+            self.cached_head = self.ring.head.load(Ordering::Acquire);
+            if tail.wrapping_sub(self.cached_head) > self.ring.mask {
+                return Err(value);
+            }
+        }
+
+        unsafe { (*self.ring.slots[tail & self.ring.mask].get()).write(value) };
+        self.ring
+            .tail
+            .store(tail.wrapping_add(1), Ordering::Release);
+        Ok(())
+    }
+}
+
+pub(crate) struct RingConsumer<T> {
+    ring: Arc<Ring<T>>,
+    /// Last known tail, only reloaded when the ring seems empty.
+    cached_tail: usize,
+}
+
+impl<T: Copy> RingConsumer<T> {
+    /// Removes the oldest value from the ring.
+    pub(crate) fn pop(&mut self) -> Option<T> {
+        let head = self.ring.head.load(Ordering::Relaxed);
+        if head == self.cached_tail {
+            self.cached_tail = self.ring.tail.load(Ordering::Acquire);
+            if head == self.cached_tail {
+                return None;
+            }
+        }
+
+        let value = unsafe { (*self.ring.slots[head & self.ring.mask].get()).assume_init() };
+        self.ring
+            .head
+            .store(head.wrapping_add(1), Ordering::Release);
+        Some(value)
+    }
+
+    /// Returns the number of values currently in the ring.
+    pub(crate) fn len(&self) -> usize {
+        let head = self.ring.head.load(Ordering::Relaxed);
+        self.ring.tail.load(Ordering::Acquire).wrapping_sub(head)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_push_pop_in_order() {
+        let (mut producer, mut consumer) = spsc_ring(4);
+        assert_eq!(consumer.pop(), None);
+
+        for value in 0..4 {
+            assert_eq!(producer.push(value), Ok(()));
+        }
+        assert_eq!(producer.push(4), Err(4));
+        assert_eq!(consumer.len(), 4);
+
+        assert_eq!(consumer.pop(), Some(0));
+        assert_eq!(producer.push(4), Ok(()));
+        for value in 1..=4 {
+            assert_eq!(consumer.pop(), Some(value));
+        }
+        assert_eq!(consumer.pop(), None);
+    }
+
+    #[test]
+    fn test_capacity_rounded_to_power_of_two() {
+        let (mut producer, _consumer) = spsc_ring(5);
+        for value in 0..8 {
+            assert_eq!(producer.push(value), Ok(()));
+        }
+        assert_eq!(producer.push(8), Err(8));
+    }
+
+    #[test]
+    fn test_across_threads() {
+        const COUNT: u32 = 10_000;
+        let (mut producer, mut consumer) = spsc_ring(64);
+
+        let thread = std::thread::spawn(move || {
+            for value in 0..COUNT {
+                while producer.push(value).is_err() {
+                    std::thread::yield_now();
+                }
+            }
+        });
+
+        let mut expected = 0;
+        while expected < COUNT {
+            if let Some(value) = consumer.pop() {
+                assert_eq!(value, expected);
+                expected += 1;
+            } else {
+                std::thread::yield_now();
+            }
+        }
+        thread.join().unwrap();
+    }
+}
@@ -0,0 +1,400 @@
+use std::collections::VecDeque;
+use std::sync::{Arc, Condvar, Mutex, MutexGuard};
+use std::thread::JoinHandle;
+use std::time::{Duration, Instant};
+
+use crate::device::Connection;
+use crate::output::{OutputReport, PlayerLedFlags};
+use crate::prelude::*;
+
+/// Maximum number of reports queued per Wii remote, excluding the coalesced rumble and player LED reports.
+const DEVICE_QUEUE_CAPACITY: usize = 64;
+
+/// Number of output reports that may be sent per second, per Wii remote and for all Wii remotes of the radio.
+#[derive(Debug, Clone, Copy)]
+pub struct OutputBudget {
+    /// Reports per second sent to a single Wii remote.
+    pub device_rate: f64,
+    /// Reports that can be sent to a single Wii remote at once after being idle.
+    pub device_burst: u32,
+    /// Reports per second sent to all Wii remotes of the scheduler, which share one Bluetooth radio.
+    pub radio_rate: f64,
+    /// Reports that can be sent to all Wii remotes at once after being idle.
+    pub radio_burst: u32,
+}
+
+impl Default for OutputBudget {
+    fn default() -> Self {
+        Self {
+            device_rate: 100.0,
+            device_burst: 4,
+            radio_rate: 400.0,
+            radio_burst: 8,
+        }
+    }
+}
+
+/// Allows `rate` reports per second with bursts of up to `burst` reports.
+#[derive(Debug)]
+struct TokenBucket {
+    rate: f64,
+    burst: f64,
+    tokens: f64,
+    updated: Instant,
+}
+
+impl TokenBucket {
+    fn new(rate: f64, burst: u32, now: Instant) -> Self {
+        let burst = f64::from(burst.max(1));
+        Self {
+            rate: rate.max(f64::MIN_POSITIVE),
+            burst,
+            tokens: burst,
+            updated: now,
+        }
+    }
+
+    fn refill(&mut self, now: Instant) {
+        let elapsed = now.saturating_duration_since(self.updated).as_secs_f64();
+        self.tokens = f64::min(self.burst, self.tokens + elapsed * self.rate);
+        self.updated = now;
+    }
+
+    /// Returns the time until a report can be sent, zero if it can be sent now.
+    fn wait_time(&mut self, now: Instant) -> Duration {
+        self.refill(now);
+        if self.tokens >= 1.0 {
+            Duration::ZERO
+        } else {
+            Duration::from_secs_f64((1.0 - self.tokens) / self.rate)
+        }
+    }
+
+    fn take(&mut self) {
+        self.tokens -= 1.0;
+    }
+}
+
+/// The output reports waiting to be sent to a Wii remote.
+///
+/// Rumble and player LED reports replace the previous queued report of the same kind,
+/// a queued rumble state is sent with the next report instead of a separate rumble report.
+#[derive(Debug, Default)]
+struct DeviceQueue {
+    rumble: Option<bool>,
+    player_leds: Option<PlayerLedFlags>,
+    reports: VecDeque<OutputReport>,
+}
+
+impl DeviceQueue {
+    fn push(&mut self, output_report: OutputReport) -> WiimoteResult<()> {
+        match output_report {
+            OutputReport::Rumble(rumble) => self.rumble = Some(rumble),
+            OutputReport::PlayerLed(flags) => self.player_leds = Some(flags),
+            output_report if self.reports.len() < DEVICE_QUEUE_CAPACITY => {
+                self.reports.push_back(output_report);
+            }
+            _ => return Err(WiimoteError::QueueFull),
+        }
+        Ok(())
+    }
+
+    fn is_empty(&self) -> bool {
+        self.rumble.is_none() && self.player_leds.is_none() && self.reports.is_empty()
+    }
+
+    /// Returns the next report to send and the rumble state to send with it, `None` to keep the current state.
+    fn pop(&mut self) -> Option<(OutputReport, Option<bool>)> {
+        let output_report = self
+            .reports
+            .pop_front()
+            .or_else(|| self.player_leds.take().map(OutputReport::PlayerLed))
+            .or_else(|| self.rumble.map(OutputReport::Rumble))?;
+        Some((output_report, self.rumble.take()))
+    }
+}
+
+struct ScheduledDevice {
+    connection: Arc<Connection>,
+    queue: DeviceQueue,
+    budget: TokenBucket,
+}
+
+struct SchedulerState {
+    devices: Vec<ScheduledDevice>,
+    radio_budget: TokenBucket,
+    budget: OutputBudget,
+    /// Index of the device that is checked first by the next flush, so every device gets its turn.
+    next_device: usize,
+    /// Number of reports taken from the queues that are not written yet.
+    in_flight: usize,
+    stop: bool,
+}
+
+impl SchedulerState {
+    /// Takes the reports that fit into the budgets, returns the time until the next report fits
+    /// or `None` if no reports are queued.
+    fn take_ready(
+        &mut self,
+        now: Instant,
+        batch: &mut Vec<(Arc<Connection>, OutputReport, Option<bool>)>,
+    ) -> Option<Duration> {
+        let device_count = self.devices.len();
+        let mut wait: Option<Duration> = None;
+        let mut sent_any = true;
+        while sent_any {
+            sent_any = false;
+            for offset in 0..device_count {
+                let index = (self.next_device + offset) % device_count;
+                let device = &mut self.devices[index];
+                if device.queue.is_empty() {
+                    continue;
+                }
+                let device_wait = device.budget.wait_time(now);
+                let radio_wait = self.radio_budget.wait_time(now);
+                let next = Duration::max(device_wait, radio_wait);
+                if next > Duration::ZERO {
+                    wait = Some(wait.map_or(next, |wait| wait.min(next)));
+                    continue;
+                }
+                if let Some((output_report, rumble)) = device.queue.pop() {
+                    device.budget.take();
+                    self.radio_budget.take();
+                    batch.push((Arc::clone(&device.connection), output_report, rumble));
+                    self.next_device = (index + 1) % device_count;
+                    sent_any = true;
+                }
+            }
+        }
+        if self.devices.iter().any(|device| !device.queue.is_empty()) {
+            wait.or(Some(Duration::ZERO))
+        } else {
+            None
+        }
+    }
+}
+
+struct Shared {
+    state: Mutex<SchedulerState>,
+    changed: Condvar,
+}
+
+impl Shared {
+    fn lock(&self) -> MutexGuard<'_, SchedulerState> {
+        match self.state.lock() {
+            Ok(state) => state,
+            Err(err) => err.into_inner(),
+        }
+    }
+}
+
+/// Sends the output reports of many Wii remotes on a background thread within a report budget.
+///
+/// Queued rumble and player LED reports are coalesced so only the latest state is sent,
+/// which keeps force feedback from flooding the Bluetooth link shared by all Wii remotes of the radio.
+pub struct OutputScheduler {
+    shared: Arc<Shared>,
+    thread: Option<JoinHandle<()>>,
+}
+
+impl OutputScheduler {
+    /// Creates a scheduler sending at most the reports of `budget`.
+    #[must_use]
+    pub fn new(budget: OutputBudget) -> Self {
+        let shared = Arc::new(Shared {
+            state: Mutex::new(SchedulerState {
+                devices: Vec::new(),
+                radio_budget: TokenBucket::new(
+                    budget.radio_rate,
+                    budget.radio_burst,
+                    Instant::now(),
+                ),
+                budget,
+                next_device: 0,
+                in_flight: 0,
+                stop: false,
+            }),
+            changed: Condvar::new(),
+        });
+
+        let thread_shared = Arc::clone(&shared);
+        let thread = std::thread::Builder::new()
+            .name("wii-remote-output".to_string())
+            .spawn(move || run(&thread_shared))
+            .expect("Failed to spawn Wii remote output thread");
+
+        Self {
+            shared,
+            thread: Some(thread),
+        }
+    }
+
+    /// Queues the output report to be sent to the Wii remote without waiting for it.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the Wii remote is disconnected or its queue is full.
+    pub fn send(&self, wiimote: &WiimoteDevice, output_report: OutputReport) -> WiimoteResult<()> {
+        let connection = wiimote.connection();
+        if !connection.is_connected() {
+            return Err(WiimoteError::Disconnected);
+        }
+
+        let mut state = self.shared.lock();
+        let index = match state
+            .devices
+            .iter()
+            .position(|device| Arc::ptr_eq(&device.connection, connection))
+        {
+            Some(index) => index,
+            None => {
+                let budget = TokenBucket::new(
+                    state.budget.device_rate,
+                    state.budget.device_burst,
+                    Instant::now(),
+                );
+                state.devices.push(ScheduledDevice {
+                    connection: Arc::clone(connection),
+                    queue: DeviceQueue::default(),
+                    budget,
+                });
+                state.devices.len() - 1
+            }
+        };
+        state.devices[index].queue.push(output_report)?;
+        drop(state);
+        self.shared.changed.notify_all();
+        Ok(())
+    }
+
+    /// Waits up to `timeout` until all queued reports are sent.
+    /// Returns whether all reports were sent.
+    pub fn flush(&self, timeout: Duration) -> bool {
+        let deadline = Instant::now() + timeout;
+        let mut state = self.shared.lock();
+        loop {
+            let is_idle =
+                state.in_flight == 0 && state.devices.iter().all(|device| device.queue.is_empty());
+            let remaining = deadline.saturating_duration_since(Instant::now());
+            if is_idle || remaining.is_zero() {
+                return is_idle;
+            }
+            state = match self.shared.changed.wait_timeout(state, remaining) {
+                Ok((state, _)) => state,
+                Err(err) => err.into_inner().0,
+            };
+        }
+    }
+}
+
+impl Default for OutputScheduler {
+    fn default() -> Self {
+        Self::new(OutputBudget::default())
+    }
+}
+
+impl Drop for OutputScheduler {
+    fn drop(&mut self) {
+        self.shared.lock().stop = true;
+        self.shared.changed.notify_all();
+        if let Some(thread) = self.thread.take() {
+            _ = thread.join();
+        }
+    }
+}
+
+fn run(shared: &Shared) {
+    let mut batch = Vec::new();
+    let mut state = shared.lock();
+    while !state.stop {
+        let wait = state.take_ready(Instant::now(), &mut batch);
+        if !batch.is_empty() {
+            state.in_flight = batch.len();
+            drop(state);
+            // Writes can block, they are sent without holding the state so reports can be queued meanwhile
+            let mut disconnected = Vec::new();
+            for (connection, output_report, rumble) in batch.drain(..) {
+                if let Some(rumble) = rumble {
+                    connection.set_rumble(rumble);
+                }
+                if connection.write(&output_report).is_err() {
+                    disconnected.push(connection);
+                }
+            }
+            state = shared.lock();
+            state.in_flight = 0;
+            // Reports queued for a disconnected Wii remote are discarded
+            state.devices.retain(|device| {
+                !disconnected
+                    .iter()
+                    .any(|connection| Arc::ptr_eq(connection, &device.connection))
+            });
+            shared.changed.notify_all();
+            continue;
+        }
+
+        state = match wait {
+            Some(wait) => match shared.changed.wait_timeout(state, wait) {
+                Ok((state, _)) => state,
+                Err(err) => err.into_inner().0,
+            },
+            None => match shared.changed.wait(state) {
+                Ok(state) => state,
+                Err(err) => err.into_inner(),
+            },
+        };
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_rumble_and_leds_coalesced() {
+        let mut queue = DeviceQueue::default();
+        queue.push(OutputReport::Rumble(true)).unwrap();
+        queue
+            .push(OutputReport::PlayerLed(PlayerLedFlags::LED_1))
+            .unwrap();
+        queue.push(OutputReport::Rumble(false)).unwrap();
+        queue
+            .push(OutputReport::PlayerLed(PlayerLedFlags::LED_2))
+            .unwrap();
+
+        // Only the latest LED state is sent, carrying the latest rumble state
+        match queue.pop() {
+            Some((OutputReport::PlayerLed(flags), Some(false))) => {
+                assert_eq!(flags.bits(), PlayerLedFlags::LED_2.bits());
+            }
+            other => panic!("Unexpected report {other:?}"),
+        }
+        assert!(queue.pop().is_none());
+    }
+
+    #[test]
+    fn test_rumble_merged_into_queued_report() {
+        let mut queue = DeviceQueue::default();
+        queue.push(OutputReport::StatusRequest).unwrap();
+        queue.push(OutputReport::Rumble(true)).unwrap();
+
+        assert!(matches!(
+            queue.pop(),
+            Some((OutputReport::StatusRequest, Some(true)))
+        ));
+        assert!(queue.is_empty());
+    }
+
+    #[test]
+    fn test_token_bucket_limits_rate() {
+        let now = Instant::now();
+        let mut bucket = TokenBucket::new(100.0, 2, now);
+        for _ in 0..2 {
+            assert_eq!(bucket.wait_time(now), Duration::ZERO);
+            bucket.take();
+        }
+        let wait = bucket.wait_time(now);
+        assert!(wait > Duration::from_millis(9) && wait <= Duration::from_millis(10));
+        assert_eq!(bucket.wait_time(now + wait), Duration::ZERO);
+    }
+}
@@ -0,0 +1,103 @@
+use std::sync::atomic::{fence, AtomicU64, AtomicUsize, Ordering};
+
+/// A sequence lock over `WORDS` 64 bit words.
+///
+/// Readers never block, they retry while a write is in progress.
+/// Writers compute the new value outside of the critical section, which only stores the words.
+#[derive(Debug)]
+pub(crate) struct SeqLock<const WORDS: usize> {
+    /// Odd while a write is in progress.
+    sequence: AtomicUsize,
+    words: [AtomicU64; WORDS],
+}
+
+impl<const WORDS: usize> SeqLock<WORDS> {
+    pub(crate) fn new(words: [u64; WORDS]) -> Self {
+        Self {
+            sequence: AtomicUsize::new(0),
+            words: words.map(AtomicU64::new),
+        }
+    }
+
+    /// Returns a consistent copy of the words.
+    pub(crate) fn read(&self) -> [u64; WORDS] {
+        self.read_with_sequence().1
+    }
+
+    /// Replaces the words with `f` applied to a consistent copy of them and returns the new words.
+    /// `f` is called again if another write happened in the meantime.
+    pub(crate) fn update(&self, mut f: impl FnMut([u64; WORDS]) -> [u64; WORDS]) -> [u64; WORDS] {
+        loop {
+            let (sequence, words) = self.read_with_sequence();
+            let words = f(words);
+            if self
+                .sequence
+                .compare_exchange(sequence, sequence + 1, Ordering::Acquire, Ordering::Relaxed)
+                .is_err()
+            {
+                continue;
+            }
+            // Readers that see a stored word must also see the odd sequence
+            fence(Ordering::Release);
+            for (word, value) in self.words.iter().zip(words) {
+                word.store(value, Ordering::Relaxed);
+            }
+            self.sequence.store(sequence + 2, Ordering::Release);
+            return words;
+        }
+    }
+
+    /// Replaces the words.
+    pub(crate) fn store(&self, words: [u64; WORDS]) {
+        self.update(|_| words);
+    }
+
+    fn read_with_sequence(&self) -> (usize, [u64; WORDS]) {
+        loop {
+            let sequence = self.sequence.load(Ordering::Acquire);
+            if sequence & 1 == 0 {
+                let words = std::array::from_fn(|index| self.words[index].load(Ordering::Relaxed));
+                fence(Ordering::Acquire);
+                if self.sequence.load(Ordering::Relaxed) == sequence {
+                    return (sequence, words);
+                }
+            }
+            std::hint::spin_loop();
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::sync::atomic::AtomicBool;
+    use std::sync::Arc;
+
+    use super::*;
+
+    #[test]
+    fn test_reads_are_never_torn() {
+        let lock = Arc::new(SeqLock::new([0u64; 4]));
+        let stop = Arc::new(AtomicBool::new(false));
+        let readers = (0..2)
+            .map(|_| {
+                let lock = Arc::clone(&lock);
+                let stop = Arc::clone(&stop);
+                std::thread::spawn(move || {
+                    while !stop.load(Ordering::Relaxed) {
+                        let words = lock.read();
+                        assert!(words.iter().all(|word| *word == words[0]));
+                    }
+                })
+            })
+            .collect::<Vec<_>>();
+
+        for _ in 0..10_000 {
+            lock.update(|words| words.map(|word| word + 1));
+        }
+        stop.store(true, Ordering::Relaxed);
+        for reader in readers {
+            reader.join().unwrap();
+        }
+        assert_eq!(lock.read(), [10_000; 4]);
+    }
+}
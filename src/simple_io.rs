@@ -1,61 +1,106 @@
+use std::time::Duration;
+
 use crate::prelude::*;
 
-use crate::input::{AcknowledgeData, InputReport, MemoryData};
-use crate::output::{Addressing, OutputReport};
+use crate::output::Addressing;
 
 const RETRY_COUNT: usize = 5;
-const READ_TIMEOUT: usize = 250;
+const READ_TIMEOUT: Duration = Duration::from_millis(250);
+
+/// A memory request of up to 16 bytes sent with `transfer`.
+#[derive(Debug, Clone, Copy)]
+pub enum MemoryRequest {
+    Read(Addressing),
+    Write(Addressing, [u8; 16]),
+}
 
-/// Reads up to 16 bytes from the Wii remote.
-/// Discards reports other than the expected data, only use during setup to prevent race-conditions.
-pub fn read_16_bytes_sync(
+/// Queues all requests at once and returns the results in the order of `requests`.
+/// The requests are sent in order, writes without waiting for their acknowledges
+/// and every request after a read once the read completed.
+/// Reports other than the replies are kept for the next read of the Wii remote.
+/// Requests without a reply within `READ_TIMEOUT` are sent again up to `RETRY_COUNT` times.
+pub fn transfer(
     wiimote: &WiimoteDevice,
-    addressing: Addressing,
-) -> WiimoteResult<MemoryData> {
-    let memory_read_request = OutputReport::ReadMemory(addressing);
-    wiimote.write(&memory_read_request).unwrap();
-
-    for _i in 0..RETRY_COUNT {
-        let input_report = wiimote.read_timeout(READ_TIMEOUT)?;
-        if let InputReport::ReadMemory(memory_data) = input_report {
-            return Ok(memory_data);
+    requests: &[MemoryRequest],
+) -> Vec<WiimoteResult<Vec<u8>>> {
+    let mut results = requests
+        .iter()
+        .map(|_| Err(WiimoteError::Timeout))
+        .collect::<Vec<_>>();
+
+    let metrics = wiimote.connection().metrics();
+    for attempt in 0..RETRY_COUNT {
+        let transactions = requests
+            .iter()
+            .zip(&results)
+            .enumerate()
+            .filter(|(_, (_, result))| matches!(result, Err(WiimoteError::Timeout)))
+            .map(|(index, (request, _))| (index, send(wiimote, request)))
+            .collect::<Vec<_>>();
+        if transactions.is_empty() {
+            break;
+        }
+        if attempt > 0 {
+            metrics.memory_retries.add(transactions.len());
+        }
+        for (index, transaction) in transactions {
+            results[index] = transaction.wait(READ_TIMEOUT);
         }
     }
-    Err(WiimoteDeviceError::InvalidData.into())
+    metrics.memory_timeouts.add(
+        results
+            .iter()
+            .filter(|result| matches!(result, Err(WiimoteError::Timeout)))
+            .count(),
+    );
+    results
 }
 
-/// Reads up to 16 bytes from the Wii remote and checks the resulting report data.
-/// Discards reports other than the expected data, only use during setup to prevent race-conditions.
-pub fn read_16_bytes_sync_checked(
-    wiimote: &WiimoteDevice,
-    addressing: Addressing,
-) -> WiimoteResult<[u8; 16]> {
-    let address = addressing.address;
-    let size = addressing.size;
-
-    let memory_data = read_16_bytes_sync(wiimote, addressing)?;
-    if memory_data.address_offset() != address as u16 || (memory_data.size() as u16) < size {
-        Err(WiimoteDeviceError::InvalidData.into())
-    } else {
-        Ok(memory_data.data)
+/// Sends the requests one at a time, every request once the previous one completed,
+/// for registers that must be written in order. Stops at the first request that failed.
+pub fn send_in_order(wiimote: &WiimoteDevice, requests: &[MemoryRequest]) -> WiimoteResult<()> {
+    for request in requests {
+        if let Err(error) = send(wiimote, request).wait(READ_TIMEOUT) {
+            if matches!(error, WiimoteError::Timeout) {
+                wiimote.connection().metrics().memory_timeouts.add(1);
+            }
+            return Err(error);
+        }
     }
+    Ok(())
 }
 
-/// Writes up to 16 bytes to the Wii remote.
-/// Discards reports other than the acknowledge result, only use during setup to prevent race-conditions.
+/// Sends the requests in order with `send_in_order`, the whole sequence is sent again
+/// if a request timed out, up to `RETRY_COUNT` times.
+pub fn transfer_in_order(wiimote: &WiimoteDevice, requests: &[MemoryRequest]) -> WiimoteResult<()> {
+    for attempt in 0..RETRY_COUNT {
+        if attempt > 0 {
+            wiimote.connection().metrics().memory_retries.add(1);
+        }
+        match send_in_order(wiimote, requests) {
+            Err(WiimoteError::Timeout) => {}
+            result => return result,
+        }
+    }
+    Err(WiimoteError::Timeout)
+}
+
+/// Sends the request without waiting for the reply.
+pub fn send(wiimote: &WiimoteDevice, request: &MemoryRequest) -> MemoryTransaction {
+    match request {
+        MemoryRequest::Read(addressing) => wiimote.read_memory(*addressing),
+        MemoryRequest::Write(addressing, data) => wiimote.write_memory(*addressing, data),
+    }
+}
+
+/// Writes up to 16 bytes to the Wii remote and waits for the acknowledge.
 pub fn write_16_bytes_sync(
     wiimote: &WiimoteDevice,
     addressing: Addressing,
     data: &[u8; 16],
-) -> WiimoteResult<AcknowledgeData> {
-    let memory_write_request = OutputReport::WriteMemory(addressing, *data);
-    wiimote.write(&memory_write_request).unwrap();
-
-    for _i in 0..RETRY_COUNT {
-        let input_report = wiimote.read_timeout(READ_TIMEOUT)?;
-        if let InputReport::Acknowledge(acknowledge_data) = input_report {
-            return Ok(acknowledge_data);
-        }
-    }
-    Err(WiimoteDeviceError::InvalidData.into())
+) -> WiimoteResult<()> {
+    transfer(wiimote, &[MemoryRequest::Write(addressing, *data)])
+        .pop()
+        .unwrap_or(Err(WiimoteError::Timeout))
+        .map(|_| ())
 }
@@ -0,0 +1,494 @@
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::thread::JoinHandle;
+use std::time::{Duration, Instant};
+
+use crate::device::Connection;
+use crate::output::{Addressing, OutputReport};
+use crate::prelude::*;
+use crate::ring::{spsc_ring, RingConsumer, RingProducer};
+use crate::simple_io::{self, MemoryRequest};
+
+/// Number of audio bytes in a speaker data report.
+pub const SPEAKER_PACKET_SIZE: usize = 20;
+/// Maximum number of packets sent at once when the pacing thread woke up late,
+/// older packets are dropped instead of flooding the Wii remote.
+const MAX_PACKETS_PER_WAKEUP: usize = 4;
+/// Number of times the initialization sequence is started over after a register write timed out.
+const INITIALIZATION_ATTEMPTS: usize = 5;
+
+/// The encoding of the audio sent to the speaker.
+///
+/// WiiBrew Documentation: <https://www.wiibrew.org/wiki/Wiimote#Speaker>
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum SpeakerFormat {
+    /// 4 bit Yamaha ADPCM, 40 samples per report.
+    Adpcm,
+    /// 8 bit signed PCM, 20 samples per report.
+    Pcm8,
+}
+
+impl SpeakerFormat {
+    /// Returns the number of samples sent in a speaker data report.
+    #[must_use]
+    pub const fn samples_per_packet(self) -> usize {
+        match self {
+            Self::Adpcm => SPEAKER_PACKET_SIZE * 2,
+            Self::Pcm8 => SPEAKER_PACKET_SIZE,
+        }
+    }
+}
+
+/// The configuration of the speaker.
+#[derive(Debug, Clone, Copy)]
+pub struct SpeakerConfig {
+    pub format: SpeakerFormat,
+    /// Samples per second, the Wii remote plays at most about 3000 ADPCM or 2000 PCM samples per second reliably.
+    pub sample_rate: u32,
+    /// Volume of the speaker, 0x00-0x40 for ADPCM and 0x00-0xFF for PCM.
+    pub volume: u8,
+}
+
+impl SpeakerConfig {
+    /// Returns the 7 bytes of the speaker configuration register at 0xA20001.
+    #[allow(clippy::cast_possible_truncation)]
+    fn register(&self) -> [u8; 7] {
+        let (format, clock) = match self.format {
+            SpeakerFormat::Adpcm => (0x00, 6_000_000),
+            SpeakerFormat::Pcm8 => (0x40, 12_000_000),
+        };
+        let rate = (clock / self.sample_rate.max(1)).min(u32::from(u16::MAX)) as u16;
+        let [rate_low, rate_high] = rate.to_le_bytes();
+        [0x00, format, rate_low, rate_high, self.volume, 0x00, 0x00]
+    }
+
+    /// Returns the time it takes to play a single speaker data report.
+    fn packet_interval(&self) -> Duration {
+        #[allow(clippy::cast_possible_truncation)]
+        let samples = self.format.samples_per_packet() as u32;
+        Duration::from_secs(1) * samples / self.sample_rate.max(1)
+    }
+}
+
+impl Default for SpeakerConfig {
+    fn default() -> Self {
+        Self {
+            format: SpeakerFormat::Adpcm,
+            sample_rate: 3000,
+            volume: 0x40,
+        }
+    }
+}
+
+const ADPCM_DIFFERENCES: [i32; 16] = [1, 3, 5, 7, 9, 11, 13, 15, -1, -3, -5, -7, -9, -11, -13, -15];
+const ADPCM_STEP_SCALES: [i32; 8] = [230, 230, 230, 230, 307, 409, 512, 614];
+
+/// Encodes 16 bit PCM samples to 4 bit Yamaha ADPCM as played by the speaker.
+#[derive(Debug, Clone, Copy)]
+pub struct AdpcmEncoder {
+    predictor: i32,
+    step: i32,
+}
+
+impl AdpcmEncoder {
+    #[must_use]
+    pub const fn new() -> Self {
+        Self {
+            predictor: 0,
+            step: 127,
+        }
+    }
+
+    /// Encodes a single sample into a 4 bit code.
+    pub fn encode(&mut self, sample: i16) -> u8 {
+        let difference = i32::from(sample) - self.predictor;
+        let mut code = i32::min(7, difference.abs() * 4 / self.step);
+        if difference < 0 {
+            code |= 8;
+        }
+        self.decode_step(code);
+        #[allow(clippy::cast_possible_truncation, clippy::cast_sign_loss)]
+        {
+            code as u8
+        }
+    }
+
+    /// Encodes pairs of samples into `output`, the first sample of a pair in the high nibble.
+    /// Returns the number of bytes written, a trailing odd sample is ignored.
+    pub fn encode_slice(&mut self, samples: &[i16], output: &mut [u8]) -> usize {
+        let mut written = 0;
+        for (pair, output) in samples.chunks_exact(2).zip(output.iter_mut()) {
+            *output = self.encode(pair[0]) << 4 | self.encode(pair[1]);
+            written += 1;
+        }
+        written
+    }
+
+    /// Updates the predictor like the decoder of the speaker does.
+    fn decode_step(&mut self, code: i32) {
+        let code = (code & 0xF) as usize;
+        self.predictor = (self.predictor + self.step * ADPCM_DIFFERENCES[code] / 8)
+            .clamp(i32::from(i16::MIN), i32::from(i16::MAX));
+        self.step = ((self.step * ADPCM_STEP_SCALES[code & 7]) >> 8).clamp(127, 24576);
+    }
+}
+
+impl Default for AdpcmEncoder {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+/// Writes up to 16 bytes to the speaker registers.
+fn register_write(address: u32, bytes: &[u8]) -> MemoryRequest {
+    let mut data = [0u8; 16];
+    data[..bytes.len()].copy_from_slice(bytes);
+    #[allow(clippy::cast_possible_truncation)]
+    MemoryRequest::Write(
+        Addressing::control_registers(address, bytes.len() as u16),
+        data,
+    )
+}
+
+struct SharedState {
+    stop: AtomicBool,
+    underruns: AtomicUsize,
+}
+
+/// Streams audio to the speaker of a Wii remote.
+///
+/// Samples are encoded into a bounded queue of speaker data reports, a dedicated thread sends them
+/// at the rate the speaker plays them. The packets are preallocated, streaming does not allocate.
+pub struct SpeakerStream {
+    config: SpeakerConfig,
+    packets: RingProducer<[u8; SPEAKER_PACKET_SIZE]>,
+    encoder: AdpcmEncoder,
+    /// The packet being filled and the number of samples in it.
+    packet: [u8; SPEAKER_PACKET_SIZE],
+    packet_samples: usize,
+    /// A full packet that did not fit into the queue yet.
+    full_packet: Option<[u8; SPEAKER_PACKET_SIZE]>,
+    connection: Arc<Connection>,
+    state: Arc<SharedState>,
+    thread: Option<JoinHandle<()>>,
+}
+
+impl SpeakerStream {
+    /// Enables and configures the speaker and starts the thread sending the audio.
+    /// Up to `capacity` speaker data reports are queued.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the Wii remote is disconnected or did not acknowledge the configuration.
+    pub fn start(
+        wiimote: &WiimoteDevice,
+        config: SpeakerConfig,
+        capacity: usize,
+    ) -> WiimoteResult<Self> {
+        Self::initialize(wiimote, &config)?;
+        wiimote.write(&OutputReport::SpeakerMute(false))?;
+
+        let (packets, consumer) = spsc_ring(capacity);
+        let connection = Arc::clone(wiimote.connection());
+        let state = Arc::new(SharedState {
+            stop: AtomicBool::new(false),
+            underruns: AtomicUsize::new(0),
+        });
+
+        let thread_connection = Arc::clone(&connection);
+        let thread_state = Arc::clone(&state);
+        let interval = config.packet_interval();
+        let thread = std::thread::Builder::new()
+            .name("wii-remote-speaker".to_string())
+            .spawn(move || run(&thread_connection, consumer, interval, &thread_state))
+            .expect("Failed to spawn Wii remote speaker thread");
+
+        Ok(Self {
+            config,
+            packets,
+            encoder: AdpcmEncoder::new(),
+            packet: [0; SPEAKER_PACKET_SIZE],
+            packet_samples: 0,
+            full_packet: None,
+            connection,
+            state,
+            thread: Some(thread),
+        })
+    }
+
+    /// Runs the initialization sequence of the speaker.
+    /// The registers only configure the speaker if they are written in order,
+    /// the whole sequence is started over if a write timed out.
+    fn initialize(wiimote: &WiimoteDevice, config: &SpeakerConfig) -> WiimoteResult<()> {
+        // https://www.wiibrew.org/wiki/Wiimote#Initialization_Sequence
+        let requests = [
+            register_write(0xA2_0009, &[0x01]),
+            register_write(0xA2_0001, &[0x08]),
+            register_write(0xA2_0001, &config.register()),
+            register_write(0xA2_0008, &[0x01]),
+        ];
+        for attempt in 0..INITIALIZATION_ATTEMPTS {
+            if attempt > 0 {
+                wiimote.connection().metrics().memory_retries.add(1);
+            }
+            wiimote.write(&OutputReport::SpeakerEnable(true))?;
+            wiimote.write(&OutputReport::SpeakerMute(true))?;
+            match simple_io::send_in_order(wiimote, &requests) {
+                Err(WiimoteError::Timeout) => {}
+                result => return result,
+            }
+        }
+        Err(WiimoteError::Timeout)
+    }
+
+    /// Encodes the 16 bit PCM samples and queues them for playback.
+    /// Returns the number of samples accepted, less than `samples.len()` if the queue is full.
+    pub fn write(&mut self, samples: &[i16]) -> usize {
+        let samples_per_packet = self.config.format.samples_per_packet();
+        let mut accepted = 0;
+        while accepted < samples.len() {
+            if !self.push_full_packet() {
+                break;
+            }
+
+            let count = usize::min(
+                samples_per_packet - self.packet_samples,
+                samples.len() - accepted,
+            );
+            let samples = &samples[accepted..accepted + count];
+            match self.config.format {
+                SpeakerFormat::Adpcm => {
+                    // Samples are encoded in pairs, the packet always contains an even number of samples
+                    // unless this is the end of the input.
+                    for sample in samples {
+                        let code = self.encoder.encode(*sample);
+                        let byte = &mut self.packet[self.packet_samples / 2];
+                        if self.packet_samples & 1 == 0 {
+                            *byte = code << 4;
+                        } else {
+                            *byte |= code;
+                        }
+                        self.packet_samples += 1;
+                    }
+                }
+                SpeakerFormat::Pcm8 => {
+                    for (byte, sample) in self.packet[self.packet_samples..].iter_mut().zip(samples)
+                    {
+                        #[allow(clippy::cast_possible_truncation, clippy::cast_sign_loss)]
+                        {
+                            *byte = (sample >> 8) as i8 as u8;
+                        }
+                    }
+                    self.packet_samples += count;
+                }
+            }
+            accepted += count;
+
+            if self.packet_samples == samples_per_packet {
+                self.full_packet = Some(self.packet);
+                self.packet_samples = 0;
+            }
+        }
+        self.push_full_packet();
+        accepted
+    }
+
+    /// Pads the partially filled packet with silence and queues it, so the last samples are played.
+    /// Returns `false` if the queue is full, `flush` again once queued audio was sent.
+    pub fn flush(&mut self) -> bool {
+        const SILENCE: [i16; SPEAKER_PACKET_SIZE * 2] = [0; SPEAKER_PACKET_SIZE * 2];
+        let samples_per_packet = self.config.format.samples_per_packet();
+        let missing = (samples_per_packet - self.packet_samples) % samples_per_packet;
+        self.write(&SILENCE[..missing]) == missing && self.full_packet.is_none()
+    }
+
+    /// Queues the full packet, returns `false` if it did not fit into the queue.
+    /// The sending thread is woken if it waits for audio.
+    fn push_full_packet(&mut self) -> bool {
+        let Some(packet) = self.full_packet.take() else {
+            return true;
+        };
+        if let Err(packet) = self.packets.push(packet) {
+            self.full_packet = Some(packet);
+            return false;
+        }
+        if let Some(thread) = &self.thread {
+            thread.thread().unpark();
+        }
+        true
+    }
+
+    /// Returns the number of times no audio was queued when the next report was due.
+    #[must_use]
+    pub fn underruns(&self) -> usize {
+        self.state.underruns.load(Ordering::Relaxed)
+    }
+
+    /// Returns the configuration of the speaker.
+    #[must_use]
+    pub const fn config(&self) -> &SpeakerConfig {
+        &self.config
+    }
+}
+
+impl Drop for SpeakerStream {
+    fn drop(&mut self) {
+        self.state.stop.store(true, Ordering::Relaxed);
+        if let Some(thread) = self.thread.take() {
+            thread.thread().unpark();
+            _ = thread.join();
+        }
+        _ = self.connection.write(&OutputReport::SpeakerMute(true));
+        _ = self.connection.write(&OutputReport::SpeakerEnable(false));
+    }
+}
+
+fn run(
+    connection: &Connection,
+    mut packets: RingConsumer<[u8; SPEAKER_PACKET_SIZE]>,
+    interval: Duration,
+    state: &SharedState,
+) {
+    let mut deadline = Instant::now();
+    let mut playing = false;
+    #[allow(clippy::cast_possible_truncation)]
+    let length = SPEAKER_PACKET_SIZE as u8;
+
+    while !state.stop.load(Ordering::Relaxed) {
+        let now = Instant::now();
+        if now < deadline {
+            std::thread::sleep(deadline - now);
+            continue;
+        }
+
+        // Send every packet that is due, a late wakeup sends a short batch to catch up
+        let mut sent = 0;
+        while deadline <= now && sent < MAX_PACKETS_PER_WAKEUP {
+            let Some(packet) = packets.pop() else {
+                break;
+            };
+            if connection
+                .write(&OutputReport::SpeakerData(length, packet))
+                .is_err()
+            {
+                return;
+            }
+            deadline += interval;
+            sent += 1;
+        }
+
+        if sent == 0 {
+            if playing {
+                state.underruns.fetch_add(1, Ordering::Relaxed);
+                playing = false;
+            }
+            // Nothing queued, `write` wakes the thread once audio arrives and starts a new schedule
+            std::thread::park();
+            deadline = Instant::now();
+        } else {
+            playing = true;
+            // Too far behind, drop the packets whose time already passed instead of sending more at once
+            while deadline <= now && packets.pop().is_some() {
+                deadline += interval;
+            }
+            if deadline <= now {
+                deadline = now + interval;
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Decodes like the speaker does, the encoder tracks the same predictor.
+    fn decode(codes: &[u8]) -> Vec<i32> {
+        let mut decoder = AdpcmEncoder::new();
+        codes
+            .iter()
+            .map(|code| {
+                decoder.decode_step(i32::from(*code));
+                decoder.predictor
+            })
+            .collect()
+    }
+
+    #[test]
+    fn test_adpcm_follows_signal() {
+        let samples = (0..600)
+            .map(|index| {
+                let phase = f64::from(index) * std::f64::consts::TAU / 60.0;
+                #[allow(clippy::cast_possible_truncation)]
+                {
+                    (phase.sin() * 12000.0) as i16
+                }
+            })
+            .collect::<Vec<_>>();
+        let mut encoder = AdpcmEncoder::new();
+        let codes = samples
+            .iter()
+            .map(|sample| encoder.encode(*sample))
+            .collect::<Vec<_>>();
+        let decoded = decode(&codes);
+
+        // After the step size adapted, the decoded signal stays close to the input
+        for (sample, decoded) in samples.iter().zip(&decoded).skip(60) {
+            assert!(
+                (i32::from(*sample) - decoded).abs() < 2500,
+                "{sample} {decoded}"
+            );
+        }
+    }
+
+    #[test]
+    fn test_encode_slice_packs_high_nibble_first() {
+        let mut encoder = AdpcmEncoder::new();
+        let mut expected = AdpcmEncoder::new();
+        let mut output = [0u8; 2];
+        assert_eq!(encoder.encode_slice(&[1000, -1000, 500], &mut output), 1);
+        assert_eq!(
+            output[0],
+            expected.encode(1000) << 4 | expected.encode(-1000)
+        );
+    }
+
+    #[cfg(feature = "mock")]
+    #[test]
+    fn test_flush_sends_partial_packet() {
+        use crate::mock::MockWiimote;
+        use crate::native::NativeWiimoteDevice;
+
+        let mock = MockWiimote::connect("speaker-flush");
+        let device = WiimoteDevice::new(NativeWiimoteDevice::take(&mock), None).unwrap();
+        let mut stream = SpeakerStream::start(&device, SpeakerConfig::default(), 4).unwrap();
+
+        // One and a half packets, only the full packet is sent before the flush
+        assert_eq!(stream.write(&[1000; 60]), 60);
+        let deadline = Instant::now() + Duration::from_secs(10);
+        while mock.speaker_reports() < 1 && Instant::now() < deadline {
+            std::thread::sleep(Duration::from_millis(1));
+        }
+        std::thread::sleep(stream.config().packet_interval() * 2);
+        assert_eq!(mock.speaker_reports(), 1);
+
+        assert!(stream.flush());
+        while mock.speaker_reports() < 2 && Instant::now() < deadline {
+            std::thread::sleep(Duration::from_millis(1));
+        }
+        assert_eq!(mock.speaker_reports(), 2);
+        assert!(stream.flush());
+        drop(stream);
+        assert_eq!(mock.speaker_reports(), 2);
+    }
+
+    #[test]
+    fn test_config_register() {
+        let config = SpeakerConfig::default();
+        assert_eq!(
+            config.register(),
+            [0x00, 0x00, 0xD0, 0x07, 0x40, 0x00, 0x00]
+        );
+        assert_eq!(config.packet_interval(), Duration::from_nanos(13_333_333));
+    }
+}
@@ -0,0 +1,602 @@
+use std::collections::VecDeque;
+#[cfg(feature = "async")]
+use std::future::Future;
+#[cfg(feature = "async")]
+use std::pin::Pin;
+use std::sync::{Arc, Condvar, Mutex, MutexGuard};
+#[cfg(feature = "async")]
+use std::task::{Context, Poll, Waker};
+use std::time::{Duration, Instant};
+
+use crate::device::Connection;
+use crate::input::{InputReportRef, RawReport};
+use crate::output::{Addressing, OutputReport};
+use crate::prelude::*;
+
+/// Time after which a sent request without reply fails with `WiimoteError::Timeout`.
+const REPLY_TIMEOUT: Duration = Duration::from_secs(1);
+/// Maximum time `MemoryTransaction::wait` reads from the Wii remote at once.
+const WAIT_READ_INTERVAL: Duration = Duration::from_millis(10);
+/// Interval in which a polled transaction checks for expired requests while the Wii remote sends no reports.
+#[cfg(feature = "async")]
+const EXPIRY_CHECK_INTERVAL: Duration = Duration::from_millis(100);
+/// Report number of the write memory output report in acknowledge reports.
+const WRITE_MEMORY_REPORT_NUMBER: u8 = 0x16;
+/// Maximum number of bytes in a single write memory report or read memory reply.
+const CHUNK_SIZE: usize = 16;
+
+/// The result of a memory transaction, the read bytes or an empty vector for writes.
+pub type TransactionResult = WiimoteResult<Vec<u8>>;
+type CompletionCallback = Box<dyn FnOnce(TransactionResult) + Send>;
+
+#[derive(Default)]
+struct Completion {
+    finished: bool,
+    result: Option<TransactionResult>,
+    #[cfg(feature = "async")]
+    waker: Option<Waker>,
+    callback: Option<CompletionCallback>,
+}
+
+/// The completion of a memory transaction shared between the engine and the `MemoryTransaction`.
+#[derive(Default)]
+pub(crate) struct TransactionState {
+    completion: Mutex<Completion>,
+    completed: Condvar,
+}
+
+impl TransactionState {
+    fn lock(&self) -> MutexGuard<'_, Completion> {
+        match self.completion.lock() {
+            Ok(completion) => completion,
+            Err(err) => err.into_inner(),
+        }
+    }
+
+    fn is_finished(&self) -> bool {
+        self.lock().finished
+    }
+
+    /// Completes the transaction unless it was cancelled, runs the completion callback on the calling thread.
+    pub(crate) fn complete(&self, result: TransactionResult) {
+        let mut completion = self.lock();
+        if completion.finished {
+            return;
+        }
+        completion.finished = true;
+        let callback = completion.callback.take();
+        #[cfg(feature = "async")]
+        let waker = completion.waker.take();
+        if let Some(callback) = callback {
+            drop(completion);
+            callback(result);
+        } else {
+            completion.result = Some(result);
+            drop(completion);
+        }
+        self.completed.notify_all();
+        #[cfg(feature = "async")]
+        if let Some(waker) = waker {
+            waker.wake();
+        }
+    }
+
+    /// Cancels the transaction, returns the result if it was completed in the meantime.
+    fn cancel(&self) -> Option<TransactionResult> {
+        let mut completion = self.lock();
+        completion.finished = true;
+        completion.result.take()
+    }
+}
+
+/// A memory request handled by the `TransactionEngine`.
+#[derive(Debug)]
+pub(crate) enum TransactionRequest {
+    Read(Addressing),
+    Write(Addressing, Vec<u8>),
+}
+
+enum PendingKind {
+    Read {
+        addressing: Addressing,
+        data: Vec<u8>,
+        received: Vec<bool>,
+        chunks_remaining: usize,
+    },
+    Write {
+        chunks: Vec<OutputReport>,
+        acks_remaining: usize,
+        error_code: Option<u8>,
+    },
+}
+
+struct Pending {
+    kind: PendingKind,
+    state: Arc<TransactionState>,
+    sent_at: Option<Instant>,
+}
+
+impl Pending {
+    fn new(request: TransactionRequest, state: Arc<TransactionState>) -> Self {
+        let kind = match request {
+            TransactionRequest::Read(addressing) => {
+                let chunks = (addressing.size as usize).div_ceil(CHUNK_SIZE);
+                PendingKind::Read {
+                    addressing,
+                    data: vec![0u8; addressing.size as usize],
+                    received: vec![false; chunks],
+                    chunks_remaining: chunks,
+                }
+            }
+            TransactionRequest::Write(addressing, data) => {
+                let chunks = data
+                    .chunks(CHUNK_SIZE)
+                    .enumerate()
+                    .map(|(index, chunk)| {
+                        let mut buffer = [0u8; CHUNK_SIZE];
+                        buffer[..chunk.len()].copy_from_slice(chunk);
+                        #[allow(clippy::cast_possible_truncation)]
+                        let chunk_addressing =
+                            addressing.offset((index * CHUNK_SIZE) as u32, chunk.len() as u16);
+                        OutputReport::WriteMemory(chunk_addressing, buffer)
+                    })
+                    .collect::<Vec<_>>();
+                PendingKind::Write {
+                    acks_remaining: chunks.len(),
+                    chunks,
+                    error_code: None,
+                }
+            }
+        };
+        Self {
+            kind,
+            state,
+            sent_at: None,
+        }
+    }
+
+    const fn is_read(&self) -> bool {
+        matches!(self.kind, PendingKind::Read { .. })
+    }
+}
+
+/// Matches read memory and acknowledge reports to pending memory transactions of a Wii remote.
+///
+/// Requests are sent in order. Writes are sent without waiting for the previous acknowledges,
+/// a read is only sent once the previous read completed and the Wii remote replies to it with one report per 16 bytes.
+#[derive(Default)]
+pub(crate) struct TransactionEngine {
+    pending: VecDeque<Pending>,
+    /// Transactions finished by the engine, completed by the caller after releasing the device.
+    finished: Vec<(Arc<TransactionState>, TransactionResult)>,
+}
+
+impl TransactionEngine {
+    pub(crate) fn is_idle(&self) -> bool {
+        self.pending.is_empty() && self.finished.is_empty()
+    }
+
+    pub(crate) fn submit(&mut self, request: TransactionRequest, state: Arc<TransactionState>) {
+        if let TransactionRequest::Read(addressing) = &request {
+            if addressing.size == 0 {
+                self.finished.push((state, Ok(Vec::new())));
+                return;
+            }
+        }
+        self.pending.push_back(Pending::new(request, state));
+    }
+
+    /// Sends the requests up to and including the first pending read, returns `false` if sending failed.
+    /// The requests following a read wait for its reply, the Wii remote handles one read at a time.
+    pub(crate) fn send_pending(
+        &mut self,
+        now: Instant,
+        mut send: impl FnMut(&OutputReport) -> bool,
+    ) -> bool {
+        self.pending.retain(|pending| !pending.state.is_finished());
+
+        for pending in &mut self.pending {
+            if pending.sent_at.is_none() {
+                let sent = match &pending.kind {
+                    PendingKind::Read { addressing, .. } => {
+                        send(&OutputReport::ReadMemory(*addressing))
+                    }
+                    PendingKind::Write { chunks, .. } => chunks.iter().all(&mut send),
+                };
+                if !sent {
+                    return false;
+                }
+                pending.sent_at = Some(now);
+            }
+            if pending.is_read() {
+                break;
+            }
+        }
+        true
+    }
+
+    /// Passes the report to the pending transaction it replies to, returns `true` if the report was consumed.
+    pub(crate) fn route(&mut self, report: &RawReport) -> bool {
+        if self.pending.is_empty() {
+            return false;
+        }
+        match report.view() {
+            Ok(InputReportRef::ReadMemory(memory_data)) => {
+                let address_offset = memory_data.address_offset();
+                let Some(index) = self.pending.iter().position(|pending| {
+                    pending.sent_at.is_some() && read_chunk(pending, address_offset).is_some()
+                }) else {
+                    return false;
+                };
+                let chunk = read_chunk(&self.pending[index], address_offset).unwrap();
+
+                let result = if memory_data.error_flag() != 0 {
+                    Some(Err(WiimoteDeviceError::MemoryAccess(
+                        memory_data.error_flag(),
+                    )
+                    .into()))
+                } else if let PendingKind::Read {
+                    data,
+                    received,
+                    chunks_remaining,
+                    ..
+                } = &mut self.pending[index].kind
+                {
+                    let start = chunk * CHUNK_SIZE;
+                    let size = usize::min(CHUNK_SIZE, data.len() - start);
+                    if (memory_data.size() as usize) < size {
+                        Some(Err(WiimoteDeviceError::InvalidData.into()))
+                    } else {
+                        data[start..start + size].copy_from_slice(&memory_data.data[..size]);
+                        received[chunk] = true;
+                        *chunks_remaining -= 1;
+                        (*chunks_remaining == 0).then(|| Ok(std::mem::take(data)))
+                    }
+                } else {
+                    None
+                };
+                if let Some(result) = result {
+                    self.finish(index, result);
+                }
+                true
+            }
+            Ok(InputReportRef::Acknowledge(acknowledge))
+                if acknowledge.report_number() == WRITE_MEMORY_REPORT_NUMBER =>
+            {
+                let Some(index) = self.pending.iter().position(|pending| {
+                    pending.sent_at.is_some()
+                        && matches!(pending.kind, PendingKind::Write { acks_remaining, .. } if acks_remaining > 0)
+                }) else {
+                    return false;
+                };
+                let PendingKind::Write {
+                    acks_remaining,
+                    error_code,
+                    ..
+                } = &mut self.pending[index].kind
+                else {
+                    unreachable!()
+                };
+                *acks_remaining -= 1;
+                if acknowledge.error_code() != 0 {
+                    error_code.get_or_insert(acknowledge.error_code());
+                }
+                if *acks_remaining == 0 {
+                    let result = match error_code {
+                        Some(error_code) => {
+                            Err(WiimoteDeviceError::MemoryAccess(*error_code).into())
+                        }
+                        None => Ok(Vec::new()),
+                    };
+                    self.finish(index, result);
+                }
+                true
+            }
+            _ => false,
+        }
+    }
+
+    /// Fails the sent requests that did not receive a reply within `REPLY_TIMEOUT`.
+    pub(crate) fn expire(&mut self, now: Instant) {
+        while let Some(index) = self.pending.iter().position(|pending| {
+            matches!(pending.sent_at, Some(sent_at) if now.duration_since(sent_at) > REPLY_TIMEOUT)
+        }) {
+            self.finish(index, Err(WiimoteError::Timeout));
+        }
+    }
+
+    /// Returns when the first sent request without reply expires.
+    pub(crate) fn next_deadline(&self) -> Option<Instant> {
+        self.pending
+            .iter()
+            .filter_map(|pending| pending.sent_at)
+            .min()
+            .map(|sent_at| sent_at + REPLY_TIMEOUT)
+    }
+
+    /// Fails all pending requests, used when the Wii remote disconnected.
+    pub(crate) fn fail_all(&mut self) {
+        for pending in self.pending.drain(..) {
+            self.finished
+                .push((pending.state, Err(WiimoteError::Disconnected)));
+        }
+    }
+
+    pub(crate) fn take_finished(&mut self) -> Vec<(Arc<TransactionState>, TransactionResult)> {
+        std::mem::take(&mut self.finished)
+    }
+
+    fn finish(&mut self, index: usize, result: TransactionResult) {
+        if let Some(pending) = self.pending.remove(index) {
+            self.finished.push((pending.state, result));
+        }
+    }
+}
+
+/// Returns the index of the chunk of the pending read that starts at `address_offset`, if not yet received.
+fn read_chunk(pending: &Pending, address_offset: u16) -> Option<usize> {
+    let PendingKind::Read {
+        addressing,
+        received,
+        ..
+    } = &pending.kind
+    else {
+        return None;
+    };
+    #[allow(clippy::cast_possible_truncation)]
+    let relative_offset = address_offset.wrapping_sub(addressing.address as u16) as usize;
+    let chunk = relative_offset / CHUNK_SIZE;
+    (chunk * CHUNK_SIZE == relative_offset && received.get(chunk) == Some(&false)).then_some(chunk)
+}
+
+/// A memory read or write sent to the Wii remote that completes when the Wii remote replied.
+///
+/// Replies are picked from the reports while the Wii remote is read, all other reports keep flowing to the readers
+/// (`WiimoteDevice::read`, `BackgroundIo` or `WiimoteReactor`).
+/// `wait` reads from the Wii remote itself.
+/// With the `async` feature, the transaction is a `Future` that is woken once the Wii remote has input
+/// and checks for expired requests while the Wii remote sends no reports.
+#[must_use]
+pub struct MemoryTransaction {
+    state: Arc<TransactionState>,
+    connection: Arc<Connection>,
+}
+
+impl MemoryTransaction {
+    pub(crate) fn new(connection: Arc<Connection>) -> (Self, Arc<TransactionState>) {
+        let state = Arc::new(TransactionState::default());
+        let transaction = Self {
+            state: Arc::clone(&state),
+            connection,
+        };
+        (transaction, state)
+    }
+
+    /// Returns whether the transaction is completed.
+    #[must_use]
+    pub fn is_complete(&self) -> bool {
+        self.state.is_finished()
+    }
+
+    /// Returns the result if the transaction is completed, the result can only be taken once.
+    pub fn try_take(&mut self) -> Option<TransactionResult> {
+        self.state.lock().result.take()
+    }
+
+    /// Waits up to `timeout` for the reply of the Wii remote.
+    ///
+    /// # Errors
+    ///
+    /// This function will return an error if the Wii remote is disconnected,
+    /// rejected the request or did not reply in time (`WiimoteError::Timeout`).
+    pub fn wait(self, timeout: Duration) -> TransactionResult {
+        let deadline = Instant::now() + timeout;
+        loop {
+            {
+                let mut completion = self.state.lock();
+                if completion.finished {
+                    return completion
+                        .result
+                        .take()
+                        .unwrap_or(Err(WiimoteError::Timeout));
+                }
+            }
+
+            let remaining = deadline.saturating_duration_since(Instant::now());
+            if remaining.is_zero() {
+                return self.state.cancel().unwrap_or(Err(WiimoteError::Timeout));
+            }
+            if let Err(error) = self
+                .connection
+                .pump(Duration::min(remaining, WAIT_READ_INTERVAL))
+            {
+                return self.state.cancel().unwrap_or(Err(error));
+            }
+        }
+    }
+
+    /// Calls `f` with the result once the transaction is completed,
+    /// on the thread that received the reply or immediately if the transaction is already completed.
+    pub fn on_complete<F>(self, f: F)
+    where
+        F: FnOnce(TransactionResult) + Send + 'static,
+    {
+        let mut completion = self.state.lock();
+        if completion.finished {
+            if let Some(result) = completion.result.take() {
+                drop(completion);
+                f(result);
+            }
+        } else {
+            completion.callback = Some(Box::new(f));
+        }
+    }
+}
+
+#[cfg(feature = "async")]
+impl Future for MemoryTransaction {
+    type Output = TransactionResult;
+
+    fn poll(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Self::Output> {
+        let deadline = Instant::now() + EXPIRY_CHECK_INTERVAL;
+        crate::driver::poll_ready(&self.connection, cx, false, Some(deadline), || {
+            self.poll_completion(cx)
+        })
+        .unwrap_or_else(|error| Poll::Ready(self.state.cancel().unwrap_or(Err(error))))
+    }
+}
+
+#[cfg(feature = "async")]
+impl MemoryTransaction {
+    fn poll_completion(&self, cx: &Context<'_>) -> Poll<TransactionResult> {
+        if !self.state.is_finished() {
+            // Replies may already be queued, read them without waiting
+            _ = self.connection.pump(Duration::ZERO);
+        }
+
+        let mut completion = self.state.lock();
+        if completion.finished {
+            Poll::Ready(
+                completion
+                    .result
+                    .take()
+                    .unwrap_or(Err(WiimoteError::Timeout)),
+            )
+        } else {
+            completion.waker = Some(cx.waker().clone());
+            Poll::Pending
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn raw_report(bytes: &[u8]) -> RawReport {
+        let mut report = RawReport::default();
+        report.data[..bytes.len()].copy_from_slice(bytes);
+        #[allow(clippy::cast_possible_truncation)]
+        {
+            report.length = bytes.len() as u8;
+        }
+        report
+    }
+
+    /// Read memory reply with `size` bytes of `value` at `address_offset`.
+    fn memory_reply(address_offset: u16, size: u8, value: u8) -> RawReport {
+        let mut bytes = [0u8; 22];
+        bytes[0] = 0x21;
+        bytes[3] = (size - 1) << 4;
+        bytes[4..6].copy_from_slice(&address_offset.to_be_bytes());
+        bytes[6..6 + size as usize].fill(value);
+        raw_report(&bytes)
+    }
+
+    fn take_result(engine: &mut TransactionEngine) -> TransactionResult {
+        let mut finished = engine.take_finished();
+        assert_eq!(finished.len(), 1);
+        finished.pop().unwrap().1
+    }
+
+    #[test]
+    fn test_read_assembled_from_chunks() {
+        let mut engine = TransactionEngine::default();
+        let state = Arc::new(TransactionState::default());
+        engine.submit(
+            TransactionRequest::Read(Addressing::control_registers(0xA6_0020, 32)),
+            state,
+        );
+
+        let mut sent = 0;
+        assert!(engine.send_pending(Instant::now(), |_| {
+            sent += 1;
+            true
+        }));
+        assert_eq!(sent, 1);
+
+        assert!(!engine.route(&raw_report(&[0x30, 0x00, 0x00])));
+        assert!(engine.route(&memory_reply(0x0030, 16, 0x02)));
+        assert!(engine.take_finished().is_empty());
+        assert!(engine.route(&memory_reply(0x0020, 16, 0x01)));
+
+        let data = take_result(&mut engine).unwrap();
+        assert_eq!(data[..16], [0x01; 16]);
+        assert_eq!(data[16..], [0x02; 16]);
+        assert!(engine.is_idle());
+    }
+
+    #[test]
+    fn test_writes_pipelined_and_acknowledged_in_order() {
+        let mut engine = TransactionEngine::default();
+        engine.submit(
+            TransactionRequest::Write(Addressing::control_registers(0xA4_00F0, 20), vec![0; 20]),
+            Arc::new(TransactionState::default()),
+        );
+        engine.submit(
+            TransactionRequest::Read(Addressing::control_registers(0xA4_00FA, 6)),
+            Arc::new(TransactionState::default()),
+        );
+
+        let mut sent = 0;
+        assert!(engine.send_pending(Instant::now(), |_| {
+            sent += 1;
+            true
+        }));
+        // Both write chunks and the following read are sent without waiting
+        assert_eq!(sent, 3);
+
+        assert!(engine.route(&raw_report(&[0x22, 0x00, 0x00, 0x16, 0x00])));
+        assert!(engine.route(&raw_report(&[0x22, 0x00, 0x00, 0x16, 0x07])));
+        assert!(matches!(
+            take_result(&mut engine),
+            Err(WiimoteError::WiimoteDeviceError(
+                WiimoteDeviceError::MemoryAccess(7)
+            ))
+        ));
+    }
+
+    #[test]
+    fn test_read_waits_for_previous_read() {
+        let mut engine = TransactionEngine::default();
+        for address in [0x0016, 0x0026] {
+            engine.submit(
+                TransactionRequest::Read(Addressing::eeprom(address, 16)),
+                Arc::new(TransactionState::default()),
+            );
+        }
+
+        let mut sent = 0;
+        engine.send_pending(Instant::now(), |_| {
+            sent += 1;
+            true
+        });
+        assert_eq!(sent, 1);
+
+        assert!(engine.route(&memory_reply(0x0016, 16, 0x00)));
+        engine.send_pending(Instant::now(), |_| {
+            sent += 1;
+            true
+        });
+        assert_eq!(sent, 2);
+    }
+
+    #[test]
+    fn test_unanswered_request_expires() {
+        let mut engine = TransactionEngine::default();
+        engine.submit(
+            TransactionRequest::Read(Addressing::eeprom(0x0016, 10)),
+            Arc::new(TransactionState::default()),
+        );
+        let now = Instant::now();
+        engine.send_pending(now, |_| true);
+
+        engine.expire(now);
+        assert!(engine.take_finished().is_empty());
+        engine.expire(now + REPLY_TIMEOUT * 2);
+        assert!(matches!(
+            take_result(&mut engine),
+            Err(WiimoteError::Timeout)
+        ));
+    }
+}